@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+// Minimal allocator that hands out storage aligned to 'Alignment' bytes. Used for the columnar
+// particle arrays so that each array starts on a cache line and can be loaded with aligned SIMD loads.
+template<typename T, std::size_t Alignment = 64>
+class AlignedAllocator
+{
+public:
+	using value_type = T;
+
+	template<typename U>
+	struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+	AlignedAllocator() noexcept = default;
+
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+	T* allocate(std::size_t n)
+	{
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+	}
+
+	void deallocate(T* p, std::size_t /* n */) noexcept
+	{
+		::operator delete(p, std::align_val_t(Alignment));
+	}
+
+	template<typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+};
@@ -1,4 +1,5 @@
 #include "App.h"
+#include "FrameTiming.h"
 #include "MacroHelper.h"
 
 #include "implot.h"
@@ -43,7 +44,7 @@ App::App() noexcept
 	m_window->Initialize();
 
 	// Even though adding atoms here is temporary, it MUST be done AFTER window initialization because
-	// Initialize() will create the Renderer which will create a ParticleAdded event handler
+	// Initialize() will create the Renderer which will create a ParticlesAdded event handler
 	SimulationManager::AddParticle(1, SimulationManager::GetDefaultMass(1), 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f);
 	/*
 	SimulationManager::AddParticle(2, SimulationManager::GetDefaultMass(2), 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f);
@@ -57,18 +58,30 @@ App::App() noexcept
 	SimulationManager::AddParticle(10, SimulationManager::GetDefaultMass(10), 0.0f, 0.0f, 0.0f, -1.0f, 2.0f, 10.0f);
 	*/
 
+	// From here on the simulations are stepped on their own thread
+	SimulationManager::StartSimulationThread();
+
 	PROFILE_END_SESSION();
 }
 
 int App::Run() const
 {
+	FrameTiming& frameTiming = FrameTiming::Get();
+
 	while (true)
 	{
+		// The frame starts with the messages, so the time spent on input is part of it
+		frameTiming.BeginFrame();
+
 		// process all messages pending, but to not block for new messages
 		if (const auto ecode = m_window->ProcessMessages())
 		{
+			// A capture may still be writing its trace. The app is closing, so it's fine to wait for it here
+			PROFILE_WAIT_FOR_WRITER();
 			PROFILE_BEGIN_SESSION("Shutdown", "profile/Profile-Shutdown.json");
 
+			SimulationManager::StopSimulationThread();
+
 			// Shutdown ImGui
 			{
 				PROFILE_SCOPE("ImGui_ImplDX11_Shutdown");
@@ -88,6 +101,7 @@ int App::Run() const
 			}
 
 			PROFILE_END_SESSION(); // End shutdown
+			PROFILE_WAIT_FOR_WRITER();
 
 			// if return optional has value, means we're quitting so return exit code
 			return *ecode;
@@ -96,12 +110,29 @@ int App::Run() const
 		// Inform the Instrumentor that we are starting the next frame
 		PROFILE_NEXT_FRAME();
 
-		// Update the active simulation before updating the window
-		SimulationManager::Update();
+		frameTiming.BeginPhase(FramePhase::Simulation);
+
+		// Apply the edits the UI queued last frame and deliver the events the previous frame deferred. Only
+		// wait for the simulation thread if there are any. The wait is part of the Simulation phase, the UI
+		// phase never takes the lock
+		if (SimulationManager::HasQueuedEdits() || SimulationManager::HasDeferredEvents())
+		{
+			SimulationManager::SimulationLock lock;
+			SimulationManager::ApplyQueuedEdits();
+			SimulationManager::DispatchDeferredEvents();
+		}
+
+		// Pick up the latest state the simulation thread has published. The renderer and the UI draw from it
+		// without waiting on the physics
+		SimulationManager::AcquireSnapshot();
 
 		// Update the window-side data and render
+		frameTiming.BeginPhase(FramePhase::RendererUpdate);
 		m_window->Update();
 		if (m_window->Render())
+		{
+			frameTiming.BeginPhase(FramePhase::Present);
 			m_window->Present();
+		}
 	}
 }
\ No newline at end of file
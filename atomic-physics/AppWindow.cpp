@@ -1,4 +1,5 @@
 #include "AppWindow.h"
+#include "FrameTiming.h"
 #include "WindowsMessageMap.h"
 
 
@@ -95,8 +96,8 @@ void AppWindow::Update() noexcept
 {
 	PROFILE_FUNCTION();
 
-	// At this point for the current frame, the Simulation has already been updated
-	// All we need to do on the window side is query the Simulation to render it
+	// At this point for the current frame, the latest simulation snapshot has already been acquired
+	// All we need to do on the window side is query the snapshot to render it
 	m_simulationRenderer->Update();
 
 	// Ideally, the window should keep some logic about whether or not the mouse is
@@ -120,6 +121,8 @@ bool AppWindow::Render() noexcept
 { 
 	PROFILE_FUNCTION();
 
+	FrameTiming::Get().BeginPhase(FramePhase::Render);
+
 	// Clear the window
 	ID3D11DeviceContext4* context = DeviceResources::D3DDeviceContext();
 	{
@@ -150,7 +153,9 @@ bool AppWindow::Render() noexcept
 	}
 
 	// Render the UI
+	FrameTiming::Get().BeginPhase(FramePhase::UI);
 	m_ui->Render(m_simulationRenderer);
+	FrameTiming::Get().BeginPhase(FramePhase::Render);
 
 	// Render 3D scene - MUST render here because we render on top of ImGui, but if we render
 	//					 after finalizing the ImGui draw, then Present will be called by ImGui
@@ -0,0 +1,671 @@
+#include "BarnesHut.h"
+#include "CpuFeatures.h"
+#include "PhysicsConstants.h"
+#include "SimulationKernels.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	// Spread the lower 10 bits of v so there are two zero bits between each of them
+	inline std::uint32_t SpreadBits(std::uint32_t v) noexcept
+	{
+		v &= 0x000003FF;
+		v = (v | (v << 16)) & 0x030000FF;
+		v = (v | (v << 8)) & 0x0300F00F;
+		v = (v | (v << 4)) & 0x030C30C3;
+		v = (v | (v << 2)) & 0x09249249;
+		return v;
+	}
+
+	// Sum the (softened) field and potential at (x, y, z) from the 'count' point charges in s_x/y/z/q
+	using DirectKernel = void(*)(const float* s_x, const float* s_y, const float* s_z, const float* s_q, unsigned int count,
+		float x, float y, float z, float softening2, float& e_x, float& e_y, float& e_z, float& potential) noexcept;
+
+	// Sum the field and potential at (x, y, z) from 'count' accepted nodes (monopole + dipole about m_x/y/z)
+	using MultipoleKernel = void(*)(const float* m_x, const float* m_y, const float* m_z, const float* m_q,
+		const float* m_px, const float* m_py, const float* m_pz, unsigned int count,
+		float x, float y, float z, float softening2, float& e_x, float& e_y, float& e_z, float& potential) noexcept;
+
+	void DirectKernel_Scalar(const float* s_x, const float* s_y, const float* s_z, const float* s_q, unsigned int count,
+		float x, float y, float z, float softening2, float& e_x, float& e_y, float& e_z, float& potential) noexcept
+	{
+		for (unsigned int iii = 0; iii < count; ++iii)
+		{
+			float dx = x - s_x[iii];
+			float dy = y - s_y[iii];
+			float dz = z - s_z[iii];
+			float invR = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz + softening2);
+			float qInvR = s_q[iii] * invR;
+			float qInvR3 = qInvR * invR * invR;
+
+			e_x += qInvR3 * dx;
+			e_y += qInvR3 * dy;
+			e_z += qInvR3 * dz;
+			potential += qInvR;
+		}
+	}
+
+	void MultipoleKernel_Scalar(const float* m_x, const float* m_y, const float* m_z, const float* m_q,
+		const float* m_px, const float* m_py, const float* m_pz, unsigned int count,
+		float x, float y, float z, float softening2, float& e_x, float& e_y, float& e_z, float& potential) noexcept
+	{
+		for (unsigned int iii = 0; iii < count; ++iii)
+		{
+			float dx = x - m_x[iii];
+			float dy = y - m_y[iii];
+			float dz = z - m_z[iii];
+			float invR = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz + softening2);
+			float invR2 = invR * invR;
+			float invR3 = invR2 * invR;
+			float dipoleDotD = m_px[iii] * dx + m_py[iii] * dy + m_pz[iii] * dz;
+
+			// Monopole: q d / r^3, dipole: 3 (p.d) d / r^5 - p / r^3
+			float radial = m_q[iii] * invR3 + 3.0f * dipoleDotD * invR3 * invR2;
+			e_x += radial * dx - m_px[iii] * invR3;
+			e_y += radial * dy - m_py[iii] * invR3;
+			e_z += radial * dz - m_pz[iii] * invR3;
+			potential += m_q[iii] * invR + dipoleDotD * invR3;
+		}
+	}
+
+#ifdef SIMD_X86
+	SIMD_TARGET("avx2")
+	inline float HorizontalSum(__m256 v) noexcept
+	{
+		__m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+		return _mm_cvtss_f32(sum);
+	}
+
+	SIMD_TARGET("avx2")
+	void DirectKernel_AVX2(const float* s_x, const float* s_y, const float* s_z, const float* s_q, unsigned int count,
+		float x, float y, float z, float softening2, float& e_x, float& e_y, float& e_z, float& potential) noexcept
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 x8 = _mm256_set1_ps(x);
+		const __m256 y8 = _mm256_set1_ps(y);
+		const __m256 z8 = _mm256_set1_ps(z);
+		const __m256 eps8 = _mm256_set1_ps(softening2);
+
+		__m256 ex8 = _mm256_setzero_ps(), ey8 = _mm256_setzero_ps(), ez8 = _mm256_setzero_ps(), phi8 = _mm256_setzero_ps();
+
+		unsigned int iii = 0;
+		for (; iii + 8 <= count; iii += 8)
+		{
+			__m256 dx = _mm256_sub_ps(x8, _mm256_loadu_ps(s_x + iii));
+			__m256 dy = _mm256_sub_ps(y8, _mm256_loadu_ps(s_y + iii));
+			__m256 dz = _mm256_sub_ps(z8, _mm256_loadu_ps(s_z + iii));
+			__m256 r2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_add_ps(_mm256_mul_ps(dz, dz), eps8));
+
+			__m256 invR = _mm256_div_ps(one, _mm256_sqrt_ps(r2));
+			__m256 qInvR = _mm256_mul_ps(_mm256_loadu_ps(s_q + iii), invR);
+			__m256 qInvR3 = _mm256_mul_ps(qInvR, _mm256_mul_ps(invR, invR));
+
+			ex8 = _mm256_add_ps(ex8, _mm256_mul_ps(qInvR3, dx));
+			ey8 = _mm256_add_ps(ey8, _mm256_mul_ps(qInvR3, dy));
+			ez8 = _mm256_add_ps(ez8, _mm256_mul_ps(qInvR3, dz));
+			phi8 = _mm256_add_ps(phi8, qInvR);
+		}
+
+		e_x += HorizontalSum(ex8);
+		e_y += HorizontalSum(ey8);
+		e_z += HorizontalSum(ez8);
+		potential += HorizontalSum(phi8);
+
+		DirectKernel_Scalar(s_x + iii, s_y + iii, s_z + iii, s_q + iii, count - iii, x, y, z, softening2, e_x, e_y, e_z, potential);
+	}
+
+	SIMD_TARGET("avx2")
+	void MultipoleKernel_AVX2(const float* m_x, const float* m_y, const float* m_z, const float* m_q,
+		const float* m_px, const float* m_py, const float* m_pz, unsigned int count,
+		float x, float y, float z, float softening2, float& e_x, float& e_y, float& e_z, float& potential) noexcept
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 three = _mm256_set1_ps(3.0f);
+		const __m256 x8 = _mm256_set1_ps(x);
+		const __m256 y8 = _mm256_set1_ps(y);
+		const __m256 z8 = _mm256_set1_ps(z);
+		const __m256 eps8 = _mm256_set1_ps(softening2);
+
+		__m256 ex8 = _mm256_setzero_ps(), ey8 = _mm256_setzero_ps(), ez8 = _mm256_setzero_ps(), phi8 = _mm256_setzero_ps();
+
+		unsigned int iii = 0;
+		for (; iii + 8 <= count; iii += 8)
+		{
+			__m256 dx = _mm256_sub_ps(x8, _mm256_loadu_ps(m_x + iii));
+			__m256 dy = _mm256_sub_ps(y8, _mm256_loadu_ps(m_y + iii));
+			__m256 dz = _mm256_sub_ps(z8, _mm256_loadu_ps(m_z + iii));
+			__m256 r2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_add_ps(_mm256_mul_ps(dz, dz), eps8));
+
+			__m256 invR = _mm256_div_ps(one, _mm256_sqrt_ps(r2));
+			__m256 invR2 = _mm256_mul_ps(invR, invR);
+			__m256 invR3 = _mm256_mul_ps(invR2, invR);
+
+			__m256 q = _mm256_loadu_ps(m_q + iii);
+			__m256 px = _mm256_loadu_ps(m_px + iii);
+			__m256 py = _mm256_loadu_ps(m_py + iii);
+			__m256 pz = _mm256_loadu_ps(m_pz + iii);
+			__m256 dipoleDotD = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, dx), _mm256_mul_ps(py, dy)), _mm256_mul_ps(pz, dz));
+
+			__m256 radial = _mm256_add_ps(_mm256_mul_ps(q, invR3), _mm256_mul_ps(_mm256_mul_ps(three, dipoleDotD), _mm256_mul_ps(invR3, invR2)));
+			ex8 = _mm256_add_ps(ex8, _mm256_sub_ps(_mm256_mul_ps(radial, dx), _mm256_mul_ps(px, invR3)));
+			ey8 = _mm256_add_ps(ey8, _mm256_sub_ps(_mm256_mul_ps(radial, dy), _mm256_mul_ps(py, invR3)));
+			ez8 = _mm256_add_ps(ez8, _mm256_sub_ps(_mm256_mul_ps(radial, dz), _mm256_mul_ps(pz, invR3)));
+			phi8 = _mm256_add_ps(phi8, _mm256_add_ps(_mm256_mul_ps(q, invR), _mm256_mul_ps(dipoleDotD, invR3)));
+		}
+
+		e_x += HorizontalSum(ex8);
+		e_y += HorizontalSum(ey8);
+		e_z += HorizontalSum(ez8);
+		potential += HorizontalSum(phi8);
+
+		MultipoleKernel_Scalar(m_x + iii, m_y + iii, m_z + iii, m_q + iii, m_px + iii, m_py + iii, m_pz + iii, count - iii,
+			x, y, z, softening2, e_x, e_y, e_z, potential);
+	}
+#endif
+}
+
+BarnesHut::BarnesHut(float openingAngle, float softening) noexcept :
+	m_openingAngle(openingAngle),
+	m_softening(std::max(softening, MinSoftening)),
+	m_rootMinX(0.0f),
+	m_rootMinY(0.0f),
+	m_rootMinZ(0.0f),
+	m_rootSize(0.0f),
+	m_potentialEnergy(0.0)
+{
+}
+
+void BarnesHut::SetSoftening(float softening) noexcept
+{
+	// A softening of 0 would turn the self interaction inside a leaf into a division by zero
+	m_softening = std::max(softening, MinSoftening);
+}
+
+void BarnesHut::Compute(const ParticleStore& particles) noexcept
+{
+	PROFILE_FUNCTION();
+
+	unsigned int count = particles.Size();
+	m_forceX.resize(count);
+	m_forceY.resize(count);
+	m_forceZ.resize(count);
+	m_potentialEnergy = 0.0;
+
+	if (count == 0)
+	{
+		m_nodes.clear();
+		return;
+	}
+
+	ComputeBounds(particles);
+	SortParticles(particles);
+	BuildTree();
+	EvaluateForces();
+}
+
+void BarnesHut::ComputeBounds(const ParticleStore& particles) noexcept
+{
+	PROFILE_FUNCTION();
+
+	constexpr unsigned int chunkSize = 16384;
+	unsigned int count = particles.Size();
+	unsigned int chunkCount = (count + chunkSize - 1) / chunkSize;
+
+	const float* p_x = particles.PositionX();
+	const float* p_y = particles.PositionY();
+	const float* p_z = particles.PositionZ();
+
+	struct Bounds { float min[3]; float max[3]; };
+	std::vector<Bounds> chunkBounds(chunkCount);
+
+	ThreadPool::Get().ParallelFor(0, count, chunkSize,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			Bounds b = { { p_x[begin], p_y[begin], p_z[begin] }, { p_x[begin], p_y[begin], p_z[begin] } };
+			for (unsigned int iii = begin; iii < end; ++iii)
+			{
+				b.min[0] = std::min(b.min[0], p_x[iii]); b.max[0] = std::max(b.max[0], p_x[iii]);
+				b.min[1] = std::min(b.min[1], p_y[iii]); b.max[1] = std::max(b.max[1], p_y[iii]);
+				b.min[2] = std::min(b.min[2], p_z[iii]); b.max[2] = std::max(b.max[2], p_z[iii]);
+			}
+			chunkBounds[begin / chunkSize] = b;
+		}
+	);
+
+	Bounds bounds = chunkBounds[0];
+	for (const Bounds& b : chunkBounds)
+	{
+		for (unsigned int axis = 0; axis < 3; ++axis)
+		{
+			bounds.min[axis] = std::min(bounds.min[axis], b.min[axis]);
+			bounds.max[axis] = std::max(bounds.max[axis], b.max[axis]);
+		}
+	}
+
+	// The root is a cube slightly larger than the particle extents so the largest coordinate still maps inside it
+	float size = std::max({ bounds.max[0] - bounds.min[0], bounds.max[1] - bounds.min[1], bounds.max[2] - bounds.min[2] });
+	m_rootSize = size * 1.0001f + 1.0e-6f;
+	m_rootMinX = bounds.min[0];
+	m_rootMinY = bounds.min[1];
+	m_rootMinZ = bounds.min[2];
+}
+
+void BarnesHut::SortParticles(const ParticleStore& particles) noexcept
+{
+	PROFILE_FUNCTION();
+
+	unsigned int count = particles.Size();
+	const unsigned int* type = particles.Type();
+	const float* p_x = particles.PositionX();
+	const float* p_y = particles.PositionY();
+	const float* p_z = particles.PositionZ();
+
+	constexpr unsigned int cellsPerAxis = 1u << MortonBits;
+	float scale = static_cast<float>(cellsPerAxis) / m_rootSize;
+
+	m_keys.resize(count);
+	ThreadPool::Get().ParallelFor(0, count, 4096,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			for (unsigned int iii = begin; iii < end; ++iii)
+			{
+				std::uint32_t cx = std::min(static_cast<std::uint32_t>((p_x[iii] - m_rootMinX) * scale), cellsPerAxis - 1);
+				std::uint32_t cy = std::min(static_cast<std::uint32_t>((p_y[iii] - m_rootMinY) * scale), cellsPerAxis - 1);
+				std::uint32_t cz = std::min(static_cast<std::uint32_t>((p_z[iii] - m_rootMinZ) * scale), cellsPerAxis - 1);
+				std::uint64_t code = (SpreadBits(cx) << 2) | (SpreadBits(cy) << 1) | SpreadBits(cz);
+				m_keys[iii] = (code << 32) | iii;
+			}
+		}
+	);
+
+	// Parallel merge sort: sort fixed size runs, then merge pairs of runs until a single run remains
+	constexpr unsigned int runSize = 8192;
+	ThreadPool::Get().ParallelFor(0, count, runSize,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			std::sort(m_keys.begin() + begin, m_keys.begin() + end);
+		}
+	);
+
+	for (unsigned int width = runSize; width < count; width *= 2)
+	{
+		unsigned int mergeCount = (count + 2 * width - 1) / (2 * width);
+		ThreadPool::Get().ParallelFor(0, mergeCount, 1,
+			[&](unsigned int begin, unsigned int end) noexcept
+			{
+				for (unsigned int merge = begin; merge < end; ++merge)
+				{
+					unsigned int low = merge * 2 * width;
+					unsigned int mid = std::min(low + width, count);
+					unsigned int high = std::min(low + 2 * width, count);
+					std::inplace_merge(m_keys.begin() + low, m_keys.begin() + mid, m_keys.begin() + high);
+				}
+			}
+		);
+	}
+
+	m_sortedX.resize(count);
+	m_sortedY.resize(count);
+	m_sortedZ.resize(count);
+	m_sortedCharge.resize(count);
+	m_potential.resize(count);
+	ThreadPool::Get().ParallelFor(0, count, 4096,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			for (unsigned int iii = begin; iii < end; ++iii)
+			{
+				unsigned int index = static_cast<unsigned int>(m_keys[iii]);
+				m_sortedX[iii] = p_x[index];
+				m_sortedY[iii] = p_y[index];
+				m_sortedZ[iii] = p_z[index];
+				m_sortedCharge[iii] = Constants::ParticleCharge(type[index]);
+			}
+		}
+	);
+}
+
+unsigned int BarnesHut::CellLevel(unsigned int begin, unsigned int end) const noexcept
+{
+	// The keys are sorted, so the deepest cell containing the whole range is given by the
+	// common prefix of the first and last Morton code
+	std::uint32_t diff = static_cast<std::uint32_t>((m_keys[begin] ^ m_keys[end - 1]) >> 32);
+	if (diff == 0)
+		return MortonBits;
+
+	return (std::countl_zero(diff) - (32 - 3 * MortonBits)) / 3;
+}
+
+void BarnesHut::InitializeNode(Node& node, unsigned int begin, unsigned int end) const noexcept
+{
+	node = {};
+	node.begin = begin;
+	node.end = end;
+	node.size = m_rootSize / static_cast<float>(1u << CellLevel(begin, end));
+}
+
+void BarnesHut::BuildTree() noexcept
+{
+	PROFILE_FUNCTION();
+
+	unsigned int count = static_cast<unsigned int>(m_keys.size());
+
+	// Build the top of the tree serially, stopping at ranges small enough to be built as independent subtrees
+	m_nodes.clear();
+	m_deferredNodes.clear();
+	m_nodes.emplace_back();
+	InitializeNode(m_nodes[0], 0, count);
+	BuildNode(m_nodes, 0, true);
+	unsigned int topCount = static_cast<unsigned int>(m_nodes.size());
+
+	// Build each subtree into its own array (local index 0 is the subtree root)
+	std::vector<std::vector<Node>> subtrees(m_deferredNodes.size());
+	ThreadPool::Get().ParallelFor(0, static_cast<unsigned int>(subtrees.size()), 1,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			for (unsigned int iii = begin; iii < end; ++iii)
+			{
+				std::vector<Node>& subtree = subtrees[iii];
+				subtree.push_back(m_nodes[m_deferredNodes[iii]]);
+				BuildNode(subtree, 0, false);
+
+				for (unsigned int node = static_cast<unsigned int>(subtree.size()); node-- > 0;)
+					ComputeMoments(subtree, node);
+			}
+		}
+	);
+
+	// Append the subtrees (minus their roots, which already have a slot) and fix up the child indices
+	for (unsigned int iii = 0; iii < subtrees.size(); ++iii)
+	{
+		std::vector<Node>& subtree = subtrees[iii];
+		unsigned int offset = static_cast<unsigned int>(m_nodes.size()) - 1;
+		for (Node& node : subtree)
+		{
+			if (node.childCount > 0)
+				node.firstChild += offset;
+		}
+
+		m_nodes[m_deferredNodes[iii]] = subtree[0];
+		m_nodes.insert(m_nodes.end(), subtree.begin() + 1, subtree.end());
+	}
+
+	// Children always come after their parent, so a reverse sweep visits them first
+	for (unsigned int node = topCount; node-- > 0;)
+		ComputeMoments(m_nodes, node);
+}
+
+void BarnesHut::BuildNode(std::vector<Node>& nodes, unsigned int nodeIndex, bool deferLargeRanges) noexcept
+{
+	unsigned int begin = nodes[nodeIndex].begin;
+	unsigned int end = nodes[nodeIndex].end;
+	unsigned int level = CellLevel(begin, end);
+
+	if (end - begin <= LeafSize || level >= MortonBits)
+		return;
+
+	if (deferLargeRanges && end - begin < SubtreeSize)
+	{
+		m_deferredNodes.push_back(nodeIndex);
+		return;
+	}
+
+	// Split the range by the octant at 'level'. The range shares no deeper prefix, so there are at least 2 children
+	unsigned int shift = 32 + 3 * (MortonBits - 1 - level);
+	unsigned int childBegin[9];
+	unsigned int childCount = 0;
+	unsigned int current = begin;
+	while (current < end)
+	{
+		std::uint64_t octant = (m_keys[current] >> shift) & 7;
+		unsigned int next = static_cast<unsigned int>(std::partition_point(m_keys.begin() + current, m_keys.begin() + end,
+			[shift, octant](std::uint64_t key) noexcept { return ((key >> shift) & 7) == octant; }) - m_keys.begin());
+
+		childBegin[childCount++] = current;
+		current = next;
+	}
+	childBegin[childCount] = end;
+
+	unsigned int firstChild = static_cast<unsigned int>(nodes.size());
+	nodes[nodeIndex].firstChild = firstChild;
+	nodes[nodeIndex].childCount = childCount;
+
+	nodes.resize(nodes.size() + childCount);
+	for (unsigned int iii = 0; iii < childCount; ++iii)
+		InitializeNode(nodes[firstChild + iii], childBegin[iii], childBegin[iii + 1]);
+
+	for (unsigned int iii = 0; iii < childCount; ++iii)
+		BuildNode(nodes, firstChild + iii, deferLargeRanges);
+}
+
+void BarnesHut::ComputeMoments(std::vector<Node>& nodes, unsigned int nodeIndex) noexcept
+{
+	Node& node = nodes[nodeIndex];
+
+	float charge = 0.0f, absCharge = 0.0f;
+	float cx = 0.0f, cy = 0.0f, cz = 0.0f;
+
+	if (node.childCount == 0)
+	{
+		for (unsigned int iii = node.begin; iii < node.end; ++iii)
+		{
+			float q = m_sortedCharge[iii];
+			float w = std::abs(q);
+			charge += q;
+			absCharge += w;
+			cx += w * m_sortedX[iii];
+			cy += w * m_sortedY[iii];
+			cz += w * m_sortedZ[iii];
+		}
+	}
+	else
+	{
+		for (unsigned int iii = node.firstChild; iii < node.firstChild + node.childCount; ++iii)
+		{
+			const Node& child = nodes[iii];
+			charge += child.charge;
+			absCharge += child.absCharge;
+			cx += child.absCharge * child.centerX;
+			cy += child.absCharge * child.centerY;
+			cz += child.absCharge * child.centerZ;
+		}
+	}
+
+	if (absCharge > 0.0f)
+	{
+		cx /= absCharge;
+		cy /= absCharge;
+		cz /= absCharge;
+	}
+	else
+	{
+		cx = m_sortedX[node.begin];
+		cy = m_sortedY[node.begin];
+		cz = m_sortedZ[node.begin];
+	}
+
+	// Dipole moment about the expansion center
+	float dipoleX = 0.0f, dipoleY = 0.0f, dipoleZ = 0.0f;
+	if (node.childCount == 0)
+	{
+		for (unsigned int iii = node.begin; iii < node.end; ++iii)
+		{
+			float q = m_sortedCharge[iii];
+			dipoleX += q * (m_sortedX[iii] - cx);
+			dipoleY += q * (m_sortedY[iii] - cy);
+			dipoleZ += q * (m_sortedZ[iii] - cz);
+		}
+	}
+	else
+	{
+		for (unsigned int iii = node.firstChild; iii < node.firstChild + node.childCount; ++iii)
+		{
+			const Node& child = nodes[iii];
+			dipoleX += child.dipoleX + child.charge * (child.centerX - cx);
+			dipoleY += child.dipoleY + child.charge * (child.centerY - cy);
+			dipoleZ += child.dipoleZ + child.charge * (child.centerZ - cz);
+		}
+	}
+
+	node.charge = charge;
+	node.absCharge = absCharge;
+	node.centerX = cx;
+	node.centerY = cy;
+	node.centerZ = cz;
+	node.dipoleX = dipoleX;
+	node.dipoleY = dipoleY;
+	node.dipoleZ = dipoleZ;
+}
+
+void BarnesHut::EvaluateForces() noexcept
+{
+	PROFILE_FUNCTION();
+
+	unsigned int count = static_cast<unsigned int>(m_keys.size());
+	float theta = m_openingAngle;
+	float softening2 = m_softening * m_softening;
+	float selfPotential = 1.0f / std::sqrt(softening2);
+
+	DirectKernel directKernel = DirectKernel_Scalar;
+	MultipoleKernel multipoleKernel = MultipoleKernel_Scalar;
+#ifdef SIMD_X86
+	if (SimulationKernels::GetSimdLevel() >= SimdLevel::AVX2)
+	{
+		directKernel = DirectKernel_AVX2;
+		multipoleKernel = MultipoleKernel_AVX2;
+	}
+#endif
+
+	// The tree is walked once per group of nearby targets instead of once per particle. Every target in
+	// the group then shares the same interaction list, which is laid out contiguously for the kernels
+	m_groups.clear();
+	{
+		std::vector<unsigned int> stack = { 0 };
+		while (!stack.empty())
+		{
+			const Node& node = m_nodes[stack.back()];
+			unsigned int nodeIndex = stack.back();
+			stack.pop_back();
+
+			if (node.childCount == 0 || node.end - node.begin <= GroupSize)
+				m_groups.push_back(nodeIndex);
+			else
+			{
+				for (unsigned int child = 0; child < node.childCount; ++child)
+					stack.push_back(node.firstChild + child);
+			}
+		}
+	}
+
+	ThreadPool::Get().ParallelFor(0, static_cast<unsigned int>(m_groups.size()), GroupsPerChunk,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			ParticleStore::AlignedVector<float> s_x, s_y, s_z, s_q;
+			ParticleStore::AlignedVector<float> m_x, m_y, m_z, m_q, m_px, m_py, m_pz;
+
+			// At most 8 children are pushed per level
+			unsigned int stack[8 * (MortonBits + 1)];
+
+			for (unsigned int group = begin; group < end; ++group)
+			{
+				const Node& target = m_nodes[m_groups[group]];
+
+				// Bounding sphere of the targets
+				float minX = m_sortedX[target.begin], maxX = minX;
+				float minY = m_sortedY[target.begin], maxY = minY;
+				float minZ = m_sortedZ[target.begin], maxZ = minZ;
+				for (unsigned int iii = target.begin + 1; iii < target.end; ++iii)
+				{
+					minX = std::min(minX, m_sortedX[iii]); maxX = std::max(maxX, m_sortedX[iii]);
+					minY = std::min(minY, m_sortedY[iii]); maxY = std::max(maxY, m_sortedY[iii]);
+					minZ = std::min(minZ, m_sortedZ[iii]); maxZ = std::max(maxZ, m_sortedZ[iii]);
+				}
+				float gx = 0.5f * (minX + maxX);
+				float gy = 0.5f * (minY + maxY);
+				float gz = 0.5f * (minZ + maxZ);
+				float radius = 0.5f * std::sqrt((maxX - minX) * (maxX - minX) + (maxY - minY) * (maxY - minY) + (maxZ - minZ) * (maxZ - minZ));
+
+				// Build the interaction list
+				s_x.clear(); s_y.clear(); s_z.clear(); s_q.clear();
+				m_x.clear(); m_y.clear(); m_z.clear(); m_q.clear(); m_px.clear(); m_py.clear(); m_pz.clear();
+
+				unsigned int stackSize = 0;
+				stack[stackSize++] = 0;
+				while (stackSize > 0)
+				{
+					const Node& node = m_nodes[stack[--stackSize]];
+
+					float dx = gx - node.centerX;
+					float dy = gy - node.centerY;
+					float dz = gz - node.centerZ;
+					float distance = std::sqrt(dx * dx + dy * dy + dz * dz) - radius;
+
+					// A node overlapping the group is never accepted, which also guarantees every self term shows up exactly once
+					bool overlapsGroup = node.begin < target.end && target.begin < node.end;
+					if (!overlapsGroup && distance > 0.0f && node.size < theta * distance)
+					{
+						m_x.push_back(node.centerX);
+						m_y.push_back(node.centerY);
+						m_z.push_back(node.centerZ);
+						m_q.push_back(node.charge);
+						m_px.push_back(node.dipoleX);
+						m_py.push_back(node.dipoleY);
+						m_pz.push_back(node.dipoleZ);
+					}
+					else if (node.childCount == 0)
+					{
+						s_x.insert(s_x.end(), m_sortedX.begin() + node.begin, m_sortedX.begin() + node.end);
+						s_y.insert(s_y.end(), m_sortedY.begin() + node.begin, m_sortedY.begin() + node.end);
+						s_z.insert(s_z.end(), m_sortedZ.begin() + node.begin, m_sortedZ.begin() + node.end);
+						s_q.insert(s_q.end(), m_sortedCharge.begin() + node.begin, m_sortedCharge.begin() + node.end);
+					}
+					else
+					{
+						for (unsigned int child = 0; child < node.childCount; ++child)
+							stack[stackSize++] = node.firstChild + child;
+					}
+				}
+
+				// Evaluate it for every target in the group
+				unsigned int directCount = static_cast<unsigned int>(s_x.size());
+				unsigned int multipoleCount = static_cast<unsigned int>(m_x.size());
+				for (unsigned int iii = target.begin; iii < target.end; ++iii)
+				{
+					float x = m_sortedX[iii];
+					float y = m_sortedY[iii];
+					float z = m_sortedZ[iii];
+					float e_x = 0.0f, e_y = 0.0f, e_z = 0.0f, potential = 0.0f;
+
+					directKernel(s_x.data(), s_y.data(), s_z.data(), s_q.data(), directCount, x, y, z, softening2, e_x, e_y, e_z, potential);
+					multipoleKernel(m_x.data(), m_y.data(), m_z.data(), m_q.data(), m_px.data(), m_py.data(), m_pz.data(), multipoleCount,
+						x, y, z, softening2, e_x, e_y, e_z, potential);
+
+					// The direct sum included the target itself (at distance 0 -> 1 / softening)
+					float q = m_sortedCharge[iii];
+					potential -= q * selfPotential;
+
+					unsigned int index = static_cast<unsigned int>(m_keys[iii]);
+					float scale = Constants::CoulombConstant * q;
+					m_forceX[index] = scale * e_x;
+					m_forceY[index] = scale * e_y;
+					m_forceZ[index] = scale * e_z;
+					m_potential[iii] = q * potential;
+				}
+			}
+		}
+	);
+
+	double energy = 0.0;
+	for (unsigned int iii = 0; iii < count; ++iii)
+		energy += m_potential[iii];
+	m_potentialEnergy = 0.5 * Constants::CoulombConstant * energy;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "CorePch.h"
+#include "ParticleStore.h"
+
+#include <cstdint>
+#include <vector>
+
+// Barnes-Hut tree code for the Coulomb force between all charged particles (electrons have a charge of -1,
+// nuclei a charge equal to their element number).
+//
+// The particles are sorted along a Morton (Z-order) curve so every octree node covers a contiguous range of
+// the sorted particles. Each node stores the monopole and dipole moment of its charges about their center of
+// absolute charge. Forces are evaluated for small groups of neighboring particles at a time: a node whose
+// size / distance from the group is below the opening angle is treated as a single multipole, otherwise its
+// children are visited, and leaves that are reached are summed directly over the sorted particle copies.
+// The potential is softened (1 / sqrt(r^2 + softening^2)) so electrons and nuclei cannot collapse onto each other.
+class BarnesHut
+{
+public:
+	BarnesHut(float openingAngle = 0.5f, float softening = 0.01f) noexcept;
+	BarnesHut(const BarnesHut&) = delete;
+	void operator=(const BarnesHut&) = delete;
+
+	float GetOpeningAngle() const noexcept { return m_openingAngle; }
+	void SetOpeningAngle(float theta) noexcept { m_openingAngle = theta; }
+	float GetSoftening() const noexcept { return m_softening; }
+	void SetSoftening(float softening) noexcept;
+
+	// Build the tree and evaluate the force on every particle
+	void Compute(const ParticleStore& particles) noexcept;
+
+	const float* ForceX() const noexcept { return m_forceX.data(); }
+	const float* ForceY() const noexcept { return m_forceY.data(); }
+	const float* ForceZ() const noexcept { return m_forceZ.data(); }
+
+	// Total electrostatic energy from the last Compute (kcal/mol)
+	double PotentialEnergy() const noexcept { return m_potentialEnergy; }
+	unsigned int NodeCount() const noexcept { return static_cast<unsigned int>(m_nodes.size()); }
+
+private:
+	struct Node
+	{
+		// Expansion center (center of absolute charge)
+		float centerX, centerY, centerZ;
+		float size;			// edge length of the octree cell
+		float charge;		// total charge
+		float absCharge;	// total absolute charge, used to combine the children's expansion centers
+		float dipoleX, dipoleY, dipoleZ;
+		unsigned int begin, end;	// range of sorted particles
+		unsigned int firstChild;	// children are stored contiguously
+		unsigned int childCount;	// 0 for a leaf
+	};
+
+	void ComputeBounds(const ParticleStore& particles) noexcept;
+	void SortParticles(const ParticleStore& particles) noexcept;
+	void BuildTree() noexcept;
+	void BuildNode(std::vector<Node>& nodes, unsigned int nodeIndex, bool deferLargeRanges) noexcept;
+	void ComputeMoments(std::vector<Node>& nodes, unsigned int nodeIndex) noexcept;
+	void InitializeNode(Node& node, unsigned int begin, unsigned int end) const noexcept;
+	unsigned int CellLevel(unsigned int begin, unsigned int end) const noexcept;
+	void EvaluateForces() noexcept;
+
+	// Octree depth is limited to MortonBits levels, so a deep leaf may end up with more than LeafSize particles
+	static constexpr unsigned int MortonBits = 10;
+	static constexpr unsigned int LeafSize = 16;
+	// Ranges at least this large are split into subtrees that are built in parallel
+	static constexpr unsigned int SubtreeSize = 4096;
+	// Nodes with at most GroupSize particles share one tree walk / interaction list between all their particles
+	static constexpr unsigned int GroupSize = 64;
+	static constexpr unsigned int GroupsPerChunk = 4;
+	static constexpr float MinSoftening = 1.0e-4f;
+
+	float m_openingAngle;
+	float m_softening;
+
+	float m_rootMinX, m_rootMinY, m_rootMinZ;
+	float m_rootSize;
+
+	// (morton code << 32 | particle index), sorted
+	std::vector<std::uint64_t> m_keys;
+	std::vector<Node> m_nodes;
+	std::vector<unsigned int> m_deferredNodes;
+	std::vector<unsigned int> m_groups;
+
+	// Sorted copies of the particle positions / charges so leaves can be summed with contiguous loads
+	ParticleStore::AlignedVector<float> m_sortedX;
+	ParticleStore::AlignedVector<float> m_sortedY;
+	ParticleStore::AlignedVector<float> m_sortedZ;
+	ParticleStore::AlignedVector<float> m_sortedCharge;
+
+	ParticleStore::AlignedVector<float> m_forceX;
+	ParticleStore::AlignedVector<float> m_forceY;
+	ParticleStore::AlignedVector<float> m_forceZ;
+	ParticleStore::AlignedVector<float> m_potential;	// per particle (sorted order)
+
+	double m_potentialEnergy;
+};
@@ -0,0 +1,480 @@
+#include "Benchmark.h"
+#include "Clock.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <sstream>
+
+namespace
+{
+	void Summarize(Benchmark::Result& result) noexcept
+	{
+		std::vector<double> sorted = result.samples;
+		std::sort(sorted.begin(), sorted.end());
+
+		size_t count = sorted.size();
+		result.min = sorted.front();
+		result.max = sorted.back();
+		result.median = count % 2 == 1 ? sorted[count / 2] : 0.5 * (sorted[count / 2 - 1] + sorted[count / 2]);
+		result.mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / count;
+
+		double sumOfSquares = 0.0;
+		for (double sample : sorted)
+			sumOfSquares += (sample - result.mean) * (sample - result.mean);
+		result.stddev = count > 1 ? std::sqrt(sumOfSquares / (count - 1)) : 0.0;
+
+		result.itemsPerSecond = result.median > 0.0 ? result.items * 1.0e9 / result.median : 0.0;
+	}
+
+	std::string Quote(const std::string& text) noexcept
+	{
+		std::string quoted = "\"";
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				quoted += '\\';
+			quoted += c;
+		}
+		return quoted + '"';
+	}
+
+	std::string Number(double value) noexcept
+	{
+		char text[32];
+		int length = std::snprintf(text, sizeof(text), "%.3f", value);
+		return std::string(text, length);
+	}
+
+	// Just enough JSON to read back what WriteJson writes: objects, arrays, strings without unicode escapes,
+	// numbers, true, false and null
+	struct JsonValue
+	{
+		enum class Type { Null, Boolean, Number, String, Array, Object };
+
+		Type type = Type::Null;
+		double number = 0.0;
+		std::string string;
+		std::vector<JsonValue> array;
+		std::vector<std::pair<std::string, JsonValue>> object;
+
+		const JsonValue* Find(const std::string& key) const noexcept
+		{
+			for (const auto& [name, value] : object)
+			{
+				if (name == key)
+					return &value;
+			}
+			return nullptr;
+		}
+	};
+
+	class JsonParser
+	{
+	public:
+		JsonParser(const std::string& text) noexcept : m_text(text), m_position(0) {}
+
+		bool Parse(JsonValue& value) noexcept
+		{
+			return ParseValue(value) && (SkipWhitespace(), m_position == m_text.size());
+		}
+		size_t Position() const noexcept { return m_position; }
+
+	private:
+		void SkipWhitespace() noexcept
+		{
+			while (m_position < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_position])))
+				++m_position;
+		}
+
+		bool Consume(char c) noexcept
+		{
+			SkipWhitespace();
+			if (m_position < m_text.size() && m_text[m_position] == c)
+			{
+				++m_position;
+				return true;
+			}
+			return false;
+		}
+
+		bool ConsumeWord(const char* word) noexcept
+		{
+			size_t length = std::char_traits<char>::length(word);
+			if (m_text.compare(m_position, length, word) != 0)
+				return false;
+			m_position += length;
+			return true;
+		}
+
+		bool ParseString(std::string& string) noexcept
+		{
+			if (!Consume('"'))
+				return false;
+			for (; m_position < m_text.size(); ++m_position)
+			{
+				char c = m_text[m_position];
+				if (c == '"')
+				{
+					++m_position;
+					return true;
+				}
+				if (c == '\\' && ++m_position < m_text.size())
+				{
+					c = m_text[m_position];
+					c = c == 'n' ? '\n' : c == 't' ? '\t' : c;
+				}
+				string += c;
+			}
+			return false;
+		}
+
+		bool ParseValue(JsonValue& value) noexcept
+		{
+			SkipWhitespace();
+			if (m_position >= m_text.size())
+				return false;
+
+			char c = m_text[m_position];
+			if (c == '{')
+			{
+				value.type = JsonValue::Type::Object;
+				++m_position;
+				if (Consume('}'))
+					return true;
+				do
+				{
+					std::pair<std::string, JsonValue> member;
+					if (!ParseString(member.first) || !Consume(':') || !ParseValue(member.second))
+						return false;
+					value.object.push_back(std::move(member));
+				} while (Consume(','));
+				return Consume('}');
+			}
+			if (c == '[')
+			{
+				value.type = JsonValue::Type::Array;
+				++m_position;
+				if (Consume(']'))
+					return true;
+				do
+				{
+					value.array.emplace_back();
+					if (!ParseValue(value.array.back()))
+						return false;
+				} while (Consume(','));
+				return Consume(']');
+			}
+			if (c == '"')
+			{
+				value.type = JsonValue::Type::String;
+				return ParseString(value.string);
+			}
+			if (ConsumeWord("true") || ConsumeWord("false"))
+			{
+				value.type = JsonValue::Type::Boolean;
+				value.number = c == 't' ? 1.0 : 0.0;
+				return true;
+			}
+			if (ConsumeWord("null"))
+				return true;
+
+			const char* begin = m_text.c_str() + m_position;
+			char* end = nullptr;
+			value.type = JsonValue::Type::Number;
+			value.number = std::strtod(begin, &end);
+			m_position += end - begin;
+			return end != begin;
+		}
+
+		const std::string& m_text;
+		size_t m_position;
+	};
+
+	double Median(std::vector<double>& values) noexcept
+	{
+		size_t middle = values.size() / 2;
+		std::nth_element(values.begin(), values.begin() + middle, values.end());
+		double upper = values[middle];
+		if (values.size() % 2 == 1)
+			return upper;
+		return 0.5 * (*std::max_element(values.begin(), values.begin() + middle) + upper);
+	}
+
+	// Two-sided p-value of the Mann-Whitney U test, from the normal approximation with a correction for ties.
+	// Accurate enough from about 8 samples per side, which every benchmark takes
+	double MannWhitneyPValue(const std::vector<double>& a, const std::vector<double>& b) noexcept
+	{
+		struct Ranked
+		{
+			double value;
+			bool fromA;
+		};
+		std::vector<Ranked> all;
+		all.reserve(a.size() + b.size());
+		for (double value : a)
+			all.push_back({ value, true });
+		for (double value : b)
+			all.push_back({ value, false });
+		std::sort(all.begin(), all.end(), [](const Ranked& lhs, const Ranked& rhs) { return lhs.value < rhs.value; });
+
+		// Tied values share the average of their ranks
+		double rankSumA = 0.0;
+		double tieCorrection = 0.0;
+		for (size_t first = 0; first < all.size();)
+		{
+			size_t last = first;
+			while (last + 1 < all.size() && all[last + 1].value == all[first].value)
+				++last;
+
+			double rank = 0.5 * (first + last) + 1.0;
+			for (size_t iii = first; iii <= last; ++iii)
+			{
+				if (all[iii].fromA)
+					rankSumA += rank;
+			}
+			double ties = static_cast<double>(last - first + 1);
+			tieCorrection += ties * ties * ties - ties;
+			first = last + 1;
+		}
+
+		double n1 = static_cast<double>(a.size());
+		double n2 = static_cast<double>(b.size());
+		double n = n1 + n2;
+		double u = rankSumA - n1 * (n1 + 1.0) / 2.0;
+		double mean = n1 * n2 / 2.0;
+		double variance = n1 * n2 / 12.0 * ((n + 1.0) - tieCorrection / (n * (n - 1.0)));
+		if (variance <= 0.0)
+			return 1.0;
+
+		// Continuity correction, then both tails
+		double z = std::max(std::abs(u - mean) - 0.5, 0.0) / std::sqrt(variance);
+		return std::erfc(z / std::sqrt(2.0));
+	}
+}
+
+namespace Benchmark
+{
+	Result Run(const Case& benchmarkCase, const Options& options) noexcept
+	{
+		Result result = {};
+		result.name = benchmarkCase.name;
+		result.items = benchmarkCase.items;
+
+		auto timeSample = [&benchmarkCase](uint64_t runs) noexcept {
+			if (benchmarkCase.setup)
+				benchmarkCase.setup();
+
+			uint64_t start = Clock::Now();
+			for (uint64_t iii = 0; iii < runs; ++iii)
+				benchmarkCase.run();
+			return Clock::Now() - start;
+		};
+
+		// The first run also pays for caches, lazily built structures and page faults, so the batches are sized
+		// by the second one
+		timeSample(1);
+		result.runsPerSample = 1;
+		if (benchmarkCase.batchable)
+		{
+			uint64_t ticks = std::max<uint64_t>(timeSample(1), 1);
+			result.runsPerSample = std::max<uint64_t>(static_cast<uint64_t>(options.batchSeconds * Clock::Frequency / ticks), 1);
+		}
+
+		uint64_t elapsed = 0;
+		uint64_t minTicks = static_cast<uint64_t>(options.minSeconds * Clock::Frequency);
+		while (result.samples.size() < options.maxSamples && (result.samples.size() < options.minSamples || elapsed < minTicks))
+		{
+			uint64_t ticks = timeSample(result.runsPerSample);
+			elapsed += ticks;
+			result.samples.push_back(static_cast<double>(ticks) * (1.0e9 / Clock::Frequency) / result.runsPerSample);
+		}
+
+		Summarize(result);
+		return result;
+	}
+
+	Context CurrentContext() noexcept
+	{
+		Context context = {};
+
+		std::time_t now = std::time(nullptr);
+		std::tm utc = {};
+#ifdef _WIN32
+		gmtime_s(&utc, &now);
+#else
+		gmtime_r(&now, &utc);
+#endif
+		char date[32];
+		std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", &utc);
+		context.date = date;
+
+#if defined(_MSC_VER)
+		context.compiler = "MSVC " + std::to_string(_MSC_VER);
+#elif defined(__clang__)
+		context.compiler = "Clang " __clang_version__;
+#elif defined(__GNUC__)
+		context.compiler = "GCC " __VERSION__;
+#endif
+
+#ifdef NDEBUG
+		context.buildType = "release";
+#else
+		context.buildType = "debug";
+#endif
+
+		context.threads = ThreadPool::Get().ThreadCount();
+
+		const CpuFeatures& features = CpuFeatures::Get();
+		context.cpuFeatures = features.avx512f ? "avx512f" : features.avx2 ? "avx2" : features.sse2 ? "sse2" : "scalar";
+		return context;
+	}
+
+	bool WriteJson(const std::string& filepath, const Context& context, const std::vector<Result>& results) noexcept
+	{
+		std::ofstream file(filepath);
+		if (!file)
+			return false;
+
+		file << "{\n";
+		file << "\t\"context\": {\"date\": " << Quote(context.date) << ", \"compiler\": " << Quote(context.compiler)
+			<< ", \"buildType\": " << Quote(context.buildType) << ", \"threads\": " << context.threads
+			<< ", \"cpuFeatures\": " << Quote(context.cpuFeatures) << ", \"unit\": \"ns\"},\n";
+		file << "\t\"benchmarks\": [";
+
+		for (size_t iii = 0; iii < results.size(); ++iii)
+		{
+			const Result& result = results[iii];
+			file << (iii == 0 ? "\n" : ",\n");
+			file << "\t\t{\"name\": " << Quote(result.name) << ", \"items\": " << result.items << ", \"runsPerSample\": " << result.runsPerSample
+				<< ", \"mean\": " << Number(result.mean) << ", \"median\": " << Number(result.median) << ", \"stddev\": " << Number(result.stddev)
+				<< ", \"min\": " << Number(result.min) << ", \"max\": " << Number(result.max) << ", \"itemsPerSecond\": " << Number(result.itemsPerSecond)
+				<< ",\n\t\t \"samples\": [";
+			for (size_t jjj = 0; jjj < result.samples.size(); ++jjj)
+				file << (jjj == 0 ? "" : ", ") << Number(result.samples[jjj]);
+			file << "]}";
+		}
+
+		file << "\n\t]\n}\n";
+		return static_cast<bool>(file);
+	}
+
+	bool ReadJson(const std::string& filepath, Context& context, std::vector<Result>& results, std::string& error) noexcept
+	{
+		std::ifstream file(filepath);
+		if (!file)
+		{
+			error = "could not open '" + filepath + "'";
+			return false;
+		}
+		std::stringstream text;
+		text << file.rdbuf();
+		std::string contents = text.str();
+
+		JsonValue root;
+		JsonParser parser(contents);
+		if (!parser.Parse(root))
+		{
+			error = filepath + ": invalid JSON near offset " + std::to_string(parser.Position());
+			return false;
+		}
+
+		const JsonValue* benchmarks = root.Find("benchmarks");
+		if (benchmarks == nullptr || benchmarks->type != JsonValue::Type::Array)
+		{
+			error = filepath + ": no \"benchmarks\" array";
+			return false;
+		}
+
+		context = {};
+		if (const JsonValue* contextValue = root.Find("context"))
+		{
+			auto text = [contextValue](const char* key) noexcept {
+				const JsonValue* value = contextValue->Find(key);
+				return value != nullptr ? value->string : std::string();
+			};
+			context.date = text("date");
+			context.compiler = text("compiler");
+			context.buildType = text("buildType");
+			context.cpuFeatures = text("cpuFeatures");
+			const JsonValue* threads = contextValue->Find("threads");
+			context.threads = threads != nullptr ? static_cast<unsigned int>(threads->number) : 0;
+		}
+
+		results.clear();
+		for (const JsonValue& benchmark : benchmarks->array)
+		{
+			const JsonValue* name = benchmark.Find("name");
+			const JsonValue* samples = benchmark.Find("samples");
+			if (name == nullptr || samples == nullptr || samples->array.empty())
+			{
+				error = filepath + ": every benchmark needs a name and samples";
+				return false;
+			}
+
+			Result result = {};
+			result.name = name->string;
+			const JsonValue* items = benchmark.Find("items");
+			result.items = items != nullptr ? static_cast<uint64_t>(items->number) : 1;
+			const JsonValue* runsPerSample = benchmark.Find("runsPerSample");
+			result.runsPerSample = runsPerSample != nullptr ? static_cast<uint64_t>(runsPerSample->number) : 1;
+			for (const JsonValue& sample : samples->array)
+				result.samples.push_back(sample.number);
+
+			Summarize(result);
+			results.push_back(std::move(result));
+		}
+		return true;
+	}
+
+	Comparison Compare(const std::vector<std::vector<double>>& baseline, const std::vector<std::vector<double>>& contender) noexcept
+	{
+		constexpr unsigned int Resamples = 2000;
+
+		auto pool = [](const std::vector<std::vector<double>>& runs) noexcept {
+			std::vector<double> samples;
+			for (const std::vector<double>& run : runs)
+				samples.insert(samples.end(), run.begin(), run.end());
+			return samples;
+		};
+		std::vector<double> a = pool(baseline);
+		std::vector<double> b = pool(contender);
+
+		Comparison comparison = {};
+		comparison.pValue = MannWhitneyPValue(a, b);
+		comparison.ratio = Median(b) / Median(a);
+
+		// Percentile bootstrap of the ratio of the medians: pick as many runs as there are with replacement, then
+		// resample within each picked run. Seeded, so the same files always give the same interval
+		std::mt19937 engine(12345);
+		auto resample = [&engine](const std::vector<std::vector<double>>& runs, std::vector<double>& samples) noexcept {
+			std::uniform_int_distribution<size_t> pickRun(0, runs.size() - 1);
+			samples.clear();
+			for (size_t iii = 0; iii < runs.size(); ++iii)
+			{
+				const std::vector<double>& run = runs[pickRun(engine)];
+				std::uniform_int_distribution<size_t> pickSample(0, run.size() - 1);
+				for (size_t jjj = 0; jjj < run.size(); ++jjj)
+					samples.push_back(run[pickSample(engine)]);
+			}
+		};
+		std::vector<double> ratios(Resamples);
+		for (double& ratio : ratios)
+		{
+			resample(baseline, a);
+			resample(contender, b);
+			ratio = Median(b) / Median(a);
+		}
+		std::sort(ratios.begin(), ratios.end());
+		comparison.ratioLow = ratios[static_cast<size_t>(0.025 * (Resamples - 1))];
+		comparison.ratioHigh = ratios[static_cast<size_t>(0.975 * (Resamples - 1))];
+		return comparison;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "CorePch.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Minimal benchmark harness for atomic-physics-bench. Every case is timed over a number of samples so the
+// results carry their spread, not just an average, and two runs can be compared statistically
+namespace Benchmark
+{
+	struct Case
+	{
+		std::string name;				// "<what>/<parameter>", e.g. "Simulation::Step/100000"
+		uint64_t items = 1;				// processed per run, for the throughput
+		std::function<void()> setup;	// not timed, before every sample. May be empty
+		std::function<void()> run;		// timed
+		// The run can be repeated without the setup in between, so short runs are timed in batches that are
+		// long enough for the clock
+		bool batchable = true;
+	};
+
+	struct Options
+	{
+		double minSeconds = 0.5;			// keep sampling until this much time was spent in the runs...
+		unsigned int minSamples = 10;		// ...and at least this many samples were taken
+		unsigned int maxSamples = 1000;
+		double batchSeconds = 0.001;		// target duration of a batch
+	};
+
+	struct Result
+	{
+		std::string name;
+		uint64_t items;
+		uint64_t runsPerSample;
+		std::vector<double> samples;		// nanoseconds per run, in the order they were taken
+		double mean, median, stddev, min, max;
+		double itemsPerSecond;				// at the median
+	};
+
+	Result Run(const Case& benchmarkCase, const Options& options) noexcept;
+
+	// Everything about the run that affects the results, so that two files can be checked to be comparable
+	struct Context
+	{
+		std::string date;					// ISO 8601, UTC
+		std::string compiler;
+		std::string buildType;
+		unsigned int threads;
+		std::string cpuFeatures;
+	};
+	Context CurrentContext() noexcept;
+
+	bool WriteJson(const std::string& filepath, const Context& context, const std::vector<Result>& results) noexcept;
+	// Reads a file written by WriteJson. The summaries are recomputed from the samples
+	bool ReadJson(const std::string& filepath, Context& context, std::vector<Result>& results, std::string& error) noexcept;
+
+	// How a contender's samples compare to a baseline's, each given as one or more runs of the same case. The
+	// ratio is contender / baseline of the medians of all samples, so above 1 is slower. Its confidence interval
+	// comes from a two-level bootstrap, first of the runs and then of the samples within them, so that with
+	// several runs per side the run-to-run variance (layout, frequency, other load) widens it. The p-value is
+	// from a two-sided Mann-Whitney U test over all samples; it only sees the variance within the runs, so
+	// with many samples it is tiny for any shift and should not decide on its own
+	struct Comparison
+	{
+		double ratio;
+		double ratioLow, ratioHigh;		// 95% confidence interval
+		double pValue;
+	};
+	Comparison Compare(const std::vector<std::vector<double>>& baseline, const std::vector<std::vector<double>>& contender) noexcept;
+}
@@ -0,0 +1,203 @@
+// Compares result files of atomic-physics-bench and fails when a case got slower:
+//
+//   atomic-physics-bench-compare <baseline.json>[,<baseline.json>...] <contender.json>[,<contender.json>...]
+//                                [--threshold PERCENT] [--filter TEXT]
+//
+// A case counts as a regression only when the whole 95% interval of the median ratio is more than the threshold
+// slower, so neither noise nor a significant but negligible change fails the comparison. The samples of one run
+// don't show how much a whole run moves from one process to the next, so for a decision pass several runs of
+// each binary, comma separated; the interval then includes the run-to-run spread. Exits with 1 if there is a
+// regression, 2 on bad input.
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct Options
+	{
+		std::vector<std::string> baseline;
+		std::vector<std::string> contender;
+		std::string filter;
+		double threshold = 0.05;
+	};
+
+	struct Side
+	{
+		std::vector<Benchmark::Context> contexts;
+		std::vector<std::vector<Benchmark::Result>> runs;
+	};
+
+	void PrintUsage(const char* program) noexcept
+	{
+		std::fprintf(stderr,
+			"usage: %s <baseline.json>[,...] <contender.json>[,...] [options]\n"
+			"  several comma separated files per side are repeated runs; use at least 3 per side for a decision\n"
+			"  --threshold PERCENT  slowdown of the median that counts as a regression (default 5)\n"
+			"  --filter TEXT        only compare the cases whose name contains TEXT\n", program);
+	}
+
+	std::vector<std::string> SplitList(const std::string& list) noexcept
+	{
+		std::vector<std::string> items;
+		for (size_t first = 0; first <= list.size();)
+		{
+			size_t last = std::min(list.find(',', first), list.size());
+			if (last > first)
+				items.push_back(list.substr(first, last - first));
+			first = last + 1;
+		}
+		return items;
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options) noexcept
+	{
+		for (int iii = 1; iii < argc; ++iii)
+		{
+			std::string argument = argv[iii];
+			bool hasValue = iii + 1 < argc;
+
+			if (argument == "--threshold" && hasValue)
+				options.threshold = std::strtod(argv[++iii], nullptr) / 100.0;
+			else if (argument == "--filter" && hasValue)
+				options.filter = argv[++iii];
+			else if (argument[0] != '-' && options.baseline.empty())
+				options.baseline = SplitList(argument);
+			else if (argument[0] != '-' && options.contender.empty())
+				options.contender = SplitList(argument);
+			else
+				return false;
+		}
+		return !options.baseline.empty() && !options.contender.empty() && options.threshold >= 0.0;
+	}
+
+	bool ReadSide(const std::vector<std::string>& filepaths, Side& side, std::string& error) noexcept
+	{
+		side.contexts.resize(filepaths.size());
+		side.runs.resize(filepaths.size());
+		for (size_t iii = 0; iii < filepaths.size(); ++iii)
+		{
+			if (!Benchmark::ReadJson(filepaths[iii], side.contexts[iii], side.runs[iii], error))
+				return false;
+		}
+		return true;
+	}
+
+	// The samples of the case in every run that has it
+	std::vector<std::vector<double>> SamplesOf(const Side& side, const std::string& name) noexcept
+	{
+		std::vector<std::vector<double>> samples;
+		for (const std::vector<Benchmark::Result>& run : side.runs)
+		{
+			auto match = std::find_if(run.begin(), run.end(), [&name](const Benchmark::Result& result) { return result.name == name; });
+			if (match != run.end())
+				samples.push_back(match->samples);
+		}
+		return samples;
+	}
+
+	void WarnIfDifferent(const char* what, const std::string& baseline, const std::string& contender) noexcept
+	{
+		if (baseline != contender)
+			std::fprintf(stderr, "warning: %s differs: '%s' vs '%s'\n", what, baseline.c_str(), contender.c_str());
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage(argv[0]);
+		return 2;
+	}
+
+	Side baseline, contender;
+	std::string error;
+	if (!ReadSide(options.baseline, baseline, error) || !ReadSide(options.contender, contender, error))
+	{
+		std::fprintf(stderr, "error: %s\n", error.c_str());
+		return 2;
+	}
+
+	// Results from different machines or builds can still be compared, but the differences are not only the code's
+	const Benchmark::Context& baselineContext = baseline.contexts.front();
+	for (const Benchmark::Context& contenderContext : contender.contexts)
+	{
+		WarnIfDifferent("compiler", baselineContext.compiler, contenderContext.compiler);
+		WarnIfDifferent("build type", baselineContext.buildType, contenderContext.buildType);
+		WarnIfDifferent("cpu features", baselineContext.cpuFeatures, contenderContext.cpuFeatures);
+		WarnIfDifferent("thread count", std::to_string(baselineContext.threads), std::to_string(contenderContext.threads));
+	}
+	if (baseline.runs.size() < 2 || contender.runs.size() < 2)
+		std::fprintf(stderr, "warning: with a single run per side the interval leaves out the run-to-run spread; pass several runs for a decision\n");
+
+	std::printf("%-48s %10s %22s %10s  %s\n", "case", "change", "95% interval", "p-value", "verdict");
+
+	unsigned int regressions = 0;
+	unsigned int improvements = 0;
+	std::vector<std::string> names;
+	for (const std::vector<Benchmark::Result>& run : baseline.runs)
+	{
+		for (const Benchmark::Result& result : run)
+		{
+			if (result.name.find(options.filter) != std::string::npos && std::find(names.begin(), names.end(), result.name) == names.end())
+				names.push_back(result.name);
+		}
+	}
+
+	for (const std::string& name : names)
+	{
+		std::vector<std::vector<double>> contenderSamples = SamplesOf(contender, name);
+		if (contenderSamples.empty())
+		{
+			std::printf("%-48s %10s %22s %10s  %s\n", name.c_str(), "", "", "", "missing");
+			continue;
+		}
+
+		Benchmark::Comparison comparison = Benchmark::Compare(SamplesOf(baseline, name), contenderSamples);
+
+		// Decided by the interval alone; the p-value only shows how consistent the samples within the runs are
+		const char* verdict = "same";
+		if (comparison.ratioLow > 1.0 + options.threshold)
+		{
+			verdict = "REGRESSION";
+			++regressions;
+		}
+		else if (comparison.ratioHigh < 1.0 / (1.0 + options.threshold))
+		{
+			verdict = "improvement";
+			++improvements;
+		}
+		else if (comparison.ratioLow > 1.0)
+			verdict = "slower, within threshold";
+		else if (comparison.ratioHigh < 1.0)
+			verdict = "faster, within threshold";
+
+		char interval[64];
+		std::snprintf(interval, sizeof(interval), "[%+.1f%%, %+.1f%%]", (comparison.ratioLow - 1.0) * 100.0, (comparison.ratioHigh - 1.0) * 100.0);
+		std::printf("%-48s %+9.1f%% %22s %10.2g  %s\n", name.c_str(), (comparison.ratio - 1.0) * 100.0, interval, comparison.pValue, verdict);
+	}
+
+	std::vector<std::string> added;
+	for (const std::vector<Benchmark::Result>& run : contender.runs)
+	{
+		for (const Benchmark::Result& result : run)
+		{
+			if (result.name.find(options.filter) != std::string::npos && SamplesOf(baseline, result.name).empty() &&
+				std::find(added.begin(), added.end(), result.name) == added.end())
+			{
+				std::printf("%-48s %10s %22s %10s  %s\n", result.name.c_str(), "", "", "", "new");
+				added.push_back(result.name);
+			}
+		}
+	}
+
+	std::printf("\n%u regression(s), %u improvement(s) at a %.1f%% threshold over %zu vs %zu run(s)\n", regressions, improvements,
+		options.threshold * 100.0, baseline.runs.size(), contender.runs.size());
+	return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,383 @@
+// Benchmarks of the hot paths of the simulation core, to get a reproducible baseline before and after a
+// performance change:
+//
+//   atomic-physics-bench [--filter TEXT] [--max-particles N] [--threads N] [--min-time S] [--min-samples N] [--output file] [--list]
+//
+// Each case reports the median, mean, standard deviation and range of its samples, and --output writes every
+// sample to JSON so that two runs can be compared.
+#include "Benchmark.h"
+#include "Event.h"
+#include "SimulationManager.h"
+#include "SphereInstance.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct Options
+	{
+		std::string filter;
+		std::string output;
+		// The 10^7 particle cases take minutes per sample on a desktop machine, so they are opt-in
+		unsigned long long maxParticles = 1000000;
+		unsigned int threads = 0;
+		bool list = false;
+		Benchmark::Options run;
+	};
+
+	struct Registration
+	{
+		std::string name;
+		uint64_t particles;					// 0 if the case doesn't depend on a particle count
+		std::function<Benchmark::Case()> create;	// called only if the case is run, since setting up can be costly
+	};
+
+	// Particle counts of the size sweeps
+	constexpr unsigned int ParticleCounts[] = { 1000, 10000, 100000, 1000000, 10000000 };
+	// Lennard-Jones neighbor lists of 10^7 particles need more memory than a typical machine has
+	constexpr unsigned int MaxLennardJonesParticles = 1000000;
+	constexpr unsigned int HandlerCounts[] = { 1, 16, 256, 4096 };
+
+	// Carbon, nitrogen and oxygen at about the number density of a liquid, so the neighbor lists are
+	// representative at every particle count
+	constexpr unsigned int BenchmarkTypes[] = { 6, 7, 8 };
+	constexpr float ParticlesPerCubicNanometer = 10.0f;
+
+	float BoxHalfExtent(unsigned int count) noexcept
+	{
+		return 0.5f * std::cbrt(count / ParticlesPerCubicNanometer);
+	}
+
+	// The particles sit on a cubic lattice that fills the box, each moved off its site by up to a quarter of the
+	// lattice spacing. Uniformly random positions put some pairs almost on top of each other, and the huge
+	// Lennard-Jones forces between them blow the system up, so the neighbor lists would be rebuilt every step.
+	// On the lattice no two particles start closer than half the spacing (about 0.23 nm, well above sigma)
+	std::vector<Particle> LatticeParticles(unsigned int count, float halfExtent) noexcept
+	{
+		unsigned int sites = static_cast<unsigned int>(std::ceil(std::cbrt(static_cast<double>(count))));
+		float spacing = 2.0f * halfExtent / sites;
+
+		std::default_random_engine engine;
+		std::uniform_int_distribution<unsigned int> typeIndex(0, static_cast<unsigned int>(std::size(BenchmarkTypes) - 1));
+		std::uniform_real_distribution<float> jitter(-0.25f * spacing, 0.25f * spacing);
+		std::uniform_real_distribution<float> velocity(-1.0f, 1.0f);
+
+		// Spread the particles over all the sites rather than filling the first ones, so that the density is
+		// the same everywhere in the box
+		std::vector<unsigned int> site(static_cast<size_t>(sites) * sites * sites);
+		std::iota(site.begin(), site.end(), 0u);
+		std::shuffle(site.begin(), site.end(), engine);
+
+		std::vector<Particle> particles(count);
+		for (unsigned int iii = 0; iii < count; ++iii)
+		{
+			Particle& p = particles[iii];
+			unsigned int x = site[iii] % sites;
+			unsigned int y = site[iii] / sites % sites;
+			unsigned int z = site[iii] / (sites * sites);
+			p.type = BenchmarkTypes[typeIndex(engine)];
+			p.mass = SimulationManager::GetDefaultMass(p.type);
+			p.p_x = -halfExtent + (x + 0.5f) * spacing + jitter(engine);
+			p.p_y = -halfExtent + (y + 0.5f) * spacing + jitter(engine);
+			p.p_z = -halfExtent + (z + 0.5f) * spacing + jitter(engine);
+			p.v_x = velocity(engine);
+			p.v_y = velocity(engine);
+			p.v_z = velocity(engine);
+		}
+		return particles;
+	}
+
+	std::unique_ptr<Simulation> CreateSimulation(unsigned int count) noexcept
+	{
+		auto simulation = std::make_unique<Simulation>();
+		float halfExtent = BoxHalfExtent(count);
+		simulation->SetBoxSize(halfExtent);
+		simulation->AddParticles(LatticeParticles(count, halfExtent));
+		return simulation;
+	}
+
+	// One velocity Verlet step, which is what Simulation::Update runs m_substepsPerTick times per tick. Update
+	// itself is paced by the wall clock, so it can't be timed directly. The box reflects the particles unless
+	// 'periodic', as it does by default
+	Benchmark::Case SimulationStep(unsigned int count, bool lennardJones, bool periodic) noexcept
+	{
+		std::shared_ptr<Simulation> simulation = CreateSimulation(count);
+		simulation->SetLennardJonesEnabled(lennardJones);
+		simulation->SetPeriodic(periodic);
+
+		Benchmark::Case benchmarkCase;
+		benchmarkCase.items = count;
+		benchmarkCase.run = [simulation]() noexcept { simulation->Run(1); };
+		return benchmarkCase;
+	}
+
+	Benchmark::Case PlaceRandomParticles(unsigned int count) noexcept
+	{
+		if (SimulationManager::SimulationCount() == 0)
+			SimulationManager::Initialize();
+		SimulationManager::SetBoxSize(BoxHalfExtent(count));
+
+		Benchmark::Case benchmarkCase;
+		benchmarkCase.items = count;
+		benchmarkCase.batchable = false;
+		benchmarkCase.setup = []() noexcept { SimulationManager::DeleteTemporaryParticles(); };
+		benchmarkCase.run = [count]() noexcept {
+			static const std::vector<unsigned int> types(std::begin(BenchmarkTypes), std::end(BenchmarkTypes));
+			SimulationManager::PlaceRandomParticles(types, count, 1.0f);
+		};
+		return benchmarkCase;
+	}
+
+	// Removes every tenth particle, picked at random, so the removals are spread over the whole store
+	Benchmark::Case RemoveParticles(unsigned int count) noexcept
+	{
+		struct State
+		{
+			std::unique_ptr<Simulation> source;
+			Simulation simulation;
+			std::vector<unsigned int> indices;
+		};
+		auto state = std::make_shared<State>();
+		state->source = CreateSimulation(count);
+
+		std::vector<unsigned int> all(count);
+		std::iota(all.begin(), all.end(), 0u);
+		std::shuffle(all.begin(), all.end(), std::default_random_engine());
+		state->indices.assign(all.begin(), all.begin() + count / 10);
+		std::sort(state->indices.begin(), state->indices.end(), std::greater<unsigned int>());
+
+		Benchmark::Case benchmarkCase;
+		benchmarkCase.items = state->indices.size();
+		benchmarkCase.batchable = false;
+		benchmarkCase.setup = [state]() noexcept { state->simulation.CopyFrom(*state->source); };
+		benchmarkCase.run = [state]() noexcept { state->simulation.RemoveParticles(state->indices); };
+		return benchmarkCase;
+	}
+
+	// Halves the box, so every particle outside of the new box is clamped back inside
+	Benchmark::Case SetBoxSize(unsigned int count) noexcept
+	{
+		struct State
+		{
+			std::unique_ptr<Simulation> source;
+			Simulation simulation;
+			float halfExtent;
+		};
+		auto state = std::make_shared<State>();
+		state->source = CreateSimulation(count);
+		state->halfExtent = BoxHalfExtent(count);
+
+		Benchmark::Case benchmarkCase;
+		benchmarkCase.items = count;
+		benchmarkCase.batchable = false;
+		benchmarkCase.setup = [state]() noexcept { state->simulation.CopyFrom(*state->source); };
+		benchmarkCase.run = [state]() noexcept { state->simulation.SetBoxSize(state->halfExtent / 2.0f); };
+		return benchmarkCase;
+	}
+
+	Benchmark::Case EventDispatch(unsigned int handlers) noexcept
+	{
+		struct State
+		{
+			Event<unsigned int> event;
+			uint64_t sum = 0;
+		};
+		auto state = std::make_shared<State>();
+		for (unsigned int iii = 0; iii < handlers; ++iii)
+			state->event.AddHandler([state = state.get()](unsigned int value) noexcept { state->sum += value; });
+
+		Benchmark::Case benchmarkCase;
+		benchmarkCase.items = handlers;
+		benchmarkCase.run = [state]() noexcept { state->event(1); };
+		return benchmarkCase;
+	}
+
+#ifdef _WIN32
+	// The per-atom matrices Renderer::UpdateAllSphereModelViewProjectionInstanceData packs into the instance
+	// constant buffer, written to memory instead of a mapped buffer
+	Benchmark::Case PackSphereInstances(unsigned int count) noexcept
+	{
+		struct Instance
+		{
+			DirectX::XMFLOAT4X4 model;
+			DirectX::XMFLOAT4X4 modelViewProjection;
+			DirectX::XMFLOAT4X4 inverseTransposeModel;
+		};
+		struct State
+		{
+			std::vector<Particle> particles;
+			std::vector<Instance> instances;
+			DirectX::XMFLOAT4X4 viewProjection;
+		};
+		auto state = std::make_shared<State>();
+		float halfExtent = BoxHalfExtent(count);
+		state->particles = LatticeParticles(count, halfExtent);
+		state->instances.resize(count);
+
+		DirectX::XMMATRIX view = DirectX::XMMatrixLookAtLH(DirectX::XMVectorSet(0.0f, 0.0f, -4.0f * halfExtent, 1.0f), DirectX::XMVectorZero(), DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		DirectX::XMMATRIX projection = DirectX::XMMatrixPerspectiveFovLH(DirectX::XM_PIDIV4, 16.0f / 9.0f, 0.01f, 100.0f * halfExtent);
+		DirectX::XMStoreFloat4x4(&state->viewProjection, view * projection);
+
+		Benchmark::Case benchmarkCase;
+		benchmarkCase.items = count;
+		benchmarkCase.run = [state]() noexcept {
+			DirectX::XMMATRIX viewProjection = DirectX::XMLoadFloat4x4(&state->viewProjection);
+			for (size_t iii = 0; iii < state->particles.size(); ++iii)
+			{
+				const Particle& p = state->particles[iii];
+				Instance& instance = state->instances[iii];
+				PackSphereInstance({ p.p_x, p.p_y, p.p_z }, p.type, viewProjection, instance.model, instance.modelViewProjection, instance.inverseTransposeModel);
+			}
+		};
+		return benchmarkCase;
+	}
+#endif
+
+	std::vector<Registration> RegisterCases() noexcept
+	{
+		std::vector<Registration> cases;
+		for (unsigned int count : ParticleCounts)
+			cases.push_back({ "Simulation::Step/" + std::to_string(count), count, [count]() { return SimulationStep(count, false, false); } });
+		for (unsigned int count : ParticleCounts)
+			cases.push_back({ "Simulation::Step/Periodic/" + std::to_string(count), count, [count]() { return SimulationStep(count, false, true); } });
+		for (unsigned int count : ParticleCounts)
+		{
+			if (count <= MaxLennardJonesParticles)
+				cases.push_back({ "Simulation::Step/LennardJones/" + std::to_string(count), count, [count]() { return SimulationStep(count, true, false); } });
+		}
+		for (unsigned int count : ParticleCounts)
+			cases.push_back({ "SimulationManager::PlaceRandomParticles/" + std::to_string(count), count, [count]() { return PlaceRandomParticles(count); } });
+		for (unsigned int count : ParticleCounts)
+			cases.push_back({ "Simulation::RemoveParticles/" + std::to_string(count), count, [count]() { return RemoveParticles(count); } });
+		for (unsigned int count : ParticleCounts)
+			cases.push_back({ "Simulation::SetBoxSize/" + std::to_string(count), count, [count]() { return SetBoxSize(count); } });
+		for (unsigned int handlers : HandlerCounts)
+			cases.push_back({ "Event::Dispatch/" + std::to_string(handlers), 0, [handlers]() { return EventDispatch(handlers); } });
+#ifdef _WIN32
+		for (unsigned int count : ParticleCounts)
+			cases.push_back({ "Renderer::PackSphereInstances/" + std::to_string(count), count, [count]() { return PackSphereInstances(count); } });
+#endif
+		return cases;
+	}
+
+	void PrintUsage(const char* program) noexcept
+	{
+		std::fprintf(stderr,
+			"usage: %s [options]\n"
+			"  --filter TEXT        only run the cases whose name contains TEXT\n"
+			"  --max-particles N    skip the cases with more particles (default 1000000)\n"
+			"  --threads N          worker threads (default: one per hardware thread)\n"
+			"  --min-time S         seconds to sample each case for (default 0.5)\n"
+			"  --min-samples N      samples to take of each case at least (default 10)\n"
+			"  --output FILE        write the results and every sample as JSON\n"
+			"  --list               list the cases without running them\n", program);
+	}
+
+	bool ParseCount(const char* text, unsigned long long& value) noexcept
+	{
+		char* end = nullptr;
+		value = std::strtoull(text, &end, 10);
+		return end != text && *end == '\0';
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options) noexcept
+	{
+		for (int iii = 1; iii < argc; ++iii)
+		{
+			std::string argument = argv[iii];
+			bool hasValue = iii + 1 < argc;
+			unsigned long long count = 0;
+
+			if (argument == "--filter" && hasValue)
+				options.filter = argv[++iii];
+			else if (argument == "--max-particles" && hasValue && ParseCount(argv[++iii], count))
+				options.maxParticles = count;
+			else if (argument == "--threads" && hasValue && ParseCount(argv[++iii], count) && count > 0)
+				options.threads = static_cast<unsigned int>(count);
+			else if (argument == "--min-time" && hasValue)
+				options.run.minSeconds = std::strtod(argv[++iii], nullptr);
+			else if (argument == "--min-samples" && hasValue && ParseCount(argv[++iii], count) && count > 0)
+				options.run.minSamples = static_cast<unsigned int>(count);
+			else if (argument == "--output" && hasValue)
+				options.output = argv[++iii];
+			else if (argument == "--list")
+				options.list = true;
+			else
+				return false;
+		}
+		return true;
+	}
+
+	// Nanoseconds in the most readable unit
+	std::string FormatTime(double nanoseconds) noexcept
+	{
+		char text[32];
+		if (nanoseconds >= 1.0e6)
+			std::snprintf(text, sizeof(text), "%.3f ms", nanoseconds * 1.0e-6);
+		else if (nanoseconds >= 1.0e3)
+			std::snprintf(text, sizeof(text), "%.3f us", nanoseconds * 1.0e-3);
+		else
+			std::snprintf(text, sizeof(text), "%.1f ns", nanoseconds);
+		return text;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage(argv[0]);
+		return 2;
+	}
+
+	if (options.threads != 0)
+		ThreadPool::Get().SetThreadCount(options.threads);
+
+	std::vector<Registration> cases = RegisterCases();
+	std::erase_if(cases, [&options](const Registration& registration) {
+		return registration.name.find(options.filter) == std::string::npos || registration.particles > options.maxParticles;
+	});
+
+	if (options.list)
+	{
+		for (const Registration& registration : cases)
+			std::printf("%s\n", registration.name.c_str());
+		return 0;
+	}
+
+	Benchmark::Context context = Benchmark::CurrentContext();
+	std::printf("%s, %s build, %u threads, %s\n\n", context.compiler.c_str(), context.buildType.c_str(), context.threads, context.cpuFeatures.c_str());
+	std::printf("%-48s %14s %14s %12s %14s %16s\n", "case", "median", "mean", "stddev", "min", "items/s");
+	std::fflush(stdout);
+
+	std::vector<Benchmark::Result> results;
+	for (const Registration& registration : cases)
+	{
+		Benchmark::Case benchmarkCase = registration.create();
+		benchmarkCase.name = registration.name;
+		Benchmark::Result result = Benchmark::Run(benchmarkCase, options.run);
+
+		std::printf("%-48s %14s %14s %11.1f%% %14s %16.4g\n", result.name.c_str(), FormatTime(result.median).c_str(), FormatTime(result.mean).c_str(),
+			result.mean > 0.0 ? 100.0 * result.stddev / result.mean : 0.0, FormatTime(result.min).c_str(), result.itemsPerSecond);
+		std::fflush(stdout);
+		results.push_back(std::move(result));
+	}
+
+	if (!options.output.empty() && !Benchmark::WriteJson(options.output, context, results))
+	{
+		std::fprintf(stderr, "error: could not write '%s'\n", options.output.c_str());
+		return 1;
+	}
+
+	return 0;
+}
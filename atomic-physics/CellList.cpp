@@ -0,0 +1,171 @@
+#include "CellList.h"
+#include "PhysicsConstants.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+
+CellList::CellList() noexcept :
+	m_cellSizeX(1.0f),
+	m_cellSizeY(1.0f),
+	m_cellSizeZ(1.0f),
+	m_inverseCellSizeX(1.0f),
+	m_inverseCellSizeY(1.0f),
+	m_inverseCellSizeZ(1.0f),
+	m_boxMaxX(0.0f),
+	m_boxMaxY(0.0f),
+	m_boxMaxZ(0.0f),
+	m_cellCountX(1),
+	m_cellCountY(1),
+	m_cellCountZ(1),
+	m_periodic(false)
+{
+	m_cellStart.assign(2, 0);
+}
+
+unsigned int CellList::ClampedCoordinate(float position, float boxMax, float inverseCellSize, unsigned int cellCount) noexcept
+{
+	// Particles may overshoot the walls by up to one step before they are reflected, so clamp into the grid
+	float cell = (position + boxMax) * inverseCellSize;
+	if (cell <= 0.0f)
+		return 0;
+	unsigned int coordinate = static_cast<unsigned int>(cell);
+	return coordinate < cellCount ? coordinate : cellCount - 1;
+}
+
+void CellList::WrappedCellRange(float position, float radius, float boxMax, float inverseCellSize, unsigned int cellCount, unsigned int& first, unsigned int& count) noexcept
+{
+	unsigned int center = ClampedCoordinate(position, boxMax, inverseCellSize, cellCount);
+	unsigned int reach = static_cast<unsigned int>(std::ceil(radius * inverseCellSize));
+
+	// Once the range wraps onto itself every cell along the axis has to be visited, but only once
+	if (2 * reach + 1 >= cellCount)
+	{
+		first = 0;
+		count = cellCount;
+		return;
+	}
+
+	first = (center + cellCount - reach) % cellCount;
+	count = 2 * reach + 1;
+}
+
+unsigned int CellList::CellOf(float x, float y, float z) const noexcept
+{
+	unsigned int cx = ClampedCoordinate(x, m_boxMaxX, m_inverseCellSizeX, m_cellCountX);
+	unsigned int cy = ClampedCoordinate(y, m_boxMaxY, m_inverseCellSizeY, m_cellCountY);
+	unsigned int cz = ClampedCoordinate(z, m_boxMaxZ, m_inverseCellSizeZ, m_cellCountZ);
+	return (cz * m_cellCountY + cy) * m_cellCountX + cx;
+}
+
+void CellList::Build(const ParticleStore& particles, DirectX::XMFLOAT3 boxMax, float cutoff, bool periodic) noexcept
+{
+	PROFILE_FUNCTION();
+
+	// Size the grid ------------------------------------------------------------------
+	cutoff = std::max(cutoff, 2.0f * Constants::MaxAtomicRadius());
+
+	auto cellsAlongAxis = [cutoff](float axisBoxMax) noexcept -> unsigned int
+	{
+		float cells = std::floor(2.0f * axisBoxMax / cutoff);
+		return static_cast<unsigned int>(std::clamp(cells, 1.0f, static_cast<float>(MaxCellsPerAxis)));
+	};
+
+	m_periodic = periodic;
+	m_boxMaxX = boxMax.x;
+	m_boxMaxY = boxMax.y;
+	m_boxMaxZ = boxMax.z;
+	m_cellCountX = cellsAlongAxis(boxMax.x);
+	m_cellCountY = cellsAlongAxis(boxMax.y);
+	m_cellCountZ = cellsAlongAxis(boxMax.z);
+	m_cellSizeX = 2.0f * boxMax.x / m_cellCountX;
+	m_cellSizeY = 2.0f * boxMax.y / m_cellCountY;
+	m_cellSizeZ = 2.0f * boxMax.z / m_cellCountZ;
+	m_inverseCellSizeX = 1.0f / m_cellSizeX;
+	m_inverseCellSizeY = 1.0f / m_cellSizeY;
+	m_inverseCellSizeZ = 1.0f / m_cellSizeZ;
+
+	unsigned int cellCount = CellCount();
+	unsigned int particleCount = particles.Size();
+
+	m_cellStart.assign(cellCount + 1, 0);
+	m_sortedIndices.resize(particleCount);
+	m_particleCell.resize(particleCount);
+
+	if (particleCount == 0)
+		return;
+
+	// Counting sort ------------------------------------------------------------------
+	// Each chunk of particles builds its own histogram so that no atomics are needed. Limit the number
+	// of chunks so that the histograms stay small relative to the grid.
+	constexpr unsigned int MinParticlesPerChunk = 4096;
+	constexpr unsigned int MaxHistogramEntries = 1 << 24;
+	unsigned int chunkCount = std::min(ThreadPool::Get().ThreadCount() * 2, (particleCount + MinParticlesPerChunk - 1) / MinParticlesPerChunk);
+	chunkCount = std::max(1u, std::min(chunkCount, MaxHistogramEntries / cellCount));
+	unsigned int particlesPerChunk = (particleCount + chunkCount - 1) / chunkCount;
+
+	m_chunkCounts.assign(static_cast<size_t>(chunkCount) * cellCount, 0);
+
+	const float* p_x = particles.PositionX();
+	const float* p_y = particles.PositionY();
+	const float* p_z = particles.PositionZ();
+
+	// 1. Bin every particle and count the particles per cell for each chunk
+	ThreadPool::Get().ParallelFor(0, chunkCount, 1,
+		[&](unsigned int firstChunk, unsigned int lastChunk) noexcept
+		{
+			for (unsigned int chunk = firstChunk; chunk < lastChunk; ++chunk)
+			{
+				unsigned int* counts = m_chunkCounts.data() + static_cast<size_t>(chunk) * cellCount;
+				unsigned int end = std::min(particleCount, (chunk + 1) * particlesPerChunk);
+				for (unsigned int iii = chunk * particlesPerChunk; iii < end; ++iii)
+				{
+					unsigned int cell = CellOf(p_x[iii], p_y[iii], p_z[iii]);
+					m_particleCell[iii] = cell;
+					++counts[cell];
+				}
+			}
+		}
+	);
+
+	// 2. Exclusive prefix sum over (cell, chunk) so each chunk knows where to write within each cell.
+	//    The counts are replaced in place by the write offsets
+	unsigned int offset = 0;
+	for (unsigned int cell = 0; cell < cellCount; ++cell)
+	{
+		m_cellStart[cell] = offset;
+		for (unsigned int chunk = 0; chunk < chunkCount; ++chunk)
+		{
+			unsigned int& count = m_chunkCounts[static_cast<size_t>(chunk) * cellCount + cell];
+			unsigned int chunkCellCount = count;
+			count = offset;
+			offset += chunkCellCount;
+		}
+	}
+	m_cellStart[cellCount] = offset;
+
+	// 3. Scatter the particle indices. Chunks are processed in order within each cell, so the indices in
+	//    each cell end up in ascending order
+	ThreadPool::Get().ParallelFor(0, chunkCount, 1,
+		[&](unsigned int firstChunk, unsigned int lastChunk) noexcept
+		{
+			for (unsigned int chunk = firstChunk; chunk < lastChunk; ++chunk)
+			{
+				unsigned int* offsets = m_chunkCounts.data() + static_cast<size_t>(chunk) * cellCount;
+				unsigned int end = std::min(particleCount, (chunk + 1) * particlesPerChunk);
+				for (unsigned int iii = chunk * particlesPerChunk; iii < end; ++iii)
+					m_sortedIndices[offsets[m_particleCell[iii]]++] = iii;
+			}
+		}
+	);
+}
+
+void CellList::QueryRange(const ParticleStore& particles, float x, float y, float z, float radius, std::vector<unsigned int>& results) const noexcept
+{
+	results.clear();
+	ForEachInRange(particles, x, y, z, radius,
+		[&results](unsigned int j, float, float, float, float) noexcept
+		{
+			results.push_back(j);
+		}
+	);
+}
@@ -0,0 +1,170 @@
+#pragma once
+#include "CorePch.h"
+#include "ParticleStore.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Uniform grid ("cell list") over the simulation box. The box [-boxMax, boxMax] is divided into cells whose
+// edges are at least the interaction cutoff, so every neighbor of a particle lies in its own cell or
+// one of the 26 surrounding cells. Particle indices are bucketed by cell with a parallel counting sort.
+//
+// With periodic boundaries the grid wraps around and queries use minimum image displacements, so a
+// query radius must not exceed half of the smallest box length.
+class CellList
+{
+public:
+	CellList() noexcept;
+	CellList(const CellList&) = delete;
+	void operator=(const CellList&) = delete;
+
+	// Rebuild the grid for the current particle positions. 'cutoff' is the largest distance that will be
+	// queried with ForEachNeighbor; it is never allowed to drop below the largest atomic diameter
+	void Build(const ParticleStore& particles, DirectX::XMFLOAT3 boxMax, float cutoff = 0.0f, bool periodic = false) noexcept;
+
+	bool IsPeriodic() const noexcept { return m_periodic; }
+
+	// Smallest cell edge - any query radius up to this only needs to visit the 27 surrounding cells
+	float CellSize() const noexcept { return std::min(m_cellSizeX, std::min(m_cellSizeY, m_cellSizeZ)); }
+	unsigned int CellCountX() const noexcept { return m_cellCountX; }
+	unsigned int CellCountY() const noexcept { return m_cellCountY; }
+	unsigned int CellCountZ() const noexcept { return m_cellCountZ; }
+	unsigned int CellCount() const noexcept { return m_cellCountX * m_cellCountY * m_cellCountZ; }
+
+	unsigned int CellOf(float x, float y, float z) const noexcept;
+	unsigned int CellOfParticle(unsigned int particleIndex) const noexcept { return m_particleCell[particleIndex]; }
+
+	// Indices of the particles in a cell, in ascending order
+	const unsigned int* CellBegin(unsigned int cell) const noexcept { return m_sortedIndices.data() + m_cellStart[cell]; }
+	const unsigned int* CellEnd(unsigned int cell) const noexcept { return m_sortedIndices.data() + m_cellStart[cell + 1]; }
+
+	// Particle indices ordered by cell - consecutive entries are spatially close
+	const std::vector<unsigned int>& SortedIndices() const noexcept { return m_sortedIndices; }
+
+	// Call fn(index, dx, dy, dz, distanceSquared) for every particle within 'radius' of (x, y, z),
+	// where (dx, dy, dz) is the vector from the query point to the particle
+	template<typename F>
+	void ForEachInRange(const ParticleStore& particles, float x, float y, float z, float radius, const F& fn) const noexcept;
+
+	// Call fn(neighborIndex, dx, dy, dz, distanceSquared) for every other particle within 'radius' of particle i
+	template<typename F>
+	void ForEachNeighbor(const ParticleStore& particles, unsigned int i, float radius, const F& fn) const noexcept;
+
+	// Collect every particle within 'radius' of (x, y, z)
+	void QueryRange(const ParticleStore& particles, float x, float y, float z, float radius, std::vector<unsigned int>& results) const noexcept;
+
+private:
+	// Limit on cells per axis so that a huge box doesn't allocate an enormous, mostly empty grid
+	static constexpr unsigned int MaxCellsPerAxis = 128;
+
+	static unsigned int ClampedCoordinate(float position, float boxMax, float inverseCellSize, unsigned int cellCount) noexcept;
+	// Periodic only: first cell and number of cells along an axis covered by [position - radius, position + radius]
+	static void WrappedCellRange(float position, float radius, float boxMax, float inverseCellSize, unsigned int cellCount, unsigned int& first, unsigned int& count) noexcept;
+
+	float m_cellSizeX, m_cellSizeY, m_cellSizeZ;
+	float m_inverseCellSizeX, m_inverseCellSizeY, m_inverseCellSizeZ;
+	float m_boxMaxX, m_boxMaxY, m_boxMaxZ;
+	unsigned int m_cellCountX, m_cellCountY, m_cellCountZ;
+	bool m_periodic;
+
+	std::vector<unsigned int> m_cellStart;		// CellCount() + 1 offsets into m_sortedIndices
+	std::vector<unsigned int> m_sortedIndices;	// particle indices grouped by cell
+	std::vector<unsigned int> m_particleCell;	// cell of each particle
+
+	// Scratch space for the counting sort: one histogram row per chunk of particles
+	std::vector<unsigned int> m_chunkCounts;
+};
+
+template<typename F>
+void CellList::ForEachInRange(const ParticleStore& particles, float x, float y, float z, float radius, const F& fn) const noexcept
+{
+	if (m_sortedIndices.empty())
+		return;
+
+	const float* p_x = particles.PositionX();
+	const float* p_y = particles.PositionY();
+	const float* p_z = particles.PositionZ();
+	float radiusSquared = radius * radius;
+
+	if (m_periodic)
+	{
+		float lengthX = 2.0f * m_boxMaxX, inverseLengthX = 1.0f / lengthX;
+		float lengthY = 2.0f * m_boxMaxY, inverseLengthY = 1.0f / lengthY;
+		float lengthZ = 2.0f * m_boxMaxZ, inverseLengthZ = 1.0f / lengthZ;
+
+		unsigned int firstX, countX, firstY, countY, firstZ, countZ;
+		WrappedCellRange(x, radius, m_boxMaxX, m_inverseCellSizeX, m_cellCountX, firstX, countX);
+		WrappedCellRange(y, radius, m_boxMaxY, m_inverseCellSizeY, m_cellCountY, firstY, countY);
+		WrappedCellRange(z, radius, m_boxMaxZ, m_inverseCellSizeZ, m_cellCountZ, firstZ, countZ);
+
+		for (unsigned int oz = 0; oz < countZ; ++oz)
+		{
+			unsigned int cz = (firstZ + oz) % m_cellCountZ;
+			for (unsigned int oy = 0; oy < countY; ++oy)
+			{
+				unsigned int cy = (firstY + oy) % m_cellCountY;
+				for (unsigned int ox = 0; ox < countX; ++ox)
+				{
+					unsigned int cx = (firstX + ox) % m_cellCountX;
+					unsigned int cell = (cz * m_cellCountY + cy) * m_cellCountX + cx;
+					for (const unsigned int* it = CellBegin(cell); it != CellEnd(cell); ++it)
+					{
+						unsigned int j = *it;
+						float dx = p_x[j] - x;
+						float dy = p_y[j] - y;
+						float dz = p_z[j] - z;
+						dx -= lengthX * std::nearbyint(dx * inverseLengthX);
+						dy -= lengthY * std::nearbyint(dy * inverseLengthY);
+						dz -= lengthZ * std::nearbyint(dz * inverseLengthZ);
+						float distanceSquared = dx * dx + dy * dy + dz * dz;
+						if (distanceSquared <= radiusSquared)
+							fn(j, dx, dy, dz, distanceSquared);
+					}
+				}
+			}
+		}
+		return;
+	}
+
+	// Range of cells overlapped by the bounding box of the query sphere
+	unsigned int minX = ClampedCoordinate(x - radius, m_boxMaxX, m_inverseCellSizeX, m_cellCountX);
+	unsigned int maxX = ClampedCoordinate(x + radius, m_boxMaxX, m_inverseCellSizeX, m_cellCountX);
+	unsigned int minY = ClampedCoordinate(y - radius, m_boxMaxY, m_inverseCellSizeY, m_cellCountY);
+	unsigned int maxY = ClampedCoordinate(y + radius, m_boxMaxY, m_inverseCellSizeY, m_cellCountY);
+	unsigned int minZ = ClampedCoordinate(z - radius, m_boxMaxZ, m_inverseCellSizeZ, m_cellCountZ);
+	unsigned int maxZ = ClampedCoordinate(z + radius, m_boxMaxZ, m_inverseCellSizeZ, m_cellCountZ);
+
+	for (unsigned int cz = minZ; cz <= maxZ; ++cz)
+	{
+		for (unsigned int cy = minY; cy <= maxY; ++cy)
+		{
+			for (unsigned int cx = minX; cx <= maxX; ++cx)
+			{
+				unsigned int cell = (cz * m_cellCountY + cy) * m_cellCountX + cx;
+				for (const unsigned int* it = CellBegin(cell); it != CellEnd(cell); ++it)
+				{
+					unsigned int j = *it;
+					float dx = p_x[j] - x;
+					float dy = p_y[j] - y;
+					float dz = p_z[j] - z;
+					float distanceSquared = dx * dx + dy * dy + dz * dz;
+					if (distanceSquared <= radiusSquared)
+						fn(j, dx, dy, dz, distanceSquared);
+				}
+			}
+		}
+	}
+}
+
+template<typename F>
+void CellList::ForEachNeighbor(const ParticleStore& particles, unsigned int i, float radius, const F& fn) const noexcept
+{
+	ForEachInRange(particles, particles.PositionX()[i], particles.PositionY()[i], particles.PositionZ()[i], radius,
+		[i, &fn](unsigned int j, float dx, float dy, float dz, float distanceSquared) noexcept
+		{
+			if (j != i)
+				fn(j, dx, dy, dz, distanceSquared);
+		}
+	);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "CorePch.h"
+
+#include <chrono>
+
+// Portable monotonic clock for the simulation core. std::chrono::steady_clock is backed by
+// QueryPerformanceCounter on Windows and clock_gettime(CLOCK_MONOTONIC) on Linux
+struct Clock
+{
+	// Clock readings are in nanoseconds
+	static constexpr uint64_t Frequency = 1000000000;
+
+	static uint64_t Now() noexcept
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	static double Seconds(uint64_t ticks) noexcept { return static_cast<double>(ticks) / Frequency; }
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+// Platform-neutral part of pch.h. The simulation core (particles, force fields, integrators, timing and
+// profiling) only includes this header so that it builds without Windows, Direct3D or ImGui, e.g. for the
+// headless runner on Linux compute nodes.
+
+#include <cstdint>
+
+#ifdef _WIN32
+#include <DirectXMath.h>
+#else
+// DirectXMath is not available, so define the one storage type the core uses with the same layout
+namespace DirectX
+{
+	struct XMFLOAT3
+	{
+		float x;
+		float y;
+		float z;
+
+		XMFLOAT3() = default;
+		constexpr XMFLOAT3(float _x, float _y, float _z) noexcept : x(_x), y(_y), z(_z) {}
+	};
+}
+#endif
+
+// Profiling may be used virtually throughout the application so just include it here
+#include "Profile.h"
@@ -0,0 +1,80 @@
+#include "CpuFeatures.h"
+
+#if defined(SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#elif defined(SIMD_X86)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#ifdef SIMD_X86
+namespace
+{
+	void CpuId(int leaf, int subleaf, int registers[4]) noexcept
+	{
+#if defined(_MSC_VER)
+		__cpuidex(registers, leaf, subleaf);
+#else
+		unsigned int a, b, c, d;
+		__cpuid_count(leaf, subleaf, a, b, c, d);
+		registers[0] = static_cast<int>(a);
+		registers[1] = static_cast<int>(b);
+		registers[2] = static_cast<int>(c);
+		registers[3] = static_cast<int>(d);
+#endif
+	}
+
+	unsigned long long XGetBV() noexcept
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		unsigned int eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+	}
+
+	CpuFeatures DetectCpuFeatures() noexcept
+	{
+		CpuFeatures features;
+
+		int registers[4] = {};
+		CpuId(0, 0, registers);
+		int maxLeaf = registers[0];
+
+		if (maxLeaf < 1)
+			return features;
+
+		CpuId(1, 0, registers);
+		features.sse2 = (registers[3] & (1 << 26)) != 0;
+
+		// AVX requires both CPU support and the OS having enabled XSAVE for the YMM registers
+		bool osxsave = (registers[2] & (1 << 27)) != 0;
+		bool avx = (registers[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || maxLeaf < 7)
+			return features;
+
+		unsigned long long xcr0 = XGetBV();
+		bool ymmEnabled = (xcr0 & 0x6) == 0x6;			// XMM | YMM
+		bool zmmEnabled = (xcr0 & 0xE6) == 0xE6;		// XMM | YMM | opmask | ZMM_Hi256 | Hi16_ZMM
+
+		CpuId(7, 0, registers);
+		features.avx2 = ymmEnabled && (registers[1] & (1 << 5)) != 0;
+		features.avx512f = features.avx2 && zmmEnabled && (registers[1] & (1 << 16)) != 0;
+
+		return features;
+	}
+}
+#endif
+
+const CpuFeatures& CpuFeatures::Get() noexcept
+{
+#ifdef SIMD_X86
+	static const CpuFeatures features = DetectCpuFeatures();
+#else
+	static const CpuFeatures features;
+#endif
+	return features;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#endif
+
+// MSVC allows any intrinsic in any function, GCC/Clang require the function to be compiled for the target ISA
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMD_TARGET(isa)
+#endif
+
+// Instruction set extensions that are detected at runtime so that the simulation kernels can
+// pick the widest implementation the current machine supports
+struct CpuFeatures
+{
+	bool sse2 = false;
+	bool avx2 = false;	  // AVX + AVX2 and the OS saves the YMM state
+	bool avx512f = false; // AVX-512 Foundation and the OS saves the ZMM/opmask state
+
+	static const CpuFeatures& Get() noexcept;
+};
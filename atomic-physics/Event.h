@@ -1,38 +1,127 @@
 #pragma once
-#include "pch.h"
+#include "CorePch.h"
 
+#include <algorithm>
 #include <functional>
-#include <unordered_map>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <vector>
 
-using EventToken = std::intptr_t; // use intptr_t because we do a reinterpret_cast of a memory address which is supposed to be a long long
+// Tokens are handed out in increasing order starting at 1, so 0 never refers to a handler
+using EventToken = uint64_t;
 
+// Handlers are kept in a contiguous array in the order they were added, so triggering an event is a linear
+// walk over them without any allocation. Events whose arguments can be stored by value can also be deferred:
+// the arguments are queued and delivered by DispatchDeferred, e.g. once per frame, and DeferLatest coalesces
+// the queue down to the most recent arguments for events where only the final state matters
 template<class... T>
 class Event
 {
 public:
 	Event() noexcept {}
 
-	template<class... T>
-	EventToken AddHandler(std::function<void(T...)>& fn) noexcept
+	EventToken AddHandler(std::function<void(T...)> fn) noexcept
 	{
-		// Just take the address of the function in memory as the token, which
-		// therefore guarantees its uniqueness
-		EventToken token = reinterpret_cast<EventToken>(&fn);
-		m_handlers[token] = fn;
-		return token;
+		// Adding could reallocate the handlers while they are being walked, so a handler added while the event
+		// is being triggered is held back until the dispatch is over. It isn't called by that dispatch
+		if (m_dispatchDepth > 0)
+			m_addedDuringDispatch.push_back({ ++m_lastToken, std::move(fn) });
+		else
+			m_handlers.push_back({ ++m_lastToken, std::move(fn) });
+		return m_lastToken;
 	}
 
-	bool RemoveHandler(EventToken token) noexcept { return m_handlers.erase(token); }
+	bool RemoveHandler(EventToken token) noexcept
+	{
+		auto added = std::find_if(m_addedDuringDispatch.begin(), m_addedDuringDispatch.end(), [token](const Handler& h) { return h.token == token; });
+		if (token != 0 && added != m_addedDuringDispatch.end())
+		{
+			m_addedDuringDispatch.erase(added);
+			return true;
+		}
+
+		auto handler = std::find_if(m_handlers.begin(), m_handlers.end(), [token](const Handler& h) { return h.token == token; });
+		if (token == 0 || handler == m_handlers.end())
+			return false;
+
+		// A handler may remove itself or another one while the event is being triggered, so only clear the
+		// token then and compact the array once the dispatch is over
+		if (m_dispatchDepth > 0)
+		{
+			handler->token = 0;
+			m_removedDuringDispatch = true;
+		}
+		else
+			m_handlers.erase(handler);
+		return true;
+	}
 
 	// overload operator() to trigger the event
-	template<class... T>
 	void operator()(T... args) noexcept
 	{
-		// Trigger each event handler
-		for (auto& handler : m_handlers)
-			handler.second(std::forward<T>(args)...);
+		++m_dispatchDepth;
+		for (const Handler& handler : m_handlers)
+		{
+			if (handler.token != 0)
+				handler.fn(args...);
+		}
+
+		if (--m_dispatchDepth == 0)
+		{
+			if (m_removedDuringDispatch)
+			{
+				std::erase_if(m_handlers, [](const Handler& h) { return h.token == 0; });
+				m_removedDuringDispatch = false;
+			}
+			if (!m_addedDuringDispatch.empty())
+			{
+				std::move(m_addedDuringDispatch.begin(), m_addedDuringDispatch.end(), std::back_inserter(m_handlers));
+				m_addedDuringDispatch.clear();
+			}
+		}
+	}
+
+	// Queue the arguments for the next DispatchDeferred. Nothing is queued while there are no handlers
+	void Defer(T... args) noexcept requires (std::is_copy_constructible_v<std::decay_t<T>> && ...)
+	{
+		if (!m_handlers.empty() || !m_addedDuringDispatch.empty())
+			m_deferred.emplace_back(args...);
+	}
+
+	// Replace anything that is queued, so only the most recent arguments are delivered
+	void DeferLatest(T... args) noexcept requires (std::is_copy_constructible_v<std::decay_t<T>> && ...)
+	{
+		m_deferred.clear();
+		Defer(args...);
+	}
+
+	bool HasDeferred() const noexcept { return !m_deferred.empty(); }
+
+	void DispatchDeferred() noexcept requires (std::is_copy_constructible_v<std::decay_t<T>> && ...)
+	{
+		// Deliver from a second queue so handlers can defer again without invalidating this loop. Both
+		// queues keep their capacity, so a steady stream of deferred events stops allocating
+		m_delivering.swap(m_deferred);
+		for (const Arguments& args : m_delivering)
+			std::apply(*this, args);
+		m_delivering.clear();
 	}
 
 private:
-	std::unordered_map<EventToken, std::function<void(T...)>> m_handlers;
-};
\ No newline at end of file
+	struct Handler
+	{
+		EventToken token;	// 0 once removed during a dispatch
+		std::function<void(T...)> fn;
+	};
+	using Arguments = std::tuple<std::decay_t<T>...>;
+
+	std::vector<Handler> m_handlers;
+	EventToken m_lastToken = 0;
+	unsigned int m_dispatchDepth = 0;
+	bool m_removedDuringDispatch = false;
+	std::vector<Handler> m_addedDuringDispatch;	// appended to m_handlers once the dispatch is over
+
+	std::vector<Arguments> m_deferred;
+	std::vector<Arguments> m_delivering;
+};
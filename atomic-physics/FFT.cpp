@@ -0,0 +1,115 @@
+#include "FFT.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <numbers>
+
+void FFT::Resize(unsigned int size) noexcept
+{
+	m_size = size;
+
+	m_twiddles.resize(size / 2);
+	for (unsigned int k = 0; k < size / 2; ++k)
+	{
+		double angle = -2.0 * std::numbers::pi * k / size;
+		m_twiddles[k] = { static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)) };
+	}
+
+	unsigned int bits = 0;
+	while ((1u << bits) < size)
+		++bits;
+
+	m_bitReversed.resize(size);
+	for (unsigned int iii = 0; iii < size; ++iii)
+	{
+		unsigned int reversed = 0;
+		for (unsigned int bit = 0; bit < bits; ++bit)
+			reversed |= ((iii >> bit) & 1) << (bits - 1 - bit);
+		m_bitReversed[iii] = reversed;
+	}
+}
+
+void FFT::Transform(std::complex<float>* data, unsigned int stride, bool inverse) const noexcept
+{
+	for (unsigned int iii = 0; iii < m_size; ++iii)
+	{
+		unsigned int jjj = m_bitReversed[iii];
+		if (iii < jjj)
+			std::swap(data[iii * stride], data[jjj * stride]);
+	}
+
+	// Iterative Cooley-Tukey butterflies
+	for (unsigned int length = 2; length <= m_size; length *= 2)
+	{
+		unsigned int half = length / 2;
+		unsigned int twiddleStep = m_size / length;
+		for (unsigned int start = 0; start < m_size; start += length)
+		{
+			for (unsigned int k = 0; k < half; ++k)
+			{
+				std::complex<float> w = m_twiddles[k * twiddleStep];
+				if (inverse)
+					w = std::conj(w);
+
+				std::complex<float>& a = data[(start + k) * stride];
+				std::complex<float>& b = data[(start + k + half) * stride];
+				std::complex<float> t = w * b;
+				b = a - t;
+				a = a + t;
+			}
+		}
+	}
+}
+
+void FFT3D::Resize(unsigned int nx, unsigned int ny, unsigned int nz) noexcept
+{
+	m_x.Resize(nx);
+	m_y.Resize(ny);
+	m_z.Resize(nz);
+}
+
+void FFT3D::Transform(std::complex<float>* data, bool inverse) const noexcept
+{
+	PROFILE_FUNCTION();
+
+	unsigned int nx = m_x.Size();
+	unsigned int ny = m_y.Size();
+	unsigned int nz = m_z.Size();
+
+	// x lines are contiguous
+	ThreadPool::Get().ParallelFor(0, ny * nz, 16,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			for (unsigned int line = begin; line < end; ++line)
+				inverse ? m_x.Inverse(data + line * nx) : m_x.Forward(data + line * nx);
+		}
+	);
+
+	// y and z lines are strided, so copy each one into a contiguous buffer first. Consecutive line
+	// indices are neighbors in x, so the lines in one chunk share the cache lines they touch
+	auto stridedPass = [&](const FFT& fft, unsigned int lineCount, unsigned int stride, auto lineStart) noexcept
+	{
+		ThreadPool::Get().ParallelFor(0, lineCount, 16,
+			[&](unsigned int begin, unsigned int end) noexcept
+			{
+				std::vector<std::complex<float>> buffer(fft.Size());
+				for (unsigned int line = begin; line < end; ++line)
+				{
+					std::complex<float>* start = data + lineStart(line);
+					for (unsigned int iii = 0; iii < fft.Size(); ++iii)
+						buffer[iii] = start[iii * stride];
+
+					inverse ? fft.Inverse(buffer.data()) : fft.Forward(buffer.data());
+
+					for (unsigned int iii = 0; iii < fft.Size(); ++iii)
+						start[iii * stride] = buffer[iii];
+				}
+			}
+		);
+	};
+
+	// y lines: one per (x, z)
+	stridedPass(m_y, nx * nz, nx, [nx, ny](unsigned int line) noexcept { return (line / nx) * nx * ny + line % nx; });
+	// z lines: one per (x, y)
+	stridedPass(m_z, nx * ny, nx * ny, [](unsigned int line) noexcept { return line; });
+}
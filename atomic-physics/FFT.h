@@ -0,0 +1,53 @@
+#pragma once
+#include "CorePch.h"
+
+#include <complex>
+#include <vector>
+
+// In-place radix-2 complex FFT. The transform is unnormalized in both directions, so
+// Inverse(Forward(x)) == Size() * x
+class FFT
+{
+public:
+	FFT() noexcept = default;
+	// 'size' must be a power of two
+	explicit FFT(unsigned int size) noexcept { Resize(size); }
+
+	void Resize(unsigned int size) noexcept;
+	unsigned int Size() const noexcept { return m_size; }
+
+	// 'data' holds Size() elements spaced 'stride' elements apart
+	void Forward(std::complex<float>* data, unsigned int stride = 1) const noexcept { Transform(data, stride, false); }
+	void Inverse(std::complex<float>* data, unsigned int stride = 1) const noexcept { Transform(data, stride, true); }
+
+private:
+	void Transform(std::complex<float>* data, unsigned int stride, bool inverse) const noexcept;
+
+	unsigned int m_size = 0;
+	std::vector<std::complex<float>> m_twiddles;	// exp(-2 pi i k / size) for k < size / 2
+	std::vector<unsigned int> m_bitReversed;
+};
+
+// 3D complex FFT over an x-fastest (index = (z * ny + y) * nx + x) grid. Every 1D line along an axis is
+// independent, so each axis pass is split across the ThreadPool
+class FFT3D
+{
+public:
+	FFT3D() noexcept = default;
+
+	// Every dimension must be a power of two
+	void Resize(unsigned int nx, unsigned int ny, unsigned int nz) noexcept;
+	unsigned int SizeX() const noexcept { return m_x.Size(); }
+	unsigned int SizeY() const noexcept { return m_y.Size(); }
+	unsigned int SizeZ() const noexcept { return m_z.Size(); }
+
+	void Forward(std::complex<float>* data) const noexcept { Transform(data, false); }
+	void Inverse(std::complex<float>* data) const noexcept { Transform(data, true); }
+
+private:
+	void Transform(std::complex<float>* data, bool inverse) const noexcept;
+
+	FFT m_x;
+	FFT m_y;
+	FFT m_z;
+};
@@ -0,0 +1,144 @@
+#include "FrameTiming.h"
+#include "Clock.h"
+
+namespace
+{
+	// Microseconds; longer frames, e.g. while the window is being dragged, are counted as 10 s
+	constexpr uint64_t HighestFrameTime = 10000000;
+
+	constexpr uint64_t TicksPerMicrosecond = Clock::Frequency / 1000000;
+
+	double Milliseconds(uint64_t ticks) noexcept { return Clock::Seconds(ticks) * 1000.0; }
+}
+
+FrameTiming::FrameTiming() noexcept :
+	m_budget(1000.0f / 60.0f),
+	m_startTime(0),
+	m_frameStart(0),
+	m_phaseStart(0),
+	m_phase(FramePhase::Messages),
+	m_inFrame(false),
+	m_frameIndex(0),
+	m_phaseTicks{},
+	m_frames(HighestFrameTime),
+	m_phases{
+		HdrHistogram(HighestFrameTime), HdrHistogram(HighestFrameTime), HdrHistogram(HighestFrameTime),
+		HdrHistogram(HighestFrameTime), HdrHistogram(HighestFrameTime), HdrHistogram(HighestFrameTime)
+	},
+	m_overBudgetCount(0),
+	m_historyOffset(0),
+	m_overBudgetHistoryOffset(0)
+{
+	static_assert(PhaseCount == 6, "Add a histogram to m_phases for the new phase");
+
+	m_history.reserve(HistorySize);
+	m_overBudgetHistory.reserve(OverBudgetHistorySize);
+}
+
+const char* FrameTiming::PhaseName(FramePhase phase) noexcept
+{
+	switch (phase)
+	{
+	case FramePhase::Messages:			return "Messages";
+	case FramePhase::Simulation:		return "Simulation";
+	case FramePhase::RendererUpdate:	return "Renderer Update";
+	case FramePhase::UI:				return "UI";
+	case FramePhase::Render:			return "Render";
+	case FramePhase::Present:			return "Present";
+	default:							return "";
+	}
+}
+
+void FrameTiming::BeginFrame() noexcept
+{
+	uint64_t now = Clock::Now();
+	if (m_inFrame)
+		EndFrame(now);
+	else
+		m_startTime = now;
+
+	m_inFrame = true;
+	m_frameStart = now;
+	m_phaseStart = now;
+	m_phase = FramePhase::Messages;
+	m_phaseTicks.fill(0);
+}
+
+void FrameTiming::BeginPhase(FramePhase phase) noexcept
+{
+	uint64_t now = Clock::Now();
+	m_phaseTicks[static_cast<unsigned int>(m_phase)] += now - m_phaseStart;
+	m_phaseStart = now;
+	m_phase = phase;
+}
+
+void FrameTiming::EndFrame(uint64_t now) noexcept
+{
+	m_phaseTicks[static_cast<unsigned int>(m_phase)] += now - m_phaseStart;
+
+	uint64_t frameTicks = now - m_frameStart;
+	m_frames.Record(frameTicks / TicksPerMicrosecond);
+
+	Frame frame;
+	frame.index = m_frameIndex++;
+	frame.time = Clock::Seconds(m_frameStart - m_startTime);
+	frame.duration = Milliseconds(frameTicks);
+	for (unsigned int iii = 0; iii < PhaseCount; ++iii)
+	{
+		m_phases[iii].Record(m_phaseTicks[iii] / TicksPerMicrosecond);
+		frame.phases[iii] = Milliseconds(m_phaseTicks[iii]);
+	}
+	frame.overBudget = frame.duration > m_budget;
+
+	if (m_history.size() < HistorySize)
+		m_history.push_back(frame);
+	else
+	{
+		m_history[m_historyOffset] = frame;
+		m_historyOffset = (m_historyOffset + 1) % HistorySize;
+	}
+
+	if (frame.overBudget)
+	{
+		++m_overBudgetCount;
+		if (m_overBudgetHistory.size() < OverBudgetHistorySize)
+			m_overBudgetHistory.push_back(frame);
+		else
+		{
+			m_overBudgetHistory[m_overBudgetHistoryOffset] = frame;
+			m_overBudgetHistoryOffset = (m_overBudgetHistoryOffset + 1) % OverBudgetHistorySize;
+		}
+	}
+}
+
+void FrameTiming::Reset() noexcept
+{
+	m_frames.Clear();
+	for (HdrHistogram& histogram : m_phases)
+		histogram.Clear();
+	m_overBudgetCount = 0;
+
+	m_history.clear();
+	m_historyOffset = 0;
+	m_overBudgetHistory.clear();
+	m_overBudgetHistoryOffset = 0;
+
+	// The frame in flight is still recorded, but the time starts over with it
+	m_startTime = m_frameStart;
+}
+
+FrameTiming::Summary FrameTiming::Summarize(const HdrHistogram& histogram) noexcept
+{
+	constexpr double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+	uint64_t values[4];
+	histogram.ValuesAtPercentiles(percentiles, values, 4);
+
+	Summary summary;
+	summary.p50 = values[0] / 1000.0;
+	summary.p90 = values[1] / 1000.0;
+	summary.p99 = values[2] / 1000.0;
+	summary.p999 = values[3] / 1000.0;
+	summary.max = histogram.Max() / 1000.0;
+	summary.mean = histogram.Mean() / 1000.0;
+	return summary;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "CorePch.h"
+#include "HdrHistogram.h"
+
+#include <array>
+#include <vector>
+
+// The parts of a frame on the main thread, in the order they run. The simulations are stepped on their own
+// thread, so the Simulation phase is the time the frame spends synchronizing with it. It is the only phase
+// that takes the SimulationLock, so a frame held up by a long physics tick shows up there and not as UI time
+enum class FramePhase : unsigned int
+{
+	Messages,			// window messages and input
+	Simulation,			// waiting for the SimulationLock, the queued edits, deferred events and the snapshot
+	RendererUpdate,		// renderer reading the snapshot, mouse and keyboard
+	UI,					// building the ImGui windows
+	Render,				// clearing, the 3D scene and the ImGui draw data
+	Present,
+	Count
+};
+
+// Records the duration of every frame and of its phases, keeps their distributions in HDR histograms so the
+// percentiles are exact to 3 significant digits over the whole session, and flags the frames that take longer
+// than the frame budget. Averages hide stutters, the tail percentiles don't.
+//
+// Only used from the main thread
+class FrameTiming
+{
+public:
+	static constexpr unsigned int PhaseCount = static_cast<unsigned int>(FramePhase::Count);
+	static constexpr unsigned int HistorySize = 2000;
+	static constexpr unsigned int OverBudgetHistorySize = 32;
+
+	struct Frame
+	{
+		uint64_t index;
+		double time;							// seconds since the first frame, at its start
+		double duration;						// milliseconds
+		std::array<double, PhaseCount> phases;	// milliseconds
+		bool overBudget;
+	};
+
+	// Milliseconds
+	struct Summary
+	{
+		double p50, p90, p99, p999;
+		double max;
+		double mean;
+	};
+
+	FrameTiming() noexcept;
+	FrameTiming(const FrameTiming&) = delete;
+	void operator=(const FrameTiming&) = delete;
+
+	static FrameTiming& Get() noexcept
+	{
+		static FrameTiming* instance = new FrameTiming();
+		return *instance;
+	}
+
+	static const char* PhaseName(FramePhase phase) noexcept;
+
+	// Ends the previous frame, if there is one, and starts the next one in the Messages phase
+	void BeginFrame() noexcept;
+	// Ends the current phase and starts 'phase'. A phase may be entered more than once per frame
+	void BeginPhase(FramePhase phase) noexcept;
+
+	float GetBudget() const noexcept { return m_budget; }
+	void SetBudget(float milliseconds) noexcept { m_budget = milliseconds; }
+
+	uint64_t FrameCount() const noexcept { return m_frames.Count(); }
+	uint64_t OverBudgetCount() const noexcept { return m_overBudgetCount; }
+	Summary FrameSummary() const noexcept { return Summarize(m_frames); }
+	Summary PhaseSummary(FramePhase phase) const noexcept { return Summarize(m_phases[static_cast<unsigned int>(phase)]); }
+
+	// Rings of the latest frames and of the latest frames over budget. The oldest entry is at the offset once
+	// the ring is full
+	const std::vector<Frame>& History() const noexcept { return m_history; }
+	unsigned int HistoryOffset() const noexcept { return m_historyOffset; }
+	const std::vector<Frame>& OverBudgetHistory() const noexcept { return m_overBudgetHistory; }
+	unsigned int OverBudgetHistoryOffset() const noexcept { return m_overBudgetHistoryOffset; }
+
+	// Clears the histograms and the history, e.g. to measure after loading a scenario
+	void Reset() noexcept;
+
+private:
+	void EndFrame(uint64_t now) noexcept;
+	static Summary Summarize(const HdrHistogram& histogram) noexcept;
+
+	float m_budget;						// milliseconds
+
+	uint64_t m_startTime;				// start of the first frame since the last Reset
+	uint64_t m_frameStart;
+	uint64_t m_phaseStart;
+	FramePhase m_phase;
+	bool m_inFrame;
+	uint64_t m_frameIndex;
+	std::array<uint64_t, PhaseCount> m_phaseTicks;
+
+	// Microseconds
+	HdrHistogram m_frames;
+	std::array<HdrHistogram, PhaseCount> m_phases;
+	uint64_t m_overBudgetCount;
+
+	std::vector<Frame> m_history;
+	unsigned int m_historyOffset;
+	std::vector<Frame> m_overBudgetHistory;
+	unsigned int m_overBudgetHistoryOffset;
+};
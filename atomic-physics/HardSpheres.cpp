@@ -0,0 +1,526 @@
+#include "HardSpheres.h"
+#include "PhysicsConstants.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	constexpr unsigned int ParticlesPerChunk = 4096;
+
+	template<typename T, typename A>
+	bool ColumnMatches(const std::vector<T, A>& synced, const T* current, unsigned int count) noexcept
+	{
+		return count == 0 || std::memcmp(synced.data(), current, count * sizeof(T)) == 0;
+	}
+}
+
+HardSpheres::HardSpheres() noexcept :
+	m_valid(false),
+	m_periodic(false),
+	m_currentTime(0.0),
+	m_boxMax{ 0.0, 0.0, 0.0 },
+	m_length{ 0.0, 0.0, 0.0 },
+	m_cellSize{ 1.0, 1.0, 1.0 },
+	m_cellCount{ 1, 1, 1 },
+	m_rebuildCount(0),
+	m_collisionCount(0),
+	m_wallCollisionCount(0),
+	m_cellCrossingCount(0),
+	m_staleEventCount(0)
+{
+}
+
+void HardSpheres::Advance(ParticleStore& particles, float timeDelta, DirectX::XMFLOAT3 boxMax, bool periodic) noexcept
+{
+	PROFILE_FUNCTION();
+
+	if (!m_valid || !MatchesParticles(particles, boxMax, periodic))
+		Rebuild(particles, boxMax, periodic);
+
+	// Lazily deleted events pile up in the heap, so sweep them out once it grows too large
+	size_t maxQueueSize = static_cast<size_t>(MaxEventsPerParticle) * m_time.size() + 1024;
+	if (m_queue.size() > maxQueueSize)
+	{
+		PROFILE_SCOPE("HardSpheres Compact Queue");
+
+		size_t before = m_queue.size();
+		m_queue.erase(std::remove_if(m_queue.begin(), m_queue.end(), [this](const Event& event) noexcept { return IsStale(event); }), m_queue.end());
+		std::make_heap(m_queue.begin(), m_queue.end(), Later);
+		m_staleEventCount += before - m_queue.size();
+	}
+
+	double endTime = m_currentTime + timeDelta;
+
+	{
+		PROFILE_SCOPE("HardSpheres Process Events");
+
+		while (!m_queue.empty() && m_queue.front().time <= endTime)
+		{
+			std::pop_heap(m_queue.begin(), m_queue.end(), Later);
+			Event event = m_queue.back();
+			m_queue.pop_back();
+
+			if (IsStale(event))
+			{
+				++m_staleEventCount;
+				continue;
+			}
+
+			m_currentTime = event.time;
+			switch (event.type)
+			{
+			case EventType::Collision:		ProcessCollision(event); break;
+			case EventType::Wall:			ProcessWall(event); break;
+			case EventType::CellCrossing:	ProcessCellCrossing(event); break;
+			}
+		}
+	}
+
+	m_currentTime = endTime;
+	Synchronize(particles, endTime);
+}
+
+bool HardSpheres::MatchesParticles(const ParticleStore& particles, DirectX::XMFLOAT3 boxMax, bool periodic) const noexcept
+{
+	unsigned int count = particles.Size();
+	if (count != m_syncedType.size() || periodic != m_periodic ||
+		boxMax.x != m_boxMax[0] || boxMax.y != m_boxMax[1] || boxMax.z != m_boxMax[2])
+		return false;
+
+	const float* positions[3] = { particles.PositionX(), particles.PositionY(), particles.PositionZ() };
+	const float* velocities[3] = { particles.VelocityX(), particles.VelocityY(), particles.VelocityZ() };
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		if (!ColumnMatches(m_syncedPosition[axis], positions[axis], count) || !ColumnMatches(m_syncedVelocity[axis], velocities[axis], count))
+			return false;
+	}
+
+	return ColumnMatches(m_syncedType, particles.Type(), count) && ColumnMatches(m_syncedMass, particles.Mass(), count);
+}
+
+void HardSpheres::Rebuild(const ParticleStore& particles, DirectX::XMFLOAT3 boxMax, bool periodic) noexcept
+{
+	PROFILE_FUNCTION();
+
+	unsigned int count = particles.Size();
+	const unsigned int* type = particles.Type();
+	const unsigned int* mass = particles.Mass();
+	const float* positions[3] = { particles.PositionX(), particles.PositionY(), particles.PositionZ() };
+	const float* velocities[3] = { particles.VelocityX(), particles.VelocityY(), particles.VelocityZ() };
+
+	m_valid = true;
+	m_periodic = periodic;
+	m_currentTime = 0.0;
+	++m_rebuildCount;
+
+	m_boxMax[0] = boxMax.x;
+	m_boxMax[1] = boxMax.y;
+	m_boxMax[2] = boxMax.z;
+
+	// Any two spheres that touch have centers in the same or adjacent cells
+	double diameter = 2.0 * Constants::MaxAtomicRadius();
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		m_length[axis] = 2.0 * m_boxMax[axis];
+		double cells = std::floor(m_length[axis] / diameter);
+		m_cellCount[axis] = static_cast<unsigned int>(std::clamp(cells, 1.0, static_cast<double>(MaxCellsPerAxis)));
+		m_cellSize[axis] = m_length[axis] / m_cellCount[axis];
+	}
+
+	m_radius.resize(count);
+	m_inverseMass.resize(count);
+	for (unsigned int iii = 0; iii < count; ++iii)
+	{
+		m_radius[iii] = Constants::AtomicRadii[type[iii]];
+		double inertialMass = Constants::InertialMass(type[iii], mass[iii]);
+		m_inverseMass[iii] = inertialMass == 0.0 ? 0.0 : 1.0 / inertialMass;
+	}
+
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		m_position[axis].resize(count);
+		m_velocity[axis].resize(count);
+		for (unsigned int iii = 0; iii < count; ++iii)
+		{
+			double position = positions[axis][iii];
+			if (periodic)
+				position -= m_length[axis] * std::floor((position + m_boxMax[axis]) / m_length[axis]);
+			else
+			{
+				// Spheres that poke through a wall are pushed back inside
+				double limit = std::max(m_boxMax[axis] - m_radius[iii], 0.0);
+				position = std::clamp(position, -limit, limit);
+			}
+			m_position[axis][iii] = position;
+			// A sphere wider than the box is held in place between the walls along that axis
+			m_velocity[axis][iii] = periodic || m_boxMax[axis] > m_radius[iii] ? velocities[axis][iii] : 0.0;
+		}
+	}
+
+	m_time.assign(count, m_currentTime);
+	m_eventCount.assign(count, 0);
+
+	m_cellHead.assign(static_cast<size_t>(m_cellCount[0]) * m_cellCount[1] * m_cellCount[2], NoParticle);
+	m_cellNext.resize(count);
+	m_cellPrevious.resize(count);
+	m_cellCoordinate.resize(3 * static_cast<size_t>(count));
+	for (unsigned int iii = 0; iii < count; ++iii)
+	{
+		unsigned int coordinate[3];
+		for (unsigned int axis = 0; axis < 3; ++axis)
+		{
+			double cell = std::floor((m_position[axis][iii] + m_boxMax[axis]) / m_cellSize[axis]);
+			coordinate[axis] = static_cast<unsigned int>(std::clamp(cell, 0.0, static_cast<double>(m_cellCount[axis] - 1)));
+			m_cellCoordinate[3 * iii + axis] = coordinate[axis];
+		}
+		InsertIntoCell(iii, CellIndex(coordinate));
+	}
+
+	// Every pair only needs to be predicted once, from its lower index
+	m_queue.clear();
+	const int minOffset[3] = { -1, -1, -1 };
+	const int maxOffset[3] = { 1, 1, 1 };
+	for (unsigned int iii = 0; iii < count; ++iii)
+	{
+		if (!m_periodic)
+			PredictWall(iii);
+		PredictCellCrossing(iii);
+		PredictCollisionsInCells(iii, minOffset, maxOffset, iii + 1);
+	}
+}
+
+void HardSpheres::Synchronize(ParticleStore& particles, double time) noexcept
+{
+	PROFILE_FUNCTION();
+
+	unsigned int count = particles.Size();
+	float* positions[3] = { particles.PositionX(), particles.PositionY(), particles.PositionZ() };
+	float* velocities[3] = { particles.VelocityX(), particles.VelocityY(), particles.VelocityZ() };
+
+	// Moving every particle to the same time doesn't change any trajectory, so the queued events stay valid
+	ThreadPool::Get().ParallelFor(0, count, ParticlesPerChunk,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			for (unsigned int iii = begin; iii < end; ++iii)
+				Drift(iii, time);
+
+			for (unsigned int axis = 0; axis < 3; ++axis)
+			{
+				for (unsigned int iii = begin; iii < end; ++iii)
+				{
+					positions[axis][iii] = static_cast<float>(m_position[axis][iii]);
+					velocities[axis][iii] = static_cast<float>(m_velocity[axis][iii]);
+				}
+			}
+		}
+	);
+
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		m_syncedPosition[axis].assign(positions[axis], positions[axis] + count);
+		m_syncedVelocity[axis].assign(velocities[axis], velocities[axis] + count);
+	}
+	m_syncedType.assign(particles.Type(), particles.Type() + count);
+	m_syncedMass.assign(particles.Mass(), particles.Mass() + count);
+}
+
+double HardSpheres::KineticEnergy() const noexcept
+{
+	double energy = 0.0;
+	for (size_t iii = 0; iii < m_inverseMass.size(); ++iii)
+	{
+		if (m_inverseMass[iii] == 0.0)
+			continue;
+
+		double speedSquared = m_velocity[0][iii] * m_velocity[0][iii] + m_velocity[1][iii] * m_velocity[1][iii] + m_velocity[2][iii] * m_velocity[2][iii];
+		energy += 0.5 * speedSquared / m_inverseMass[iii];
+	}
+	return energy;
+}
+
+void HardSpheres::Drift(unsigned int i, double time) noexcept
+{
+	double dt = time - m_time[i];
+	m_position[0][i] += m_velocity[0][i] * dt;
+	m_position[1][i] += m_velocity[1][i] * dt;
+	m_position[2][i] += m_velocity[2][i] * dt;
+	m_time[i] = time;
+}
+
+bool HardSpheres::IsStale(const Event& event) const noexcept
+{
+	if (event.particleCount != m_eventCount[event.particle])
+		return true;
+	return event.type == EventType::Collision && event.partnerCount != m_eventCount[event.partner];
+}
+
+void HardSpheres::Schedule(EventType type, double time, unsigned int i, unsigned int partner) noexcept
+{
+	unsigned int partnerCount = type == EventType::Collision ? m_eventCount[partner] : 0;
+	m_queue.push_back({ time, i, partner, m_eventCount[i], partnerCount, type });
+	std::push_heap(m_queue.begin(), m_queue.end(), Later);
+}
+
+void HardSpheres::PredictAll(unsigned int i) noexcept
+{
+	const int minOffset[3] = { -1, -1, -1 };
+	const int maxOffset[3] = { 1, 1, 1 };
+
+	if (!m_periodic)
+		PredictWall(i);
+	PredictCellCrossing(i);
+	PredictCollisionsInCells(i, minOffset, maxOffset, 0);
+}
+
+void HardSpheres::PredictAfterCrossing(unsigned int i, unsigned int axis, bool upward) noexcept
+{
+	int minOffset[3] = { -1, -1, -1 };
+	int maxOffset[3] = { 1, 1, 1 };
+	minOffset[axis] = maxOffset[axis] = upward ? 1 : -1;
+
+	PredictCellCrossing(i);
+	PredictCollisionsInCells(i, minOffset, maxOffset, 0);
+}
+
+void HardSpheres::PredictCollisionsInCells(unsigned int i, const int (&minOffset)[3], const int (&maxOffset)[3], unsigned int firstPartner) noexcept
+{
+	// Electrons have no radius and never collide with anything but the walls
+	if (m_radius[i] == 0.0)
+		return;
+
+	// Cells to visit along each axis. With fewer than three cells the wrapped offsets repeat, so each is kept once
+	unsigned int cells[3][3];
+	unsigned int cellCounts[3] = { 0, 0, 0 };
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		int cellCount = static_cast<int>(m_cellCount[axis]);
+		for (int offset = minOffset[axis]; offset <= maxOffset[axis]; ++offset)
+		{
+			int cell = static_cast<int>(m_cellCoordinate[3 * i + axis]) + offset;
+			if (m_periodic)
+				cell = (cell + cellCount) % cellCount;
+			else if (cell < 0 || cell >= cellCount)
+				continue;
+
+			if (std::find(cells[axis], cells[axis] + cellCounts[axis], static_cast<unsigned int>(cell)) == cells[axis] + cellCounts[axis])
+				cells[axis][cellCounts[axis]++] = static_cast<unsigned int>(cell);
+		}
+	}
+
+	for (unsigned int zzz = 0; zzz < cellCounts[2]; ++zzz)
+	{
+		for (unsigned int yyy = 0; yyy < cellCounts[1]; ++yyy)
+		{
+			for (unsigned int xxx = 0; xxx < cellCounts[0]; ++xxx)
+			{
+				const unsigned int coordinate[3] = { cells[0][xxx], cells[1][yyy], cells[2][zzz] };
+				for (unsigned int j = m_cellHead[CellIndex(coordinate)]; j != NoParticle; j = m_cellNext[j])
+				{
+					if (j != i && j >= firstPartner)
+						PredictCollision(i, j);
+				}
+			}
+		}
+	}
+}
+
+void HardSpheres::PredictCollision(unsigned int i, unsigned int j) noexcept
+{
+	double sigma = m_radius[i] + m_radius[j];
+	if (m_radius[j] == 0.0 || (m_inverseMass[i] == 0.0 && m_inverseMass[j] == 0.0))
+		return;
+
+	// Relative position and velocity at the current time. Particle j is only moved forward on paper
+	double dtj = m_currentTime - m_time[j];
+	double dr[3], dv[3];
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		double ri = m_position[axis][i] + m_velocity[axis][i] * (m_currentTime - m_time[i]);
+		dr[axis] = m_position[axis][j] + m_velocity[axis][j] * dtj - ri;
+		if (m_periodic)
+			dr[axis] -= m_length[axis] * std::nearbyint(dr[axis] / m_length[axis]);
+		dv[axis] = m_velocity[axis][j] - m_velocity[axis][i];
+	}
+
+	// Solve |dr + dv t| = sigma for the first root. Only approaching pairs can collide
+	double b = dr[0] * dv[0] + dr[1] * dv[1] + dr[2] * dv[2];
+	if (b >= 0.0)
+		return;
+
+	double speedSquared = dv[0] * dv[0] + dv[1] * dv[1] + dv[2] * dv[2];
+	double gap = dr[0] * dr[0] + dr[1] * dr[1] + dr[2] * dr[2] - sigma * sigma;
+	double discriminant = b * b - speedSquared * gap;
+	if (discriminant < 0.0)
+		return;
+
+	// Equivalent to (-b - sqrt(discriminant)) / speedSquared without the cancellation. Pairs that already
+	// overlap (gap < 0) collide right away
+	double t = gap / (std::sqrt(discriminant) - b);
+	Schedule(EventType::Collision, m_currentTime + std::max(t, 0.0), i, j);
+}
+
+void HardSpheres::PredictWall(unsigned int i) noexcept
+{
+	double earliest = INFINITY;
+	unsigned int wallAxis = 0;
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		double velocity = m_velocity[axis][i];
+		if (velocity == 0.0)
+			continue;
+
+		double limit = m_boxMax[axis] - m_radius[i];
+		if (limit <= 0.0)
+			continue;
+
+		double t = ((velocity > 0.0 ? limit : -limit) - m_position[axis][i]) / velocity;
+		if (t < earliest)
+		{
+			earliest = t;
+			wallAxis = axis;
+		}
+	}
+
+	if (earliest != INFINITY)
+		Schedule(EventType::Wall, m_currentTime + std::max(earliest, 0.0), i, wallAxis);
+}
+
+void HardSpheres::PredictCellCrossing(unsigned int i) noexcept
+{
+	// The partner field holds 2 * axis + 1 for a crossing in the positive direction, 2 * axis otherwise
+	double earliest = INFINITY;
+	unsigned int crossing = 0;
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		double velocity = m_velocity[axis][i];
+		unsigned int cell = m_cellCoordinate[3 * i + axis];
+		bool upward = velocity > 0.0;
+		if (velocity == 0.0)
+			continue;
+
+		// Without periodic boundaries the outermost cells are bounded by the walls
+		if (!m_periodic && (upward ? cell + 1 == m_cellCount[axis] : cell == 0))
+			continue;
+
+		double boundary = -m_boxMax[axis] + (upward ? cell + 1 : cell) * m_cellSize[axis];
+		double t = (boundary - m_position[axis][i]) / velocity;
+		if (t < earliest)
+		{
+			earliest = t;
+			crossing = 2 * axis + (upward ? 1 : 0);
+		}
+	}
+
+	if (earliest != INFINITY)
+		Schedule(EventType::CellCrossing, m_currentTime + std::max(earliest, 0.0), i, crossing);
+}
+
+void HardSpheres::ProcessCollision(const Event& event) noexcept
+{
+	unsigned int i = event.particle;
+	unsigned int j = event.partner;
+	Drift(i, m_currentTime);
+	Drift(j, m_currentTime);
+
+	double dr[3], dv[3];
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		dr[axis] = m_position[axis][j] - m_position[axis][i];
+		if (m_periodic)
+			dr[axis] -= m_length[axis] * std::nearbyint(dr[axis] / m_length[axis]);
+		dv[axis] = m_velocity[axis][j] - m_velocity[axis][i];
+	}
+
+	// Elastic impulse along the line of centers. An immovable particle (inverse mass 0) acts like a wall
+	double b = dr[0] * dv[0] + dr[1] * dv[1] + dr[2] * dv[2];
+	double distanceSquared = dr[0] * dr[0] + dr[1] * dr[1] + dr[2] * dr[2];
+	double impulse = 2.0 * b / (distanceSquared * (m_inverseMass[i] + m_inverseMass[j]));
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		m_velocity[axis][i] += impulse * m_inverseMass[i] * dr[axis];
+		m_velocity[axis][j] -= impulse * m_inverseMass[j] * dr[axis];
+	}
+
+	++m_eventCount[i];
+	++m_eventCount[j];
+	++m_collisionCount;
+
+	PredictAll(i);
+	PredictAll(j);
+}
+
+void HardSpheres::ProcessWall(const Event& event) noexcept
+{
+	unsigned int i = event.particle;
+	Drift(i, m_currentTime);
+	m_velocity[event.partner][i] = -m_velocity[event.partner][i];
+
+	++m_eventCount[i];
+	++m_wallCollisionCount;
+
+	PredictAll(i);
+}
+
+void HardSpheres::ProcessCellCrossing(const Event& event) noexcept
+{
+	unsigned int i = event.particle;
+	unsigned int axis = event.partner / 2;
+	bool upward = (event.partner & 1) != 0;
+	Drift(i, m_currentTime);
+
+	RemoveFromCell(i);
+
+	// Leaving through a periodic face re-enters on the opposite side of the box
+	unsigned int& cell = m_cellCoordinate[3 * i + axis];
+	if (upward)
+	{
+		if (++cell == m_cellCount[axis])
+		{
+			cell = 0;
+			m_position[axis][i] -= m_length[axis];
+		}
+	}
+	else
+	{
+		if (cell-- == 0)
+		{
+			cell = m_cellCount[axis] - 1;
+			m_position[axis][i] += m_length[axis];
+		}
+	}
+
+	const unsigned int coordinate[3] = { m_cellCoordinate[3 * i], m_cellCoordinate[3 * i + 1], m_cellCoordinate[3 * i + 2] };
+	InsertIntoCell(i, CellIndex(coordinate));
+	++m_cellCrossingCount;
+
+	// The velocity is unchanged, so every event already queued for the particle is still valid
+	PredictAfterCrossing(i, axis, upward);
+}
+
+void HardSpheres::InsertIntoCell(unsigned int i, unsigned int cell) noexcept
+{
+	unsigned int head = m_cellHead[cell];
+	m_cellNext[i] = head;
+	m_cellPrevious[i] = NoParticle;
+	if (head != NoParticle)
+		m_cellPrevious[head] = i;
+	m_cellHead[cell] = i;
+}
+
+void HardSpheres::RemoveFromCell(unsigned int i) noexcept
+{
+	const unsigned int coordinate[3] = { m_cellCoordinate[3 * i], m_cellCoordinate[3 * i + 1], m_cellCoordinate[3 * i + 2] };
+	unsigned int next = m_cellNext[i];
+	unsigned int previous = m_cellPrevious[i];
+
+	if (previous != NoParticle)
+		m_cellNext[previous] = next;
+	else
+		m_cellHead[CellIndex(coordinate)] = next;
+
+	if (next != NoParticle)
+		m_cellPrevious[next] = previous;
+}
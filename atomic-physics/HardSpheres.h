@@ -0,0 +1,137 @@
+#pragma once
+#include "CorePch.h"
+#include "ParticleStore.h"
+
+#include <cstdint>
+#include <vector>
+
+// Event-driven molecular dynamics for hard spheres (Rapaport, "The Art of Molecular Dynamics Simulation", ch. 14).
+// Every particle is a sphere of its atomic radius that moves in a straight line until it touches another
+// sphere or a box wall, at which point the collision is resolved exactly with an elastic impulse. Instead of
+// stepping time in small increments, the time of every upcoming collision is predicted analytically and kept
+// in a priority queue, and particles are only moved when one of their events fires.
+//
+// Collision partners are limited to the surrounding cells of a grid whose cells are at least one atomic
+// diameter wide, so a particle leaving its cell is an event as well. Each particle keeps the time its
+// position was last brought up to date and a counter of the collisions it took part in; events that were
+// predicted before a later collision of either particle are stale and discarded when they reach the front
+// of the queue.
+//
+// Massless particles are treated as immovable, and electrons, which have no radius, only bounce off the walls.
+// With periodic boundaries every box length should be at least three atomic diameters so that a pair of
+// spheres can only meet through one periodic image.
+class HardSpheres
+{
+public:
+	HardSpheres() noexcept;
+	HardSpheres(const HardSpheres&) = delete;
+	void operator=(const HardSpheres&) = delete;
+
+	// Advance every particle by 'timeDelta', resolving every collision along the way. The event queue is
+	// kept between calls and is rebuilt when the particles, the box or the boundaries were changed since
+	// the last call
+	void Advance(ParticleStore& particles, float timeDelta, DirectX::XMFLOAT3 boxMax, bool periodic) noexcept;
+	// Force the event queue to be rebuilt on the next Advance
+	void Invalidate() noexcept { m_valid = false; }
+
+	uint64_t CollisionCount() const noexcept { return m_collisionCount; }
+	uint64_t WallCollisionCount() const noexcept { return m_wallCollisionCount; }
+	uint64_t CellCrossingCount() const noexcept { return m_cellCrossingCount; }
+	// Events that were invalidated by an earlier collision before they fired
+	uint64_t StaleEventCount() const noexcept { return m_staleEventCount; }
+	size_t QueueSize() const noexcept { return m_queue.size(); }
+	unsigned int RebuildCount() const noexcept { return m_rebuildCount; }
+
+	// Kinetic energy of the particles, in amu * nm^2 / ps^2. Conserved exactly by the collisions
+	double KineticEnergy() const noexcept;
+
+private:
+	enum class EventType : uint8_t
+	{
+		Collision,
+		Wall,
+		CellCrossing
+	};
+
+	struct Event
+	{
+		double time;
+		unsigned int particle;
+		unsigned int partner;		// other particle for a collision, the axis for a wall / cell crossing
+		unsigned int particleCount;
+		unsigned int partnerCount;
+		EventType type;
+	};
+
+	// Orders the binary heap so the earliest event is at the front
+	static bool Later(const Event& a, const Event& b) noexcept { return a.time > b.time; }
+
+	bool MatchesParticles(const ParticleStore& particles, DirectX::XMFLOAT3 boxMax, bool periodic) const noexcept;
+	void Rebuild(const ParticleStore& particles, DirectX::XMFLOAT3 boxMax, bool periodic) noexcept;
+	void Synchronize(ParticleStore& particles, double time) noexcept;
+
+	// Bring a particle's position up to 'time'
+	void Drift(unsigned int i, double time) noexcept;
+	bool IsStale(const Event& event) const noexcept;
+	void Schedule(EventType type, double time, unsigned int i, unsigned int partner) noexcept;
+
+	// Queue every event of particle i from the current time onwards: its wall hit, its next cell crossing and
+	// collisions with every particle in the surrounding cells (only those from 'firstPartner' on). For a
+	// particle that just entered a new cell, only the layer of cells that became adjacent needs to be searched
+	void PredictAll(unsigned int i) noexcept;
+	void PredictAfterCrossing(unsigned int i, unsigned int axis, bool upward) noexcept;
+	void PredictCollision(unsigned int i, unsigned int j) noexcept;
+	void PredictCollisionsInCells(unsigned int i, const int (&minOffset)[3], const int (&maxOffset)[3], unsigned int firstPartner) noexcept;
+	void PredictWall(unsigned int i) noexcept;
+	void PredictCellCrossing(unsigned int i) noexcept;
+
+	void ProcessCollision(const Event& event) noexcept;
+	void ProcessWall(const Event& event) noexcept;
+	void ProcessCellCrossing(const Event& event) noexcept;
+
+	void InsertIntoCell(unsigned int i, unsigned int cell) noexcept;
+	void RemoveFromCell(unsigned int i) noexcept;
+	unsigned int CellIndex(const unsigned int (&coordinate)[3]) const noexcept { return (coordinate[2] * m_cellCount[1] + coordinate[1]) * m_cellCount[0] + coordinate[0]; }
+
+	// Drop stale events once the heap holds this many entries per particle
+	static constexpr unsigned int MaxEventsPerParticle = 32;
+	// Limit on cells per axis so that a huge box doesn't allocate an enormous, mostly empty grid
+	static constexpr unsigned int MaxCellsPerAxis = 128;
+	static constexpr unsigned int NoParticle = ~0u;
+
+	bool m_valid;
+	bool m_periodic;
+	double m_currentTime;
+	double m_boxMax[3];
+	double m_length[3];
+	double m_cellSize[3];
+	unsigned int m_cellCount[3];
+	unsigned int m_rebuildCount;
+
+	// Internal state in double precision so that predicted contacts don't drift apart from the actual ones
+	std::vector<double> m_position[3];
+	std::vector<double> m_velocity[3];
+	std::vector<double> m_time;				// time each position was last brought up to date
+	std::vector<double> m_radius;
+	std::vector<double> m_inverseMass;		// 0 for immovable particles
+	std::vector<unsigned int> m_eventCount;	// collisions each particle has taken part in
+
+	// Particles per cell as intrusive doubly linked lists
+	std::vector<unsigned int> m_cellHead;
+	std::vector<unsigned int> m_cellNext;
+	std::vector<unsigned int> m_cellPrevious;
+	std::vector<unsigned int> m_cellCoordinate;	// 3 per particle
+
+	std::vector<Event> m_queue;
+
+	// The particle data as it was written back by the last Advance, to detect outside changes
+	ParticleStore::AlignedVector<float> m_syncedPosition[3];
+	ParticleStore::AlignedVector<float> m_syncedVelocity[3];
+	std::vector<unsigned int> m_syncedType;
+	std::vector<unsigned int> m_syncedMass;
+
+	uint64_t m_collisionCount;
+	uint64_t m_wallCollisionCount;
+	uint64_t m_cellCrossingCount;
+	uint64_t m_staleEventCount;
+};
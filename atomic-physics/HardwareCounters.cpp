@@ -0,0 +1,96 @@
+#include "HardwareCounters.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+	int OpenCounter(uint64_t config, int groupFD) noexcept
+	{
+		perf_event_attr attributes = {};
+		attributes.size = sizeof(attributes);
+		attributes.type = PERF_TYPE_HARDWARE;
+		attributes.config = config;
+		attributes.disabled = groupFD < 0 ? 1 : 0;	// the leader starts the whole group once it is complete
+		attributes.exclude_kernel = 1;
+		attributes.exclude_hv = 1;
+		attributes.read_format = PERF_FORMAT_GROUP;
+
+		// pid 0, cpu -1: the calling thread on whichever CPU it runs
+		return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, groupFD, 0));
+	}
+}
+
+bool HardwareCounters::Open() noexcept
+{
+	if (IsOpen())
+		return true;
+
+	// Same order as the members of CounterValues
+	constexpr uint64_t Configs[CounterCount] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+
+	for (int iii = 0; iii < CounterCount; ++iii)
+	{
+		m_fds[iii] = OpenCounter(Configs[iii], m_fds[0]);
+		if (m_fds[iii] < 0)
+		{
+			Close();
+			return false;
+		}
+	}
+
+	m_groupFD = m_fds[0];
+	ioctl(m_groupFD, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(m_groupFD, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return true;
+}
+
+void HardwareCounters::Close() noexcept
+{
+	for (int& fd : m_fds)
+	{
+		if (fd >= 0)
+			close(fd);
+		fd = -1;
+	}
+	m_groupFD = -1;
+}
+
+bool HardwareCounters::Read(CounterValues& values) const noexcept
+{
+	// PERF_FORMAT_GROUP: the number of counters followed by their values, in the order they were opened
+	uint64_t buffer[1 + CounterCount];
+	if (m_groupFD < 0 || read(m_groupFD, buffer, sizeof(buffer)) != static_cast<ssize_t>(sizeof(buffer)))
+		return false;
+
+	values.cycles = buffer[1];
+	values.instructions = buffer[2];
+	values.cacheMisses = buffer[3];
+	values.branchMisses = buffer[4];
+	return true;
+}
+
+#else
+
+bool HardwareCounters::Open() noexcept { return false; }
+void HardwareCounters::Close() noexcept {}
+bool HardwareCounters::Read(CounterValues&) const noexcept { return false; }
+
+#endif
+
+bool HardwareCounters::Available() noexcept
+{
+	static const bool available = []() noexcept {
+		HardwareCounters counters;
+		return counters.Open();
+	}();
+	return available;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+// Hardware event counts of one thread, or the difference between two readings
+struct CounterValues
+{
+	uint64_t cycles = 0;
+	uint64_t instructions = 0;
+	uint64_t cacheMisses = 0;		// last level cache misses
+	uint64_t branchMisses = 0;
+
+	CounterValues operator-(const CounterValues& rhs) const noexcept
+	{
+		return { cycles - rhs.cycles, instructions - rhs.instructions, cacheMisses - rhs.cacheMisses, branchMisses - rhs.branchMisses };
+	}
+};
+
+// Performance monitoring counters of the calling thread, counted in user mode only. On Linux this is a
+// perf_event_open group, so all four counters are scheduled onto the PMU together and their ratios are
+// consistent. Elsewhere, or where the kernel doesn't allow it (perf_event_paranoid, virtual machines without
+// a virtual PMU), Open fails and the counters are simply not available.
+//
+// Every Read is a system call (~1 us), so the counters are only meant for scopes that do real work.
+//
+// Doesn't include CorePch.h because the profiler, which CorePch.h includes, uses it
+class HardwareCounters
+{
+public:
+	HardwareCounters() noexcept = default;
+	HardwareCounters(const HardwareCounters&) = delete;
+	void operator=(const HardwareCounters&) = delete;
+	~HardwareCounters() noexcept { Close(); }
+
+	// Start counting on the calling thread. Only that thread can Read the counters
+	bool Open() noexcept;
+	void Close() noexcept;
+	bool IsOpen() const noexcept { return m_groupFD >= 0; }
+
+	bool Read(CounterValues& values) const noexcept;
+
+	// Whether the counters can be opened on this machine at all
+	static bool Available() noexcept;
+
+private:
+	static constexpr int CounterCount = 4;
+
+	int m_groupFD = -1;
+	int m_fds[CounterCount] = { -1, -1, -1, -1 };
+};
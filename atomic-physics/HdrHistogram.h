@@ -0,0 +1,139 @@
+#pragma once
+#include "CorePch.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <vector>
+
+// High dynamic range histogram (after Gil Tene's HdrHistogram). Integer values from 1 up to a highest trackable
+// value are counted with a fixed number of significant decimal digits: the range is split into buckets that
+// double in size, and every bucket into the same number of linear sub-buckets. Recording is a couple of shifts
+// and an increment, the memory is fixed up front, and every percentile comes back within the precision of the
+// value, so the tail of a distribution is as accurate as its middle.
+class HdrHistogram
+{
+public:
+	// 'significantDigits' in [1, 5]. Values above 'highestTrackableValue' are recorded as that value
+	HdrHistogram(uint64_t highestTrackableValue, int significantDigits = 3) noexcept :
+		m_highestTrackableValue(std::max<uint64_t>(highestTrackableValue, 2)),
+		m_count(0),
+		m_total(0),
+		m_min(UINT64_MAX),
+		m_max(0)
+	{
+		// Enough sub-buckets that the step between two of them is below one unit of the least significant digit
+		uint64_t largestSingleUnitResolution = 2;
+		for (int iii = 0; iii < std::clamp(significantDigits, 1, 5); ++iii)
+			largestSingleUnitResolution *= 10;
+
+		int subBucketCountMagnitude = static_cast<int>(std::bit_width(largestSingleUnitResolution - 1));
+		m_subBucketHalfCountMagnitude = subBucketCountMagnitude - 1;
+		m_subBucketHalfCount = uint64_t(1) << m_subBucketHalfCountMagnitude;
+		m_subBucketMask = (uint64_t(1) << subBucketCountMagnitude) - 1;
+
+		// Bucket 0 holds [0, subBucketCount), every following bucket doubles the range
+		unsigned int bucketCount = 1;
+		for (uint64_t smallestUntrackable = m_subBucketMask + 1; smallestUntrackable <= m_highestTrackableValue; smallestUntrackable <<= 1)
+			++bucketCount;
+
+		// Only bucket 0 uses its lower half; the lower half of the others overlaps the previous bucket
+		m_counts.resize((bucketCount + 1) * m_subBucketHalfCount, 0);
+	}
+
+	void Record(uint64_t value) noexcept
+	{
+		value = std::min(value, m_highestTrackableValue);
+		++m_counts[CountsIndex(value)];
+		++m_count;
+		m_total += value;
+		m_min = std::min(m_min, value);
+		m_max = std::max(m_max, value);
+	}
+
+	// 'percentile' in [0, 100]. The highest value that is equivalent to the recorded one at this precision
+	uint64_t ValueAtPercentile(double percentile) const noexcept
+	{
+		uint64_t value = 0;
+		ValuesAtPercentiles(&percentile, &value, 1);
+		return value;
+	}
+
+	// Several percentiles in a single pass over the counts. 'percentiles' must be in ascending order
+	void ValuesAtPercentiles(const double* percentiles, uint64_t* values, size_t count) const noexcept
+	{
+		size_t next = 0;
+		uint64_t seen = 0;
+		for (size_t index = 0; index < m_counts.size() && next < count; ++index)
+		{
+			seen += m_counts[index];
+			while (next < count && seen > 0 && seen >= CountAtPercentile(percentiles[next]))
+				values[next++] = std::min(HighestEquivalentValue(ValueFromIndex(index)), m_max);
+		}
+		for (; next < count; ++next)
+			values[next] = m_max;
+	}
+
+	uint64_t Count() const noexcept { return m_count; }
+	uint64_t Min() const noexcept { return m_count == 0 ? 0 : m_min; }
+	uint64_t Max() const noexcept { return m_max; }
+	double Mean() const noexcept { return m_count == 0 ? 0.0 : static_cast<double>(m_total) / static_cast<double>(m_count); }
+
+	void Clear() noexcept
+	{
+		std::fill(m_counts.begin(), m_counts.end(), uint64_t(0));
+		m_count = 0;
+		m_total = 0;
+		m_min = UINT64_MAX;
+		m_max = 0;
+	}
+
+private:
+	uint64_t CountAtPercentile(double percentile) const noexcept
+	{
+		uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 * static_cast<double>(m_count)));
+		return std::max<uint64_t>(rank, 1);
+	}
+
+	int BucketIndex(uint64_t value) const noexcept
+	{
+		// The position of the highest set bit above the sub-bucket range
+		return static_cast<int>(std::bit_width(value | m_subBucketMask)) - m_subBucketHalfCountMagnitude - 1;
+	}
+
+	size_t CountsIndex(uint64_t value) const noexcept
+	{
+		int bucketIndex = BucketIndex(value);
+		uint64_t subBucketIndex = value >> bucketIndex;
+		return static_cast<size_t>(((static_cast<uint64_t>(bucketIndex) + 1) << m_subBucketHalfCountMagnitude) + subBucketIndex - m_subBucketHalfCount);
+	}
+
+	uint64_t ValueFromIndex(size_t index) const noexcept
+	{
+		int bucketIndex = static_cast<int>(index >> m_subBucketHalfCountMagnitude) - 1;
+		uint64_t subBucketIndex = (index & (m_subBucketHalfCount - 1)) + m_subBucketHalfCount;
+		if (bucketIndex < 0)
+		{
+			subBucketIndex -= m_subBucketHalfCount;
+			bucketIndex = 0;
+		}
+		return subBucketIndex << bucketIndex;
+	}
+
+	uint64_t HighestEquivalentValue(uint64_t value) const noexcept
+	{
+		int bucketIndex = BucketIndex(value);
+		return ((value >> bucketIndex) << bucketIndex) + (uint64_t(1) << bucketIndex) - 1;
+	}
+
+	uint64_t m_highestTrackableValue;
+	int m_subBucketHalfCountMagnitude;
+	uint64_t m_subBucketHalfCount;
+	uint64_t m_subBucketMask;
+	std::vector<uint64_t> m_counts;
+
+	uint64_t m_count;
+	uint64_t m_total;
+	uint64_t m_min;
+	uint64_t m_max;
+};
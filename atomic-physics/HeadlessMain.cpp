@@ -0,0 +1,158 @@
+// Headless entry point: runs a scenario at full speed without a window, Direct3D or ImGui, so long
+// simulations can be run as batch jobs (e.g. on Linux compute nodes) and report their throughput.
+//
+//   atomic-physics-headless <scenario> [--steps N] [--threads N] [--report-every N] [--output file] [--profile file] [--counters]
+#include "Clock.h"
+#include "Scenario.h"
+#include "SimulationManager.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace
+{
+	struct Options
+	{
+		std::string scenario;
+		std::string output;
+		std::string profile;
+		unsigned long long steps = 1000;
+		unsigned long long reportEvery = 0;
+		unsigned int threads = 0;
+		bool counters = false;
+	};
+
+	void PrintUsage(const char* program) noexcept
+	{
+		std::fprintf(stderr,
+			"usage: %s <scenario> [options]\n"
+			"  --steps N          time steps to run (default 1000)\n"
+			"  --threads N        worker threads (default: one per hardware thread)\n"
+			"  --report-every N   print progress every N steps\n"
+			"  --output FILE      save the final state as a scenario\n"
+			"  --profile FILE     write a profiling trace of the run\n"
+			"  --counters         count cycles, instructions, cache and branch misses per profiled scope (Linux)\n", program);
+	}
+
+	bool ParseCount(const char* text, unsigned long long& value) noexcept
+	{
+		char* end = nullptr;
+		value = std::strtoull(text, &end, 10);
+		return end != text && *end == '\0';
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options) noexcept
+	{
+		for (int iii = 1; iii < argc; ++iii)
+		{
+			std::string argument = argv[iii];
+			bool hasValue = iii + 1 < argc;
+			unsigned long long count = 0;
+
+			if (argument == "--steps" && hasValue && ParseCount(argv[++iii], count))
+				options.steps = count;
+			else if (argument == "--threads" && hasValue && ParseCount(argv[++iii], count) && count > 0)
+				options.threads = static_cast<unsigned int>(count);
+			else if (argument == "--report-every" && hasValue && ParseCount(argv[++iii], count))
+				options.reportEvery = count;
+			else if (argument == "--output" && hasValue)
+				options.output = argv[++iii];
+			else if (argument == "--profile" && hasValue)
+				options.profile = argv[++iii];
+			else if (argument == "--counters")
+				options.counters = true;
+			else if (argument[0] != '-' && options.scenario.empty())
+				options.scenario = argument;
+			else
+				return false;
+		}
+		return !options.scenario.empty();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage(argv[0]);
+		return 2;
+	}
+
+	if (options.threads != 0)
+		ThreadPool::Get().SetThreadCount(options.threads);
+
+	SimulationManager::Initialize();
+
+	std::string error;
+	if (!Scenario::Load(options.scenario, error))
+	{
+		std::fprintf(stderr, "error: %s\n", error.c_str());
+		return 1;
+	}
+
+	const unsigned int particleCount = SimulationManager::ParticleCount();
+	std::printf("scenario:   %s\n", options.scenario.c_str());
+	std::printf("particles:  %u\n", particleCount);
+	std::printf("threads:    %u\n", ThreadPool::Get().ThreadCount());
+	std::printf("time step:  %g ps\n", SimulationManager::GetTimeStep());
+	std::fflush(stdout);
+
+#ifdef PROFILE
+	if (options.counters && !Instrumentor::Get().SetHardwareCounters(true))
+		std::fprintf(stderr, "warning: hardware counters are not available (perf_event_paranoid, or no PMU in a virtual machine)\n");
+#endif
+	if (!options.profile.empty())
+		PROFILE_BEGIN_SESSION("Headless", options.profile);
+
+	// Run in batches so progress can be reported without touching the clock every step
+	constexpr unsigned long long MaxBatch = 1ull << 30;
+	unsigned long long batch = std::min(options.reportEvery != 0 ? options.reportEvery : options.steps, MaxBatch);
+	unsigned long long completed = 0;
+	uint64_t start = Clock::Now();
+	while (completed < options.steps)
+	{
+		unsigned long long steps = std::min(batch, options.steps - completed);
+		SimulationManager::Run(static_cast<unsigned int>(steps));
+		completed += steps;
+
+		if (options.reportEvery != 0)
+		{
+			double elapsed = Clock::Seconds(Clock::Now() - start);
+			std::printf("step %llu / %llu  t = %.6g ps  %.1f steps/s\n", completed, options.steps, SimulationManager::SimulatedSeconds(), completed / elapsed);
+			std::fflush(stdout);
+		}
+	}
+	double elapsed = Clock::Seconds(Clock::Now() - start);
+
+	if (!options.profile.empty())
+	{
+		PROFILE_END_SESSION();
+		PROFILE_WAIT_FOR_WRITER();
+	}
+
+	std::printf("steps:      %llu in %.3f s\n", completed, elapsed);
+	std::printf("throughput: %.1f steps/s, %.3f M particle-steps/s\n", completed / elapsed, completed * static_cast<double>(particleCount) / elapsed * 1.0e-6);
+	std::printf("simulated:  %.6g ps\n", SimulationManager::SimulatedSeconds());
+	if (SimulationManager::GetIntegrator() == Integrator::EventDriven)
+	{
+		const HardSpheres& hardSpheres = SimulationManager::GetHardSpheres();
+		std::printf("collisions: %llu (%.1f / s), wall %llu\n", static_cast<unsigned long long>(hardSpheres.CollisionCount()),
+			hardSpheres.CollisionCount() / elapsed, static_cast<unsigned long long>(hardSpheres.WallCollisionCount()));
+	}
+	else
+	{
+		std::printf("neighbor list rebuilds: %u\n", SimulationManager::GetNeighborList().RebuildCount());
+	}
+
+	if (!options.output.empty() && !Scenario::Save(options.output))
+	{
+		std::fprintf(stderr, "error: could not write '%s'\n", options.output.c_str());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,269 @@
+#include "LennardJones.h"
+#include "CpuFeatures.h"
+#include "PhysicsConstants.h"
+#include "SimulationKernels.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	// Everything a kernel needs to evaluate the forces for a range of particles
+	struct ForceKernelArgs
+	{
+		const unsigned int* type;
+		const float* p_x;
+		const float* p_y;
+		const float* p_z;
+
+		const unsigned int* offsets;
+		const unsigned int* neighbors;
+
+		const float* sigma2;
+		const float* epsilon24;
+		const float* cutoff2;
+		const float* energyShift;
+
+		// Box lengths for minimum image displacements. The inverse lengths are 0 without periodic boundaries
+		float boxLength[3];
+		float inverseBoxLength[3];
+
+		float* f_x;
+		float* f_y;
+		float* f_z;
+		float* energy;
+	};
+
+	using ForceKernel = void(*)(const ForceKernelArgs& args, unsigned int begin, unsigned int end) noexcept;
+
+	// Adds the contribution of neighbor j to the force/energy accumulators of particle i
+	inline void AccumulatePair(const ForceKernelArgs& args, unsigned int pairBase, float x, float y, float z, unsigned int j,
+		float& fx, float& fy, float& fz, float& energy) noexcept
+	{
+		unsigned int pair = pairBase + args.type[j];
+
+		float dx = x - args.p_x[j];
+		float dy = y - args.p_y[j];
+		float dz = z - args.p_z[j];
+		dx -= args.boxLength[0] * std::nearbyint(dx * args.inverseBoxLength[0]);
+		dy -= args.boxLength[1] * std::nearbyint(dy * args.inverseBoxLength[1]);
+		dz -= args.boxLength[2] * std::nearbyint(dz * args.inverseBoxLength[2]);
+		float r2 = dx * dx + dy * dy + dz * dz;
+
+		// cutoff2 is 0 for any pair involving an electron, so those pairs are skipped here as well
+		if (r2 >= args.cutoff2[pair] || r2 <= 0.0f)
+			return;
+
+		float inv2 = 1.0f / r2;
+		float s2 = args.sigma2[pair] * inv2;
+		float s6 = s2 * s2 * s2;
+		float s12 = s6 * s6;
+
+		// F(r) / r = 24 eps (2 (sigma/r)^12 - (sigma/r)^6) / r^2
+		float f = args.epsilon24[pair] * (2.0f * s12 - s6) * inv2;
+		fx += f * dx;
+		fy += f * dy;
+		fz += f * dz;
+		energy += args.epsilon24[pair] * (1.0f / 6.0f) * (s12 - s6) - args.energyShift[pair];
+	}
+
+	void ComputeForces_Scalar(const ForceKernelArgs& args, unsigned int begin, unsigned int end) noexcept
+	{
+		for (unsigned int iii = begin; iii < end; ++iii)
+		{
+			unsigned int pairBase = args.type[iii] * LennardJones::ElementCount;
+			float x = args.p_x[iii];
+			float y = args.p_y[iii];
+			float z = args.p_z[iii];
+
+			float fx = 0.0f, fy = 0.0f, fz = 0.0f, energy = 0.0f;
+			for (unsigned int k = args.offsets[iii]; k < args.offsets[iii + 1]; ++k)
+				AccumulatePair(args, pairBase, x, y, z, args.neighbors[k], fx, fy, fz, energy);
+
+			args.f_x[iii] = fx;
+			args.f_y[iii] = fy;
+			args.f_z[iii] = fz;
+			args.energy[iii] = 0.5f * energy;	// each pair is visited from both sides
+		}
+	}
+
+#ifdef SIMD_X86
+	SIMD_TARGET("avx2")
+	inline float HorizontalSum(__m256 v) noexcept
+	{
+		__m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+		return _mm_cvtss_f32(sum);
+	}
+
+	// Processes 8 neighbors of a particle at a time. Neighbor positions/types and the pair parameters
+	// are fetched with gathers, and out-of-range pairs are masked out of the accumulators
+	SIMD_TARGET("avx2")
+	void ComputeForces_AVX2(const ForceKernelArgs& args, unsigned int begin, unsigned int end) noexcept
+	{
+		const __m256 two = _mm256_set1_ps(2.0f);
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 sixth = _mm256_set1_ps(1.0f / 6.0f);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 lengthX = _mm256_set1_ps(args.boxLength[0]), inverseLengthX = _mm256_set1_ps(args.inverseBoxLength[0]);
+		const __m256 lengthY = _mm256_set1_ps(args.boxLength[1]), inverseLengthY = _mm256_set1_ps(args.inverseBoxLength[1]);
+		const __m256 lengthZ = _mm256_set1_ps(args.boxLength[2]), inverseLengthZ = _mm256_set1_ps(args.inverseBoxLength[2]);
+		constexpr int nearest = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+
+		for (unsigned int iii = begin; iii < end; ++iii)
+		{
+			unsigned int pairBase = args.type[iii] * LennardJones::ElementCount;
+			float x = args.p_x[iii];
+			float y = args.p_y[iii];
+			float z = args.p_z[iii];
+
+			__m256i pairBase8 = _mm256_set1_epi32(static_cast<int>(pairBase));
+			__m256 x8 = _mm256_set1_ps(x);
+			__m256 y8 = _mm256_set1_ps(y);
+			__m256 z8 = _mm256_set1_ps(z);
+
+			__m256 fx8 = zero, fy8 = zero, fz8 = zero, energy8 = zero;
+
+			unsigned int k = args.offsets[iii];
+			unsigned int last = args.offsets[iii + 1];
+			for (; k + 8 <= last; k += 8)
+			{
+				__m256i j = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(args.neighbors + k));
+
+				__m256 dx = _mm256_sub_ps(x8, _mm256_i32gather_ps(args.p_x, j, 4));
+				__m256 dy = _mm256_sub_ps(y8, _mm256_i32gather_ps(args.p_y, j, 4));
+				__m256 dz = _mm256_sub_ps(z8, _mm256_i32gather_ps(args.p_z, j, 4));
+				dx = _mm256_sub_ps(dx, _mm256_mul_ps(lengthX, _mm256_round_ps(_mm256_mul_ps(dx, inverseLengthX), nearest)));
+				dy = _mm256_sub_ps(dy, _mm256_mul_ps(lengthY, _mm256_round_ps(_mm256_mul_ps(dy, inverseLengthY), nearest)));
+				dz = _mm256_sub_ps(dz, _mm256_mul_ps(lengthZ, _mm256_round_ps(_mm256_mul_ps(dz, inverseLengthZ), nearest)));
+				__m256 r2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+
+				__m256i typeJ = _mm256_i32gather_epi32(reinterpret_cast<const int*>(args.type), j, 4);
+				__m256i pair = _mm256_add_epi32(pairBase8, typeJ);
+				__m256 cutoff2 = _mm256_i32gather_ps(args.cutoff2, pair, 4);
+
+				__m256 mask = _mm256_and_ps(_mm256_cmp_ps(r2, cutoff2, _CMP_LT_OQ), _mm256_cmp_ps(r2, zero, _CMP_GT_OQ));
+				if (_mm256_movemask_ps(mask) == 0)
+					continue;
+
+				__m256 sigma2 = _mm256_i32gather_ps(args.sigma2, pair, 4);
+				__m256 epsilon24 = _mm256_i32gather_ps(args.epsilon24, pair, 4);
+				__m256 shift = _mm256_i32gather_ps(args.energyShift, pair, 4);
+
+				// Masked lanes may hold inf/nan (r2 == 0), they are zeroed by the 'and' below
+				__m256 inv2 = _mm256_div_ps(one, r2);
+				__m256 s2 = _mm256_mul_ps(sigma2, inv2);
+				__m256 s6 = _mm256_mul_ps(_mm256_mul_ps(s2, s2), s2);
+				__m256 s12 = _mm256_mul_ps(s6, s6);
+
+				__m256 f = _mm256_mul_ps(_mm256_mul_ps(epsilon24, _mm256_sub_ps(_mm256_mul_ps(two, s12), s6)), inv2);
+				f = _mm256_and_ps(f, mask);
+				fx8 = _mm256_add_ps(fx8, _mm256_mul_ps(f, dx));
+				fy8 = _mm256_add_ps(fy8, _mm256_mul_ps(f, dy));
+				fz8 = _mm256_add_ps(fz8, _mm256_mul_ps(f, dz));
+
+				__m256 u = _mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(epsilon24, sixth), _mm256_sub_ps(s12, s6)), shift);
+				energy8 = _mm256_add_ps(energy8, _mm256_and_ps(u, mask));
+			}
+
+			float fx = HorizontalSum(fx8);
+			float fy = HorizontalSum(fy8);
+			float fz = HorizontalSum(fz8);
+			float energy = HorizontalSum(energy8);
+
+			for (; k < last; ++k)
+				AccumulatePair(args, pairBase, x, y, z, args.neighbors[k], fx, fy, fz, energy);
+
+			args.f_x[iii] = fx;
+			args.f_y[iii] = fy;
+			args.f_z[iii] = fz;
+			args.energy[iii] = 0.5f * energy;
+		}
+	}
+#endif
+}
+
+LennardJones::LennardJones(float cutoffScale) noexcept :
+	m_maxCutoff(0.0f),
+	m_potentialEnergy(0.0)
+{
+	for (unsigned int a = 0; a < ElementCount; ++a)
+	{
+		for (unsigned int b = 0; b < ElementCount; ++b)
+		{
+			unsigned int pair = a * ElementCount + b;
+
+			// Lorentz-Berthelot mixing
+			float sigma = Constants::AtomicRadii[a] + Constants::AtomicRadii[b];
+			float epsilon = std::sqrt(Constants::LennardJonesEpsilon[a] * Constants::LennardJonesEpsilon[b]);
+
+			// Electrons (and anything else without a size or well depth) do not interact
+			if (a == 0 || b == 0 || sigma <= 0.0f || epsilon <= 0.0f)
+			{
+				m_pairSigma2[pair] = 0.0f;
+				m_pairEpsilon24[pair] = 0.0f;
+				m_pairCutoff2[pair] = 0.0f;
+				m_pairEnergyShift[pair] = 0.0f;
+				continue;
+			}
+
+			float cutoff = cutoffScale * sigma;
+			float sc6 = std::pow(1.0f / cutoffScale, 6.0f);
+
+			m_pairSigma2[pair] = sigma * sigma;
+			m_pairEpsilon24[pair] = 24.0f * epsilon;
+			m_pairCutoff2[pair] = cutoff * cutoff;
+			m_pairEnergyShift[pair] = 4.0f * epsilon * (sc6 * sc6 - sc6);
+
+			m_maxCutoff = std::max(m_maxCutoff, cutoff);
+		}
+	}
+}
+
+void LennardJones::Compute(const ParticleStore& particles, const NeighborList& neighborList) noexcept
+{
+	PROFILE_FUNCTION();
+
+	unsigned int count = particles.Size();
+	m_forceX.resize(count);
+	m_forceY.resize(count);
+	m_forceZ.resize(count);
+	m_energy.resize(count);
+
+	DirectX::XMFLOAT3 boxMax = neighborList.GetBoxMax();
+	bool periodic = neighborList.IsPeriodic();
+
+	ForceKernelArgs args = {
+		particles.Type(), particles.PositionX(), particles.PositionY(), particles.PositionZ(),
+		neighborList.Offsets().data(), neighborList.Neighbors().data(),
+		m_pairSigma2.data(), m_pairEpsilon24.data(), m_pairCutoff2.data(), m_pairEnergyShift.data(),
+		{ 2.0f * boxMax.x, 2.0f * boxMax.y, 2.0f * boxMax.z },
+		{ periodic ? 0.5f / boxMax.x : 0.0f, periodic ? 0.5f / boxMax.y : 0.0f, periodic ? 0.5f / boxMax.z : 0.0f },
+		m_forceX.data(), m_forceY.data(), m_forceZ.data(), m_energy.data()
+	};
+
+	// Follow the SIMD level chosen for the integration kernels so that forcing 'Scalar' affects both
+	ForceKernel kernel = ComputeForces_Scalar;
+#ifdef SIMD_X86
+	if (SimulationKernels::GetSimdLevel() >= SimdLevel::AVX2)
+		kernel = ComputeForces_AVX2;
+#endif
+
+	ThreadPool::Get().ParallelFor(0, count, ParticlesPerChunk,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			kernel(args, begin, end);
+		}
+	);
+
+	double energy = 0.0;
+	for (unsigned int iii = 0; iii < count; ++iii)
+		energy += m_energy[iii];
+	m_potentialEnergy = energy;
+}
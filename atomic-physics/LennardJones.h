@@ -0,0 +1,60 @@
+#pragma once
+#include "CorePch.h"
+#include "NeighborList.h"
+#include "ParticleStore.h"
+
+#include <array>
+#include <cmath>
+
+// Truncated and shifted Lennard-Jones pair force:
+//
+//		U(r) = 4 eps_ij [ (sigma_ij / r)^12 - (sigma_ij / r)^6 ] - U(r_c)		for r < r_c = cutoffScale * sigma_ij
+//
+// sigma for each element is its atomic diameter (2 * Constants::AtomicRadii) and eps comes from
+// Constants::LennardJonesEpsilon. Unlike elements are combined with the Lorentz-Berthelot mixing rules
+// (sigma_ij = (sigma_i + sigma_j) / 2, eps_ij = sqrt(eps_i * eps_j)) and the resulting pair parameters
+// are precomputed into a matrix indexed by the two particle types.
+class LennardJones
+{
+public:
+	static constexpr unsigned int ElementCount = 11;
+
+	LennardJones(float cutoffScale = 2.5f) noexcept;
+	LennardJones(const LennardJones&) = delete;
+	void operator=(const LennardJones&) = delete;
+
+	// Largest pair cutoff - the neighbor lists must be built with at least this cutoff
+	float Cutoff() const noexcept { return m_maxCutoff; }
+
+	// Evaluate the force on every particle from its neighbors. Uses the full neighbor lists, so every
+	// particle only ever writes its own force and the particles can be split across threads freely
+	void Compute(const ParticleStore& particles, const NeighborList& neighborList) noexcept;
+
+	const float* ForceX() const noexcept { return m_forceX.data(); }
+	const float* ForceY() const noexcept { return m_forceY.data(); }
+	const float* ForceZ() const noexcept { return m_forceZ.data(); }
+
+	// Total potential energy from the last Compute (kcal/mol)
+	double PotentialEnergy() const noexcept { return m_potentialEnergy; }
+
+	float PairSigma(unsigned int typeA, unsigned int typeB) const noexcept { return std::sqrt(m_pairSigma2[typeA * ElementCount + typeB]); }
+	float PairEpsilon(unsigned int typeA, unsigned int typeB) const noexcept { return m_pairEpsilon24[typeA * ElementCount + typeB] / 24.0f; }
+
+private:
+	static constexpr unsigned int ParticlesPerChunk = 512;
+
+	float m_maxCutoff;
+
+	// Pair parameter matrix (ElementCount x ElementCount), stored as separate arrays so they can be gathered
+	alignas(64) std::array<float, ElementCount * ElementCount> m_pairSigma2;
+	alignas(64) std::array<float, ElementCount * ElementCount> m_pairEpsilon24;	// 24 * eps
+	alignas(64) std::array<float, ElementCount * ElementCount> m_pairCutoff2;
+	alignas(64) std::array<float, ElementCount * ElementCount> m_pairEnergyShift;	// U(r_c) before shifting
+
+	ParticleStore::AlignedVector<float> m_forceX;
+	ParticleStore::AlignedVector<float> m_forceY;
+	ParticleStore::AlignedVector<float> m_forceZ;
+	ParticleStore::AlignedVector<float> m_energy;	// per particle (half of each pair)
+
+	double m_potentialEnergy;
+};
@@ -218,12 +218,12 @@ void MoveLookController::Update(D3D11_VIEWPORT viewport) noexcept
         // When a button is pressed, we must begin tracking the time before we can make an update
         if (m_elapsedTime < 0.01f)
         {
-            m_elapsedTime = SimulationManager::TotalSeconds();
+            m_elapsedTime = Clock::Seconds(Clock::Now());
             return;
         }
 
         // Compute the time delta
-        double currentTime = SimulationManager::TotalSeconds();
+        double currentTime = Clock::Seconds(Clock::Now());
         double timeDelta = currentTime - m_elapsedTime;
         m_elapsedTime = currentTime;
 
@@ -255,14 +255,14 @@ void MoveLookController::Update(D3D11_VIEWPORT viewport) noexcept
             // If the move start time is less than 0, it needs to be set
             if (m_moveStartTime < 0.0)
             {
-                m_moveStartTime = SimulationManager::TotalSeconds();
+                m_moveStartTime = Clock::Seconds(Clock::Now());
                 m_timeAtLastMoveUpdate = m_moveStartTime;
             }
 
             // If rotating left/right, just compute the necessary angle and call RotateLeftRight / RotateUpDown
             if (m_rotatingLeftRight || m_rotatingUpDown)
             {
-                double currentTime = SimulationManager::TotalSeconds();
+                double currentTime = Clock::Seconds(Clock::Now());
                 double timeDelta;
                 if (m_moveStartTime + m_movementMaxTime < currentTime)
                 {
@@ -284,7 +284,7 @@ void MoveLookController::Update(D3D11_VIEWPORT viewport) noexcept
             else
             {
                 // Compute the ratio of elapsed time / allowed time to complete
-                double timeRatio = (SimulationManager::TotalSeconds() - m_moveStartTime) / m_movementMaxTime;
+                double timeRatio = (Clock::Seconds(Clock::Now()) - m_moveStartTime) / m_movementMaxTime;
 
                 // if the current time is passed the max time, just assign final postion
                 // Need to also set the updated view matrix has been read flag because SceneRenderer
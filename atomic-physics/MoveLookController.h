@@ -1,5 +1,6 @@
 #pragma once
 #include "pch.h"
+#include "Clock.h"
 #include "DeviceResources.h"
 #include "Keyboard.h"
 #include "Mouse.h"
@@ -0,0 +1,146 @@
+#include "NeighborList.h"
+#include "PhysicsConstants.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+NeighborList::NeighborList(float cutoff, float skin) noexcept :
+	m_cutoff(std::max(cutoff, 2.0f * Constants::MaxAtomicRadius())),
+	m_skin(skin),
+	m_periodic(false),
+	m_valid(false),
+	m_boxMax({ 0.0f, 0.0f, 0.0f }),
+	m_rebuildCount(0),
+	m_stepsSinceRebuild(0)
+{
+	m_offsets.assign(1, 0);
+}
+
+void NeighborList::SetCutoff(float cutoff) noexcept
+{
+	m_cutoff = std::max(cutoff, 2.0f * Constants::MaxAtomicRadius());
+	Invalidate();
+}
+
+bool NeighborList::Update(const ParticleStore& particles, DirectX::XMFLOAT3 boxMax) noexcept
+{
+	PROFILE_FUNCTION();
+
+	if (NeedsRebuild(particles))
+	{
+		Build(particles, boxMax);
+		return true;
+	}
+
+	++m_stepsSinceRebuild;
+	return false;
+}
+
+bool NeighborList::NeedsRebuild(const ParticleStore& particles) const noexcept
+{
+	PROFILE_FUNCTION();
+
+	unsigned int count = particles.Size();
+	if (!m_valid || m_referenceX.size() != count)
+		return true;
+
+	const float* p_x = particles.PositionX();
+	const float* p_y = particles.PositionY();
+	const float* p_z = particles.PositionZ();
+	const float* r_x = m_referenceX.data();
+	const float* r_y = m_referenceY.data();
+	const float* r_z = m_referenceZ.data();
+
+	float halfSkin = 0.5f * m_skin;
+	float limitSquared = halfSkin * halfSkin;
+
+	// A particle that wrapped around the box has only moved by its minimum image displacement.
+	// Without periodic boundaries the inverse lengths are 0, which leaves the displacement untouched
+	float lengthX = 2.0f * m_boxMax.x, inverseLengthX = m_periodic ? 1.0f / lengthX : 0.0f;
+	float lengthY = 2.0f * m_boxMax.y, inverseLengthY = m_periodic ? 1.0f / lengthY : 0.0f;
+	float lengthZ = 2.0f * m_boxMax.z, inverseLengthZ = m_periodic ? 1.0f / lengthZ : 0.0f;
+
+	std::atomic<bool> exceeded(false);
+	ThreadPool::Get().ParallelFor(0, count, ParticlesPerChunk * 16,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			if (exceeded.load(std::memory_order_relaxed))
+				return;
+
+			// Branch-free max reduction over the chunk so the loop vectorizes
+			float maxSquared = 0.0f;
+			for (unsigned int iii = begin; iii < end; ++iii)
+			{
+				float dx = p_x[iii] - r_x[iii];
+				float dy = p_y[iii] - r_y[iii];
+				float dz = p_z[iii] - r_z[iii];
+				dx -= lengthX * std::nearbyint(dx * inverseLengthX);
+				dy -= lengthY * std::nearbyint(dy * inverseLengthY);
+				dz -= lengthZ * std::nearbyint(dz * inverseLengthZ);
+				float d2 = dx * dx + dy * dy + dz * dz;
+				maxSquared = d2 > maxSquared ? d2 : maxSquared;
+			}
+
+			if (maxSquared > limitSquared)
+				exceeded.store(true, std::memory_order_relaxed);
+		}
+	);
+
+	return exceeded.load(std::memory_order_relaxed);
+}
+
+void NeighborList::Build(const ParticleStore& particles, DirectX::XMFLOAT3 boxMax) noexcept
+{
+	PROFILE_FUNCTION();
+
+	unsigned int count = particles.Size();
+	float radius = ListRadius();
+
+	// Bin the particles with cells at least as large as the list radius
+	m_boxMax = boxMax;
+	m_cellList.Build(particles, boxMax, radius, m_periodic);
+
+	// Pass 1: count the neighbors of each particle
+	m_offsets.assign(count + 1, 0);
+	ThreadPool::Get().ParallelFor(0, count, ParticlesPerChunk,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			for (unsigned int iii = begin; iii < end; ++iii)
+			{
+				unsigned int neighborCount = 0;
+				m_cellList.ForEachNeighbor(particles, iii, radius,
+					[&neighborCount](unsigned int, float, float, float, float) noexcept { ++neighborCount; });
+				m_offsets[iii + 1] = neighborCount;
+			}
+		}
+	);
+
+	// Exclusive prefix sum -> CSR row offsets
+	for (unsigned int iii = 0; iii < count; ++iii)
+		m_offsets[iii + 1] += m_offsets[iii];
+
+	// Pass 2: fill in the neighbor indices
+	m_neighbors.resize(m_offsets[count]);
+	ThreadPool::Get().ParallelFor(0, count, ParticlesPerChunk,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			for (unsigned int iii = begin; iii < end; ++iii)
+			{
+				unsigned int* out = m_neighbors.data() + m_offsets[iii];
+				m_cellList.ForEachNeighbor(particles, iii, radius,
+					[&out](unsigned int j, float, float, float, float) noexcept { *out++ = j; });
+			}
+		}
+	);
+
+	// Remember where every particle was so displacement can be measured against it
+	m_referenceX.assign(particles.PositionX(), particles.PositionX() + count);
+	m_referenceY.assign(particles.PositionY(), particles.PositionY() + count);
+	m_referenceZ.assign(particles.PositionZ(), particles.PositionZ() + count);
+
+	m_valid = true;
+	++m_rebuildCount;
+	m_stepsSinceRebuild = 0;
+}
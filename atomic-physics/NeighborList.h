@@ -0,0 +1,77 @@
+#pragma once
+#include "CorePch.h"
+#include "CellList.h"
+#include "ParticleStore.h"
+
+#include <vector>
+
+// Verlet neighbor lists. Every particle stores the indices of all particles within cutoff + skin of it
+// at the time of the last build. As long as no particle has moved more than skin / 2 since then, no pair
+// can have come within the cutoff without already being in the list, so the lists are only rebuilt once
+// that displacement is exceeded (or when particles are added/removed or the box changes).
+//
+// The lists are stored in compressed sparse row (CSR) form: the neighbors of particle i are
+// Neighbors()[Offsets()[i] ... Offsets()[i + 1]). Lists are full, i.e. each pair appears in both lists.
+class NeighborList
+{
+public:
+	// The cutoff is never allowed to drop below the largest atomic diameter
+	NeighborList(float cutoff = 0.0f, float skin = 0.1f) noexcept;
+	NeighborList(const NeighborList&) = delete;
+	void operator=(const NeighborList&) = delete;
+
+	float GetCutoff() const noexcept { return m_cutoff; }
+	float GetSkin() const noexcept { return m_skin; }
+	float ListRadius() const noexcept { return m_cutoff + m_skin; }
+	void SetCutoff(float cutoff) noexcept;
+	void SetSkin(float skin) noexcept { m_skin = skin; Invalidate(); }
+	// With periodic boundaries pairs are found across the box faces and displacements are minimum images
+	bool IsPeriodic() const noexcept { return m_periodic; }
+	void SetPeriodic(bool periodic) noexcept { m_periodic = periodic; Invalidate(); }
+	// Box used for the most recent build
+	DirectX::XMFLOAT3 GetBoxMax() const noexcept { return m_boxMax; }
+
+	// Rebuild the lists if they may no longer contain every pair within the cutoff. Returns true if rebuilt
+	bool Update(const ParticleStore& particles, DirectX::XMFLOAT3 boxMax) noexcept;
+	bool NeedsRebuild(const ParticleStore& particles) const noexcept;
+	void Build(const ParticleStore& particles, DirectX::XMFLOAT3 boxMax) noexcept;
+	// Force a rebuild on the next Update (e.g. particle indices changed)
+	void Invalidate() noexcept { m_valid = false; }
+
+	unsigned int RebuildCount() const noexcept { return m_rebuildCount; }
+	unsigned int StepsSinceRebuild() const noexcept { return m_stepsSinceRebuild; }
+	size_t TotalNeighbors() const noexcept { return m_neighbors.size(); }
+
+	const unsigned int* NeighborsBegin(unsigned int i) const noexcept { return m_neighbors.data() + m_offsets[i]; }
+	const unsigned int* NeighborsEnd(unsigned int i) const noexcept { return m_neighbors.data() + m_offsets[i + 1]; }
+	unsigned int NeighborCount(unsigned int i) const noexcept { return m_offsets[i + 1] - m_offsets[i]; }
+
+	const std::vector<unsigned int>& Offsets() const noexcept { return m_offsets; }
+	const std::vector<unsigned int>& Neighbors() const noexcept { return m_neighbors; }
+
+	// Cell list used for the most recent build
+	const CellList& GetCellList() const noexcept { return m_cellList; }
+
+private:
+	// Particles handed to each ThreadPool task while building / checking the lists
+	static constexpr unsigned int ParticlesPerChunk = 1024;
+
+	float m_cutoff;
+	float m_skin;
+	bool m_periodic;
+	bool m_valid;
+	DirectX::XMFLOAT3 m_boxMax;
+
+	unsigned int m_rebuildCount;
+	unsigned int m_stepsSinceRebuild;
+
+	CellList m_cellList;
+
+	std::vector<unsigned int> m_offsets;	// ParticleCount + 1 entries
+	std::vector<unsigned int> m_neighbors;
+
+	// Positions at the time of the last build, used to track displacement
+	ParticleStore::AlignedVector<float> m_referenceX;
+	ParticleStore::AlignedVector<float> m_referenceY;
+	ParticleStore::AlignedVector<float> m_referenceZ;
+};
@@ -0,0 +1,468 @@
+#include "ParticleMeshEwald.h"
+#include "PhysicsConstants.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+namespace
+{
+	constexpr float Pi = std::numbers::pi_v<float>;
+
+	unsigned int NextPowerOfTwo(unsigned int value) noexcept
+	{
+		unsigned int power = 1;
+		while (power < value)
+			power *= 2;
+		return power;
+	}
+
+	// Cardinal B-spline weights M_n(w + n - 1 - j) for j = 0 ... n - 1 and their derivatives, where w in [0, 1)
+	// is the fractional part of the scaled coordinate. Follows the recursion from Essmann et al.
+	template<unsigned int Order>
+	void BSplineWeights(float w, float* weights, float* derivatives) noexcept
+	{
+		weights[Order - 1] = 0.0f;
+		weights[1] = w;
+		weights[0] = 1.0f - w;
+
+		auto raiseOrder = [w, weights](unsigned int k) noexcept
+		{
+			float div = 1.0f / static_cast<float>(k - 1);
+			weights[k - 1] = div * w * weights[k - 2];
+			for (unsigned int j = 1; j <= k - 2; ++j)
+				weights[k - j - 1] = div * ((w + j) * weights[k - j - 2] + (k - j - w) * weights[k - j - 1]);
+			weights[0] = div * (1.0f - w) * weights[0];
+		};
+
+		for (unsigned int k = 3; k < Order; ++k)
+			raiseOrder(k);
+
+		// The derivative of an order n spline is the difference of two order n - 1 splines
+		derivatives[0] = -weights[0];
+		for (unsigned int j = 1; j < Order; ++j)
+			derivatives[j] = weights[j - 1] - weights[j];
+
+		raiseOrder(Order);
+	}
+
+	// |b(m)|^2 from Essmann et al. (eq. 4.4) for every m along an axis of 'size' grid points
+	template<unsigned int Order>
+	std::vector<float> BSplineModuli(unsigned int size) noexcept
+	{
+		float weights[Order], derivatives[Order];
+		BSplineWeights<Order>(0.0f, weights, derivatives);
+
+		std::vector<float> moduli(size);
+		for (unsigned int m = 0; m < size; ++m)
+		{
+			double re = 0.0, im = 0.0;
+			for (unsigned int k = 0; k < Order - 1; ++k)
+			{
+				double angle = 2.0 * std::numbers::pi * m * k / size;
+				re += weights[Order - 2 - k] * std::cos(angle);
+				im += weights[Order - 2 - k] * std::sin(angle);
+			}
+			double denominator = re * re + im * im;
+			moduli[m] = denominator > 1.0e-10 ? static_cast<float>(1.0 / denominator) : 0.0f;
+		}
+
+		// The denominator can vanish at m = size / 2 for odd orders. Interpolate from the neighbors instead
+		for (unsigned int m = 0; m < size; ++m)
+		{
+			if (moduli[m] == 0.0f)
+				moduli[m] = 0.5f * (moduli[(m + size - 1) % size] + moduli[(m + 1) % size]);
+		}
+		return moduli;
+	}
+
+	// Smallest alpha with erfc(alpha * cutoff) <= tolerance
+	float EwaldCoefficient(float cutoff, float tolerance) noexcept
+	{
+		double low = 0.0, high = 1.0;
+		while (std::erfc(high * cutoff) > tolerance)
+			high *= 2.0;
+
+		for (unsigned int iii = 0; iii < 60; ++iii)
+		{
+			double mid = 0.5 * (low + high);
+			if (std::erfc(mid * cutoff) > tolerance)
+				low = mid;
+			else
+				high = mid;
+		}
+		return static_cast<float>(high);
+	}
+}
+
+ParticleMeshEwald::ParticleMeshEwald(float gridSpacing, float tolerance) noexcept :
+	m_gridSpacing(gridSpacing),
+	m_tolerance(tolerance),
+	m_boxMax({ 0.0f, 0.0f, 0.0f }),
+	m_cutoff(0.0f),
+	m_alpha(0.0f),
+	m_dirty(true),
+	m_realEnergy(0.0),
+	m_reciprocalEnergy(0.0),
+	m_selfEnergy(0.0)
+{
+}
+
+void ParticleMeshEwald::SetGridSpacing(float spacing) noexcept
+{
+	m_gridSpacing = std::max(spacing, 0.01f);
+	m_dirty = true;
+}
+void ParticleMeshEwald::SetTolerance(float tolerance) noexcept
+{
+	m_tolerance = std::clamp(tolerance, 1.0e-10f, 0.1f);
+	m_dirty = true;
+}
+
+void ParticleMeshEwald::Setup(DirectX::XMFLOAT3 boxMax, float cutoff) noexcept
+{
+	if (!m_dirty && boxMax.x == m_boxMax.x && boxMax.y == m_boxMax.y && boxMax.z == m_boxMax.z && cutoff == m_cutoff)
+		return;
+
+	PROFILE_FUNCTION();
+
+	m_boxMax = boxMax;
+	m_cutoff = cutoff;
+	m_alpha = EwaldCoefficient(cutoff, m_tolerance);
+	m_dirty = false;
+
+	float lengthX = 2.0f * boxMax.x;
+	float lengthY = 2.0f * boxMax.y;
+	float lengthZ = 2.0f * boxMax.z;
+
+	auto gridSize = [this](float length) noexcept
+	{
+		// Clamped before the conversion, a large box over a fine spacing would not fit into an unsigned int
+		float points = std::min(std::ceil(length / m_gridSpacing), static_cast<float>(MaxGridSize));
+		return std::clamp(NextPowerOfTwo(static_cast<unsigned int>(points)), MinGridSize, MaxGridSize);
+	};
+	unsigned int nx = gridSize(lengthX);
+	unsigned int ny = gridSize(lengthY);
+	unsigned int nz = gridSize(lengthZ);
+
+	m_fft.Resize(nx, ny, nz);
+	m_grid.resize(static_cast<size_t>(nx) * ny * nz);
+	m_influence.resize(m_grid.size());
+
+	// Influence function: exp(-pi^2 m^2 / alpha^2) / (pi V m^2) * B(m), with m the reciprocal lattice vector
+	std::vector<float> moduliX = BSplineModuli<SplineOrder>(nx);
+	std::vector<float> moduliY = BSplineModuli<SplineOrder>(ny);
+	std::vector<float> moduliZ = BSplineModuli<SplineOrder>(nz);
+
+	float volume = lengthX * lengthY * lengthZ;
+	float factor = Pi * Pi / (m_alpha * m_alpha);
+
+	ThreadPool::Get().ParallelFor(0, nz, 1,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			for (unsigned int z = begin; z < end; ++z)
+			{
+				float mz = static_cast<float>(z < nz / 2 ? static_cast<int>(z) : static_cast<int>(z) - static_cast<int>(nz)) / lengthZ;
+				for (unsigned int y = 0; y < ny; ++y)
+				{
+					float my = static_cast<float>(y < ny / 2 ? static_cast<int>(y) : static_cast<int>(y) - static_cast<int>(ny)) / lengthY;
+					for (unsigned int x = 0; x < nx; ++x)
+					{
+						float mx = static_cast<float>(x < nx / 2 ? static_cast<int>(x) : static_cast<int>(x) - static_cast<int>(nx)) / lengthX;
+						float m2 = mx * mx + my * my + mz * mz;
+
+						size_t index = (static_cast<size_t>(z) * ny + y) * nx + x;
+						m_influence[index] = m2 == 0.0f ? 0.0f :
+							std::exp(-factor * m2) / (Pi * volume * m2) * moduliX[x] * moduliY[y] * moduliZ[z];
+					}
+				}
+			}
+		}
+	);
+}
+
+void ParticleMeshEwald::Compute(const ParticleStore& particles, const NeighborList& neighborList) noexcept
+{
+	PROFILE_FUNCTION();
+
+	unsigned int count = particles.Size();
+	m_forceX.assign(count, 0.0f);
+	m_forceY.assign(count, 0.0f);
+	m_forceZ.assign(count, 0.0f);
+	m_realEnergy = m_reciprocalEnergy = m_selfEnergy = 0.0;
+
+	if (count == 0)
+		return;
+
+	Setup(neighborList.GetBoxMax(), neighborList.GetCutoff());
+
+	const unsigned int* type = particles.Type();
+	m_charge.resize(count);
+	double totalCharge = 0.0, totalChargeSquared = 0.0;
+	for (unsigned int iii = 0; iii < count; ++iii)
+	{
+		m_charge[iii] = Constants::ParticleCharge(type[iii]);
+		totalCharge += m_charge[iii];
+		totalChargeSquared += m_charge[iii] * m_charge[iii];
+	}
+
+	// Every particle interacts with its own screening charge: -alpha / sqrt(pi) * q^2. A net charge is
+	// neutralized by a uniform background, which adds -pi Q^2 / (2 V alpha^2)
+	double volume = 8.0 * m_boxMax.x * m_boxMax.y * m_boxMax.z;
+	m_selfEnergy = -Constants::CoulombConstant * (m_alpha / std::sqrt(std::numbers::pi) * totalChargeSquared +
+		std::numbers::pi * totalCharge * totalCharge / (2.0 * volume * m_alpha * m_alpha));
+
+	ComputeRealSpace(particles, neighborList);
+	SpreadCharges(particles);
+	SolveReciprocal();
+	InterpolateForces(particles);
+}
+
+void ParticleMeshEwald::ComputeRealSpace(const ParticleStore& particles, const NeighborList& neighborList) noexcept
+{
+	PROFILE_FUNCTION();
+
+	unsigned int count = particles.Size();
+	const float* p_x = particles.PositionX();
+	const float* p_y = particles.PositionY();
+	const float* p_z = particles.PositionZ();
+	const unsigned int* offsets = neighborList.Offsets().data();
+	const unsigned int* neighbors = neighborList.Neighbors().data();
+
+	float lengthX = 2.0f * m_boxMax.x, inverseLengthX = 1.0f / lengthX;
+	float lengthY = 2.0f * m_boxMax.y, inverseLengthY = 1.0f / lengthY;
+	float lengthZ = 2.0f * m_boxMax.z, inverseLengthZ = 1.0f / lengthZ;
+	float cutoff2 = m_cutoff * m_cutoff;
+	float alpha = m_alpha;
+	float alpha2 = alpha * alpha;
+	float gaussianScale = 2.0f * alpha / std::sqrt(Pi);
+
+	m_realEnergyPerParticle.resize(count);
+	ThreadPool::Get().ParallelFor(0, count, ParticlesPerChunk,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			for (unsigned int iii = begin; iii < end; ++iii)
+			{
+				float x = p_x[iii];
+				float y = p_y[iii];
+				float z = p_z[iii];
+
+				float fx = 0.0f, fy = 0.0f, fz = 0.0f, potential = 0.0f;
+				for (unsigned int k = offsets[iii]; k < offsets[iii + 1]; ++k)
+				{
+					unsigned int j = neighbors[k];
+					float dx = x - p_x[j];
+					float dy = y - p_y[j];
+					float dz = z - p_z[j];
+					dx -= lengthX * std::nearbyint(dx * inverseLengthX);
+					dy -= lengthY * std::nearbyint(dy * inverseLengthY);
+					dz -= lengthZ * std::nearbyint(dz * inverseLengthZ);
+					float r2 = dx * dx + dy * dy + dz * dz;
+					if (r2 >= cutoff2 || r2 <= 0.0f)
+						continue;
+
+					float r = std::sqrt(r2);
+					float invR = 1.0f / r;
+					float screened = m_charge[j] * std::erfc(alpha * r) * invR;
+
+					// -d/dr [erfc(alpha r) / r] = erfc(alpha r) / r^2 + 2 alpha / sqrt(pi) exp(-alpha^2 r^2) / r
+					float f = (screened + m_charge[j] * gaussianScale * std::exp(-alpha2 * r2)) * invR * invR;
+					fx += f * dx;
+					fy += f * dy;
+					fz += f * dz;
+					potential += screened;
+				}
+
+				float scale = Constants::CoulombConstant * m_charge[iii];
+				m_forceX[iii] = scale * fx;
+				m_forceY[iii] = scale * fy;
+				m_forceZ[iii] = scale * fz;
+				m_realEnergyPerParticle[iii] = 0.5f * scale * potential;	// each pair is visited from both sides
+			}
+		}
+	);
+
+	double energy = 0.0;
+	for (unsigned int iii = 0; iii < count; ++iii)
+		energy += m_realEnergyPerParticle[iii];
+	m_realEnergy = energy;
+}
+
+void ParticleMeshEwald::SpreadCharges(const ParticleStore& particles) noexcept
+{
+	PROFILE_FUNCTION();
+
+	unsigned int count = particles.Size();
+	unsigned int nx = m_fft.SizeX(), ny = m_fft.SizeY(), nz = m_fft.SizeZ();
+	const float* positions[3] = { particles.PositionX(), particles.PositionY(), particles.PositionZ() };
+	const float boxMax[3] = { m_boxMax.x, m_boxMax.y, m_boxMax.z };
+	const unsigned int gridSize[3] = { nx, ny, nz };
+
+	// 1. B-spline weights for every particle
+	m_splineIndex.resize(static_cast<size_t>(count) * 3);
+	m_splineWeights.resize(static_cast<size_t>(count) * 3 * SplineOrder);
+	m_splineDerivatives.resize(static_cast<size_t>(count) * 3 * SplineOrder);
+
+	ThreadPool::Get().ParallelFor(0, count, ParticlesPerChunk,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			for (unsigned int iii = begin; iii < end; ++iii)
+			{
+				for (unsigned int axis = 0; axis < 3; ++axis)
+				{
+					// Scaled fractional coordinate in [0, gridSize)
+					float u = (positions[axis][iii] + boxMax[axis]) / (2.0f * boxMax[axis]) * gridSize[axis];
+					u -= gridSize[axis] * std::floor(u / gridSize[axis]);
+					int base = static_cast<int>(u);
+					float w = u - base;
+
+					size_t slot = static_cast<size_t>(iii) * 3 + axis;
+					m_splineIndex[slot] = static_cast<unsigned int>((base - static_cast<int>(SplineOrder) + 1 + static_cast<int>(gridSize[axis])) % static_cast<int>(gridSize[axis]));
+					BSplineWeights<SplineOrder>(w, &m_splineWeights[slot * SplineOrder], &m_splineDerivatives[slot * SplineOrder]);
+				}
+			}
+		}
+	);
+
+	// 2. Bucket the particles by the z slab their splines start in. A slab is SplineOrder planes thick, so a
+	//    particle only touches its own slab and the next one and slabs two apart never write the same plane
+	unsigned int slabCount = nz / SplineOrder;
+	m_slabOffsets.assign(slabCount + 1, 0);
+	m_slabParticles.resize(count);
+	for (unsigned int iii = 0; iii < count; ++iii)
+		++m_slabOffsets[m_splineIndex[static_cast<size_t>(iii) * 3 + 2] / SplineOrder + 1];
+	for (unsigned int slab = 0; slab < slabCount; ++slab)
+		m_slabOffsets[slab + 1] += m_slabOffsets[slab];
+	{
+		std::vector<unsigned int> next(m_slabOffsets.begin(), m_slabOffsets.end() - 1);
+		for (unsigned int iii = 0; iii < count; ++iii)
+			m_slabParticles[next[m_splineIndex[static_cast<size_t>(iii) * 3 + 2] / SplineOrder]++] = iii;
+	}
+
+	// 3. Spread the charges. The slab count is even (nz is a power of two >= 2 * SplineOrder), so even and
+	//    odd slabs can each be processed concurrently, even across the periodic wrap
+	std::fill(m_grid.begin(), m_grid.end(), std::complex<float>(0.0f, 0.0f));
+	for (unsigned int parity = 0; parity < 2; ++parity)
+	{
+		ThreadPool::Get().ParallelFor(0, slabCount / 2, 1,
+			[&](unsigned int begin, unsigned int end) noexcept
+			{
+				for (unsigned int half = begin; half < end; ++half)
+				{
+					unsigned int slab = 2 * half + parity;
+					for (unsigned int k = m_slabOffsets[slab]; k < m_slabOffsets[slab + 1]; ++k)
+					{
+						unsigned int iii = m_slabParticles[k];
+						size_t slot = static_cast<size_t>(iii) * 3;
+						const float* wx = &m_splineWeights[slot * SplineOrder];
+						const float* wy = wx + SplineOrder;
+						const float* wz = wy + SplineOrder;
+						float q = m_charge[iii];
+
+						for (unsigned int c = 0; c < SplineOrder; ++c)
+						{
+							unsigned int z = (m_splineIndex[slot + 2] + c) % nz;
+							for (unsigned int b = 0; b < SplineOrder; ++b)
+							{
+								unsigned int y = (m_splineIndex[slot + 1] + b) % ny;
+								std::complex<float>* row = m_grid.data() + (static_cast<size_t>(z) * ny + y) * nx;
+								float qyz = q * wz[c] * wy[b];
+								for (unsigned int a = 0; a < SplineOrder; ++a)
+									row[(m_splineIndex[slot] + a) % nx] += qyz * wx[a];
+							}
+						}
+					}
+				}
+			}
+		);
+	}
+}
+
+void ParticleMeshEwald::SolveReciprocal() noexcept
+{
+	PROFILE_FUNCTION();
+
+	unsigned int nx = m_fft.SizeX(), ny = m_fft.SizeY(), nz = m_fft.SizeZ();
+	size_t planeSize = static_cast<size_t>(nx) * ny;
+
+	m_fft.Forward(m_grid.data());
+
+	// E = 1/2 sum_m C(m) |S(m)|^2. Multiplying by C(m) and transforming back gives the potential on the grid
+	std::vector<double> planeEnergy(nz, 0.0);
+	ThreadPool::Get().ParallelFor(0, nz, 1,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			for (unsigned int z = begin; z < end; ++z)
+			{
+				double energy = 0.0;
+				for (size_t index = z * planeSize; index < (z + 1) * planeSize; ++index)
+				{
+					energy += m_influence[index] * std::norm(m_grid[index]);
+					m_grid[index] *= m_influence[index];
+				}
+				planeEnergy[z] = energy;
+			}
+		}
+	);
+
+	double energy = 0.0;
+	for (double e : planeEnergy)
+		energy += e;
+	m_reciprocalEnergy = 0.5 * Constants::CoulombConstant * energy;
+
+	m_fft.Inverse(m_grid.data());
+}
+
+void ParticleMeshEwald::InterpolateForces(const ParticleStore& particles) noexcept
+{
+	PROFILE_FUNCTION();
+
+	unsigned int count = particles.Size();
+	unsigned int nx = m_fft.SizeX(), ny = m_fft.SizeY(), nz = m_fft.SizeZ();
+
+	// d/dx = d/du * gridSize / length
+	float scaleX = nx / (2.0f * m_boxMax.x);
+	float scaleY = ny / (2.0f * m_boxMax.y);
+	float scaleZ = nz / (2.0f * m_boxMax.z);
+
+	ThreadPool::Get().ParallelFor(0, count, ParticlesPerChunk,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			for (unsigned int iii = begin; iii < end; ++iii)
+			{
+				size_t slot = static_cast<size_t>(iii) * 3;
+				const float* wx = &m_splineWeights[slot * SplineOrder];
+				const float* wy = wx + SplineOrder;
+				const float* wz = wy + SplineOrder;
+				const float* dx = &m_splineDerivatives[slot * SplineOrder];
+				const float* dy = dx + SplineOrder;
+				const float* dz = dy + SplineOrder;
+
+				float gx = 0.0f, gy = 0.0f, gz = 0.0f;
+				for (unsigned int c = 0; c < SplineOrder; ++c)
+				{
+					unsigned int z = (m_splineIndex[slot + 2] + c) % nz;
+					for (unsigned int b = 0; b < SplineOrder; ++b)
+					{
+						unsigned int y = (m_splineIndex[slot + 1] + b) % ny;
+						const std::complex<float>* row = m_grid.data() + (static_cast<size_t>(z) * ny + y) * nx;
+						for (unsigned int a = 0; a < SplineOrder; ++a)
+						{
+							float potential = row[(m_splineIndex[slot] + a) % nx].real();
+							gx += dx[a] * wy[b] * wz[c] * potential;
+							gy += wx[a] * dy[b] * wz[c] * potential;
+							gz += wx[a] * wy[b] * dz[c] * potential;
+						}
+					}
+				}
+
+				// F = -dE/dr, and E is quadratic in the charges so the factor 1/2 cancels
+				float scale = -Constants::CoulombConstant * m_charge[iii];
+				m_forceX[iii] += scale * scaleX * gx;
+				m_forceY[iii] += scale * scaleY * gy;
+				m_forceZ[iii] += scale * scaleZ * gz;
+			}
+		}
+	);
+}
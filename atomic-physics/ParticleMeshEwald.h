@@ -0,0 +1,97 @@
+#pragma once
+#include "CorePch.h"
+#include "FFT.h"
+#include "NeighborList.h"
+#include "ParticleStore.h"
+
+#include <complex>
+#include <vector>
+
+// Smooth particle-mesh Ewald (Essmann et al., J. Chem. Phys. 1995, 103, 8577) for the Coulomb interaction
+// between all charges and all of their periodic images. The simulation box is the unit cell.
+//
+// The 1/r potential is split into a short-range part erfc(alpha r) / r, summed over the neighbor lists up to
+// their cutoff, and a smooth long-range part that is solved on a grid: the charges are spread onto the grid
+// with B-splines, convolved with the reciprocal-space influence function using FFTs, and the resulting
+// potential is interpolated back onto the particles. alpha is picked so that erfc(alpha * cutoff) equals the
+// tolerance, and the grid is sized from the box so that its spacing is at most 'gridSpacing', up to
+// MaxGridSize points per axis.
+//
+// The neighbor list cutoff must not exceed half of the smallest box length.
+class ParticleMeshEwald
+{
+public:
+	ParticleMeshEwald(float gridSpacing = 0.1f, float tolerance = 1.0e-5f) noexcept;
+	ParticleMeshEwald(const ParticleMeshEwald&) = delete;
+	void operator=(const ParticleMeshEwald&) = delete;
+
+	float GetGridSpacing() const noexcept { return m_gridSpacing; }
+	void SetGridSpacing(float spacing) noexcept;
+	float GetTolerance() const noexcept { return m_tolerance; }
+	void SetTolerance(float tolerance) noexcept;
+
+	// Evaluate the force on every particle. The box and the real-space cutoff are taken from the neighbor list
+	void Compute(const ParticleStore& particles, const NeighborList& neighborList) noexcept;
+
+	const float* ForceX() const noexcept { return m_forceX.data(); }
+	const float* ForceY() const noexcept { return m_forceY.data(); }
+	const float* ForceZ() const noexcept { return m_forceZ.data(); }
+
+	// Energies from the last Compute (kcal/mol)
+	double PotentialEnergy() const noexcept { return m_realEnergy + m_reciprocalEnergy + m_selfEnergy; }
+	double RealSpaceEnergy() const noexcept { return m_realEnergy; }
+	double ReciprocalEnergy() const noexcept { return m_reciprocalEnergy; }
+	// Self interaction correction, plus the neutralizing background correction for a net charge
+	double SelfEnergy() const noexcept { return m_selfEnergy; }
+
+	float Alpha() const noexcept { return m_alpha; }
+	unsigned int GridSizeX() const noexcept { return m_fft.SizeX(); }
+	unsigned int GridSizeY() const noexcept { return m_fft.SizeY(); }
+	unsigned int GridSizeZ() const noexcept { return m_fft.SizeZ(); }
+
+private:
+	void Setup(DirectX::XMFLOAT3 boxMax, float cutoff) noexcept;
+	void ComputeRealSpace(const ParticleStore& particles, const NeighborList& neighborList) noexcept;
+	void SpreadCharges(const ParticleStore& particles) noexcept;
+	void SolveReciprocal() noexcept;
+	void InterpolateForces(const ParticleStore& particles) noexcept;
+
+	// Cubic B-splines. The slabs used to spread charges in parallel are SplineOrder grid planes thick
+	static constexpr unsigned int SplineOrder = 4;
+	static constexpr unsigned int MinGridSize = 2 * SplineOrder;
+	// 256^3 points are 128 MB of complex grid. Larger boxes get a coarser spacing than asked for
+	static constexpr unsigned int MaxGridSize = 256;
+	static constexpr unsigned int ParticlesPerChunk = 1024;
+
+	float m_gridSpacing;
+	float m_tolerance;
+
+	// Parameters the grid / influence function were last built for
+	DirectX::XMFLOAT3 m_boxMax;
+	float m_cutoff;
+	float m_alpha;
+	bool m_dirty;
+
+	FFT3D m_fft;
+	std::vector<std::complex<float>> m_grid;
+	std::vector<float> m_influence;		// reciprocal-space convolution factor for each grid point
+
+	// Per particle spline data: first grid index and the weights / derivatives along each axis
+	std::vector<unsigned int> m_splineIndex;	// 3 per particle
+	std::vector<float> m_splineWeights;			// 3 * SplineOrder per particle
+	std::vector<float> m_splineDerivatives;		// 3 * SplineOrder per particle
+
+	// Particles bucketed by z slab (CSR) so that slabs two apart can be spread concurrently
+	std::vector<unsigned int> m_slabOffsets;
+	std::vector<unsigned int> m_slabParticles;
+
+	ParticleStore::AlignedVector<float> m_charge;
+	ParticleStore::AlignedVector<float> m_forceX;
+	ParticleStore::AlignedVector<float> m_forceY;
+	ParticleStore::AlignedVector<float> m_forceZ;
+	ParticleStore::AlignedVector<float> m_realEnergyPerParticle;
+
+	double m_realEnergy;
+	double m_reciprocalEnergy;
+	double m_selfEnergy;
+};
@@ -0,0 +1,129 @@
+#include "ParticleStore.h"
+
+void ParticleStore::Reserve(unsigned int count) noexcept
+{
+	m_type.reserve(count);
+	m_mass.reserve(count);
+	m_positionX.reserve(count);
+	m_positionY.reserve(count);
+	m_positionZ.reserve(count);
+	m_velocityX.reserve(count);
+	m_velocityY.reserve(count);
+	m_velocityZ.reserve(count);
+	m_handle.reserve(count);
+	m_slots.reserve(count);
+}
+
+void ParticleStore::Clear() noexcept
+{
+	m_type.clear();
+	m_mass.clear();
+	m_positionX.clear();
+	m_positionY.clear();
+	m_positionZ.clear();
+	m_velocityX.clear();
+	m_velocityY.clear();
+	m_velocityZ.clear();
+
+	// Retire every handle that is still in use so none of them refers to a particle added later
+	for (const ParticleHandle& handle : m_handle)
+	{
+		Slot& slot = m_slots[handle.index];
+		++slot.generation;
+		slot.position = m_freeSlot;
+		m_freeSlot = handle.index;
+	}
+	m_handle.clear();
+}
+
+void ParticleStore::CopyFrom(const ParticleStore& other) noexcept
+{
+	m_type.assign(other.m_type.begin(), other.m_type.end());
+	m_mass.assign(other.m_mass.begin(), other.m_mass.end());
+	m_positionX.assign(other.m_positionX.begin(), other.m_positionX.end());
+	m_positionY.assign(other.m_positionY.begin(), other.m_positionY.end());
+	m_positionZ.assign(other.m_positionZ.begin(), other.m_positionZ.end());
+	m_velocityX.assign(other.m_velocityX.begin(), other.m_velocityX.end());
+	m_velocityY.assign(other.m_velocityY.begin(), other.m_velocityY.end());
+	m_velocityZ.assign(other.m_velocityZ.begin(), other.m_velocityZ.end());
+	m_handle.assign(other.m_handle.begin(), other.m_handle.end());
+	m_slots.assign(other.m_slots.begin(), other.m_slots.end());
+	m_freeSlot = other.m_freeSlot;
+}
+
+ParticleRef ParticleStore::PushBack(const Particle& particle) noexcept
+{
+	m_type.push_back(particle.type);
+	m_mass.push_back(particle.mass);
+	m_positionX.push_back(particle.p_x);
+	m_positionY.push_back(particle.p_y);
+	m_positionZ.push_back(particle.p_z);
+	m_velocityX.push_back(particle.v_x);
+	m_velocityY.push_back(particle.v_y);
+	m_velocityZ.push_back(particle.v_z);
+
+	unsigned int position = Size() - 1;
+	unsigned int slotIndex = m_freeSlot;
+	if (slotIndex == NoSlot)
+	{
+		slotIndex = static_cast<unsigned int>(m_slots.size());
+		m_slots.push_back({ position, 0 });
+	}
+	else
+	{
+		m_freeSlot = m_slots[slotIndex].position;
+		m_slots[slotIndex].position = position;
+	}
+	m_handle.push_back({ slotIndex, m_slots[slotIndex].generation });
+
+	return (*this)[position];
+}
+
+void ParticleStore::Erase(unsigned int index) noexcept
+{
+	unsigned int last = Size() - 1;
+
+	// Retire the removed particle's handle
+	unsigned int removedSlot = m_handle[index].index;
+	++m_slots[removedSlot].generation;
+	m_slots[removedSlot].position = m_freeSlot;
+	m_freeSlot = removedSlot;
+
+	if (index != last)
+	{
+		m_type[index] = m_type[last];
+		m_mass[index] = m_mass[last];
+		m_positionX[index] = m_positionX[last];
+		m_positionY[index] = m_positionY[last];
+		m_positionZ[index] = m_positionZ[last];
+		m_velocityX[index] = m_velocityX[last];
+		m_velocityY[index] = m_velocityY[last];
+		m_velocityZ[index] = m_velocityZ[last];
+		m_handle[index] = m_handle[last];
+		m_slots[m_handle[index].index].position = index;
+	}
+
+	m_type.pop_back();
+	m_mass.pop_back();
+	m_positionX.pop_back();
+	m_positionY.pop_back();
+	m_positionZ.pop_back();
+	m_velocityX.pop_back();
+	m_velocityY.pop_back();
+	m_velocityZ.pop_back();
+	m_handle.pop_back();
+}
+
+ParticleRef ParticleStore::operator[](unsigned int index) noexcept
+{
+	return { m_type[index], m_mass[index],
+			 m_positionX[index], m_positionY[index], m_positionZ[index],
+			 m_velocityX[index], m_velocityY[index], m_velocityZ[index] };
+}
+
+ConstParticleRef ParticleStore::operator[](unsigned int index) const noexcept
+{
+	return { m_type[index], m_mass[index],
+			 m_positionX[index], m_positionY[index], m_positionZ[index],
+			 m_velocityX[index], m_velocityY[index], m_velocityZ[index] };
+}
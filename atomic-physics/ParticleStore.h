@@ -0,0 +1,138 @@
+#pragma once
+#include "CorePch.h"
+#include "AlignedAllocator.h"
+
+#include <type_traits>
+#include <vector>
+
+struct Particle
+{
+	unsigned int type; // 0 --> electron, N > 0 --> element number (number of protons)
+	unsigned int mass; // [only for non-electron] #Proton + #Neutron
+	float p_x;		   // Position
+	float p_y;
+	float p_z;
+	float v_x;	       // Velocity
+	float v_y;
+	float v_z;
+};
+
+// Stable reference to a particle in a ParticleStore. Particles move around inside the store when others are
+// removed, but a handle keeps referring to the same particle until that particle itself is removed. Every
+// slot of the handle table carries a generation that is bumped when its particle is removed, so a handle to
+// a removed particle is detected instead of silently referring to whichever particle reuses the slot
+struct ParticleHandle
+{
+	unsigned int index = ~0u;		// slot in the store's handle table
+	unsigned int generation = 0;
+
+	bool operator==(const ParticleHandle& other) const noexcept { return index == other.index && generation == other.generation; }
+	bool operator!=(const ParticleHandle& other) const noexcept { return !(*this == other); }
+};
+
+// Lightweight AoS-style view of a single particle that lives in a ParticleStore. Each member is a
+// reference into one of the store's columns, so reading/writing 'p.p_x' works the same as it did
+// when the particles were stored as std::vector<Particle>.
+// NOTE: A ParticleRef is invalidated by any operation that adds or removes particles. Hold on to a
+//       ParticleHandle instead
+template<bool IsConst>
+struct BasicParticleRef
+{
+	using UIntType = std::conditional_t<IsConst, const unsigned int, unsigned int>;
+	using FloatType = std::conditional_t<IsConst, const float, float>;
+
+	UIntType& type;
+	UIntType& mass;
+	FloatType& p_x;
+	FloatType& p_y;
+	FloatType& p_z;
+	FloatType& v_x;
+	FloatType& v_y;
+	FloatType& v_z;
+
+	operator Particle() const noexcept { return { type, mass, p_x, p_y, p_z, v_x, v_y, v_z }; }
+};
+
+using ParticleRef = BasicParticleRef<false>;
+using ConstParticleRef = BasicParticleRef<true>;
+
+// Columnar (structure-of-arrays) particle storage. Every attribute is held in its own 64-byte aligned
+// array so that the physics loops only pull in the data they actually touch and can be vectorized.
+// The arrays are kept dense: removing a particle moves the last one into its place (swap-and-pop), so
+// removal is O(1) but does not preserve the order of the particles. A slot map translates the stable
+// ParticleHandles into the current indices.
+class ParticleStore
+{
+public:
+	template<typename T>
+	using AlignedVector = std::vector<T, AlignedAllocator<T, 64>>;
+
+	ParticleStore() noexcept = default;
+	ParticleStore(const ParticleStore&) = delete;
+	void operator=(const ParticleStore&) = delete;
+
+	unsigned int Size() const noexcept { return static_cast<unsigned int>(m_type.size()); }
+	bool Empty() const noexcept { return m_type.empty(); }
+	unsigned int Capacity() const noexcept { return static_cast<unsigned int>(m_type.capacity()); }
+	void Reserve(unsigned int count) noexcept;
+	void Clear() noexcept;
+	// Copy every particle of 'other'. Reuses the existing allocations, so repeated copies of a store that
+	// doesn't grow don't allocate
+	void CopyFrom(const ParticleStore& other) noexcept;
+
+	ParticleRef PushBack(const Particle& particle) noexcept;
+	// Remove the particle at 'index' and move the last particle into its place
+	void Erase(unsigned int index) noexcept;
+
+	// Handles
+	// Number of handle slots, every handle's index is below it
+	unsigned int SlotCount() const noexcept { return static_cast<unsigned int>(m_slots.size()); }
+	ParticleHandle Handle(unsigned int index) const noexcept { return m_handle[index]; }
+	bool Contains(ParticleHandle handle) const noexcept { return handle.index < m_slots.size() && m_slots[handle.index].generation == handle.generation; }
+	// Current index of a particle; the handle must refer to a particle that is still in the store
+	unsigned int IndexOf(ParticleHandle handle) const noexcept { return m_slots[handle.index].position; }
+
+	ParticleRef operator[](unsigned int index) noexcept;
+	ConstParticleRef operator[](unsigned int index) const noexcept;
+
+	// Raw column access for the hot loops
+	unsigned int* Type() noexcept { return m_type.data(); }
+	unsigned int* Mass() noexcept { return m_mass.data(); }
+	float* PositionX() noexcept { return m_positionX.data(); }
+	float* PositionY() noexcept { return m_positionY.data(); }
+	float* PositionZ() noexcept { return m_positionZ.data(); }
+	float* VelocityX() noexcept { return m_velocityX.data(); }
+	float* VelocityY() noexcept { return m_velocityY.data(); }
+	float* VelocityZ() noexcept { return m_velocityZ.data(); }
+
+	const unsigned int* Type() const noexcept { return m_type.data(); }
+	const unsigned int* Mass() const noexcept { return m_mass.data(); }
+	const float* PositionX() const noexcept { return m_positionX.data(); }
+	const float* PositionY() const noexcept { return m_positionY.data(); }
+	const float* PositionZ() const noexcept { return m_positionZ.data(); }
+	const float* VelocityX() const noexcept { return m_velocityX.data(); }
+	const float* VelocityY() const noexcept { return m_velocityY.data(); }
+	const float* VelocityZ() const noexcept { return m_velocityZ.data(); }
+
+private:
+	// An occupied slot holds the index of its particle, a free slot the next free slot
+	struct Slot
+	{
+		unsigned int position;
+		unsigned int generation;
+	};
+	static constexpr unsigned int NoSlot = ~0u;
+
+	AlignedVector<unsigned int> m_type;
+	AlignedVector<unsigned int> m_mass;
+	AlignedVector<float> m_positionX;
+	AlignedVector<float> m_positionY;
+	AlignedVector<float> m_positionZ;
+	AlignedVector<float> m_velocityX;
+	AlignedVector<float> m_velocityY;
+	AlignedVector<float> m_velocityZ;
+
+	std::vector<ParticleHandle> m_handle;	// handle of each particle
+	std::vector<Slot> m_slots;
+	unsigned int m_freeSlot = NoSlot;		// head of the free list threaded through m_slots
+};
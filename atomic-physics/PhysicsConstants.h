@@ -5,7 +5,7 @@ namespace Constants
 {
 	// Default radius for every element (all values in nanometers)
 	// Values taken from here: https://en.wikipedia.org/wiki/Atomic_radii_of_the_elements_(data_page)
-	const float AtomicRadii[11] = {
+	constexpr float AtomicRadii[11] = {
 		0.0f,	// Invalid value to take up the 0 index spot
 		0.025f,	// Hydrogen
 		0.120f,	// Helium
@@ -19,6 +19,54 @@ namespace Constants
 		0.160f  // Neon
 	};
 
+	// Lennard-Jones well depth for every element (all values in kcal/mol)
+	// Values taken from the Universal Force Field (Rappe et al., J. Am. Chem. Soc. 1992, 114, 10024)
+	// Electrons do not take part in Lennard-Jones interactions
+	constexpr float LennardJonesEpsilon[11] = {
+		0.0f,	// Electron
+		0.044f,	// Hydrogen
+		0.056f,	// Helium
+		0.025f,	// Lithium
+		0.085f, // Beryllium
+		0.180f, // Boron
+		0.105f, // Carbon
+		0.069f, // Nitrogen
+		0.060f, // Oxygen
+		0.050f, // Flourine
+		0.042f  // Neon
+	};
+
+	// Converts a force in kcal/mol/nm acting on a mass in amu into an acceleration in nm/ps^2
+	// (the simulation treats one second of simulation time as one picosecond)
+	constexpr float ForceToAcceleration = 4.184f;
+
+	// Coulomb constant in kcal/mol * nm / e^2
+	constexpr float CoulombConstant = 33.20637f;
+
+	// Electron mass in amu. The mass column only holds whole amu, so electrons (type 0) are always given this
+	constexpr float ElectronMass = 5.48579909e-4f;
+
+	// Mass in amu that forces act on. Nuclei with a mass of 0 are left untouched
+	constexpr float InertialMass(unsigned int type, unsigned int mass) noexcept
+	{
+		return type == 0 ? ElectronMass : static_cast<float>(mass);
+	}
+
+	// Electrons (type 0) carry a charge of -1, nuclei a charge equal to their element number (units of e)
+	constexpr float ParticleCharge(unsigned int type) noexcept
+	{
+		return type == 0 ? -1.0f : static_cast<float>(type);
+	}
+
+	// Largest entry in AtomicRadii - used to size spatial acceleration structures
+	constexpr float MaxAtomicRadius() noexcept
+	{
+		float maxRadius = 0.0f;
+		for (float radius : AtomicRadii)
+			maxRadius = radius > maxRadius ? radius : maxRadius;
+		return maxRadius;
+	}
+
 	// Create a constant for the radius to use when rendering in the Ball & Stick state
 	// The value is half that of the Hydrogen radius
 	//const float BallAndStickAtomRadius = 0.0125f;
@@ -1,13 +1,34 @@
 #include "Profile.h"
 
+#ifdef PROFILE
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi")
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
 // -----------------------------------------------------------------------
 // Instrumentor
 // -----------------------------------------------------------------------
 
 std::string Instrumentor::SessionName() const noexcept
 {
-	if (m_currentSession != nullptr)
-		return m_currentSession->name;
+	if (SessionIsActive())
+		return m_sessionName;
 
 	return "";
 }
@@ -25,10 +46,9 @@ void Instrumentor::CaptureFrames(unsigned int frameCount, const std::string& nam
 
 void Instrumentor::CaptureSeconds(unsigned int seconds, const std::string& name, const std::string& filepath) noexcept
 {
+	// The seconds are counted from the start of the session, which may have to wait for the previous writer
 	m_capturingSeconds = true;
-
-	m_capturingEndTime = std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now()).time_since_epoch().count();
-	m_capturingEndTime += (1000 * seconds);
+	m_secondsToCapture = seconds;
 
 	m_name = name;
 	m_filepath = filepath;
@@ -36,6 +56,27 @@ void Instrumentor::CaptureSeconds(unsigned int seconds, const std::string& name,
 
 void Instrumentor::NotifyNextFrame() noexcept
 {
+	if (LiveStatisticsEnabled())
+	{
+		// Keep the scopes that ran entirely within the frame that just ended
+		int64_t now = Now();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		CollectLocked();
+
+		// Scopes that ended after 'now' belong to the next frame
+		m_lastFrameRecords.clear();
+		std::erase_if(m_frameRecords, [this, now](const TraceRecord& record) {
+			if (record.end > now)
+				return false;
+			if (record.start >= m_frameStart)
+				m_lastFrameRecords.push_back(record);
+			return true;
+		});
+		m_lastFrameStart = m_frameStart;
+		m_lastFrameEnd = now;
+		m_frameStart = now;
+	}
+
 	if (SessionIsActive())
 	{
 		// If we are capturing frames, see if we need to end the session
@@ -51,8 +92,7 @@ void Instrumentor::NotifyNextFrame() noexcept
 		}
 		else if (m_capturingSeconds)
 		{
-			long long current = std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now()).time_since_epoch().count();
-			if (current > m_capturingEndTime)
+			if (Now() > m_capturingEndTime)
 			{
 				m_capturingSeconds = false;
 				EndSession();
@@ -61,115 +101,437 @@ void Instrumentor::NotifyNextFrame() noexcept
 	}
 	else if (m_capturingFrames || m_capturingSeconds)
 	{
-		// If there is no active session, but we need to start capturing frames, begin a new session
-		BeginSession();
+		// If there is no active session, but we need to start capturing frames, begin a new session. While the
+		// trace of the previous session is still being written this is refused, so try again next frame
+		if (BeginSession() && m_capturingSeconds)
+			m_capturingEndTime = Now() + 1000000000ll * m_secondsToCapture;
 	}
 }
 
-void Instrumentor::BeginSession() noexcept
+bool Instrumentor::BeginSession() noexcept
 {
-	m_dataCount = 0;
-	m_filepath = m_filepath;
-	m_currentSession = new InstrumentationSession{ m_name };
+	return BeginSession(m_name, m_filepath);
 }
-void Instrumentor::BeginSession(const std::string& name, std::string filepath) noexcept
+bool Instrumentor::BeginSession(const std::string& name, std::string filepath) noexcept
 {
-	m_dataCount = 0;
+	// The writer of the previous session may still be converting its trace. Waiting for it here would stall
+	// the calling thread, usually the main thread, for the whole conversion, so refuse instead
+	EndSession();
+	if (IsWriting())
+		return false;
+	WaitForWriter();	// only joins the thread, which is done
+
+	{
+		// Anything left in the buffers was recorded before the session, at most for the statistics
+		std::lock_guard<std::mutex> lock(m_mutex);
+		CollectLocked();
+		for (const std::unique_ptr<ProfileRingBuffer>& buffer : m_buffers)
+			buffer->Discard();
+		m_collectForWriter = true;
+	}
+
+	m_sessionName = name;
 	m_filepath = filepath;
-	m_currentSession = new InstrumentationSession{ name };
+	m_sessionStart = Now();
+	m_stopWriter = false;
+	m_writing.store(true, std::memory_order_release);
+	m_writer = std::thread(&Instrumentor::WriterLoop, this, filepath + ".bin", filepath);
+	m_sessionActive.store(true, std::memory_order_release);
+	UpdateRecording();
+	return true;
 }
 
 void Instrumentor::EndSession() noexcept
 {
-	std::ofstream outFile(m_filepath);
+	if (!SessionIsActive())
+		return;
 
-	// Header
-	outFile << "{\"otherData\": {},\"traceEvents\":[";
+	// Scopes that are still open when the session ends are not recorded. The writer drains what is left
+	// and writes the JSON trace on its own time
+	m_sessionActive.store(false, std::memory_order_release);
+	UpdateRecording();
+	{
+		std::lock_guard<std::mutex> lock(m_writerMutex);
+		m_stopWriter = true;
+	}
+	m_writerCondition.notify_one();
+}
+
+void Instrumentor::WaitForWriter() noexcept
+{
+	if (m_writer.joinable())
+		m_writer.join();
+}
+
+void Instrumentor::WriterLoop(std::string binaryPath, std::string jsonPath) noexcept
+{
+	std::ofstream file(binaryPath, std::ios::binary);
+
+	TraceHeader header = {};
+	std::copy(std::begin(TraceMagic), std::end(TraceMagic), header.magic);
+	header.sessionStart = m_sessionStart;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
 
-	// Data
-	for (unsigned int iii = 0; iii < m_dataCount; ++iii)
+	// Drain often enough that a busy thread doesn't fill its ring in between
+	std::vector<TraceRecord> records;
+	uint64_t recordCount = 0;
+	bool stop = false;
+	while (!stop)
 	{
-		if (iii != 0)
-			outFile << ",";
-
-		outFile << "{";
-		outFile << "\"cat\":\"function\",";
-		outFile << "\"dur\":" << (m_data[iii].end - m_data[iii].start) << ",";
-		outFile << "\"name\":\"" << m_data[iii].name << "\",";
-		outFile << "\"ph\":\"X\",";
-		outFile << "\"pid\":0,";
-		outFile << "\"tid\":" << m_data[iii].threadID << ",";
-		outFile << "\"ts\":" << m_data[iii].start;
-		outFile << "}";
+		{
+			std::unique_lock<std::mutex> lock(m_writerMutex);
+			m_writerCondition.wait_for(lock, WriterInterval, [this]() { return m_stopWriter; });
+			stop = m_stopWriter;
+		}
+
+		{
+			// The main thread may have collected some of the records already for the statistics
+			std::lock_guard<std::mutex> lock(m_mutex);
+			CollectLocked();
+			records.swap(m_pendingRecords);
+			if (stop)
+				m_collectForWriter = false;
+		}
+
+		// Write outside of the lock so that threads recording for the first time don't wait on the disk
+		file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(TraceRecord));
+		recordCount += records.size();
+		records.clear();
 	}
 
-	// Footer
-	outFile << "]}";
+	TraceFooter footer = {};
+	footer.recordCount = recordCount;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const std::unique_ptr<ProfileRingBuffer>& buffer : m_buffers)
+			footer.droppedCount += buffer->DroppedCount();
 
-	outFile.close();
+		footer.nameCount = static_cast<uint32_t>(m_names.size());
+		for (size_t iii = 0; iii < m_names.size(); ++iii)
+		{
+			uint32_t length = static_cast<uint32_t>(std::strlen(m_names[iii]));
+			uint8_t counter = m_counterNames[iii] ? 1 : 0;
+			file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+			file.write(m_names[iii], length);
+			file.write(reinterpret_cast<const char*>(&counter), sizeof(counter));
+		}
+	}
+	file.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+	file.close();
 
-	delete m_currentSession;
-	m_currentSession = nullptr;
+	ConvertTrace(binaryPath, jsonPath);
+	m_writing.store(false, std::memory_order_release);
 }
 
-void Instrumentor::WriteProfile(const std::string& name, long long start, long long end, uint32_t threadID) noexcept
+void Instrumentor::CollectLocked() noexcept
 {
-	if (m_dataCount < 999999)
+	bool statistics = LiveStatisticsEnabled();
+	if (statistics && m_statistics.size() < m_names.size())
+		m_statistics.resize(m_names.size());
+
+	for (const std::unique_ptr<ProfileRingBuffer>& buffer : m_buffers)
 	{
-		m_data[m_dataCount].name = name;
-		m_data[m_dataCount].start = start;
-		m_data[m_dataCount].end = end;
-		m_data[m_dataCount].threadID = threadID;
+		uint32_t threadID = buffer->ThreadID();
+		buffer->Drain([this, statistics, threadID](const ProfileRecord& record) {
+			TraceRecord traceRecord = { record.start, record.end, record.nameID, threadID, record.counters };
+			if (m_collectForWriter)
+				m_pendingRecords.push_back(traceRecord);
 
-		++m_dataCount;
+			if (statistics && !m_counterNames[record.nameID])
+			{
+				int64_t duration = record.end - record.start;
+				ScopeStatistics& scope = m_statistics[record.nameID];
+				++scope.count;
+				scope.total += duration;
+				scope.min = std::min(scope.min, duration);
+				scope.max = std::max(scope.max, duration);
+				scope.durations.Add(static_cast<double>(duration));
+				if (record.counters.cycles != 0)
+				{
+					++scope.countedCount;
+					scope.counters.cycles += record.counters.cycles;
+					scope.counters.instructions += record.counters.instructions;
+					scope.counters.cacheMisses += record.counters.cacheMisses;
+					scope.counters.branchMisses += record.counters.branchMisses;
+				}
+
+				if (m_frameRecords.size() < MaxFrameRecords)
+					m_frameRecords.push_back(traceRecord);
+			}
+		});
 	}
 }
 
-// -----------------------------------------------------------------------
-// InstrumentationTimer
-// -----------------------------------------------------------------------
+void Instrumentor::SetLiveStatistics(bool enabled) noexcept
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_liveStatistics.store(enabled, std::memory_order_relaxed);
+	UpdateRecording();
+
+	m_frameRecords.clear();
+	m_lastFrameRecords.clear();
+	m_frameStart = Now();
+}
+
+void Instrumentor::ResetStatistics() noexcept
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_statistics.clear();
+}
+
+void Instrumentor::GetStatistics(std::vector<ScopeSummary>& summaries) noexcept
+{
+	constexpr double Milliseconds = 1.0e-6;
+
+	summaries.clear();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (size_t iii = 0; iii < m_statistics.size(); ++iii)
+	{
+		const ScopeStatistics& scope = m_statistics[iii];
+		if (scope.count == 0)
+			continue;
+
+		double perCall = scope.countedCount != 0 ? 1.0 / scope.countedCount : 0.0;
+
+		summaries.push_back({
+			m_names[iii],
+			scope.count,
+			scope.total * Milliseconds,
+			scope.total * Milliseconds / scope.count,
+			scope.min * Milliseconds,
+			scope.max * Milliseconds,
+			scope.durations.Quantile(0.50) * Milliseconds,
+			scope.durations.Quantile(0.95) * Milliseconds,
+			scope.durations.Quantile(0.99) * Milliseconds,
+			scope.counters.cycles * perCall,
+			scope.counters.instructions * perCall,
+			scope.counters.cacheMisses * perCall,
+			scope.counters.branchMisses * perCall
+		});
+	}
+}
+
+bool Instrumentor::ConvertTrace(const std::string& binaryPath, const std::string& jsonPath) noexcept
+{
+	std::ifstream in(binaryPath, std::ios::binary);
+	TraceHeader header = {};
+	TraceFooter footer = {};
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || !std::equal(std::begin(TraceMagic), std::end(TraceMagic), header.magic))
+		return false;
+	if (!in.seekg(-static_cast<std::streamoff>(sizeof(footer)), std::ios::end) || !in.read(reinterpret_cast<char*>(&footer), sizeof(footer)))
+		return false;
+
+	// The name table follows the records
+	std::vector<std::string> names(footer.nameCount);
+	std::vector<uint8_t> counterNames(footer.nameCount);
+	in.seekg(sizeof(header) + footer.recordCount * sizeof(TraceRecord));
+	for (uint32_t iii = 0; iii < footer.nameCount; ++iii)
+	{
+		uint32_t length = 0;
+		in.read(reinterpret_cast<char*>(&length), sizeof(length));
+		names[iii].resize(length);
+		in.read(names[iii].data(), length);
+		in.read(reinterpret_cast<char*>(&counterNames[iii]), sizeof(uint8_t));
+	}
+	if (!in)
+		return false;
+
+	std::ofstream out(jsonPath);
+	if (!out)
+		return false;
+
+	// Header. Records that didn't fit into a full buffer are reported so that a gap in the trace is explained
+	out << "{\"otherData\": {\"droppedRecords\":" << footer.droppedCount << "},\"traceEvents\":[";
+
+	// Data - times in microseconds since the start of the session. Records are converted in chunks and
+	// formatted into one string per chunk, so the JSON of a long capture is written at disk speed
+	constexpr uint64_t ChunkSize = 1 << 16;
+	std::vector<TraceRecord> records(ChunkSize);
+	std::string text;
+	char number[32];
+	auto appendMicroseconds = [&text, &number](int64_t nanoseconds) {
+		int length = std::snprintf(number, sizeof(number), "%.3f", nanoseconds * 0.001);
+		text.append(number, length);
+	};
 
-InstrumentationTimer::InstrumentationTimer(const char* name) noexcept :
-	m_name(name),
-	m_stopped(false)
+	bool firstEvent = true;
+	in.seekg(sizeof(header));
+	for (uint64_t first = 0; first < footer.recordCount; first += ChunkSize)
+	{
+		uint64_t count = std::min(ChunkSize, footer.recordCount - first);
+		if (!in.read(reinterpret_cast<char*>(records.data()), count * sizeof(TraceRecord)))
+			return false;
+
+		text.clear();
+		for (uint64_t iii = 0; iii < count; ++iii)
+		{
+			const TraceRecord& record = records[iii];
+			bool counter = record.nameID < names.size() && counterNames[record.nameID] != 0;
+
+			// Counter tracks belong to the process, not to the thread that sampled them. JSON has no NaN or
+			// infinity, so such samples are left out
+			double value = counter ? std::bit_cast<double>(record.end) : 0.0;
+			if (counter && !std::isfinite(value))
+				continue;
+
+			if (!firstEvent)
+				text += ',';
+			firstEvent = false;
+
+			if (counter)
+			{
+				text += "{\"cat\":\"counter\",\"name\":\"";
+				text += names[record.nameID];
+				text += "\",\"ph\":\"C\",\"pid\":0,\"ts\":";
+				appendMicroseconds(record.start - header.sessionStart);
+				int length = std::snprintf(number, sizeof(number), "%.15g", value);
+				text += ",\"args\":{\"value\":";
+				text.append(number, length);
+				text += "}}";
+				continue;
+			}
+
+			text += "{\"cat\":\"function\",\"dur\":";
+			appendMicroseconds(record.end - record.start);
+			text += ",\"name\":\"";
+			text += record.nameID < names.size() ? names[record.nameID] : "?";
+			text += "\",\"ph\":\"X\",\"pid\":0,\"tid\":";
+			text += std::to_string(record.threadID);
+			text += ",\"ts\":";
+			appendMicroseconds(record.start - header.sessionStart);
+			if (record.counters.cycles != 0)
+			{
+				text += ",\"args\":{\"cycles\":";
+				text += std::to_string(record.counters.cycles);
+				text += ",\"instructions\":";
+				text += std::to_string(record.counters.instructions);
+				text += ",\"cacheMisses\":";
+				text += std::to_string(record.counters.cacheMisses);
+				text += ",\"branchMisses\":";
+				text += std::to_string(record.counters.branchMisses);
+				text += '}';
+			}
+			text += '}';
+		}
+		out.write(text.data(), text.size());
+	}
+
+	// Footer
+	out << "]}";
+	return static_cast<bool>(out);
+}
+
+uint32_t Instrumentor::InternName(const char* name, bool counter) noexcept
 {
-	// Don't do anything if session is not active
-	if (Instrumentor::Get().SessionIsActive())
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (size_t iii = 0; iii < m_names.size(); ++iii)
 	{
-		// Perform string processing before starting the timer
-		//		Remove __cdecl
-		size_t position = m_name.find("__cdecl ");
-		if (position != std::string::npos)
-			m_name.erase(position, 8);
-		//		Replace (void) -> ()
-		position = m_name.find("(void)");
-		if (position != std::string::npos)
-			m_name.erase(position + 1, 4);   // just erase "void" in "(void)"
-		//		Replace " -> '
-		std::replace(m_name.begin(), m_name.end(), '"', '\'');
-
-		// std::chrono::high_resolution_clock::now() is noexcept, so nothing to handle
-		m_startTimePoint = std::chrono::high_resolution_clock::now();
+		if (m_counterNames[iii] == counter && std::strcmp(name, m_names[iii]) == 0)
+			return static_cast<uint32_t>(iii);
 	}
+
+	m_names.push_back(name);
+	m_counterNames.push_back(counter);
+	return static_cast<uint32_t>(m_names.size() - 1);
 }
 
-void InstrumentationTimer::Stop() noexcept
+const char* Instrumentor::Name(uint32_t nameID) noexcept
 {
-	std::chrono::time_point<std::chrono::high_resolution_clock> endTimePoint = std::chrono::high_resolution_clock::now();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return nameID < m_names.size() ? m_names[nameID] : "?";
+}
 
-	long long start = std::chrono::time_point_cast<std::chrono::microseconds>(m_startTimePoint).time_since_epoch().count();
-	long long end = std::chrono::time_point_cast<std::chrono::microseconds>(endTimePoint).time_since_epoch().count();
+void Instrumentor::WriteProfile(uint32_t nameID, int64_t start, int64_t end, const CounterValues& counters) noexcept
+{
+	if (IsRecording())
+		ThreadBuffer().Push({ start, end, nameID, counters });
+}
+
+void Instrumentor::WriteCounter(uint32_t nameID, double value) noexcept
+{
+	if (SessionIsActive())
+		ThreadBuffer().Push({ Now(), std::bit_cast<int64_t>(value), nameID, {} });
+}
+
+uint64_t Instrumentor::ResidentBytes() noexcept
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters = {};
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.WorkingSetSize;
+	return 0;
+#elif defined(__linux__)
+	// The second field of statm is the resident set in pages
+	unsigned long long pages = 0;
+	std::FILE* file = std::fopen("/proc/self/statm", "r");
+	if (file == nullptr)
+		return 0;
+	if (std::fscanf(file, "%*s %llu", &pages) != 1)
+		pages = 0;
+	std::fclose(file);
+	return pages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#else
+	return 0;
+#endif
+}
+
+bool Instrumentor::SetHardwareCounters(bool enabled) noexcept
+{
+	if (enabled && !HardwareCounters::Available())
+		return false;
+
+	m_countersEnabled.store(enabled, std::memory_order_relaxed);
+	return true;
+}
 
-	uint32_t threadID = static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+bool Instrumentor::ReadCounters(CounterValues& values) noexcept
+{
+	if (!HardwareCountersEnabled())
+		return false;
 
-	Instrumentor::Get().WriteProfile(m_name, start, end, threadID);
+	// Opened on first use by each thread and kept open for the rest of the thread. A thread that can't open
+	// them doesn't keep trying
+	thread_local HardwareCounters counters;
+	thread_local bool failed = false;
+	if (!counters.IsOpen() && (failed || !counters.Open()))
+	{
+		failed = true;
+		return false;
+	}
 
-	//std::chrono::time_point<std::chrono::high_resolution_clock> testEndPoint = std::chrono::high_resolution_clock::now();
-	//long long testEnd = std::chrono::time_point_cast<std::chrono::microseconds>(testEndPoint).time_since_epoch().count();
+	return counters.Read(values);
+}
 
-	//long long duration = testEnd - start;
-	//double    ms = duration * 0.001;
-	//OutputDebugString(std::format("{}us ({:.3f}ms)\n", duration, ms).c_str());
+ProfileRingBuffer& Instrumentor::ThreadBuffer() noexcept
+{
+	// The buffers are owned by the Instrumentor, which is never destroyed, so a buffer outlives its thread and
+	// records of threads that have exited still make it into the session. When the thread exits, its buffer is
+	// released and can be reused by a later thread once everything in it has been collected
+	struct Owner
+	{
+		ProfileRingBuffer* buffer = nullptr;
+		~Owner() { if (buffer != nullptr) buffer->Release(); }
+	};
+	thread_local Owner owner;
+	if (owner.buffer == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		uint32_t threadID = m_threadCount++;
+		auto reusable = std::find_if(m_buffers.begin(), m_buffers.end(),
+			[](const std::unique_ptr<ProfileRingBuffer>& buffer) { return buffer->IsReusable(); });
+		if (reusable != m_buffers.end())
+		{
+			(*reusable)->Reuse(threadID);
+			owner.buffer = reusable->get();
+		}
+		else
+		{
+			m_buffers.push_back(std::make_unique<ProfileRingBuffer>(threadID));
+			owner.buffer = m_buffers.back().get();
+		}
+	}
+	return *owner.buffer;
+}
 
-	m_stopped = true;
-}
\ No newline at end of file
+#endif // PROFILE
@@ -1,77 +1,322 @@
 #pragma once
-#include "MacroHelper.h"
 #include "TestConfig.h"
 
 #ifdef PROFILE
-#include <chrono>
-#include <format>
+#include "HardwareCounters.h"
+#include "QuantileSketch.h"
 
-#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
-#include <array>
+#include <vector>
 #endif
 
 #ifdef PROFILE
 	#define PROFILE_BEGIN_SESSION(name, filepath) Instrumentor::Get().BeginSession(name, filepath)
 	#define PROFILE_END_SESSION() Instrumentor::Get().EndSession()
+	// The trace of a session is written in the background; wait for it before the process exits
+	#define PROFILE_WAIT_FOR_WRITER() Instrumentor::Get().WaitForWriter()
 	#define PROFILE_NEXT_FRAME() Instrumentor::Get().NotifyNextFrame()
 
-//	#define CAT2(a,b) a##b
-//	#define CAT(a,b) CAT2(a,b)
-	#define TIMER_VAR_NAME CAT(timer, __LINE__)
+	// Profile.h is shared with the platform-neutral core, so it can't rely on MacroHelper.h for CAT
+	#define PROFILE_CAT2(a,b) a##b
+	#define PROFILE_CAT(a,b) PROFILE_CAT2(a,b)
+	#define TIMER_VAR_NAME PROFILE_CAT(timer, __LINE__)
+
+	// Full signature of the enclosing function
+	#if defined(_MSC_VER)
+		#define PROFILE_FUNCTION_SIGNATURE __FUNCSIG__
+	#else
+		#define PROFILE_FUNCTION_SIGNATURE __PRETTY_FUNCTION__
+	#endif
+
+	// The name is sanitized at compile time into a static array and interned once per call site, so recording
+	// a scope only stores its ID and two timestamps
+	#define PROFILE_SCOPE(name) \
+		static constexpr auto PROFILE_CAT(profileName, __LINE__) = ProfileName::Sanitize(name); \
+		static const uint32_t PROFILE_CAT(profileNameID, __LINE__) = Instrumentor::Get().InternName(PROFILE_CAT(profileName, __LINE__).text); \
+		InstrumentationTimer TIMER_VAR_NAME(PROFILE_CAT(profileNameID, __LINE__))
+	#define PROFILE_FUNCTION() PROFILE_SCOPE(PROFILE_FUNCTION_SIGNATURE)
 
-	#define PROFILE_SCOPE(name) InstrumentationTimer TIMER_VAR_NAME(name)
-	#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCSIG__)
+	// Sample of a counter track, e.g. the particle count, drawn on the same timeline as the scopes. Counters
+	// only go into session traces, so the value is only evaluated while a session is active
+	#define PROFILE_COUNTER(name, value) \
+		do { \
+			static constexpr auto profileCounterName = ProfileName::Sanitize(name); \
+			static const uint32_t profileCounterID = Instrumentor::Get().InternName(profileCounterName.text, true); \
+			if (Instrumentor::Get().SessionIsActive()) \
+				Instrumentor::Get().WriteCounter(profileCounterID, static_cast<double>(value)); \
+		} while (false)
 #else
 	#define PROFILE_BEGIN_SESSION(name, filepath)
 	#define PROFILE_END_SESSION()
+	#define PROFILE_WAIT_FOR_WRITER()
 	#define PROFILE_NEXT_FRAME()
 	#define PROFILE_SCOPE(name)
 	#define PROFILE_FUNCTION()
+	#define PROFILE_COUNTER(name, value)
 #endif
 
 #ifdef PROFILE
-struct ProfileResult
+namespace ProfileName
 {
-	std::string name = "";
-	long long start = 0, end = 0;
-	uint32_t threadID = 0;
+	// Sanitized copy of a name; never longer than the original
+	template<size_t N>
+	struct Text
+	{
+		char text[N] = {};
+	};
+
+	constexpr bool StartsWith(const char* text, const char* prefix) noexcept
+	{
+		for (; *prefix != '\0'; ++text, ++prefix)
+		{
+			if (*text != *prefix)
+				return false;
+		}
+		return true;
+	}
+
+	// Strip "__cdecl " and turn "(void)" into "()" so function signatures read the same on every compiler,
+	// and replace '"' with '\'' so the name can be written into JSON as is
+	template<size_t N>
+	constexpr Text<N> Sanitize(const char (&name)[N]) noexcept
+	{
+		Text<N> result;
+		size_t out = 0;
+		for (size_t in = 0; in + 1 < N && name[in] != '\0';)
+		{
+			if (StartsWith(name + in, "__cdecl "))
+				in += 8;
+			else if (StartsWith(name + in, "(void)"))
+			{
+				result.text[out++] = '(';
+				result.text[out++] = ')';
+				in += 6;
+			}
+			else
+			{
+				result.text[out++] = name[in] == '"' ? '\'' : name[in];
+				++in;
+			}
+		}
+		return result;
+	}
+}
+
+// Fixed-size record of one profiled scope. Times are nanoseconds of Instrumentor::Now(). The counters are
+// the hardware events of the scope, all zero when they weren't counted. A sample of a counter track (its name
+// was interned as a counter) is recorded at 'start' and keeps the bits of its value in 'end'
+struct ProfileRecord
+{
+	int64_t start = 0;
+	int64_t end = 0;
+	uint32_t nameID = 0;
+	CounterValues counters;
 };
 
-struct InstrumentationSession
+// Ring of records written by one thread (the producer) and read by whoever merges the session (the
+// consumer). Neither side ever waits or takes a lock: when the ring is full, new records are dropped and
+// counted instead. Once its thread has exited and the consumer has drained it, a ring is handed to the next
+// new thread rather than freed, so threads that come and go don't add a ring each
+class ProfileRingBuffer
 {
-	std::string name;
+public:
+	// 3.5 MB per thread; the writer drains the rings every 10 ms
+	static constexpr uint64_t Capacity = 1ull << 16;
+
+	ProfileRingBuffer(uint32_t threadID) noexcept :
+		m_records(std::make_unique<ProfileRecord[]>(Capacity)),
+		m_threadID(threadID)
+	{}
+	ProfileRingBuffer(const ProfileRingBuffer&) = delete;
+	void operator=(const ProfileRingBuffer&) = delete;
+
+	uint32_t ThreadID() const noexcept { return m_threadID; }
+
+	// Producer only, when its thread exits. No more records are pushed after this
+	void Release() noexcept { m_released.store(true, std::memory_order_release); }
+	// Consumer only: true once the ring has been released and every record in it drained
+	bool IsReusable() const noexcept
+	{
+		return m_released.load(std::memory_order_acquire) &&
+			m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_relaxed);
+	}
+	// Consumer only: give a reusable ring to a new thread, which is recorded under 'threadID' from now on
+	void Reuse(uint32_t threadID) noexcept
+	{
+		m_threadID = threadID;
+		m_released.store(false, std::memory_order_relaxed);
+	}
+
+	// Producer only
+	void Push(const ProfileRecord& record) noexcept
+	{
+		uint64_t head = m_head.load(std::memory_order_relaxed);
+		if (head - m_tail.load(std::memory_order_acquire) >= Capacity)
+		{
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		m_records[head & (Capacity - 1)] = record;
+		m_head.store(head + 1, std::memory_order_release);
+	}
+
+	// Consumer only: hand every record written so far to 'fn' and free their space
+	template<typename F>
+	void Drain(F&& fn) noexcept
+	{
+		uint64_t tail = m_tail.load(std::memory_order_relaxed);
+		uint64_t head = m_head.load(std::memory_order_acquire);
+		for (; tail != head; ++tail)
+			fn(m_records[tail & (Capacity - 1)]);
+		m_tail.store(tail, std::memory_order_release);
+	}
+	// Consumer only: forget every record written so far
+	void Discard() noexcept
+	{
+		m_tail.store(m_head.load(std::memory_order_acquire), std::memory_order_release);
+		m_dropped.store(0, std::memory_order_relaxed);
+	}
+	uint64_t DroppedCount() const noexcept { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+	// Head and tail on their own cache lines so that the producer and the consumer don't contend
+	alignas(64) std::atomic<uint64_t> m_head = 0;
+	alignas(64) std::atomic<uint64_t> m_tail = 0;
+	std::atomic<uint64_t> m_dropped = 0;
+	std::atomic<bool> m_released = false;
+	std::unique_ptr<ProfileRecord[]> m_records;
+	uint32_t m_threadID;
 };
 
+// Records profiled scopes from any thread. Each thread writes to its own ring buffer, assigned the first time it
+// records something, so recording a scope is a couple of clock reads and a store.
+//
+// While a session is active, a writer thread drains the buffers every few milliseconds and streams the
+// records to '<filepath>.bin', so a capture can run for as long as there is disk space. Once the session has
+// ended, the same thread converts the binary trace into the Chrome tracing JSON file at 'filepath'
+// (chrome://tracing, https://ui.perfetto.dev); ending a session never waits for the disk.
+//
+// Independently of sessions, live statistics aggregate every recorded scope per name (count, total, min, max
+// and quantiles) and keep the scopes of the last frame, for the Performance window. While neither is in use,
+// an instrumented scope costs a single relaxed load.
+//
+// Counter tracks (PROFILE_COUNTER) go through the same buffers. They end up in the trace as counter events,
+// but not in the statistics.
+//
+// Optionally, every scope also counts cycles, instructions, cache misses and branch misses of its thread
+// (HardwareCounters), which tells compute-bound loops from memory-bound ones. That costs two system calls per
+// scope, so it is off by default
 class Instrumentor
 {
 public:
-	Instrumentor() noexcept : 
-		m_currentSession(nullptr), 
-		m_dataCount(0), 
+	// A recorded scope or counter sample (see ProfileRecord) and the thread it ran on
+	struct TraceRecord
+	{
+		int64_t start;
+		int64_t end;
+		uint32_t nameID;
+		uint32_t threadID;
+		CounterValues counters;
+	};
+
+	// Aggregate of every recorded scope with the same name, durations in milliseconds
+	struct ScopeSummary
+	{
+		const char* name;
+		uint64_t count;
+		double total, mean, min, max;
+		double p50, p95, p99;
+		// Hardware events per call, averaged over the calls that were counted. 0 if none were
+		double cycles, instructions, cacheMisses, branchMisses;
+	};
+
+	Instrumentor() noexcept :
+		m_recording(false),
+		m_sessionActive(false),
+		m_sessionStart(0),
+		m_threadCount(0),
 		m_remainingFrames(0),
 		m_capturingFrames(false),
 		m_capturingSeconds(false),
-		m_capturingEndTime(0)
+		m_capturingEndTime(0),
+		m_secondsToCapture(0),
+		m_stopWriter(false),
+		m_writing(false),
+		m_collectForWriter(false),
+		m_liveStatistics(false),
+		m_frameStart(0),
+		m_lastFrameStart(0),
+		m_lastFrameEnd(0),
+		m_countersEnabled(false)
 	{}
 
-	bool SessionIsActive() const noexcept { return m_currentSession != nullptr; }
+	// True while scopes are recorded, for a session or for the live statistics
+	bool IsRecording() const noexcept { return m_recording.load(std::memory_order_relaxed); }
+	bool SessionIsActive() const noexcept { return m_sessionActive.load(std::memory_order_relaxed); }
 
-	std::string SessionName() const noexcept; 
+	std::string SessionName() const noexcept;
 
 	void CaptureFrames(unsigned int frameCount, const std::string& name, const std::string& filepath) noexcept;
 	void CaptureSeconds(unsigned int seconds, const std::string& name, const std::string& filepath) noexcept;
 
 	void NotifyNextFrame() noexcept;
 
-	void BeginSession() noexcept;
-	void BeginSession(const std::string& name, std::string filepath = "results.json") noexcept;
+	// Ends the active session, if any, and begins a new one. Returns false, and begins nothing, while the trace
+	// of the previous session is still being written (IsWriting); call WaitForWriter first to wait for it
+	bool BeginSession() noexcept;
+	bool BeginSession(const std::string& name, std::string filepath = "results.json") noexcept;
 
 	void EndSession() noexcept;
 
-	void WriteProfile(const std::string& name, long long start, long long end, uint32_t threadID) noexcept;
+	// True until the trace of the last session has been written out
+	bool IsWriting() const noexcept { return m_writing.load(std::memory_order_acquire); }
+	void WaitForWriter() noexcept;
+
+	// Convert a binary trace written by a session into Chrome tracing JSON
+	static bool ConvertTrace(const std::string& binaryPath, const std::string& jsonPath) noexcept;
+
+	// Live statistics. The records are collected at the start of every frame (NotifyNextFrame)
+	bool LiveStatisticsEnabled() const noexcept { return m_liveStatistics.load(std::memory_order_relaxed); }
+	void SetLiveStatistics(bool enabled) noexcept;
+	void ResetStatistics() noexcept;
+	void GetStatistics(std::vector<ScopeSummary>& summaries) noexcept;
+	// Every scope that started and ended within the last complete frame, on any thread. Only for the thread
+	// that calls NotifyNextFrame
+	const std::vector<TraceRecord>& LastFrameRecords() const noexcept { return m_lastFrameRecords; }
+	int64_t LastFrameStart() const noexcept { return m_lastFrameStart; }
+	int64_t LastFrameEnd() const noexcept { return m_lastFrameEnd; }
+
+	// Fails when enabling and the counters aren't available, see HardwareCounters
+	bool SetHardwareCounters(bool enabled) noexcept;
+	bool HardwareCountersEnabled() const noexcept { return m_countersEnabled.load(std::memory_order_relaxed); }
+	// Current counters of the calling thread. False while they are disabled or can't be opened on this thread
+	bool ReadCounters(CounterValues& values) noexcept;
+
+	// Returns the ID that records refer to 'name' by; equal names of the same kind share an ID. The name must
+	// stay valid for the rest of the program, PROFILE_SCOPE passes a static array and calls this once per call site
+	uint32_t InternName(const char* name, bool counter = false) noexcept;
+	const char* Name(uint32_t nameID) noexcept;
+
+	void WriteProfile(uint32_t nameID, int64_t start, int64_t end, const CounterValues& counters = {}) noexcept;
+	// 'nameID' must have been interned as a counter
+	void WriteCounter(uint32_t nameID, double value) noexcept;
+
+	// Resident memory of the process in bytes, 0 where it can't be queried. For a counter track
+	static uint64_t ResidentBytes() noexcept;
+
+	static int64_t Now() noexcept
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
 
 	static Instrumentor& Get() noexcept
 	{
@@ -80,39 +325,126 @@ public:
 	}
 
 private:
-	InstrumentationSession* m_currentSession;
+	// Binary trace: a TraceHeader, the TraceRecords in the order they were drained, the name table (for each
+	// name, its uint32_t length, the characters and a uint8_t that is 1 for counters) and a TraceFooter
+	struct TraceHeader
+	{
+		char magic[8];
+		int64_t sessionStart;
+	};
+	struct TraceFooter
+	{
+		uint64_t recordCount;
+		uint64_t droppedCount;
+		uint32_t nameCount;
+		uint32_t reserved;
+	};
+	static constexpr char TraceMagic[8] = { 'A', 'P', 'T', 'R', 'A', 'C', 'E', '3' };
+	static constexpr std::chrono::milliseconds WriterInterval{ 10 };
+	// Limit on the scopes kept for the flame view of a frame
+	static constexpr size_t MaxFrameRecords = 1 << 16;
+
+	struct ScopeStatistics
+	{
+		uint64_t count = 0;
+		int64_t total = 0;
+		int64_t min = INT64_MAX;
+		int64_t max = 0;
+		QuantileSketch durations;
+		uint64_t countedCount = 0;	// calls with hardware counters
+		CounterValues counters;		// sum over those calls
+	};
+
+	ProfileRingBuffer& ThreadBuffer() noexcept;
+	void WriterLoop(std::string binaryPath, std::string jsonPath) noexcept;
+	void UpdateRecording() noexcept { m_recording.store(m_sessionActive.load() || m_liveStatistics.load(), std::memory_order_relaxed); }
+	// Drain every ring buffer. The records are queued for the writer during a session and, with the live
+	// statistics enabled, aggregated and kept for the current frame. m_mutex must be held
+	void CollectLocked() noexcept;
+
+	std::atomic<bool> m_recording;
+	std::atomic<bool> m_sessionActive;
+	std::string m_sessionName;
+	int64_t m_sessionStart;
 
 	std::string m_filepath, m_name;
 
-	std::array<ProfileResult, 1000000> m_data;
-	unsigned int m_dataCount;
+	// Guards the names, the list of buffers and everything collected from them. Recording a scope never takes it
+	std::mutex m_mutex;
+	std::vector<const char*> m_names;
+	std::vector<bool> m_counterNames;	// by name ID
+	std::vector<std::unique_ptr<ProfileRingBuffer>> m_buffers;
+	uint32_t m_threadCount;				// threads that have been given a buffer, which numbers them in the trace
 
 	unsigned int m_remainingFrames;
 	bool m_capturingFrames;
 
 	bool m_capturingSeconds;
-	long long m_capturingEndTime;
+	int64_t m_capturingEndTime;
+	unsigned int m_secondsToCapture;
+
+	std::thread m_writer;
+	std::mutex m_writerMutex;
+	std::condition_variable m_writerCondition;
+	bool m_stopWriter;				// guarded by m_writerMutex
+	std::atomic<bool> m_writing;
+	bool m_collectForWriter;		// guarded by m_mutex, until the writer has collected the end of its session
+	std::vector<TraceRecord> m_pendingRecords;	// collected but not written yet
+
+	std::atomic<bool> m_liveStatistics;
+	std::vector<ScopeStatistics> m_statistics;	// by name ID
+	std::vector<TraceRecord> m_frameRecords;		// collected during the current frame
+	std::vector<TraceRecord> m_lastFrameRecords;
+	int64_t m_frameStart;
+	int64_t m_lastFrameStart;
+	int64_t m_lastFrameEnd;
+
+	std::atomic<bool> m_countersEnabled;
 };
 
 
 class InstrumentationTimer
 {
 public:
-	InstrumentationTimer(const char* name) noexcept;
+	InstrumentationTimer(uint32_t nameID) noexcept :
+		m_start(0),
+		m_nameID(nameID),
+		m_stopped(!Instrumentor::Get().IsRecording()),
+		m_counting(false)
+	{
+		// Don't do anything if nothing is being recorded. The counters are read last and first in Stop, so the
+		// clock reads are not part of the counts
+		if (!m_stopped)
+		{
+			m_start = Instrumentor::Now();
+			m_counting = Instrumentor::Get().ReadCounters(m_counters);
+		}
+	}
 
 	~InstrumentationTimer()
 	{
-		if (Instrumentor::Get().SessionIsActive() && !m_stopped)
+		if (!m_stopped)
 			Stop();
 	}
 
-	void Stop() noexcept;
+	void Stop() noexcept
+	{
+		CounterValues counters;
+		if (m_counting && Instrumentor::Get().ReadCounters(counters))
+			counters = counters - m_counters;
+		else
+			counters = {};
 
+		Instrumentor::Get().WriteProfile(m_nameID, m_start, Instrumentor::Now(), counters);
+		m_stopped = true;
+	}
 
 private:
-	std::chrono::time_point<std::chrono::high_resolution_clock> m_startTimePoint;
-	std::string m_name;
+	int64_t m_start;
+	uint32_t m_nameID;
 	bool m_stopped;
+	bool m_counting;
+	CounterValues m_counters;
 };
 
 
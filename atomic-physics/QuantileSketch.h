@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Streaming quantile estimate with a bounded relative error (Masson, Rim & Lee, "DDSketch: A Fast and
+// Fully-Mergeable Quantile Sketch with Relative-Error Guarantees", VLDB 2019). Values are counted in buckets
+// whose bounds grow geometrically by gamma = (1 + a) / (1 - a), so every quantile comes back within a relative
+// error of 'a' of the true value while the memory only grows with log(max / min), not with the count.
+//
+// Doesn't include CorePch.h because the profiler, which CorePch.h includes, uses it
+class QuantileSketch
+{
+public:
+	QuantileSketch(double relativeAccuracy = 0.01) noexcept :
+		m_gamma((1.0 + relativeAccuracy) / (1.0 - relativeAccuracy)),
+		m_inverseLogGamma(1.0 / std::log(m_gamma)),
+		m_offset(0),
+		m_count(0),
+		m_zeroCount(0)
+	{}
+
+	void Add(double value) noexcept
+	{
+		++m_count;
+		if (value <= MinValue)
+		{
+			++m_zeroCount;
+			return;
+		}
+
+		// Bucket i holds the values in (gamma^(i-1), gamma^i]; only the range of buckets in use is stored
+		int index = static_cast<int>(std::ceil(std::log(value) * m_inverseLogGamma));
+		if (m_buckets.empty())
+		{
+			m_offset = index;
+			m_buckets.push_back(0);
+		}
+		else if (index < m_offset)
+		{
+			m_buckets.insert(m_buckets.begin(), m_offset - index, 0);
+			m_offset = index;
+		}
+		else if (index - m_offset >= static_cast<int>(m_buckets.size()))
+			m_buckets.resize(index - m_offset + 1, 0);
+
+		++m_buckets[index - m_offset];
+	}
+
+	// 'q' in [0, 1]
+	double Quantile(double q) const noexcept
+	{
+		if (m_count == 0)
+			return 0.0;
+
+		uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(m_count - 1));
+		uint64_t seen = m_zeroCount;
+		if (rank < seen)
+			return 0.0;
+
+		for (size_t iii = 0; iii < m_buckets.size(); ++iii)
+		{
+			seen += m_buckets[iii];
+			if (seen > rank)
+				return BucketValue(m_offset + static_cast<int>(iii));
+		}
+		return BucketValue(m_offset + static_cast<int>(m_buckets.size()) - 1);
+	}
+
+	uint64_t Count() const noexcept { return m_count; }
+
+	void Clear() noexcept
+	{
+		m_buckets.clear();
+		m_offset = 0;
+		m_count = 0;
+		m_zeroCount = 0;
+	}
+
+private:
+	// Values at or below this are counted without a bucket and reported as 0
+	static constexpr double MinValue = 1.0;
+
+	// The value within the bucket that is within the relative error of both of its bounds
+	double BucketValue(int index) const noexcept { return 2.0 * std::pow(m_gamma, index) / (m_gamma + 1.0); }
+
+	double m_gamma;
+	double m_inverseLogGamma;
+	int m_offset;					// index of m_buckets[0]
+	std::vector<uint64_t> m_buckets;
+	uint64_t m_count;
+	uint64_t m_zeroCount;
+};
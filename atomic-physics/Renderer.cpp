@@ -33,21 +33,27 @@ Renderer::Renderer(D3D11_VIEWPORT vp) noexcept :
 	InitializeLightingData();
 
 	// Assign event handlers
-	t_particleAdded = SimulationManager::SetParticleAddedEventHandler(
-		[this](const Particle& particle, unsigned int particleIndex) noexcept {
-			this->OnParticleAdded(particle, particleIndex);
+	t_particlesAdded = SimulationManager::SetParticlesAddedEventHandler(
+		[this](const ParticleStore& particles, unsigned int first, unsigned int count) noexcept {
+			this->OnParticlesAdded(particles, first, count);
 		}
 	);
 
-	t_particleRemoved = SimulationManager::SetParticleRemovedEventHandler(
-		[this](unsigned int particleIndex) noexcept {
-			this->OnParticleRemoved(particleIndex);
+	t_particlesRemoved = SimulationManager::SetParticlesRemovedEventHandler(
+		[this](const std::vector<ParticleHandle>& handles, const std::vector<unsigned int>& indices) noexcept {
+			this->OnParticlesRemoved(handles, indices);
 		}
 	);
 
 	t_particleTypeChanged = SimulationManager::SetParticleTypeChangedEventHandler(
-		[this](unsigned int particleIndex, unsigned int particleType) noexcept {
-			this->OnParticleTypeChanged(particleIndex, particleType);
+		[this](ParticleHandle handle, unsigned int particleType) noexcept {
+			this->OnParticleTypeChanged(handle, particleType);
+		}
+	);
+
+	t_activeSimulationChanged = SimulationManager::SetActiveSimulationChangedEventHandler(
+		[this](unsigned int simulationIndex) noexcept {
+			this->OnActiveSimulationChanged(simulationIndex);
 		}
 	);
 }
@@ -55,9 +61,10 @@ Renderer::Renderer(D3D11_VIEWPORT vp) noexcept :
 Renderer::~Renderer() noexcept
 {
 	// Remove Event Handlers
-	SimulationManager::RemoveParticleAddedEventHandler(t_particleAdded);
-	SimulationManager::RemoveParticleRemovedEventHandler(t_particleRemoved);
+	SimulationManager::RemoveParticlesAddedEventHandler(t_particlesAdded);
+	SimulationManager::RemoveParticlesRemovedEventHandler(t_particlesRemoved);
 	SimulationManager::RemoveParticleTypeChangedEventHandler(t_particleTypeChanged);
+	SimulationManager::RemoveActiveSimulationChangedEventHandler(t_activeSimulationChanged);
 }
 
 void Renderer::InitializeAllSphereData() noexcept
@@ -124,43 +131,65 @@ void Renderer::SetViewport(D3D11_VIEWPORT viewport) noexcept
 	}	 
 }
 
-void Renderer::OnParticleAdded(const Particle& particle, unsigned int /* particleIndex */) noexcept
+void Renderer::OnParticlesAdded(const ParticleStore& particles, unsigned int first, unsigned int count) noexcept
+{
+	PROFILE_FUNCTION();
+
+	const unsigned int* type = particles.Type();
+	const float* p_x = particles.PositionX();
+	const float* p_y = particles.PositionY();
+	const float* p_z = particles.PositionZ();
+
+	m_atoms.reserve(m_atoms.size() + count);
+	for (unsigned int iii = first; iii < first + count; ++iii)
+		m_atoms.push_back({ { p_x[iii], p_y[iii], p_z[iii] }, type[iii] });
+}
+
+void Renderer::OnParticlesRemoved(const std::vector<ParticleHandle>& /* handles */, const std::vector<unsigned int>& indices) noexcept
 {
-	std::unique_ptr<Sphere> sphere = std::make_unique<Sphere>(m_moveLookController);
-	sphere->Position(particle.p_x, particle.p_y, particle.p_z);
-	sphere->Velocity(particle.v_x, particle.v_y, particle.v_z);
-	sphere->SetAtomType(particle.type);
+	PROFILE_FUNCTION();
 
-	m_drawables.push_back(std::move(sphere));
+	// The atoms mirror the order of the particles, so replay the same swap-and-pops as the simulation
+	for (unsigned int index : indices)
+	{
+		m_atoms[index] = m_atoms.back();
+		m_atoms.pop_back();
+	}
 }
 
-void Renderer::OnParticleRemoved(unsigned int particleIndex) noexcept
+void Renderer::OnParticleTypeChanged(ParticleHandle handle, unsigned int particleType) noexcept
 {
-	m_drawables.erase(m_drawables.begin() + particleIndex);
+	// The event is deferred, so the particle may have been removed since
+	const ParticleStore& particles = SimulationManager::GetParticles();
+	if (particles.Contains(handle))
+		m_atoms[particles.IndexOf(handle)].elementNumber = particleType;
 }
 
-void Renderer::OnParticleTypeChanged(unsigned int particleIndex, unsigned int particleType) noexcept
+void Renderer::OnActiveSimulationChanged(unsigned int /* simulationIndex */) noexcept
 {
-	Sphere* s = dynamic_cast<Sphere*>(m_drawables[particleIndex].get());
-	s->SetAtomType(particleType);
+	PROFILE_FUNCTION();
+
+	// A different simulation is displayed now, so take all of its particles as one batch
+	m_atoms.clear();
+	const ParticleStore& particles = SimulationManager::GetParticles();
+	OnParticlesAdded(particles, 0, particles.Size());
+
+	NotifyBoxSizeChanged();
 }
 
 void Renderer::Update() noexcept
 {
 	PROFILE_FUNCTION();
 
-	// Update all particle's positions/velocities
-	const std::vector<Particle>& particles = SimulationManager::GetParticles();
-	size_t size = particles.size();
+	// Update all atom positions from the latest snapshot. Particles added since it was published keep
+	// their previous position for a frame
+	const ParticleStore& particles = SimulationManager::GetSnapshot().particles;
+	const float* p_x = particles.PositionX();
+	const float* p_y = particles.PositionY();
+	const float* p_z = particles.PositionZ();
+	unsigned int size = std::min(particles.Size(), static_cast<unsigned int>(m_atoms.size()));
 	for (unsigned int iii = 0; iii < size; ++iii)
-	{
-		m_drawables[iii]->Position(particles[iii].p_x, particles[iii].p_y, particles[iii].p_z);
-		m_drawables[iii]->Velocity(particles[iii].v_x, particles[iii].v_y, particles[iii].v_z);
-	}
-
-	// I don't think this does anything right now...
-	for (const std::unique_ptr<Drawable>& drawable : m_drawables)
-		drawable->Update();
+		m_atoms[iii].position = { p_x[iii], p_y[iii], p_z[iii] };
 
 	// Update the MoveLookController
 	m_moveLookController->Update(m_viewport);
@@ -246,7 +275,6 @@ void Renderer::Render() noexcept
 	//		For example, when drawing every atom as a sphere, we can make certain
 	//		improvements to the draw pipeline such as instanced rendering
 	Render_AllSpheres();
-	//Render_Generic();
 
 	// Draw the box
 	m_box->Draw();
@@ -256,15 +284,6 @@ void Renderer::Render() noexcept
 		Render_Lights();
 }
 
-void Renderer::Render_Generic() const noexcept
-{
-	PROFILE_FUNCTION();
-
-	// Draw each drawable
-	for (const std::unique_ptr<Drawable>& drawable : m_drawables)
-		drawable->Draw();
-}
-
 void Renderer::Render_AllSpheres() const noexcept
 {
 	PROFILE_FUNCTION();
@@ -281,17 +300,19 @@ void Renderer::Render_AllSpheres() const noexcept
 	m_allSphere_MaterialIndexInstanceBufferArray->Bind();
 
 	// Can only draw a maximum of MAX_INSTANCES instances at a time
-	for (unsigned int iii = 0; iii < m_drawables.size(); iii += MAX_INSTANCES)
+	unsigned int atomCount = static_cast<unsigned int>(m_atoms.size());
+	for (unsigned int iii = 0; iii < atomCount; iii += MAX_INSTANCES)
 	{
 		// Must update the buffers AFTER they are bound to the pipeline
 		UpdateAllSphereModelViewProjectionInstanceData(iii);
 		UpdateAllSphereMaterialIndexInstanceData(iii);
 
-		// Issue the DrawIndexedInstanced call
+		// Issue the DrawIndexedInstanced call for this batch only
+		UINT instanceCount = std::min(atomCount - iii, static_cast<unsigned int>(MAX_INSTANCES));
 		GFX_THROW_INFO_ONLY(
 			DeviceResources::D3DDeviceContext()->DrawIndexedInstanced(
 				m_allSphere_Mesh->IndexCount(),			// indices in the mesh
-				static_cast<UINT>(m_drawables.size()),	// number of instances
+				instanceCount,							// number of instances
 				0u,										// starting index in the mesh - always 0
 				0u,										// starting vertex in the mesh - always 0
 				0u)										// starting instance in the bound instance data - always 0
@@ -392,19 +413,13 @@ void Renderer::UpdateAllSphereModelViewProjectionInstanceData(unsigned int start
 	ModelViewProjectionPreMultipliedArray* mappedBuffer = (ModelViewProjectionPreMultipliedArray*)ms.pData;
 
 	XMMATRIX viewProjection = m_moveLookController->ViewMatrix() * m_moveLookController->ProjectionMatrix();
-	XMMATRIX model;
-
 
-	unsigned int end = std::min(startIndex + MAX_INSTANCES, static_cast<unsigned int>(m_drawables.size()));
+	unsigned int end = std::min(startIndex + MAX_INSTANCES, static_cast<unsigned int>(m_atoms.size()));
 	for (unsigned int iii = startIndex; iii < end; ++iii)
 	{
-		model = m_drawables[iii]->GetModelMatrix();
-
-		unsigned int index = iii % MAX_INSTANCES;
-
-		DirectX::XMStoreFloat4x4(&(mappedBuffer->instanceData[index].model), model);
-		DirectX::XMStoreFloat4x4(&(mappedBuffer->instanceData[index].modelViewProjection), model * viewProjection);
-		DirectX::XMStoreFloat4x4(&(mappedBuffer->instanceData[index].inverseTransposeModel), DirectX::XMMatrixTranspose(DirectX::XMMatrixInverse(nullptr, model)));
+		const AtomInstance& atom = m_atoms[iii];
+		ModelViewProjectionPreMultiplied& instance = mappedBuffer->instanceData[iii % MAX_INSTANCES];
+		PackSphereInstance(atom.position, atom.elementNumber, viewProjection, instance.model, instance.modelViewProjection, instance.inverseTransposeModel);
 	}
 
 	GFX_THROW_INFO_ONLY(
@@ -432,12 +447,11 @@ void Renderer::UpdateAllSphereMaterialIndexInstanceData(unsigned int startIndex)
 
 	PhongMaterialIndexArray* mappedBuffer = (PhongMaterialIndexArray*)ms.pData;
 
-	unsigned int end = std::min(startIndex + MAX_INSTANCES, static_cast<unsigned int>(m_drawables.size()));
+	unsigned int end = std::min(startIndex + MAX_INSTANCES, static_cast<unsigned int>(m_atoms.size()));
 	for (unsigned int iii = startIndex; iii < end; ++iii)
 	{
-		Sphere* sphere = dynamic_cast<Sphere*>(m_drawables[iii].get());
 		unsigned int index = iii % MAX_INSTANCES;
-		mappedBuffer->materialIndex[index].materialIndex = sphere->GetElementNumber() - 1;
+		mappedBuffer->materialIndex[index].materialIndex = m_atoms[iii].elementNumber - 1; // materials start with hydrogen
 	}
 
 	GFX_THROW_INFO_ONLY(
@@ -10,8 +10,9 @@
 #include "MaterialBufferArray.h"
 #include "Mouse.h"
 #include "MoveLookController.h"
-#include "Sphere.h"
+#include "PhysicsConstants.h"
 #include "SimulationManager.h"
+#include "SphereInstance.h"
 
 #include <memory>
 #include <vector>
@@ -69,7 +70,6 @@ public:
 
 private:
 	void Render_AllSpheres() const noexcept;
-	void Render_Generic() const noexcept;
 	void Render_Lights() const noexcept;
 
 	void InitializeAllSphereData() noexcept;
@@ -77,13 +77,21 @@ private:
 	void UpdateAllSphereModelViewProjectionInstanceData(unsigned int startIndex) const noexcept;
 	void UpdateAllSphereMaterialIndexInstanceData(unsigned int startIndex) const noexcept;
 
-	void OnParticleAdded(const Particle& particle, unsigned int particleCount) noexcept;
-	void OnParticleRemoved(unsigned int particleIndex) noexcept;
-	void OnParticleTypeChanged(unsigned int particleIndex, unsigned int particleType) noexcept;
+	void OnParticlesAdded(const ParticleStore& particles, unsigned int first, unsigned int count) noexcept;
+	void OnParticlesRemoved(const std::vector<ParticleHandle>& handles, const std::vector<unsigned int>& indices) noexcept;
+	void OnParticleTypeChanged(ParticleHandle handle, unsigned int particleType) noexcept;
+	void OnActiveSimulationChanged(unsigned int simulationIndex) noexcept;
 
 	D3D11_VIEWPORT m_viewport;
 	std::shared_ptr<MoveLookController> m_moveLookController;
-	std::vector<std::unique_ptr<Drawable>> m_drawables;
+	// Everything the instanced sphere rendering needs per atom, in the same order as the particles. Plain
+	// values rather than a Drawable per atom so that adding a batch of particles is a single append
+	struct AtomInstance
+	{
+		DirectX::XMFLOAT3 position;
+		unsigned int elementNumber;
+	};
+	std::vector<AtomInstance> m_atoms;
 	std::unique_ptr<Box> m_box;
 	
 	// Pixel Shader constant buffer arrays - set ONCE per frame
@@ -113,7 +121,8 @@ private:
 	std::unique_ptr<ConstantBufferArray> m_lighting_MaterialIndexBuffer;
 
 	// Event Tokens
-	EventToken t_particleAdded;
-	EventToken t_particleRemoved;
+	EventToken t_particlesAdded;
+	EventToken t_particlesRemoved;
 	EventToken t_particleTypeChanged;
+	EventToken t_activeSimulationChanged;
 };
\ No newline at end of file
@@ -0,0 +1,283 @@
+#include "Scenario.h"
+#include "SimulationManager.h"
+
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+	const char* IntegratorName(Integrator integrator) noexcept
+	{
+		return integrator == Integrator::EventDriven ? "event-driven" : "velocity-verlet";
+	}
+
+	const char* ElectrostaticsName(Electrostatics method) noexcept
+	{
+		switch (method)
+		{
+		case Electrostatics::BarnesHut:			return "barnes-hut";
+		case Electrostatics::ParticleMeshEwald:	return "pme";
+		default:								return "none";
+		}
+	}
+
+	// Integers are read into a signed type and checked, since reading "-1" into an unsigned one wraps around
+	bool ReadInteger(std::istringstream& line, long long min, long long max, long long& value) noexcept
+	{
+		return (line >> value) && value >= min && value <= max;
+	}
+
+	bool ApplyLine(std::istringstream& line, const std::string& keyword, std::string& error) noexcept
+	{
+		if (keyword == "box")
+		{
+			DirectX::XMFLOAT3 size;
+			if (!(line >> size.x >> size.y >> size.z) || size.x <= 0.0f || size.y <= 0.0f || size.z <= 0.0f)
+			{
+				error = "expected three positive box lengths";
+				return false;
+			}
+			// The simulation stores the half extents
+			SimulationManager::SetBoxSize({ size.x / 2.0f, size.y / 2.0f, size.z / 2.0f });
+		}
+		else if (keyword == "periodic" || keyword == "lennard-jones")
+		{
+			int enabled;
+			if (!(line >> enabled))
+			{
+				error = "expected 0 or 1";
+				return false;
+			}
+			if (keyword == "periodic")
+			{
+				if (!SimulationManager::SetPeriodic(enabled != 0))
+				{
+					error = "particle-mesh Ewald needs periodic boundaries";
+					return false;
+				}
+			}
+			else
+				SimulationManager::SetLennardJonesEnabled(enabled != 0);
+		}
+		else if (keyword == "integrator")
+		{
+			std::string name;
+			line >> name;
+			if (name == "velocity-verlet")
+				SimulationManager::SetIntegrator(Integrator::VelocityVerlet);
+			else if (name == "event-driven")
+				SimulationManager::SetIntegrator(Integrator::EventDriven);
+			else
+			{
+				error = "unknown integrator '" + name + "'";
+				return false;
+			}
+		}
+		else if (keyword == "electrostatics")
+		{
+			std::string name;
+			line >> name;
+			if (name == "none")
+				SimulationManager::SetElectrostatics(Electrostatics::None);
+			else if (name == "barnes-hut")
+				SimulationManager::SetElectrostatics(Electrostatics::BarnesHut);
+			else if (name == "pme")
+			{
+				// Rather than silently turning them on, refuse a scenario that asked for walls
+				if (!SimulationManager::IsPeriodic())
+				{
+					error = "particle-mesh Ewald needs periodic boundaries ('periodic 1')";
+					return false;
+				}
+				SimulationManager::SetElectrostatics(Electrostatics::ParticleMeshEwald);
+			}
+			else
+			{
+				error = "unknown electrostatics method '" + name + "'";
+				return false;
+			}
+		}
+		else if (keyword == "time-step")
+		{
+			float timeStep;
+			if (!(line >> timeStep) || timeStep <= 0.0f)
+			{
+				error = "expected a positive time step";
+				return false;
+			}
+			SimulationManager::SetTimeStep(timeStep);
+		}
+		else if (keyword == "substeps")
+		{
+			long long substeps;
+			if (!ReadInteger(line, 1, std::numeric_limits<unsigned int>::max(), substeps))
+			{
+				error = "expected a positive number of substeps";
+				return false;
+			}
+			SimulationManager::SetSubstepsPerTick(static_cast<unsigned int>(substeps));
+		}
+		else if (keyword == "neighbor-list-skin")
+		{
+			float skin;
+			if (!(line >> skin) || skin < 0.0f)
+			{
+				error = "expected a skin of at least 0";
+				return false;
+			}
+			SimulationManager::SetNeighborListSkin(skin);
+		}
+		else if (keyword == "barnes-hut")
+		{
+			float openingAngle, softening;
+			if (!(line >> openingAngle >> softening) || openingAngle < 0.0f || softening <= 0.0f)
+			{
+				error = "expected <opening angle> <softening> with an angle of at least 0 and a positive softening";
+				return false;
+			}
+			SimulationManager::GetBarnesHut().SetOpeningAngle(openingAngle);
+			SimulationManager::GetBarnesHut().SetSoftening(softening);
+		}
+		else if (keyword == "pme")
+		{
+			float gridSpacing, tolerance;
+			if (!(line >> gridSpacing >> tolerance) || gridSpacing <= 0.0f || tolerance <= 0.0f)
+			{
+				error = "expected <grid spacing> <tolerance>, both positive";
+				return false;
+			}
+			SimulationManager::GetParticleMeshEwald().SetGridSpacing(gridSpacing);
+			SimulationManager::GetParticleMeshEwald().SetTolerance(tolerance);
+		}
+		else if (keyword == "particle")
+		{
+			long long type, mass;
+			float p_x, p_y, p_z, v_x, v_y, v_z;
+			if (!ReadInteger(line, 0, static_cast<long long>(SimulationManager::GetParticleNames().size()) - 1, type) ||
+				!ReadInteger(line, 0, std::numeric_limits<int>::max(), mass) ||
+				!(line >> p_x >> p_y >> p_z >> v_x >> v_y >> v_z))
+			{
+				error = "expected <type> <mass> <px> <py> <pz> <vx> <vy> <vz> with a valid type and a mass of at least 0";
+				return false;
+			}
+			SimulationManager::AddParticle(static_cast<int>(type), static_cast<int>(mass), p_x, p_y, p_z, v_x, v_y, v_z);
+		}
+		else if (keyword == "random")
+		{
+			long long count;
+			float maxVelocity;
+			std::vector<unsigned int> types;
+			if (!ReadInteger(line, 1, std::numeric_limits<unsigned int>::max(), count) || !(line >> maxVelocity) || maxVelocity < 0.0f)
+			{
+				error = "expected <count> <max velocity> <type> [<type> ...] with a positive count";
+				return false;
+			}
+			for (long long type; line >> type;)
+			{
+				if (type < 0 || type >= static_cast<long long>(SimulationManager::GetParticleNames().size()))
+				{
+					error = "invalid particle type " + std::to_string(type);
+					return false;
+				}
+				types.push_back(static_cast<unsigned int>(type));
+			}
+			if (!line.eof())
+			{
+				error = "expected a particle type";
+				return false;
+			}
+			if (types.empty())
+			{
+				error = "expected at least one particle type";
+				return false;
+			}
+
+			// Random particles are placed as temporary particles, so make them permanent right away
+			SimulationManager::PlaceRandomParticles(types, static_cast<unsigned int>(count), maxVelocity);
+			SimulationManager::PublishTemporaryParticles();
+		}
+		else
+		{
+			error = "unknown setting '" + keyword + "'";
+			return false;
+		}
+
+		return true;
+	}
+}
+
+namespace Scenario
+{
+	bool Load(const std::string& filepath, std::string& error) noexcept
+	{
+		PROFILE_FUNCTION();
+
+		std::ifstream file(filepath);
+		if (!file)
+		{
+			error = "could not open '" + filepath + "'";
+			return false;
+		}
+
+		std::string text;
+		for (unsigned int lineNumber = 1; std::getline(file, text); ++lineNumber)
+		{
+			size_t comment = text.find('#');
+			if (comment != std::string::npos)
+				text.erase(comment);
+
+			std::istringstream line(text);
+			std::string keyword;
+			if (!(line >> keyword))
+				continue;
+
+			if (!ApplyLine(line, keyword, error))
+			{
+				error = filepath + ":" + std::to_string(lineNumber) + ": " + error;
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool Save(const std::string& filepath) noexcept
+	{
+		PROFILE_FUNCTION();
+
+		std::ofstream file(filepath);
+		if (!file)
+			return false;
+
+		// Enough digits to round trip every float exactly
+		file.precision(9);
+
+		// The skin first: with periodic boundaries the box is kept at least as large as the list radius
+		file << "neighbor-list-skin " << SimulationManager::GetNeighborListSkin() << '\n';
+		DirectX::XMFLOAT3 boxMax = SimulationManager::GetBoxSize();
+		file << "box " << 2.0f * boxMax.x << ' ' << 2.0f * boxMax.y << ' ' << 2.0f * boxMax.z << '\n';
+		file << "periodic " << (SimulationManager::IsPeriodic() ? 1 : 0) << '\n';
+		file << "integrator " << IntegratorName(SimulationManager::GetIntegrator()) << '\n';
+		file << "lennard-jones " << (SimulationManager::LennardJonesEnabled() ? 1 : 0) << '\n';
+		file << "electrostatics " << ElectrostaticsName(SimulationManager::GetElectrostatics()) << '\n';
+		const BarnesHut& barnesHut = SimulationManager::GetBarnesHut();
+		file << "barnes-hut " << barnesHut.GetOpeningAngle() << ' ' << barnesHut.GetSoftening() << '\n';
+		const ParticleMeshEwald& pme = SimulationManager::GetParticleMeshEwald();
+		file << "pme " << pme.GetGridSpacing() << ' ' << pme.GetTolerance() << '\n';
+		file << "time-step " << SimulationManager::GetTimeStep() << '\n';
+		file << "substeps " << SimulationManager::GetSubstepsPerTick() << '\n';
+
+		const ParticleStore& particles = SimulationManager::GetParticles();
+		for (unsigned int iii = 0; iii < particles.Size(); ++iii)
+		{
+			Particle p = particles[iii];
+			file << "particle " << p.type << ' ' << p.mass << ' '
+				<< p.p_x << ' ' << p.p_y << ' ' << p.p_z << ' '
+				<< p.v_x << ' ' << p.v_y << ' ' << p.v_z << '\n';
+		}
+
+		return static_cast<bool>(file);
+	}
+}
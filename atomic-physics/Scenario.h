@@ -0,0 +1,30 @@
+#pragma once
+#include "CorePch.h"
+
+#include <string>
+
+// Plain text description of a simulation setup, used by the headless runner to load a starting state and
+// to save the final one. One setting per line; blank lines and anything after a '#' are ignored:
+//
+//   neighbor-list-skin <skin>                 (nm)
+//   box <x> <y> <z>                           full edge lengths of the box (nm)
+//   periodic <0|1>
+//   integrator <velocity-verlet|event-driven>
+//   lennard-jones <0|1>
+//   electrostatics <none|barnes-hut|pme>
+//   barnes-hut <opening angle> <softening>    (softening in nm)
+//   pme <grid spacing> <tolerance>            (grid spacing in nm)
+//   time-step <dt>                            (ps)
+//   substeps <count>                          time steps per timer tick
+//   particle <type> <mass> <px> <py> <pz> <vx> <vy> <vz>
+//   random <count> <max velocity> <type> [<type> ...]
+//
+// Settings are applied in order to the active simulation of the SimulationManager, so a 'box' line should
+// come before any 'random' line that depends on it.
+namespace Scenario
+{
+	// Returns false and describes the first bad line in 'error' if the file can't be applied
+	bool Load(const std::string& filepath, std::string& error) noexcept;
+	// Write the active simulation's settings and every particle
+	bool Save(const std::string& filepath) noexcept;
+}
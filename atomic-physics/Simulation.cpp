@@ -1,4 +1,9 @@
 #include "Simulation.h"
+#include "Clock.h"
+#include "SimulationKernels.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
 
 using DirectX::XMFLOAT3;
 
@@ -6,80 +11,287 @@ Simulation::Simulation() noexcept :
 	m_boxMaxX(2.0f),
 	m_boxMaxY(2.0f),
 	m_boxMaxZ(2.0f),
-	m_elapsedTime(0),
-	m_isPlaying(false)
+	m_isPlaying(false),
+	m_lennardJonesEnabled(false),
+	m_electrostatics(Electrostatics::None),
+	m_integrator(Integrator::VelocityVerlet),
+	m_timeStep(static_cast<float>(DefaultTickSeconds / DefaultSubstepsPerTick)),
+	m_substepsPerTick(DefaultSubstepsPerTick),
+	m_simulatedTime(0.0),
+	m_stepCount(0),
+	m_forcesValid(false),
+	m_throughputWindowStart(Clock::Now()),
+	m_throughputWindowSteps(0),
+	m_throughputWindowUpdateTicks(0),
+	m_throughputWindowUpdates(0),
+	m_stepsPerSecond(0.0),
+	m_updateMilliseconds(0.0)
 {
 	PROFILE_FUNCTION();
 
 	m_timer = std::make_unique<StepTimer>();
+	m_timer->SetFixedTimeStep(true);
+	m_timer->SetTargetElapsedSeconds(DefaultTickSeconds);
+	m_timer->SetMaxUpdatesPerTick(DefaultCatchUpBudget);
+
+	m_neighborList.SetCutoff(m_lennardJones.Cutoff());
 }
 
 bool Simulation::ChangeParticleType(unsigned int particleIndex, unsigned int type) noexcept
 {
-	if (m_particles[particleIndex].type != type)
+	unsigned int* types = m_particles.Type();
+	if (types[particleIndex] != type)
 	{
-		m_particles[particleIndex].type = type;
+		types[particleIndex] = type;
+		m_forcesValid = false;
+		m_hardSpheres.Invalidate();
 		return true;
 	}
 	return false;
 }
 bool Simulation::ChangeParticleMass(unsigned int particleIndex, unsigned int mass) noexcept
 {
-	if (m_particles[particleIndex].mass != mass)
+	unsigned int* masses = m_particles.Mass();
+	if (masses[particleIndex] != mass)
 	{
-		m_particles[particleIndex].mass = mass;
+		masses[particleIndex] = mass;
 		return true;
 	}
 	return false;
 }
+void Simulation::SetParticlePosition(unsigned int particleIndex, float p_x, float p_y, float p_z) noexcept
+{
+	ParticleRef particle = m_particles[particleIndex];
+	particle.p_x = p_x;
+	particle.p_y = p_y;
+	particle.p_z = p_z;
+	m_forcesValid = false;
+	m_hardSpheres.Invalidate();
+}
+void Simulation::SetParticleVelocity(unsigned int particleIndex, float v_x, float v_y, float v_z) noexcept
+{
+	ParticleRef particle = m_particles[particleIndex];
+	particle.v_x = v_x;
+	particle.v_y = v_y;
+	particle.v_z = v_z;
+	m_forcesValid = false;
+	m_hardSpheres.Invalidate();
+}
 
 void Simulation::Update() noexcept
 {
 	PROFILE_FUNCTION();
 
+	uint64_t start = Clock::Now();
+
 	m_timer->Tick([&]() noexcept
 		{
 			PROFILE_SCOPE("Simulation Update Physics");
 
-			double currentTime = m_timer->GetTotalSeconds();
-			double timeDelta = currentTime - m_elapsedTime;
-			m_elapsedTime = currentTime;
-
 			if (!m_isPlaying)
 				return;
 
-			if (timeDelta > 0.1)
-				return;
+			Run(m_substepsPerTick);
+		}
+	);
+
+	// Only refresh the throughput readout once per window so that it doesn't flicker from frame to frame
+	uint64_t now = Clock::Now();
+	m_throughputWindowUpdateTicks += now - start;
+	++m_throughputWindowUpdates;
+	if (now - m_throughputWindowStart >= static_cast<uint64_t>(ThroughputWindowSeconds * Clock::Frequency))
+	{
+		double seconds = Clock::Seconds(now - m_throughputWindowStart);
+		m_stepsPerSecond = (m_stepCount - m_throughputWindowSteps) / seconds;
+		m_updateMilliseconds = Clock::Seconds(m_throughputWindowUpdateTicks) * 1000.0 / m_throughputWindowUpdates;
+
+		m_throughputWindowStart = now;
+		m_throughputWindowSteps = m_stepCount;
+		m_throughputWindowUpdateTicks = 0;
+		m_throughputWindowUpdates = 0;
+	}
+}
+
+void Simulation::Run(unsigned int steps) noexcept
+{
+	PROFILE_FUNCTION();
+
+	if (m_integrator == Integrator::EventDriven)
+	{
+		// Collisions are resolved exactly, so the whole span is covered in one go
+		float duration = m_timeStep * steps;
+		m_hardSpheres.Advance(m_particles, duration, { m_boxMaxX, m_boxMaxY, m_boxMaxZ }, m_neighborList.IsPeriodic());
+		m_simulatedTime += duration;
+		m_stepCount += steps;
+		return;
+	}
+
+	for (unsigned int iii = 0; iii < steps; ++iii)
+		Step(m_timeStep);
+}
 
-			for (Particle& p : m_particles)
-			{
-				p.p_x += static_cast<float>(p.v_x * timeDelta);
-				p.p_y += static_cast<float>(p.v_y * timeDelta);
-				p.p_z += static_cast<float>(p.v_z * timeDelta);
+void Simulation::CopyFrom(const Simulation& other) noexcept
+{
+	PROFILE_FUNCTION();
+
+	m_particles.Clear();
+
+	// The boundaries, skin and electrostatics of 'other' are consistent with each other and its box, so they
+	// are copied as they are instead of being checked one by one against this simulation's settings
+	m_electrostatics = other.m_electrostatics;
+	m_neighborList.SetPeriodic(other.IsPeriodic());
+	m_neighborList.SetSkin(other.GetNeighborListSkin());
+
+	// Size the box before adding the particles so that none of them gets pushed inwards. This also
+	// invalidates the neighbor list, the forces and the hard sphere events
+	SetBoxSize(other.GetBoxSize());
+
+	const ParticleStore& particles = other.GetParticles();
+	m_particles.Reserve(particles.Size());
+	for (unsigned int iii = 0; iii < particles.Size(); ++iii)
+		m_particles.PushBack(particles[iii]);
+
+	SetLennardJonesEnabled(other.LennardJonesEnabled());
+	m_barnesHut.SetOpeningAngle(other.m_barnesHut.GetOpeningAngle());
+	m_barnesHut.SetSoftening(other.m_barnesHut.GetSoftening());
+	m_particleMeshEwald.SetGridSpacing(other.m_particleMeshEwald.GetGridSpacing());
+	m_particleMeshEwald.SetTolerance(other.m_particleMeshEwald.GetTolerance());
+	SetIntegrator(other.GetIntegrator());
+
+	m_timeStep = other.m_timeStep;
+	m_substepsPerTick = other.m_substepsPerTick;
+	SetTickSeconds(other.GetTickSeconds());
+	SetCatchUpBudget(other.GetCatchUpBudget());
+}
+
+void Simulation::Step(float timeStep) noexcept
+{
+	PROFILE_FUNCTION();
 
-				if (p.p_x > m_boxMaxX || p.p_x < -m_boxMaxX)
-					p.v_x *= -1;
+	XMFLOAT3 boxMax = { m_boxMaxX, m_boxMaxY, m_boxMaxZ };
+	bool forcesEnabled = ForcesEnabled();
+	// Nothing else reads the lists, and keeping them up to date for a dense box without forces costs far more
+	// than the step itself
+	bool neighborListUsed = NeighborListUsed();
 
-				if (p.p_y > m_boxMaxY || p.p_y < -m_boxMaxY)
-					p.v_y *= -1;
+	// Velocity Verlet: half kick with the current forces, drift, recompute the forces, half kick
+	if (forcesEnabled)
+	{
+		if (!m_forcesValid)
+		{
+			if (neighborListUsed)
+				m_neighborList.Update(m_particles, boxMax);
+			ComputeForces();
+		}
+		Kick(0.5f * timeStep);
+	}
 
-				if (p.p_z > m_boxMaxZ || p.p_z < -m_boxMaxZ)
-					p.v_z *= -1;
-			}
+	bool periodic = m_neighborList.IsPeriodic();
+	ThreadPool::Get().ParallelFor(0, m_particles.Size(), ParticlesPerChunk,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			if (periodic)
+				SimulationKernels::IntegrateAndWrap(m_particles, begin, end, timeStep, boxMax);
+			else
+				SimulationKernels::IntegrateAndReflect(m_particles, begin, end, timeStep, boxMax);
 		}
 	);
+
+	if (forcesEnabled)
+	{
+		if (neighborListUsed)
+			m_neighborList.Update(m_particles, boxMax);
+		ComputeForces();
+		Kick(0.5f * timeStep);
+	}
+	m_forcesValid = forcesEnabled;
+
+	m_simulatedTime += timeStep;
+	++m_stepCount;
 }
 
-Particle& Simulation::AddParticle(int type, int mass, float p_x, float p_y, float p_z, float v_x, float v_y, float v_z) noexcept
+void Simulation::ComputeForces() noexcept
 {
 	PROFILE_FUNCTION();
 
-	return m_particles.emplace_back(type, mass, p_x, p_y, p_z, v_x, v_y, v_z);
+	if (m_lennardJonesEnabled)
+		m_lennardJones.Compute(m_particles, m_neighborList);
+
+	if (m_electrostatics == Electrostatics::BarnesHut)
+		m_barnesHut.Compute(m_particles);
+	else if (m_electrostatics == Electrostatics::ParticleMeshEwald)
+		m_particleMeshEwald.Compute(m_particles, m_neighborList);
+}
+
+void Simulation::Kick(float timeDelta) noexcept
+{
+	PROFILE_FUNCTION();
+
+	if (m_lennardJonesEnabled)
+		ApplyForces(m_lennardJones.ForceX(), m_lennardJones.ForceY(), m_lennardJones.ForceZ(), timeDelta);
+
+	if (m_electrostatics == Electrostatics::BarnesHut)
+		ApplyForces(m_barnesHut.ForceX(), m_barnesHut.ForceY(), m_barnesHut.ForceZ(), timeDelta);
+	else if (m_electrostatics == Electrostatics::ParticleMeshEwald)
+		ApplyForces(m_particleMeshEwald.ForceX(), m_particleMeshEwald.ForceY(), m_particleMeshEwald.ForceZ(), timeDelta);
+}
+
+void Simulation::ApplyForces(const float* f_x, const float* f_y, const float* f_z, float timeDelta) noexcept
+{
+	ThreadPool::Get().ParallelFor(0, m_particles.Size(), ParticlesPerChunk,
+		[&](unsigned int begin, unsigned int end) noexcept
+		{
+			SimulationKernels::ApplyForces(m_particles, f_x, f_y, f_z, begin, end, timeDelta);
+		}
+	);
+}
+
+ParticleRef Simulation::AddParticle(int type, int mass, float p_x, float p_y, float p_z, float v_x, float v_y, float v_z) noexcept
+{
+	PROFILE_FUNCTION();
+
+	m_neighborList.Invalidate();
+	m_forcesValid = false;
+	m_hardSpheres.Invalidate();
+	return m_particles.PushBack({ static_cast<unsigned int>(type), static_cast<unsigned int>(mass), p_x, p_y, p_z, v_x, v_y, v_z });
+}
+
+unsigned int Simulation::AddParticles(std::span<const Particle> particles) noexcept
+{
+	PROFILE_FUNCTION();
+
+	// Grow geometrically so that many small batches don't reallocate every time
+	unsigned int first = m_particles.Size();
+	unsigned int size = first + static_cast<unsigned int>(particles.size());
+	if (size > m_particles.Capacity())
+		m_particles.Reserve(std::max(size, 2 * first));
+	for (const Particle& particle : particles)
+		m_particles.PushBack(particle);
+
+	m_neighborList.Invalidate();
+	m_forcesValid = false;
+	m_hardSpheres.Invalidate();
+	return first;
 }
 
 void Simulation::RemoveParticle(unsigned int index) noexcept
 {
-	m_particles.erase(m_particles.begin() + index);
+	m_particles.Erase(index);
+	m_neighborList.Invalidate();
+	m_forcesValid = false;
+	m_hardSpheres.Invalidate();
+}
+
+void Simulation::RemoveParticles(const std::vector<unsigned int>& indices) noexcept
+{
+	PROFILE_FUNCTION();
+
+	for (unsigned int index : indices)
+		m_particles.Erase(index);
+
+	m_neighborList.Invalidate();
+	m_forcesValid = false;
+	m_hardSpheres.Invalidate();
 }
 
 XMFLOAT3 Simulation::GetBoxSize() const noexcept
@@ -92,33 +304,84 @@ void Simulation::SetBoxSize(float xyz) noexcept
 	SetBoxSize({ xyz, xyz, xyz });
 }
 
+void Simulation::SetNeighborListSkin(float skin) noexcept
+{
+	if (IsPeriodic())
+	{
+		float smallestHalfExtent = std::min({ m_boxMaxX, m_boxMaxY, m_boxMaxZ });
+		skin = std::min(skin, smallestHalfExtent - m_neighborList.GetCutoff());
+	}
+	m_neighborList.SetSkin(std::max(skin, 0.0f));
+	m_forcesValid = false;
+}
+
+bool Simulation::SetPeriodic(bool periodic) noexcept
+{
+	// The reciprocal sum and the minimum images of PME describe an infinite periodic system; with walls
+	// its forces would be wrong
+	if (!periodic && m_electrostatics == Electrostatics::ParticleMeshEwald)
+		return false;
+
+	m_neighborList.SetPeriodic(periodic);
+	m_forcesValid = false;
+
+	// The box may be too small for the neighbor list radius with periodic images
+	if (periodic)
+		SetBoxSize(GetBoxSize());
+	return true;
+}
+
+void Simulation::SetElectrostatics(Electrostatics method) noexcept
+{
+	m_electrostatics = method;
+	m_forcesValid = false;
+	m_neighborList.Invalidate();
+
+	if (method == Electrostatics::ParticleMeshEwald)
+		SetPeriodic(true);
+}
+
 void Simulation::SetBoxSize(DirectX::XMFLOAT3 size) noexcept
 {
+	if (IsPeriodic())
+	{
+		float minimum = m_neighborList.ListRadius();
+		size = { std::max(size.x, minimum), std::max(size.y, minimum), std::max(size.z, minimum) };
+	}
+
 	bool smallerBox = size.x < m_boxMaxX || size.y < m_boxMaxY || size.z < m_boxMaxZ;
 
 	m_boxMaxX = size.x;
 	m_boxMaxY = size.y;
 	m_boxMaxZ = size.z;
+	m_neighborList.Invalidate();
+	m_forcesValid = false;
+	m_hardSpheres.Invalidate();
 
 	// If the box was made smaller, update any atoms that need to be moved inwards
 	if (smallerBox)
 	{
-		for (Particle& particle : m_particles)
+		float* p_x = m_particles.PositionX();
+		float* p_y = m_particles.PositionY();
+		float* p_z = m_particles.PositionZ();
+
+		unsigned int count = m_particles.Size();
+		for (unsigned int iii = 0; iii < count; ++iii)
 		{
-			if (particle.p_x > m_boxMaxX)
-				particle.p_x = m_boxMaxX;
-			else if (particle.p_x < -m_boxMaxX)
-				particle.p_x = -m_boxMaxX;
-
-			if (particle.p_y > m_boxMaxY)
-				particle.p_y = m_boxMaxY;
-			else if (particle.p_y < -m_boxMaxY)
-				particle.p_y = -m_boxMaxY;
-
-			if (particle.p_z > m_boxMaxZ)
-				particle.p_z = m_boxMaxZ;
-			else if (particle.p_z < -m_boxMaxZ)
-				particle.p_z = -m_boxMaxZ;
+			if (p_x[iii] > m_boxMaxX)
+				p_x[iii] = m_boxMaxX;
+			else if (p_x[iii] < -m_boxMaxX)
+				p_x[iii] = -m_boxMaxX;
+
+			if (p_y[iii] > m_boxMaxY)
+				p_y[iii] = m_boxMaxY;
+			else if (p_y[iii] < -m_boxMaxY)
+				p_y[iii] = -m_boxMaxY;
+
+			if (p_z[iii] > m_boxMaxZ)
+				p_z[iii] = m_boxMaxZ;
+			else if (p_z[iii] < -m_boxMaxZ)
+				p_z[iii] = -m_boxMaxZ;
 		}
 	}
 }
\ No newline at end of file
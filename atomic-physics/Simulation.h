@@ -1,20 +1,28 @@
 #pragma once
-#include "pch.h"
+#include "CorePch.h"
+#include "BarnesHut.h"
+#include "HardSpheres.h"
+#include "LennardJones.h"
+#include "NeighborList.h"
+#include "ParticleMeshEwald.h"
+#include "ParticleStore.h"
 #include "StepTimer.h"
 
 #include <vector>
 #include <memory>
+#include <span>
 
-struct Particle
+enum class Electrostatics
 {
-	unsigned int type; // 0 --> electron, N > 0 --> element number (number of protons)
-	unsigned int mass; // [only for non-electron] #Proton + #Neutron
-	float p_x;		   // Position
-	float p_y;
-	float p_z;
-	float v_x;	       // Velocity
-	float v_y;
-	float v_z;
+	None,
+	BarnesHut,
+	ParticleMeshEwald
+};
+
+enum class Integrator
+{
+	VelocityVerlet,
+	EventDriven
 };
 
 class Simulation
@@ -26,32 +34,138 @@ public:
 	// ~Simulation --> automatically gets called because Simulation does get destructed on program close
 
 	void Update() noexcept;
+	// Advance by 'steps' time steps right away, regardless of the timer and the play state (headless runs)
+	void Run(unsigned int steps) noexcept;
+	// Replace the particles and every setting with those of 'other' so that a variant can be run side by side.
+	// The timer, the statistics and the play state are not copied
+	void CopyFrom(const Simulation& other) noexcept;
 
-	Particle& AddParticle(int type, int mass, float p_x, float p_y, float p_z, float v_x, float v_y, float v_z) noexcept;
-	const std::vector<Particle>& GetParticles() const noexcept { return m_particles; }
-	Particle& GetParticle(int index) noexcept { return m_particles[index]; }
-	unsigned int ParticleCount() const noexcept { return static_cast<unsigned int>(m_particles.size()); }
+	ParticleRef AddParticle(int type, int mass, float p_x, float p_y, float p_z, float v_x, float v_y, float v_z) noexcept;
+	// Append all of 'particles' with a single reservation. Returns the index of the first one
+	unsigned int AddParticles(std::span<const Particle> particles) noexcept;
+	const ParticleStore& GetParticles() const noexcept { return m_particles; }
+	ParticleRef GetParticle(int index) noexcept { return m_particles[index]; }
+	unsigned int ParticleCount() const noexcept { return m_particles.Size(); }
+	// Spatial grid / neighbor lists as of the most recent rebuild
+	const CellList& GetCellList() const noexcept { return m_neighborList.GetCellList(); }
+	const NeighborList& GetNeighborList() const noexcept { return m_neighborList; }
+	float GetNeighborListSkin() const noexcept { return m_neighborList.GetSkin(); }
+	// With periodic boundaries the skin is limited so that the list radius stays within half of the box
+	void SetNeighborListSkin(float skin) noexcept;
+	// Particles either bounce off the box walls or leave through one face and re-enter through the opposite one.
+	// Fails when turning them off while particle-mesh Ewald is in use
+	bool IsPeriodic() const noexcept { return m_neighborList.IsPeriodic(); }
+	bool SetPeriodic(bool periodic) noexcept;
+
+	// Lennard-Jones forces between the atoms and Coulomb forces between all charges.
+	// When both are disabled the particles move ballistically
+	const LennardJones& GetLennardJones() const noexcept { return m_lennardJones; }
+	bool LennardJonesEnabled() const noexcept { return m_lennardJonesEnabled; }
+	void SetLennardJonesEnabled(bool enabled) noexcept { m_lennardJonesEnabled = enabled; m_forcesValid = false; m_neighborList.Invalidate(); }
+	// Barnes-Hut ignores periodic images. Particle-mesh Ewald models a periodic system, so selecting it turns
+	// on periodic boundaries
+	Electrostatics GetElectrostatics() const noexcept { return m_electrostatics; }
+	void SetElectrostatics(Electrostatics method) noexcept;
+	BarnesHut& GetBarnesHut() noexcept { return m_barnesHut; }
+	const BarnesHut& GetBarnesHut() const noexcept { return m_barnesHut; }
+	ParticleMeshEwald& GetParticleMeshEwald() noexcept { return m_particleMeshEwald; }
+	const ParticleMeshEwald& GetParticleMeshEwald() const noexcept { return m_particleMeshEwald; }
+	// Velocity Verlet steps the enabled force fields; event-driven dynamics treats the atoms as hard spheres
+	// that only interact when they collide and ignores the force fields
+	Integrator GetIntegrator() const noexcept { return m_integrator; }
+	void SetIntegrator(Integrator integrator) noexcept { m_integrator = integrator; m_forcesValid = false; m_hardSpheres.Invalidate(); }
+	const HardSpheres& GetHardSpheres() const noexcept { return m_hardSpheres; }
 	void RemoveParticle(unsigned int index) noexcept;
+	// Each removal moves the last particle into the freed index, so 'indices' must be sorted in descending
+	// order and free of duplicates for every index to still refer to the particle it meant
+	void RemoveParticles(const std::vector<unsigned int>& indices) noexcept;
 
 	bool ChangeParticleType(unsigned int particleIndex, unsigned int type) noexcept;
 	bool ChangeParticleMass(unsigned int particleIndex, unsigned int mass) noexcept;
+	// Edits between steps. The forces and the predicted collisions are recomputed before the next step
+	void SetParticlePosition(unsigned int particleIndex, float p_x, float p_y, float p_z) noexcept;
+	void SetParticleVelocity(unsigned int particleIndex, float v_x, float v_y, float v_z) noexcept;
 	
 	DirectX::XMFLOAT3 GetSimulationDimensions() const noexcept { return { 2 * m_boxMaxX, 2 * m_boxMaxY, 2 * m_boxMaxZ }; }
 
 	double TotalSeconds() const noexcept { return m_timer->GetTotalSeconds(); }
 
+	// Fixed step integration. The StepTimer runs in fixed timestep mode and every timer tick advances the
+	// simulation by SubstepsPerTick velocity-Verlet steps of TimeStep (or, event-driven, by the same span of
+	// time in one go), so simulated time no longer depends on the frame rate. When frames fall behind, at most CatchUpBudget ticks are run per frame and the rest
+	// of the backlog is dropped
+	float GetTimeStep() const noexcept { return m_timeStep; }
+	void SetTimeStep(float timeStep) noexcept { m_timeStep = timeStep; }
+	unsigned int GetSubstepsPerTick() const noexcept { return m_substepsPerTick; }
+	void SetSubstepsPerTick(unsigned int substeps) noexcept { m_substepsPerTick = substeps; }
+	double GetTickSeconds() const noexcept { return m_timer->GetTargetElapsedSeconds(); }
+	void SetTickSeconds(double seconds) noexcept { m_timer->SetTargetElapsedSeconds(seconds); }
+	unsigned int GetCatchUpBudget() const noexcept { return m_timer->GetMaxUpdatesPerTick(); }
+	void SetCatchUpBudget(unsigned int maxTicks) noexcept { m_timer->SetMaxUpdatesPerTick(maxTicks); }
+	uint64_t DroppedTicks() const noexcept { return m_timer->GetDroppedUpdates(); }
+	double SecondsUntilNextTick() const noexcept { return m_timer->GetSecondsUntilNextUpdate(); }
+	double SimulatedSeconds() const noexcept { return m_simulatedTime; }
+	uint64_t StepCount() const noexcept { return m_stepCount; }
+
+	// Throughput of Update, measured over windows of ThroughputWindowSeconds of wall clock time
+	double StepsPerSecond() const noexcept { return m_stepsPerSecond; }
+	double ParticleStepsPerSecond() const noexcept { return m_stepsPerSecond * m_particles.Size(); }
+	// Average wall clock time of one call to Update
+	double UpdateMilliseconds() const noexcept { return m_updateMilliseconds; }
+
 	bool IsPlaying() const noexcept { return m_isPlaying; }
 	bool SwitchPlayPause() noexcept { m_isPlaying = !m_isPlaying; return m_isPlaying; }
 
+	// With periodic boundaries no half extent is made smaller than the neighbor list radius, so the cutoff is at
+	// most half of every box length and each pair within it is a unique nearest image
 	DirectX::XMFLOAT3 GetBoxSize() const noexcept;
 	void SetBoxSize(float xyz) noexcept;
 	void SetBoxSize(DirectX::XMFLOAT3 size) noexcept;
 
 private:
-	
+	void Step(float timeStep) noexcept;
+	bool ForcesEnabled() const noexcept { return m_lennardJonesEnabled || m_electrostatics != Electrostatics::None; }
+	// Barnes-Hut builds its own octree, so only these read the neighbor lists
+	bool NeighborListUsed() const noexcept { return m_lennardJonesEnabled || m_electrostatics == Electrostatics::ParticleMeshEwald; }
+	void ComputeForces() noexcept;
+	// v += F / m * timeDelta for every enabled force field
+	void Kick(float timeDelta) noexcept;
+	void ApplyForces(const float* f_x, const float* f_y, const float* f_z, float timeDelta) noexcept;
+
+	static constexpr double DefaultTickSeconds = 1.0 / 60.0;
+	static constexpr unsigned int DefaultSubstepsPerTick = 4;
+	static constexpr unsigned int DefaultCatchUpBudget = 4;
+	static constexpr double ThroughputWindowSeconds = 0.5;
+
+	// Number of particles handed to a single ThreadPool task. 4096 particles * 24 bytes of position/velocity
+	// keeps each chunk's working set inside a core's L2 cache and is a multiple of every SIMD width
+	static constexpr unsigned int ParticlesPerChunk = 4096;
+
 	std::unique_ptr<StepTimer> m_timer;
-	std::vector<Particle> m_particles;
+	ParticleStore m_particles;
+	NeighborList m_neighborList;
+	LennardJones m_lennardJones;
+	BarnesHut m_barnesHut;
+	ParticleMeshEwald m_particleMeshEwald;
+	HardSpheres m_hardSpheres;
 	float m_boxMaxX, m_boxMaxY, m_boxMaxZ;
-	double m_elapsedTime;
 	bool m_isPlaying;
+	bool m_lennardJonesEnabled;
+	Electrostatics m_electrostatics;
+	Integrator m_integrator;
+
+	float m_timeStep;
+	unsigned int m_substepsPerTick;
+	double m_simulatedTime;
+	uint64_t m_stepCount;
+	// The forces from the end of the previous step are reused for the first half kick of the next one
+	bool m_forcesValid;
+
+	// Throughput measurement
+	uint64_t m_throughputWindowStart;
+	uint64_t m_throughputWindowSteps;
+	uint64_t m_throughputWindowUpdateTicks;
+	unsigned int m_throughputWindowUpdates;
+	double m_stepsPerSecond;
+	double m_updateMilliseconds;
 };
\ No newline at end of file
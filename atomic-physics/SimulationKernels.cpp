@@ -0,0 +1,251 @@
+#include "SimulationKernels.h"
+#include "CpuFeatures.h"
+#include "PhysicsConstants.h"
+
+#include <atomic>
+#include <cmath>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+// GCC/Clang will fuse a multiply + add into an FMA when the target has one (AVX-512F implies FMA), which
+// rounds differently, so contraction is disabled for every kernel including the scalar one.
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#define KERNEL_NO_CONTRACT
+#define KERNEL_TARGET(isa) SIMD_TARGET(isa)
+#elif defined(__GNUC__)
+#define KERNEL_NO_CONTRACT __attribute__((optimize("fp-contract=off")))
+#define KERNEL_TARGET(isa) __attribute__((target(isa), optimize("fp-contract=off")))
+#else
+#define KERNEL_NO_CONTRACT
+#define KERNEL_TARGET(isa)
+#endif
+
+// NOTE: Every kernel computes p += v * dt as a separate multiply and add (never an FMA), mirrors a position
+// that overshot a wall back inside as (+-2 * boxMax) - p and reflects the velocity by flipping its sign bit.
+// This is what keeps the SIMD kernels bit-identical to the scalar one.
+
+namespace
+{
+	using AxisKernel = void(*)(float* p, float* v, unsigned int begin, unsigned int end, float dt, float boxMax) noexcept;
+
+	KERNEL_NO_CONTRACT
+	void IntegrateAndReflectAxis_Scalar(float* p, float* v, unsigned int begin, unsigned int end, float dt, float boxMax) noexcept
+	{
+		const float twoBoxMax = 2.0f * boxMax;
+		for (unsigned int iii = begin; iii < end; ++iii)
+		{
+			float position = p[iii] + v[iii] * dt;
+
+			// Bounce off the wall at the point of contact instead of leaving the particle outside for a step
+			if (position > boxMax)
+			{
+				position = twoBoxMax - position;
+				v[iii] = -v[iii];
+			}
+			else if (position < -boxMax)
+			{
+				position = -twoBoxMax - position;
+				v[iii] = -v[iii];
+			}
+			p[iii] = position;
+		}
+	}
+
+#ifdef SIMD_X86
+	KERNEL_NO_CONTRACT
+	void IntegrateAndReflectAxis_SSE(float* p, float* v, unsigned int begin, unsigned int end, float dt, float boxMax) noexcept
+	{
+		const __m128 dt4 = _mm_set1_ps(dt);
+		const __m128 max4 = _mm_set1_ps(boxMax);
+		const __m128 min4 = _mm_set1_ps(-boxMax);
+		const __m128 wallMax4 = _mm_set1_ps(2.0f * boxMax);
+		const __m128 wallMin4 = _mm_set1_ps(-(2.0f * boxMax));
+		const __m128 sign4 = _mm_set1_ps(-0.0f);
+
+		unsigned int iii = begin;
+		for (; iii + 4 <= end; iii += 4)
+		{
+			__m128 vel = _mm_loadu_ps(v + iii);
+			__m128 pos = _mm_add_ps(_mm_loadu_ps(p + iii), _mm_mul_ps(vel, dt4));
+
+			// Outside the box -> mirror the position and flip the sign bit of the velocity (SSE2 has no blend, so mask)
+			__m128 above = _mm_cmpgt_ps(pos, max4);
+			__m128 below = _mm_cmplt_ps(pos, min4);
+			__m128 outside = _mm_or_ps(above, below);
+			__m128 mirrored = _mm_sub_ps(_mm_or_ps(_mm_and_ps(above, wallMax4), _mm_and_ps(below, wallMin4)), pos);
+			pos = _mm_or_ps(_mm_and_ps(outside, mirrored), _mm_andnot_ps(outside, pos));
+			vel = _mm_xor_ps(vel, _mm_and_ps(outside, sign4));
+
+			_mm_storeu_ps(p + iii, pos);
+			_mm_storeu_ps(v + iii, vel);
+		}
+
+		IntegrateAndReflectAxis_Scalar(p, v, iii, end, dt, boxMax);
+	}
+
+	KERNEL_TARGET("avx2")
+	void IntegrateAndReflectAxis_AVX2(float* p, float* v, unsigned int begin, unsigned int end, float dt, float boxMax) noexcept
+	{
+		const __m256 dt8 = _mm256_set1_ps(dt);
+		const __m256 max8 = _mm256_set1_ps(boxMax);
+		const __m256 min8 = _mm256_set1_ps(-boxMax);
+		const __m256 wallMax8 = _mm256_set1_ps(2.0f * boxMax);
+		const __m256 wallMin8 = _mm256_set1_ps(-(2.0f * boxMax));
+		const __m256 sign8 = _mm256_set1_ps(-0.0f);
+
+		unsigned int iii = begin;
+		for (; iii + 8 <= end; iii += 8)
+		{
+			__m256 vel = _mm256_loadu_ps(v + iii);
+			__m256 pos = _mm256_add_ps(_mm256_loadu_ps(p + iii), _mm256_mul_ps(vel, dt8));
+
+			__m256 above = _mm256_cmp_ps(pos, max8, _CMP_GT_OQ);
+			__m256 outside = _mm256_or_ps(above, _mm256_cmp_ps(pos, min8, _CMP_LT_OQ));
+			__m256 mirrored = _mm256_sub_ps(_mm256_blendv_ps(wallMin8, wallMax8, above), pos);
+			pos = _mm256_blendv_ps(pos, mirrored, outside);
+			vel = _mm256_blendv_ps(vel, _mm256_xor_ps(vel, sign8), outside);
+
+			_mm256_storeu_ps(p + iii, pos);
+			_mm256_storeu_ps(v + iii, vel);
+		}
+
+		IntegrateAndReflectAxis_Scalar(p, v, iii, end, dt, boxMax);
+	}
+
+	KERNEL_TARGET("avx512f")
+	void IntegrateAndReflectAxis_AVX512(float* p, float* v, unsigned int begin, unsigned int end, float dt, float boxMax) noexcept
+	{
+		const __m512 dt16 = _mm512_set1_ps(dt);
+		const __m512 max16 = _mm512_set1_ps(boxMax);
+		const __m512 min16 = _mm512_set1_ps(-boxMax);
+		const __m512 wallMax16 = _mm512_set1_ps(2.0f * boxMax);
+		const __m512 wallMin16 = _mm512_set1_ps(-(2.0f * boxMax));
+		const __m512i sign16 = _mm512_set1_epi32(static_cast<int>(0x80000000));
+
+		unsigned int iii = begin;
+		for (; iii + 16 <= end; iii += 16)
+		{
+			__m512 vel = _mm512_loadu_ps(v + iii);
+			__m512 pos = _mm512_add_ps(_mm512_loadu_ps(p + iii), _mm512_mul_ps(vel, dt16));
+
+			__mmask16 above = _mm512_cmp_ps_mask(pos, max16, _CMP_GT_OQ);
+			__mmask16 outside = above | _mm512_cmp_ps_mask(pos, min16, _CMP_LT_OQ);
+			pos = _mm512_mask_sub_ps(pos, outside, _mm512_mask_blend_ps(above, wallMin16, wallMax16), pos);
+			__m512 flipped = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(vel), sign16));
+			vel = _mm512_mask_blend_ps(outside, vel, flipped);
+
+			_mm512_storeu_ps(p + iii, pos);
+			_mm512_storeu_ps(v + iii, vel);
+		}
+
+		IntegrateAndReflectAxis_Scalar(p, v, iii, end, dt, boxMax);
+	}
+#endif
+
+	KERNEL_NO_CONTRACT
+	void IntegrateAndWrapAxis(float* p, const float* v, unsigned int begin, unsigned int end, float dt, float boxMax) noexcept
+	{
+		float length = 2.0f * boxMax;
+		float inverseLength = 1.0f / length;
+		for (unsigned int iii = begin; iii < end; ++iii)
+		{
+			float position = p[iii] + v[iii] * dt;
+			p[iii] = position - length * std::floor((position + boxMax) * inverseLength);
+		}
+	}
+
+	AxisKernel KernelForLevel(SimdLevel level) noexcept
+	{
+		switch (level)
+		{
+#ifdef SIMD_X86
+		case SimdLevel::AVX512: return IntegrateAndReflectAxis_AVX512;
+		case SimdLevel::AVX2:	return IntegrateAndReflectAxis_AVX2;
+		case SimdLevel::SSE:	return IntegrateAndReflectAxis_SSE;
+#endif
+		default:
+			return IntegrateAndReflectAxis_Scalar;
+		}
+	}
+
+	std::atomic<SimdLevel>& ActiveLevel() noexcept
+	{
+		static std::atomic<SimdLevel> level(SimulationKernels::GetMaxSupportedSimdLevel());
+		return level;
+	}
+}
+
+namespace SimulationKernels
+{
+	void IntegrateAndReflect(ParticleStore& particles, unsigned int begin, unsigned int end, float timeDelta, DirectX::XMFLOAT3 boxMax) noexcept
+	{
+		AxisKernel kernel = KernelForLevel(ActiveLevel().load(std::memory_order_relaxed));
+
+		kernel(particles.PositionX(), particles.VelocityX(), begin, end, timeDelta, boxMax.x);
+		kernel(particles.PositionY(), particles.VelocityY(), begin, end, timeDelta, boxMax.y);
+		kernel(particles.PositionZ(), particles.VelocityZ(), begin, end, timeDelta, boxMax.z);
+	}
+
+	void IntegrateAndWrap(ParticleStore& particles, unsigned int begin, unsigned int end, float timeDelta, DirectX::XMFLOAT3 boxMax) noexcept
+	{
+		IntegrateAndWrapAxis(particles.PositionX(), particles.VelocityX(), begin, end, timeDelta, boxMax.x);
+		IntegrateAndWrapAxis(particles.PositionY(), particles.VelocityY(), begin, end, timeDelta, boxMax.y);
+		IntegrateAndWrapAxis(particles.PositionZ(), particles.VelocityZ(), begin, end, timeDelta, boxMax.z);
+	}
+
+	void ApplyForces(ParticleStore& particles, const float* f_x, const float* f_y, const float* f_z, unsigned int begin, unsigned int end, float timeDelta) noexcept
+	{
+		const unsigned int* type = particles.Type();
+		const unsigned int* mass = particles.Mass();
+		float* v_x = particles.VelocityX();
+		float* v_y = particles.VelocityY();
+		float* v_z = particles.VelocityZ();
+
+		// Simple enough for the compiler to vectorize on its own
+		for (unsigned int iii = begin; iii < end; ++iii)
+		{
+			float inertialMass = Constants::InertialMass(type[iii], mass[iii]);
+			float scale = inertialMass == 0.0f ? 0.0f : Constants::ForceToAcceleration * timeDelta / inertialMass;
+			v_x[iii] += f_x[iii] * scale;
+			v_y[iii] += f_y[iii] * scale;
+			v_z[iii] += f_z[iii] * scale;
+		}
+	}
+
+	SimdLevel GetSimdLevel() noexcept
+	{
+		return ActiveLevel().load(std::memory_order_relaxed);
+	}
+
+	SimdLevel GetMaxSupportedSimdLevel() noexcept
+	{
+#ifdef SIMD_X86
+		const CpuFeatures& features = CpuFeatures::Get();
+		if (features.avx512f) return SimdLevel::AVX512;
+		if (features.avx2)	  return SimdLevel::AVX2;
+		if (features.sse2)	  return SimdLevel::SSE;
+#endif
+		return SimdLevel::Scalar;
+	}
+
+	void SetSimdLevel(SimdLevel level) noexcept
+	{
+		SimdLevel maxLevel = GetMaxSupportedSimdLevel();
+		ActiveLevel().store(level > maxLevel ? maxLevel : level, std::memory_order_relaxed);
+	}
+
+	const char* SimdLevelName(SimdLevel level) noexcept
+	{
+		switch (level)
+		{
+		case SimdLevel::Scalar: return "Scalar";
+		case SimdLevel::SSE:	return "SSE";
+		case SimdLevel::AVX2:	return "AVX2";
+		case SimdLevel::AVX512: return "AVX-512";
+		}
+		return "Unknown";
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "CorePch.h"
+#include "ParticleStore.h"
+
+enum class SimdLevel
+{
+	Scalar,
+	SSE,
+	AVX2,
+	AVX512
+};
+
+// Vectorized per-particle kernels used by Simulation::Update. Each kernel has a scalar fallback that
+// produces bit-identical results, and the widest kernel supported by the CPU is selected at runtime.
+namespace SimulationKernels
+{
+	// Advance the particles in [begin, end) by 'timeDelta' and reflect any particle that crossed a wall of
+	// the box [-boxMax, boxMax]: its position is mirrored back inside and its velocity is flipped
+	void IntegrateAndReflect(ParticleStore& particles, unsigned int begin, unsigned int end, float timeDelta, DirectX::XMFLOAT3 boxMax) noexcept;
+
+	// Advance the particles in [begin, end) by 'timeDelta' and wrap any particle that left the box
+	// [-boxMax, boxMax] back in through the opposite face (periodic boundaries). Scalar only
+	void IntegrateAndWrap(ParticleStore& particles, unsigned int begin, unsigned int end, float timeDelta, DirectX::XMFLOAT3 boxMax) noexcept;
+
+	// Accelerate the particles in [begin, end) by the given forces (kcal/mol/nm) for 'timeDelta'.
+	// Electrons are accelerated with the electron mass (Constants::InertialMass), massless nuclei are left untouched
+	void ApplyForces(ParticleStore& particles, const float* f_x, const float* f_y, const float* f_z, unsigned int begin, unsigned int end, float timeDelta) noexcept;
+
+	SimdLevel GetSimdLevel() noexcept;
+	SimdLevel GetMaxSupportedSimdLevel() noexcept;
+	// Force a specific kernel (e.g. for comparison). Requests for unsupported levels are clamped to the max supported level
+	void SetSimdLevel(SimdLevel level) noexcept;
+	const char* SimdLevelName(SimdLevel level) noexcept;
+}
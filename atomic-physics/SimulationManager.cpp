@@ -1,4 +1,6 @@
 #include "SimulationManager.h"
+#include "Clock.h"
+#include "ThreadPool.h"
 
 #include <algorithm>
 #include <random>
@@ -24,13 +26,26 @@ const std::array<std::vector<IsotopeMassAbundance>, 11> SimulationManager::m_iso
 
 std::vector<std::unique_ptr<Simulation>> SimulationManager::m_simulations;
 unsigned int SimulationManager::m_activeSimulationIndex = 0;
-std::optional<unsigned int> SimulationManager::m_firstTemporaryParticleIndex = std::nullopt;
+bool SimulationManager::m_runAllSimulations = false;
+std::thread SimulationManager::m_simulationThread;
+std::mutex SimulationManager::m_simulationMutex;
+std::atomic<unsigned int> SimulationManager::m_lockWaiters = 0;
+std::mutex SimulationManager::m_sleepMutex;
+std::condition_variable SimulationManager::m_sleepCondition;
+bool SimulationManager::m_stopSimulationThread = false;
+uint64_t SimulationManager::m_publishedStepCount = 0;
+bool SimulationManager::m_snapshotIsStale = false;
+TripleBuffer<SimulationSnapshot> SimulationManager::m_snapshots;
+std::vector<std::function<void()>> SimulationManager::m_queuedEdits;
+std::vector<ParticleHandle> SimulationManager::m_temporaryParticles;
+std::vector<bool> SimulationManager::m_isTemporarySlot;
 
 PlayPauseEvent				SimulationManager::e_PlayPause;
-ParticleAddedEvent			SimulationManager::e_ParticleAdded;
-ParticleRemovedEvent		SimulationManager::e_ParticleRemoved;
+ActiveSimulationChangedEvent	SimulationManager::e_ActiveSimulationChanged;
+ParticlesAddedEvent			SimulationManager::e_ParticlesAdded;
+ParticlesRemovedEvent		SimulationManager::e_ParticlesRemoved;
 ParticleTypeChangedEvent	SimulationManager::e_ParticleTypeChanged;
-ParticleTypeChangedEvent	SimulationManager::e_ParticleMassChanged;
+ParticleMassChangedEvent	SimulationManager::e_ParticleMassChanged;
 
 void SimulationManager::Initialize() noexcept
 {
@@ -42,7 +57,230 @@ void SimulationManager::Initialize() noexcept
 
 void SimulationManager::Update() noexcept
 {
-	m_simulations[m_activeSimulationIndex]->Update();
+	PROFILE_FUNCTION();
+
+	if (!m_runAllSimulations || m_simulations.size() == 1)
+	{
+		m_simulations[m_activeSimulationIndex]->Update();
+		return;
+	}
+
+	// One task per simulation. Each simulation owns its timer and all of its state, so they can be updated
+	// concurrently, and the ParallelFor calls they make for their own particles are shared out over the same
+	// pool. Every simulation has finished its update before this returns, so the active one can be drawn
+	ThreadPool::Get().ParallelFor(0, static_cast<unsigned int>(m_simulations.size()), 1,
+		[](unsigned int begin, unsigned int end) noexcept
+		{
+			for (unsigned int iii = begin; iii < end; ++iii)
+				m_simulations[iii]->Update();
+		}
+	);
+}
+
+void SimulationManager::StartSimulationThread() noexcept
+{
+	PROFILE_FUNCTION();
+
+	if (m_simulationThread.joinable())
+		return;
+
+	{
+		// Make sure there is a snapshot to draw before the first update has finished
+		std::lock_guard<std::mutex> lock(m_simulationMutex);
+		PublishSnapshot();
+	}
+
+	m_stopSimulationThread = false;
+	m_simulationThread = std::thread(SimulationThreadLoop);
+}
+
+void SimulationManager::StopSimulationThread() noexcept
+{
+	PROFILE_FUNCTION();
+
+	if (!m_simulationThread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_stopSimulationThread = true;
+	}
+	m_sleepCondition.notify_all();
+	m_simulationThread.join();
+}
+
+void SimulationManager::SimulationThreadLoop() noexcept
+{
+#ifdef PROFILE
+	constexpr uint64_t MemorySampleInterval = Clock::Frequency / 10;
+	uint64_t lastMemorySample = 0;
+#endif
+
+	while (true)
+	{
+		double sleepSeconds;
+		{
+			std::lock_guard<std::mutex> lock(m_simulationMutex);
+			const Simulation& active = *m_simulations[m_activeSimulationIndex];
+			[[maybe_unused]] uint64_t stepCount = active.StepCount();
+			Update();
+
+			// Counter tracks for the profile trace, so a slow update can be matched with what the active
+			// simulation was doing at the time
+			PROFILE_COUNTER("Particles", active.ParticleCount());
+			PROFILE_COUNTER("Substeps", active.StepCount() - stepCount);
+			PROFILE_COUNTER("Neighbor List Size", active.GetNeighborList().TotalNeighbors());
+			PROFILE_COUNTER("Neighbor List Rebuilds", active.GetNeighborList().RebuildCount());
+
+			// Don't bother copying the particles if the active simulation didn't move
+			if (m_simulations[m_activeSimulationIndex]->StepCount() != m_publishedStepCount)
+				PublishSnapshot();
+
+			sleepSeconds = SecondsUntilNextTick();
+		}
+
+#ifdef PROFILE
+		// Reading the resident memory is a system call, so sample it at a low fixed rate and outside the lock
+		uint64_t now = Clock::Now();
+		if (now - lastMemorySample >= MemorySampleInterval)
+		{
+			lastMemorySample = now;
+			PROFILE_COUNTER("Resident Memory (MB)", Instrumentor::ResidentBytes() / (1024.0 * 1024.0));
+		}
+#endif
+
+		// Give way to anyone waiting to read or edit the simulations before taking the lock again
+		while (m_lockWaiters.load(std::memory_order_acquire) != 0)
+			std::this_thread::yield();
+
+		// Sleep until the next timer tick is due instead of spinning on the timer
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		if (m_sleepCondition.wait_for(lock, std::chrono::duration<double>(sleepSeconds), []() { return m_stopSimulationThread; }))
+			return;
+	}
+}
+
+double SimulationManager::SecondsUntilNextTick() noexcept
+{
+	if (!m_runAllSimulations)
+		return m_simulations[m_activeSimulationIndex]->SecondsUntilNextTick();
+
+	double seconds = m_simulations[0]->SecondsUntilNextTick();
+	for (const std::unique_ptr<Simulation>& simulation : m_simulations)
+		seconds = std::min(seconds, simulation->SecondsUntilNextTick());
+	return seconds;
+}
+
+void SimulationManager::PublishSnapshot() noexcept
+{
+	PROFILE_FUNCTION();
+
+	const Simulation& simulation = *m_simulations[m_activeSimulationIndex];
+
+	SimulationSnapshot& snapshot = m_snapshots.WriteBuffer();
+	snapshot.particles.CopyFrom(simulation.GetParticles());
+	snapshot.simulationIndex = m_activeSimulationIndex;
+	snapshot.stepCount = simulation.StepCount();
+	snapshot.simulatedSeconds = simulation.SimulatedSeconds();
+	snapshot.droppedTicks = simulation.DroppedTicks();
+	snapshot.isPlaying = simulation.IsPlaying();
+
+	snapshot.simulations.resize(m_simulations.size());
+	for (unsigned int iii = 0; iii < m_simulations.size(); ++iii)
+	{
+		SimulationSummary& summary = snapshot.simulations[iii];
+		summary.particleCount = m_simulations[iii]->ParticleCount();
+		summary.isPlaying = m_simulations[iii]->IsPlaying();
+		summary.stepsPerSecond = m_simulations[iii]->StepsPerSecond();
+		summary.particleStepsPerSecond = m_simulations[iii]->ParticleStepsPerSecond();
+		summary.updateMilliseconds = m_simulations[iii]->UpdateMilliseconds();
+	}
+	snapshot.runAllSimulations = m_runAllSimulations;
+
+	snapshot.boxSize = simulation.GetBoxSize();
+	snapshot.periodic = simulation.IsPeriodic();
+	snapshot.integrator = simulation.GetIntegrator();
+	snapshot.timeStep = simulation.GetTimeStep();
+	snapshot.substepsPerTick = simulation.GetSubstepsPerTick();
+	snapshot.tickSeconds = simulation.GetTickSeconds();
+	snapshot.catchUpBudget = simulation.GetCatchUpBudget();
+	snapshot.neighborListSkin = simulation.GetNeighborListSkin();
+	snapshot.lennardJonesEnabled = simulation.LennardJonesEnabled();
+	snapshot.electrostatics = simulation.GetElectrostatics();
+
+	const NeighborList& neighborList = simulation.GetNeighborList();
+	snapshot.neighborListRebuilds = neighborList.RebuildCount();
+	snapshot.stepsSinceRebuild = neighborList.StepsSinceRebuild();
+	snapshot.neighborCount = neighborList.TotalNeighbors();
+	snapshot.lennardJonesEnergy = simulation.GetLennardJones().PotentialEnergy();
+
+	if (snapshot.electrostatics == Electrostatics::BarnesHut)
+	{
+		const BarnesHut& barnesHut = simulation.GetBarnesHut();
+		snapshot.openingAngle = barnesHut.GetOpeningAngle();
+		snapshot.softening = barnesHut.GetSoftening();
+		snapshot.octreeNodes = barnesHut.NodeCount();
+		snapshot.barnesHutEnergy = barnesHut.PotentialEnergy();
+	}
+	else if (snapshot.electrostatics == Electrostatics::ParticleMeshEwald)
+	{
+		const ParticleMeshEwald& pme = simulation.GetParticleMeshEwald();
+		snapshot.gridSpacing = pme.GetGridSpacing();
+		snapshot.ewaldTolerance = pme.GetTolerance();
+		snapshot.pmeGridSize[0] = pme.GridSizeX();
+		snapshot.pmeGridSize[1] = pme.GridSizeY();
+		snapshot.pmeGridSize[2] = pme.GridSizeZ();
+		snapshot.pmeAlpha = pme.Alpha();
+		snapshot.pmeRealSpaceEnergy = pme.RealSpaceEnergy();
+		snapshot.pmeReciprocalEnergy = pme.ReciprocalEnergy();
+		snapshot.pmeSelfEnergy = pme.SelfEnergy();
+	}
+
+	if (snapshot.integrator == Integrator::EventDriven)
+	{
+		const HardSpheres& hardSpheres = simulation.GetHardSpheres();
+		snapshot.collisions = hardSpheres.CollisionCount();
+		snapshot.wallCollisions = hardSpheres.WallCollisionCount();
+		snapshot.cellCrossings = hardSpheres.CellCrossingCount();
+		snapshot.queuedEvents = hardSpheres.QueueSize();
+		snapshot.staleEvents = hardSpheres.StaleEventCount();
+		snapshot.kineticEnergy = hardSpheres.KineticEnergy();
+	}
+
+	m_snapshots.Publish();
+
+	m_publishedStepCount = snapshot.stepCount;
+	m_snapshotIsStale = false;
+}
+
+void SimulationManager::ApplyQueuedEdits() noexcept
+{
+	PROFILE_FUNCTION();
+
+	if (m_queuedEdits.empty())
+		return;
+
+	// An edit may queue further edits, so take the list first
+	std::vector<std::function<void()>> edits;
+	edits.swap(m_queuedEdits);
+	for (std::function<void()>& edit : edits)
+		edit();
+
+	m_snapshotIsStale = true;
+}
+
+SimulationManager::SimulationLock::SimulationLock() noexcept
+{
+	m_lockWaiters.fetch_add(1, std::memory_order_acq_rel);
+	m_simulationMutex.lock();
+	m_lockWaiters.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+SimulationManager::SimulationLock::~SimulationLock() noexcept
+{
+	if (m_snapshotIsStale)
+		PublishSnapshot();
+	m_simulationMutex.unlock();
 }
 
 void SimulationManager::SwitchPlayPause() noexcept
@@ -50,104 +288,266 @@ void SimulationManager::SwitchPlayPause() noexcept
 	// Delete any temporary particles (if they exist)
 	DeleteTemporaryParticles();
 
-	// Switch the play/pause state and then trigger the play pause event
-	e_PlayPause(
+	// Switch the play/pause state and then trigger the play pause event. Only the final state matters to
+	// the handlers, so repeated switches within a frame are delivered once
+	e_PlayPause.DeferLatest(
 		m_simulations[m_activeSimulationIndex]->SwitchPlayPause()
 	);
 }
 
-Particle& SimulationManager::AddParticle(int type, int mass, float p_x, float p_y, float p_z, float v_x, float v_y, float v_z) noexcept
+void SimulationManager::SwitchPlayPause(unsigned int index) noexcept
+{
+	// The play pause event only concerns the simulation that is displayed
+	if (index == m_activeSimulationIndex)
+		SwitchPlayPause();
+	else
+		m_simulations[index]->SwitchPlayPause();
+}
+
+void SimulationManager::SetActiveSimulation(unsigned int index) noexcept
 {
 	PROFILE_FUNCTION();
 
-	// Add the particle to the simulation and then trigger the ParticleAdded event
-	Particle& p = m_simulations[m_activeSimulationIndex]->AddParticle(type, mass, p_x, p_y, p_z, v_x, v_y, v_z);
-	e_ParticleAdded(p, m_simulations[m_activeSimulationIndex]->ParticleCount() - 1);
-	return p;
+	if (index == m_activeSimulationIndex || index >= m_simulations.size())
+		return;
+
+	// Temporary particles only exist while editing the active simulation. Queued particle events refer to
+	// handles of the current simulation, so they have to be delivered before it is swapped out
+	DeleteTemporaryParticles();
+	DispatchDeferredEvents();
+
+	m_activeSimulationIndex = index;
+	e_ActiveSimulationChanged(index);
+	e_PlayPause.DeferLatest(m_simulations[index]->IsPlaying());
 }
 
-void SimulationManager::RemoveParticle(unsigned int index) noexcept
-{ 
-	// If you are removing a NON-temporary particle but there are temporary particles, you must decrement the first temp particle index
-	if (!IsParticleTemporary(index) && m_firstTemporaryParticleIndex.has_value()) m_firstTemporaryParticleIndex = m_firstTemporaryParticleIndex.value() - 1;
+unsigned int SimulationManager::AddSimulation() noexcept
+{
+	PROFILE_FUNCTION();
 
-	m_simulations[m_activeSimulationIndex]->RemoveParticle(index);
-	e_ParticleRemoved(index);
+	m_simulations.push_back(std::make_unique<Simulation>());
+	return static_cast<unsigned int>(m_simulations.size() - 1);
 }
 
-void SimulationManager::RemoveParticles(std::vector<unsigned int>& indices) noexcept
+unsigned int SimulationManager::DuplicateActiveSimulation() noexcept
 {
-	// Sort the indices and then remove back to front
-	std::sort(indices.begin(), indices.end());
-	for (int iii = indices.size() - 1; iii >= 0; --iii)
-		RemoveParticle(indices[iii]);
+	PROFILE_FUNCTION();
+
+	// Temporary particles are not part of the simulation yet, so don't copy them
+	DeleteTemporaryParticles();
+
+	std::unique_ptr<Simulation> simulation = std::make_unique<Simulation>();
+	simulation->CopyFrom(*m_simulations[m_activeSimulationIndex]);
+	m_simulations.push_back(std::move(simulation));
+	return static_cast<unsigned int>(m_simulations.size() - 1);
 }
 
-void SimulationManager::ChangeParticleType(unsigned int particleIndex, unsigned int type) noexcept
+void SimulationManager::RemoveSimulation(unsigned int index) noexcept
 {
-	// If the particle type was updated, trigger the event
-	if (m_simulations[m_activeSimulationIndex]->ChangeParticleType(particleIndex, type))
+	PROFILE_FUNCTION();
+
+	if (m_simulations.size() == 1 || index >= m_simulations.size())
+		return;
+
+	if (index != m_activeSimulationIndex)
 	{
-		e_ParticleTypeChanged(particleIndex, type);
+		m_simulations.erase(m_simulations.begin() + index);
+		if (index < m_activeSimulationIndex)
+			--m_activeSimulationIndex;
+		return;
+	}
+
+	// Removing the active simulation displays the one that takes its place (or the new last one)
+	DeleteTemporaryParticles();
+	DispatchDeferredEvents();
+	m_simulations.erase(m_simulations.begin() + index);
+	m_activeSimulationIndex = std::min(index, static_cast<unsigned int>(m_simulations.size() - 1));
+	e_ActiveSimulationChanged(m_activeSimulationIndex);
+	e_PlayPause.DeferLatest(m_simulations[m_activeSimulationIndex]->IsPlaying());
+}
+
+ParticleHandle SimulationManager::AddParticle(int type, int mass, float p_x, float p_y, float p_z, float v_x, float v_y, float v_z) noexcept
+{
+	PROFILE_FUNCTION();
+
+	// Add the particle to the simulation and then trigger the ParticlesAdded event for it alone
+	Simulation& simulation = *m_simulations[m_activeSimulationIndex];
+	simulation.AddParticle(type, mass, p_x, p_y, p_z, v_x, v_y, v_z);
+	unsigned int index = simulation.ParticleCount() - 1;
+	e_ParticlesAdded(simulation.GetParticles(), index, 1);
+	return simulation.GetParticles().Handle(index);
+}
+
+unsigned int SimulationManager::AddParticles(std::span<const Particle> particles) noexcept
+{
+	PROFILE_FUNCTION();
+
+	Simulation& simulation = *m_simulations[m_activeSimulationIndex];
+	unsigned int first = simulation.AddParticles(particles);
+	if (!particles.empty())
+		e_ParticlesAdded(simulation.GetParticles(), first, static_cast<unsigned int>(particles.size()));
+	return first;
+}
+
+void SimulationManager::RemoveParticle(ParticleHandle handle) noexcept
+{ 
+	RemoveParticles({ handle });
+}
+
+void SimulationManager::RemoveParticles(const std::vector<ParticleHandle>& handles) noexcept
+{
+	PROFILE_FUNCTION();
+
+	// Remove from the highest index down. Each removal only moves the last particle, which then can't be one
+	// that is still waiting to be removed at a lower index
+	const ParticleStore& particles = GetParticles();
+	std::vector<std::pair<unsigned int, ParticleHandle>> removals;
+	removals.reserve(handles.size());
+	bool removesTemporary = false;
+	for (ParticleHandle handle : handles)
+	{
+		if (!particles.Contains(handle))
+			continue;
+
+		if (IsParticleTemporary(handle))
+		{
+			m_isTemporarySlot[handle.index] = false;
+			removesTemporary = true;
+		}
+		removals.emplace_back(particles.IndexOf(handle), handle);
+	}
+
+	std::sort(removals.begin(), removals.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+	removals.erase(std::unique(removals.begin(), removals.end(), [](const auto& a, const auto& b) { return a.first == b.first; }), removals.end());
+	if (removals.empty())
+		return;
+
+	// Drop the removed temporaries in one pass, their flags were cleared above
+	if (removesTemporary)
+		std::erase_if(m_temporaryParticles, [](ParticleHandle handle) { return !m_isTemporarySlot[handle.index]; });
+
+	std::vector<ParticleHandle> removedHandles;
+	std::vector<unsigned int> indices;
+	removedHandles.reserve(removals.size());
+	indices.reserve(removals.size());
+	for (const auto& [index, handle] : removals)
+	{
+		indices.push_back(index);
+		removedHandles.push_back(handle);
+	}
+
+	m_simulations[m_activeSimulationIndex]->RemoveParticles(indices);
+	e_ParticlesRemoved(removedHandles, indices);
+}
+
+void SimulationManager::ChangeParticleType(ParticleHandle handle, unsigned int type) noexcept
+{
+	if (!ContainsParticle(handle))
+		return;
+
+	// If the particle type was updated, queue the event. Editing many particles then costs the handlers
+	// nothing until the end of the frame
+	if (m_simulations[m_activeSimulationIndex]->ChangeParticleType(GetParticles().IndexOf(handle), type))
+	{
+		e_ParticleTypeChanged.Defer(handle, type);
 
 		// Must now change the mass to be valid for the new type
-		ChangeParticleMass(particleIndex, GetDefaultMass(type));
+		ChangeParticleMass(handle, GetDefaultMass(type));
 	}
 }
 
-void SimulationManager::ChangeParticleMass(unsigned int particleIndex, unsigned int mass) noexcept
+void SimulationManager::ChangeParticleMass(ParticleHandle handle, unsigned int mass) noexcept
+{
+	if (!ContainsParticle(handle))
+		return;
+
+	// If the particle mass was updated, queue the event
+	if (m_simulations[m_activeSimulationIndex]->ChangeParticleMass(GetParticles().IndexOf(handle), mass))
+		e_ParticleMassChanged.Defer(handle, mass);
+}
+
+void SimulationManager::SetParticlePosition(ParticleHandle handle, float p_x, float p_y, float p_z) noexcept
+{
+	if (!ContainsParticle(handle))
+		return;
+
+	m_simulations[m_activeSimulationIndex]->SetParticlePosition(GetParticles().IndexOf(handle), p_x, p_y, p_z);
+}
+
+void SimulationManager::SetParticleVelocity(ParticleHandle handle, float v_x, float v_y, float v_z) noexcept
+{
+	if (!ContainsParticle(handle))
+		return;
+
+	m_simulations[m_activeSimulationIndex]->SetParticleVelocity(GetParticles().IndexOf(handle), v_x, v_y, v_z);
+}
+
+bool SimulationManager::HasDeferredEvents() noexcept
 {
-	// If the particle mass was updated, trigger the event
-	if (m_simulations[m_activeSimulationIndex]->ChangeParticleMass(particleIndex, mass))
-		e_ParticleMassChanged(particleIndex, mass);
+	return e_PlayPause.HasDeferred() || e_ParticleTypeChanged.HasDeferred() || e_ParticleMassChanged.HasDeferred();
+}
+
+void SimulationManager::DispatchDeferredEvents() noexcept
+{
+	PROFILE_FUNCTION();
+
+	e_ParticleTypeChanged.DispatchDeferred();
+	e_ParticleMassChanged.DispatchDeferred();
+	e_PlayPause.DispatchDeferred();
 }
 
 
 
-Particle& SimulationManager::GetFirstOrCreateTemporaryParticle(unsigned int type) noexcept
+ParticleRef SimulationManager::GetFirstOrCreateTemporaryParticle(unsigned int type) noexcept
 {
-	if (m_firstTemporaryParticleIndex.has_value())
+	if (!m_temporaryParticles.empty())
 	{
-		ChangeParticleType(m_firstTemporaryParticleIndex.value(), type);
-		return m_simulations[m_activeSimulationIndex]->GetParticle(m_firstTemporaryParticleIndex.value());
+		ChangeParticleType(m_temporaryParticles.front(), type);
+		return GetParticle(m_temporaryParticles.front());
 	}
 	
-	AddParticle(type, GetDefaultMass(type), 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	m_firstTemporaryParticleIndex = m_simulations[m_activeSimulationIndex]->ParticleCount() - 1;
-	return m_simulations[m_activeSimulationIndex]->GetParticle(m_firstTemporaryParticleIndex.value());
+	ParticleHandle handle = AddParticle(type, GetDefaultMass(type), 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+	MarkTemporary(handle);
+	return GetParticle(handle);
+}
+
+void SimulationManager::MarkTemporary(ParticleHandle handle) noexcept
+{
+	if (m_isTemporarySlot.size() <= handle.index)
+		m_isTemporarySlot.resize(handle.index + 1, false);
+
+	m_isTemporarySlot[handle.index] = true;
+	m_temporaryParticles.push_back(handle);
 }
 
 void SimulationManager::DeleteTemporaryParticles() noexcept
 {
-	if (m_firstTemporaryParticleIndex.has_value())
-	{
-		int value = m_firstTemporaryParticleIndex.value();
-		for (int iii = m_simulations[m_activeSimulationIndex]->ParticleCount() - 1; iii >= value; --iii)
-			RemoveParticle(iii);
+	// Take the list first, RemoveParticle would otherwise update it while it is iterated
+	std::vector<ParticleHandle> temporaryParticles;
+	temporaryParticles.swap(m_temporaryParticles);
+	for (ParticleHandle handle : temporaryParticles)
+		m_isTemporarySlot[handle.index] = false;
 
-		m_firstTemporaryParticleIndex = std::nullopt;
-	}
+	RemoveParticles(temporaryParticles);
 }
 
 void SimulationManager::PublishTemporaryParticles() noexcept
 {
-	// The particles already exists in the simulation - simply make the temporaryindex nullopt
-	m_firstTemporaryParticleIndex = std::nullopt;
+	// The particles already exists in the simulation - simply stop tracking them as temporary
+	for (ParticleHandle handle : m_temporaryParticles)
+		m_isTemporarySlot[handle.index] = false;
+	m_temporaryParticles.clear();
 }
 
-bool SimulationManager::IsParticleTemporary(unsigned int particleIndex) noexcept
+bool SimulationManager::IsParticleTemporary(ParticleHandle handle) noexcept
 {
-	return m_firstTemporaryParticleIndex.has_value() && particleIndex >= m_firstTemporaryParticleIndex.value();
+	return handle.index < m_isTemporarySlot.size() && m_isTemporarySlot[handle.index] && GetParticles().Contains(handle);
 }
 
 void SimulationManager::PlaceRandomParticles(const std::vector<unsigned int>& allowedTypes, unsigned int numberOfParticlesToCreate, float maxVelocity) noexcept
 {
-	// If the first temporary particle index already has a value, it will be assumed that it is from creating 
-	// 1+ random particles. Therefore, in this call to add more random particles, we don't want to update it
-	// because that would make the previous random particles permanent
-	if (!m_firstTemporaryParticleIndex.has_value() && numberOfParticlesToCreate > 0)
-		m_firstTemporaryParticleIndex = ParticleCount();
-
+	// Any temporary particles that already exist are assumed to be from creating 1+ random particles
+	// before, so they stay temporary along with the new ones
 	DirectX::XMFLOAT3 boxMaxXYZ = GetBoxSize();
 
 	// Create distributions on the heap because they take up a lot of stack space and you will get a warning
@@ -156,19 +556,26 @@ void SimulationManager::PlaceRandomParticles(const std::vector<unsigned int>& al
 	auto positionGenerator = std::make_unique<std::uniform_real_distribution<float>>(-1.0f, 1.0f);
 	auto velocityGenerator = std::make_unique<std::uniform_real_distribution<float>>(-maxVelocity, maxVelocity);
 
-	for (unsigned int iii = 0; iii < numberOfParticlesToCreate; ++iii)
+	// Generate every particle first so that they are added, and announced, as one batch
+	std::vector<Particle> particles(numberOfParticlesToCreate);
+	for (Particle& p : particles)
 	{
-		int typeIndex = (*typeIndexGenerator)(engine);
-		unsigned int mass = GetDefaultMass(allowedTypes[typeIndex]);
-		
-		float p_x = (*positionGenerator)(engine) * boxMaxXYZ.x;
-		float p_y = (*positionGenerator)(engine) * boxMaxXYZ.y;
-		float p_z = (*positionGenerator)(engine) * boxMaxXYZ.z;
-
-		float v_x = (*velocityGenerator)(engine);
-		float v_y = (*velocityGenerator)(engine);
-		float v_z = (*velocityGenerator)(engine);
-
-		AddParticle(allowedTypes[typeIndex], mass, p_x, p_y, p_z, v_x, v_y, v_z);
+		p.type = allowedTypes[(*typeIndexGenerator)(engine)];
+		p.mass = GetDefaultMass(p.type);
+
+		p.p_x = (*positionGenerator)(engine) * boxMaxXYZ.x;
+		p.p_y = (*positionGenerator)(engine) * boxMaxXYZ.y;
+		p.p_z = (*positionGenerator)(engine) * boxMaxXYZ.z;
+
+		p.v_x = (*velocityGenerator)(engine);
+		p.v_y = (*velocityGenerator)(engine);
+		p.v_z = (*velocityGenerator)(engine);
 	}
+
+	unsigned int first = AddParticles(particles);
+
+	const ParticleStore& store = GetParticles();
+	m_temporaryParticles.reserve(m_temporaryParticles.size() + numberOfParticlesToCreate);
+	for (unsigned int iii = 0; iii < numberOfParticlesToCreate; ++iii)
+		MarkTemporary(store.Handle(first + iii));
 }
\ No newline at end of file
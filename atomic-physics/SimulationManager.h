@@ -1,13 +1,18 @@
 #pragma once
-#include "pch.h"
+#include "CorePch.h"
 #include "Event.h"
 #include "Simulation.h"
+#include "TripleBuffer.h"
 
 #include <array>
+#include <atomic>
+#include <condition_variable>
 #include <functional>
 #include <memory>
-#include <optional>
+#include <mutex>
+#include <span>
 #include <string>
+#include <thread>
 #include <vector>
 
 struct IsotopeMassAbundance
@@ -16,21 +21,91 @@ struct IsotopeMassAbundance
 	float abundance;
 };
 
+// Statistics of one simulation, for the table of simulations
+struct SimulationSummary
+{
+	unsigned int particleCount = 0;
+	bool isPlaying = false;
+	double stepsPerSecond = 0.0;
+	double particleStepsPerSecond = 0.0;
+	double updateMilliseconds = 0.0;
+};
+
+// Copy of the active simulation's state as of the end of an update, published by the simulation thread
+// for the renderer and the UI. It carries the settings and statistics the UI displays as well, so that
+// the UI never has to wait for the physics just to draw its windows
+struct SimulationSnapshot
+{
+	ParticleStore particles;
+	unsigned int simulationIndex = 0;
+	uint64_t stepCount = 0;
+	double simulatedSeconds = 0.0;
+	uint64_t droppedTicks = 0;
+	bool isPlaying = false;
+
+	std::vector<SimulationSummary> simulations;
+	bool runAllSimulations = false;
+
+	// Settings of the active simulation
+	DirectX::XMFLOAT3 boxSize = { 0.0f, 0.0f, 0.0f };	// half extents
+	bool periodic = false;
+	Integrator integrator = Integrator::VelocityVerlet;
+	float timeStep = 0.0f;
+	unsigned int substepsPerTick = 1;
+	double tickSeconds = 0.0;
+	unsigned int catchUpBudget = 0;
+	float neighborListSkin = 0.0f;
+	bool lennardJonesEnabled = false;
+	Electrostatics electrostatics = Electrostatics::None;
+	float openingAngle = 0.0f;		// Barnes-Hut
+	float softening = 0.0f;
+	float gridSpacing = 0.0f;		// Particle-Mesh Ewald
+	float ewaldTolerance = 0.0f;
+
+	// Statistics of the active simulation. The solver statistics are only filled in while the solver is in use
+	unsigned int neighborListRebuilds = 0;
+	unsigned int stepsSinceRebuild = 0;
+	size_t neighborCount = 0;
+	double lennardJonesEnergy = 0.0;
+	unsigned int octreeNodes = 0;
+	double barnesHutEnergy = 0.0;
+	unsigned int pmeGridSize[3] = { 0, 0, 0 };
+	float pmeAlpha = 0.0f;
+	double pmeRealSpaceEnergy = 0.0;
+	double pmeReciprocalEnergy = 0.0;
+	double pmeSelfEnergy = 0.0;
+	uint64_t collisions = 0;		// event-driven hard spheres
+	uint64_t wallCollisions = 0;
+	uint64_t cellCrossings = 0;
+	size_t queuedEvents = 0;
+	uint64_t staleEvents = 0;
+	double kineticEnergy = 0.0;
+};
+
+// Play/Pause, type and mass changes are deferred: they are queued and delivered by DispatchDeferredEvents.
+// The handles they carry may have been removed by then
+//
 // Play/Pause
 using PlayPauseEvent = Event<bool>;
 using PlayPauseEventHandler = std::function<void(bool)>;
-// Particle Added
-using ParticleAddedEvent = Event<const Particle&, unsigned int>;
-using ParticleAddedEventHandler = std::function<void(const Particle&, unsigned int)>;
-// Particle Removed
-using ParticleRemovedEvent = Event<unsigned int>;
-using ParticleRemovedEventHandler = std::function<void(unsigned int)>;
+// Active Simulation Changed
+using ActiveSimulationChangedEvent = Event<unsigned int>; // index of the simulation that is now displayed
+using ActiveSimulationChangedEventHandler = std::function<void(unsigned int)>;
+// Particles Added - fired once per batch. The new particles are always appended, so they are the 'count'
+// particles starting at index 'first'
+using ParticlesAddedEvent = Event<const ParticleStore&, unsigned int, unsigned int>; // particles, first, count
+using ParticlesAddedEventHandler = std::function<void(const ParticleStore&, unsigned int, unsigned int)>;
+// Particles Removed - fired once per batch with the handles of the removed particles and the indices they
+// occupied, in the order they were removed. Each removal moved the then last particle into the freed index,
+// and the indices are descending so that replaying the same swap-and-pops keeps a mirror in step
+using ParticlesRemovedEvent = Event<const std::vector<ParticleHandle>&, const std::vector<unsigned int>&>;
+using ParticlesRemovedEventHandler = std::function<void(const std::vector<ParticleHandle>&, const std::vector<unsigned int>&)>;
 // ParticleTypeChanged
-using ParticleTypeChangedEvent = Event<unsigned int, unsigned int>; // particle index, new type
-using ParticleTypeChangedEventHandler = std::function<void(unsigned int, unsigned int)>;
+using ParticleTypeChangedEvent = Event<ParticleHandle, unsigned int>; // particle, new type
+using ParticleTypeChangedEventHandler = std::function<void(ParticleHandle, unsigned int)>;
 // ParticleMassChanged
-using ParticleMassChangedEvent = Event<unsigned int, unsigned int>; // particle index, new mass
-using ParticleMassChangedEventHandler = std::function<void(unsigned int, unsigned int)>;
+using ParticleMassChangedEvent = Event<ParticleHandle, unsigned int>; // particle, new mass
+using ParticleMassChangedEventHandler = std::function<void(ParticleHandle, unsigned int)>;
 
 class SimulationManager
 {
@@ -41,20 +116,108 @@ public:
 	static void Initialize() noexcept;
 	static void Update() noexcept;
 
-	static Particle& AddParticle(int type, int mass, float p_x, float p_y, float p_z, float v_x, float v_y, float v_z) noexcept;
-	static void RemoveParticle(unsigned int index) noexcept;
-	static void RemoveParticles(std::vector<unsigned int>& indices) noexcept;
+	// Simulation thread. Once started, Update is called continuously on a thread of its own, paced by the
+	// simulations' timers, so that physics no longer runs in step with the frame rate. After every update
+	// that advanced the active simulation its state is published as a SimulationSnapshot
+	static void StartSimulationThread() noexcept;
+	static void StopSimulationThread() noexcept;
+
+	// While the simulation thread is running, every other thread must hold a SimulationLock to read or
+	// edit the simulations. The simulation thread gives way to waiting lock holders between updates. If
+	// queued edits were applied under the lock, the snapshot is republished when it is released so that it
+	// reflects them
+	class SimulationLock
+	{
+	public:
+		SimulationLock() noexcept;
+		SimulationLock(const SimulationLock&) = delete;
+		void operator=(const SimulationLock&) = delete;
+		~SimulationLock() noexcept;
+	};
 
-	static const std::vector<Particle>& GetParticles() noexcept { return m_simulations[m_activeSimulationIndex]->GetParticles(); }
-	static Particle& GetParticle(int index) noexcept { return m_simulations[m_activeSimulationIndex]->GetParticle(index); }
+	// Latest published state of the active simulation; never blocks. Call AcquireSnapshot once per frame
+	// and read GetSnapshot as often as needed, from the same (render) thread only
+	static void AcquireSnapshot() noexcept { m_snapshots.Acquire(); }
+
+	// Edits from the UI. The UI draws from the snapshot without taking the lock, and queues the edits it
+	// makes instead of applying them. They are applied once per frame, under a SimulationLock and before the
+	// snapshot is acquired, so the next frame already shows them. Only the main thread queues and applies
+	// edits, so the bookkeeping that only edits change (e.g. the temporary particles) can be read there freely
+	static void QueueEdit(std::function<void()> edit) noexcept { m_queuedEdits.push_back(std::move(edit)); }
+	static bool HasQueuedEdits() noexcept { return !m_queuedEdits.empty(); }
+	static void ApplyQueuedEdits() noexcept;
+
+	// Deliver the queued (deferred) events, once per frame. Requires a SimulationLock like any other edit
+	static bool HasDeferredEvents() noexcept;
+	static void DispatchDeferredEvents() noexcept;
+	static const SimulationSnapshot& GetSnapshot() noexcept { return m_snapshots.ReadBuffer(); }
+	static void Run(unsigned int steps) noexcept { m_simulations[m_activeSimulationIndex]->Run(steps); }
+
+	// Multiple simulations. Only the active simulation is displayed and edited; when RunAllSimulations is
+	// enabled, every simulation is updated each frame, concurrently on the ThreadPool, so that variants
+	// can be compared side by side. Otherwise the inactive simulations stay frozen
+	static unsigned int SimulationCount() noexcept { return static_cast<unsigned int>(m_simulations.size()); }
+	static const Simulation& GetSimulation(unsigned int index) noexcept { return *m_simulations[index]; }
+	static unsigned int GetActiveSimulationIndex() noexcept { return m_activeSimulationIndex; }
+	static void SetActiveSimulation(unsigned int index) noexcept;
+	// Both return the index of the new simulation, which is paused and not made active
+	static unsigned int AddSimulation() noexcept;
+	static unsigned int DuplicateActiveSimulation() noexcept;
+	// The last remaining simulation can't be removed
+	static void RemoveSimulation(unsigned int index) noexcept;
+	static bool GetRunAllSimulations() noexcept { return m_runAllSimulations; }
+	static void SetRunAllSimulations(bool runAll) noexcept { m_runAllSimulations = runAll; }
+
+	static ParticleHandle AddParticle(int type, int mass, float p_x, float p_y, float p_z, float v_x, float v_y, float v_z) noexcept;
+	// Add many particles with a single reservation and a single ParticlesAdded event. Returns the index of the first
+	static unsigned int AddParticles(std::span<const Particle> particles) noexcept;
+	// Removal is O(1) per particle and fires a single ParticlesRemoved event; handles that don't refer to a
+	// particle of the active simulation are ignored
+	static void RemoveParticle(ParticleHandle handle) noexcept;
+	static void RemoveParticles(const std::vector<ParticleHandle>& handles) noexcept;
+
+	static const ParticleStore& GetParticles() noexcept { return m_simulations[m_activeSimulationIndex]->GetParticles(); }
+	static bool ContainsParticle(ParticleHandle handle) noexcept { return GetParticles().Contains(handle); }
+	static ParticleRef GetParticle(ParticleHandle handle) noexcept { return m_simulations[m_activeSimulationIndex]->GetParticle(GetParticles().IndexOf(handle)); }
 	static DirectX::XMFLOAT3 GetSimulationDimensions() noexcept { return m_simulations[m_activeSimulationIndex]->GetSimulationDimensions(); }
 	static unsigned int ParticleCount() noexcept { return m_simulations[m_activeSimulationIndex]->ParticleCount(); }
 
 	// Methods to query the StepTimer
 	static double TotalSeconds() noexcept { return m_simulations[m_activeSimulationIndex]->TotalSeconds(); }
 
+	// Fixed step integration settings
+	static float GetTimeStep() noexcept { return m_simulations[m_activeSimulationIndex]->GetTimeStep(); }
+	static void SetTimeStep(float timeStep) noexcept { m_simulations[m_activeSimulationIndex]->SetTimeStep(timeStep); }
+	static unsigned int GetSubstepsPerTick() noexcept { return m_simulations[m_activeSimulationIndex]->GetSubstepsPerTick(); }
+	static void SetSubstepsPerTick(unsigned int substeps) noexcept { m_simulations[m_activeSimulationIndex]->SetSubstepsPerTick(substeps); }
+	static double GetTickSeconds() noexcept { return m_simulations[m_activeSimulationIndex]->GetTickSeconds(); }
+	static void SetTickSeconds(double seconds) noexcept { m_simulations[m_activeSimulationIndex]->SetTickSeconds(seconds); }
+	static unsigned int GetCatchUpBudget() noexcept { return m_simulations[m_activeSimulationIndex]->GetCatchUpBudget(); }
+	static void SetCatchUpBudget(unsigned int maxTicks) noexcept { m_simulations[m_activeSimulationIndex]->SetCatchUpBudget(maxTicks); }
+	static uint64_t DroppedTicks() noexcept { return m_simulations[m_activeSimulationIndex]->DroppedTicks(); }
+	static double SimulatedSeconds() noexcept { return m_simulations[m_activeSimulationIndex]->SimulatedSeconds(); }
+	static uint64_t StepCount() noexcept { return m_simulations[m_activeSimulationIndex]->StepCount(); }
+
 	static bool SimulationIsPlaying() noexcept { return m_simulations[m_activeSimulationIndex]->IsPlaying(); }
+	static bool SimulationIsPlaying(unsigned int index) noexcept { return m_simulations[index]->IsPlaying(); }
 	static void SwitchPlayPause() noexcept;
+	static void SwitchPlayPause(unsigned int index) noexcept;
+
+	static const NeighborList& GetNeighborList() noexcept { return m_simulations[m_activeSimulationIndex]->GetNeighborList(); }
+	static float GetNeighborListSkin() noexcept { return m_simulations[m_activeSimulationIndex]->GetNeighborListSkin(); }
+	static void SetNeighborListSkin(float skin) noexcept { m_simulations[m_activeSimulationIndex]->SetNeighborListSkin(skin); }
+	static const LennardJones& GetLennardJones() noexcept { return m_simulations[m_activeSimulationIndex]->GetLennardJones(); }
+	static bool LennardJonesEnabled() noexcept { return m_simulations[m_activeSimulationIndex]->LennardJonesEnabled(); }
+	static void SetLennardJonesEnabled(bool enabled) noexcept { m_simulations[m_activeSimulationIndex]->SetLennardJonesEnabled(enabled); }
+	static Electrostatics GetElectrostatics() noexcept { return m_simulations[m_activeSimulationIndex]->GetElectrostatics(); }
+	static void SetElectrostatics(Electrostatics method) noexcept { m_simulations[m_activeSimulationIndex]->SetElectrostatics(method); }
+	static BarnesHut& GetBarnesHut() noexcept { return m_simulations[m_activeSimulationIndex]->GetBarnesHut(); }
+	static ParticleMeshEwald& GetParticleMeshEwald() noexcept { return m_simulations[m_activeSimulationIndex]->GetParticleMeshEwald(); }
+	static Integrator GetIntegrator() noexcept { return m_simulations[m_activeSimulationIndex]->GetIntegrator(); }
+	static void SetIntegrator(Integrator integrator) noexcept { m_simulations[m_activeSimulationIndex]->SetIntegrator(integrator); }
+	static const HardSpheres& GetHardSpheres() noexcept { return m_simulations[m_activeSimulationIndex]->GetHardSpheres(); }
+	static bool IsPeriodic() noexcept { return m_simulations[m_activeSimulationIndex]->IsPeriodic(); }
+	static bool SetPeriodic(bool periodic) noexcept { return m_simulations[m_activeSimulationIndex]->SetPeriodic(periodic); }
 
 	static DirectX::XMFLOAT3 GetBoxSize() noexcept { return m_simulations[m_activeSimulationIndex]->GetBoxSize(); }
 	static void SetBoxSize(float xyz) noexcept { m_simulations[m_activeSimulationIndex]->SetBoxSize(xyz); }
@@ -65,56 +228,82 @@ public:
 	static const std::vector<IsotopeMassAbundance>& GetIsotopeMassAbundances(unsigned int type) noexcept { return m_isotopeMassAbundanceList[type]; }
 	static constexpr unsigned int GetDefaultMass(unsigned int type) noexcept;
 
-	static void ChangeParticleType(unsigned int particleIndex, unsigned int type) noexcept;
-	static void ChangeParticleMass(unsigned int particleIndex, unsigned int mass) noexcept;
+	// These ignore handles that don't refer to a particle of the active simulation (any more), since a queued
+	// edit may be applied after its particle has been removed
+	static void ChangeParticleType(ParticleHandle handle, unsigned int type) noexcept;
+	static void ChangeParticleMass(ParticleHandle handle, unsigned int mass) noexcept;
+	static void SetParticlePosition(ParticleHandle handle, float p_x, float p_y, float p_z) noexcept;
+	static void SetParticleVelocity(ParticleHandle handle, float v_x, float v_y, float v_z) noexcept;
 
 	// Temporary Particle Functions
-	static Particle& GetFirstOrCreateTemporaryParticle(unsigned int type) noexcept;
-	static unsigned int GetIndexOfFirstTemporaryParticle() noexcept { return m_firstTemporaryParticleIndex.value(); }
-	static bool TemporaryParticlesExist() noexcept { return m_firstTemporaryParticleIndex.has_value(); }
+	static ParticleRef GetFirstOrCreateTemporaryParticle(unsigned int type) noexcept;
+	static ParticleHandle GetFirstTemporaryParticle() noexcept { return m_temporaryParticles.front(); }
+	static bool TemporaryParticlesExist() noexcept { return !m_temporaryParticles.empty(); }
 	static void DeleteTemporaryParticles() noexcept;
 	static void PublishTemporaryParticles() noexcept;
-	static bool IsParticleTemporary(unsigned int particleIndex) noexcept;
+	static bool IsParticleTemporary(ParticleHandle handle) noexcept;
 	static void PlaceRandomParticles(const std::vector<unsigned int>& allowedTypes, unsigned int numberOfParticlesToCreate, float maxVelocity) noexcept;
 
 
 	// Events
-	static EventToken SetPlayPauseEventHandler(PlayPauseEventHandler handler) noexcept { return e_PlayPause.AddHandler(handler); }
+	static EventToken SetPlayPauseEventHandler(PlayPauseEventHandler handler) noexcept { return e_PlayPause.AddHandler(std::move(handler)); }
 	static bool RemovePlayPauseEventHandler(EventToken token) noexcept { return e_PlayPause.RemoveHandler(token); }
 
-	static EventToken SetParticleAddedEventHandler(ParticleAddedEventHandler handler) noexcept { return e_ParticleAdded.AddHandler(handler); }
-	static bool RemoveParticleAddedEventHandler(EventToken token) noexcept { return e_ParticleAdded.RemoveHandler(token); }
+	static EventToken SetActiveSimulationChangedEventHandler(ActiveSimulationChangedEventHandler handler) noexcept { return e_ActiveSimulationChanged.AddHandler(std::move(handler)); }
+	static bool RemoveActiveSimulationChangedEventHandler(EventToken token) noexcept { return e_ActiveSimulationChanged.RemoveHandler(token); }
+
+	static EventToken SetParticlesAddedEventHandler(ParticlesAddedEventHandler handler) noexcept { return e_ParticlesAdded.AddHandler(std::move(handler)); }
+	static bool RemoveParticlesAddedEventHandler(EventToken token) noexcept { return e_ParticlesAdded.RemoveHandler(token); }
 
-	static EventToken SetParticleRemovedEventHandler(ParticleRemovedEventHandler handler) noexcept { return e_ParticleRemoved.AddHandler(handler); }
-	static bool RemoveParticleRemovedEventHandler(EventToken token) noexcept { return e_ParticleRemoved.RemoveHandler(token); }
+	static EventToken SetParticlesRemovedEventHandler(ParticlesRemovedEventHandler handler) noexcept { return e_ParticlesRemoved.AddHandler(std::move(handler)); }
+	static bool RemoveParticlesRemovedEventHandler(EventToken token) noexcept { return e_ParticlesRemoved.RemoveHandler(token); }
 
-	static EventToken SetParticleTypeChangedEventHandler(ParticleTypeChangedEventHandler handler) noexcept { return e_ParticleTypeChanged.AddHandler(handler); }
+	static EventToken SetParticleTypeChangedEventHandler(ParticleTypeChangedEventHandler handler) noexcept { return e_ParticleTypeChanged.AddHandler(std::move(handler)); }
 	static bool RemoveParticleTypeChangedEventHandler(EventToken token) noexcept { return e_ParticleTypeChanged.RemoveHandler(token); }
 
-	static EventToken SetParticleMassChangedEventHandler(ParticleMassChangedEventHandler handler) noexcept { return e_ParticleMassChanged.AddHandler(handler); }
+	static EventToken SetParticleMassChangedEventHandler(ParticleMassChangedEventHandler handler) noexcept { return e_ParticleMassChanged.AddHandler(std::move(handler)); }
 	static bool RemoveParticleMassChangedEventHandler(EventToken token) noexcept { return e_ParticleMassChanged.RemoveHandler(token); }
 
 private:
 	SimulationManager(); // Don't allow construction
 
+	static void SimulationThreadLoop() noexcept;
+	// Must be called with m_simulationMutex held
+	static void PublishSnapshot() noexcept;
+	static double SecondsUntilNextTick() noexcept;
+	static void MarkTemporary(ParticleHandle handle) noexcept;
+
 	static unsigned int m_activeSimulationIndex;
 	static std::vector<std::unique_ptr<Simulation>> m_simulations;
+	static bool m_runAllSimulations;
+
+	// Simulation thread
+	static std::thread m_simulationThread;
+	static std::mutex m_simulationMutex;				// held while updating or editing the simulations
+	static std::atomic<unsigned int> m_lockWaiters;	// threads waiting for a SimulationLock
+	static std::mutex m_sleepMutex;
+	static std::condition_variable m_sleepCondition;
+	static bool m_stopSimulationThread;				// guarded by m_sleepMutex
+	static uint64_t m_publishedStepCount;
+	static bool m_snapshotIsStale;					// edits were applied since the last PublishSnapshot
+	static TripleBuffer<SimulationSnapshot> m_snapshots;
+	static std::vector<std::function<void()>> m_queuedEdits;
 
 	static const std::vector<std::string> m_particleNames;
 	static const std::array<std::vector<IsotopeMassAbundance>, 11> m_isotopeMassAbundanceList;
 
-	// Index for temporary particles that are being added
-	// NOTE: All temporary particles reside at the END of the vector or particles,
-	//		 so all we need to do is denote the index of the first temporary and that
-	//       gives us every temporary
-	static std::optional<unsigned int> m_firstTemporaryParticleIndex;
+	// Temporary particles that are being added. Removing particles reorders them, so the temporary ones
+	// are tracked by handle, with a flag per handle slot so that IsParticleTemporary is O(1)
+	static std::vector<ParticleHandle> m_temporaryParticles;
+	static std::vector<bool> m_isTemporarySlot;
 
 	// Events
 	static PlayPauseEvent			e_PlayPause;
-	static ParticleAddedEvent		e_ParticleAdded;
-	static ParticleRemovedEvent		e_ParticleRemoved;
+	static ActiveSimulationChangedEvent	e_ActiveSimulationChanged;
+	static ParticlesAddedEvent		e_ParticlesAdded;
+	static ParticlesRemovedEvent	e_ParticlesRemoved;
 	static ParticleTypeChangedEvent	e_ParticleTypeChanged;
-	static ParticleTypeChangedEvent	e_ParticleMassChanged;
+	static ParticleMassChangedEvent	e_ParticleMassChanged;
 };
 
 
@@ -0,0 +1,19 @@
+#pragma once
+#include "CorePch.h"
+#include "PhysicsConstants.h"
+
+// Needs DirectXMath, so only the Direct3D application and the Windows build of the benchmarks use it
+#ifdef _WIN32
+// Per-instance transforms of one atom sphere, as the sphere vertex shader expects them: the sphere mesh has
+// unit radius, so the model matrix scales it to the atomic radius of the element and moves it into place
+inline void PackSphereInstance(const DirectX::XMFLOAT3& position, unsigned int elementNumber, DirectX::FXMMATRIX viewProjection,
+	DirectX::XMFLOAT4X4& model, DirectX::XMFLOAT4X4& modelViewProjection, DirectX::XMFLOAT4X4& inverseTransposeModel) noexcept
+{
+	float radius = Constants::AtomicRadii[elementNumber];
+	DirectX::XMMATRIX m = DirectX::XMMatrixScaling(radius, radius, radius) * DirectX::XMMatrixTranslation(position.x, position.y, position.z);
+
+	DirectX::XMStoreFloat4x4(&model, m);
+	DirectX::XMStoreFloat4x4(&modelViewProjection, m * viewProjection);
+	DirectX::XMStoreFloat4x4(&inverseTransposeModel, DirectX::XMMatrixTranspose(DirectX::XMMatrixInverse(nullptr, m)));
+}
+#endif
@@ -1,7 +1,8 @@
 #pragma once
-#include "pch.h"
-#include "MacroHelper.h"
-#include "StepTimerException.h"
+#include "CorePch.h"
+#include "Clock.h"
+
+#include <cstdlib>
 
 // Helper class for animation and simulation timing.
 class StepTimer
@@ -14,22 +15,16 @@ public:
 		m_frameCount(0),
 		m_framesPerSecond(0),
 		m_framesThisSecond(0),
-		m_qpcSecondCounter(0),
+		m_clockSecondCounter(0),
 		m_isFixedTimeStep(false),
-		m_targetElapsedTicks(TicksPerSecond / 60)
+		m_targetElapsedTicks(TicksPerSecond / 60),
+		m_maxUpdatesPerTick(0),
+		m_droppedUpdates(0)
 	{
-		if (!QueryPerformanceFrequency(&m_qpcFrequency))
-		{
-			TERMINATE_ON_THROW(throw TIMER_EXCEPT("FAILED: StepTimer -> Constructor -> QueryPerformanceFrequency"))
-		}
-
-		if (!QueryPerformanceCounter(&m_qpcLastTime))
-		{
-			TERMINATE_ON_THROW(throw TIMER_EXCEPT("FAILED: StepTimer -> Constructor -> QueryPerformanceCounter"))
-		}
+		m_clockLastTime = Clock::Now();
 
 		// Initialize max delta to 1/10 of a second.
-		m_qpcMaxDelta = m_qpcFrequency.QuadPart / 10;
+		m_clockMaxDelta = Clock::Frequency / 10;
 	}
 
 	// Get elapsed time since the previous Update call.
@@ -52,6 +47,18 @@ public:
 	// Set how often to call Update when in fixed timestep mode.
 	void SetTargetElapsedTicks(uint64_t targetElapsed) noexcept { m_targetElapsedTicks = targetElapsed; }
 	void SetTargetElapsedSeconds(double targetElapsed) noexcept { m_targetElapsedTicks = SecondsToTicks(targetElapsed); }
+	uint64_t GetTargetElapsedTicks() const noexcept { return m_targetElapsedTicks; }
+	double GetTargetElapsedSeconds() const noexcept { return TicksToSeconds(m_targetElapsedTicks); }
+
+	// Catch-up budget for fixed timestep mode: the most Update calls a single Tick may make (0 = unlimited).
+	// If the updates can't keep up, the remaining backlog is dropped instead of growing without bound
+	void SetMaxUpdatesPerTick(uint32_t maxUpdates) noexcept { m_maxUpdatesPerTick = maxUpdates; }
+	uint32_t GetMaxUpdatesPerTick() const noexcept { return m_maxUpdatesPerTick; }
+	// Total number of fixed updates that were dropped because of the catch-up budget
+	uint64_t GetDroppedUpdates() const noexcept { return m_droppedUpdates; }
+
+	// Time from the last Tick until the next fixed update is due
+	double GetSecondsUntilNextUpdate() const noexcept { return m_leftOverTicks >= m_targetElapsedTicks ? 0.0 : TicksToSeconds(m_targetElapsedTicks - m_leftOverTicks); }
 
 	// Integer format represents time using 10,000,000 ticks per second.
 	static const uint64_t TicksPerSecond = 10000000;
@@ -63,17 +70,14 @@ public:
 	// call this to avoid having the fixed timestep logic attempt a set of catch-up 
 	// Update calls.
 
-	void ResetElapsedTime()
+	void ResetElapsedTime() noexcept
 	{
-		if (!QueryPerformanceCounter(&m_qpcLastTime))
-		{
-			throw TIMER_EXCEPT("FAILED: StepTimer -> ResetElapsedTime -> QueryPerformanceCounter");
-		}
+		m_clockLastTime = Clock::Now();
 
 		m_leftOverTicks = 0;
 		m_framesPerSecond = 0;
 		m_framesThisSecond = 0;
-		m_qpcSecondCounter = 0;
+		m_clockSecondCounter = 0;
 	}
 
 	// Update timer state, calling the specified Update function the appropriate number of times.
@@ -83,30 +87,21 @@ public:
 		PROFILE_FUNCTION();
 
 		// Query the current time.
-		LARGE_INTEGER currentTime;
-
-		if (!QueryPerformanceCounter(&currentTime))
-		{
-			TERMINATE_ON_THROW(
-				throw TIMER_EXCEPT("FAILED: StepTimer::Tick() -> QueryPerformanceCounter")
-			)
-		}
-
+		uint64_t currentTime = Clock::Now();
+		uint64_t timeDelta = currentTime - m_clockLastTime;
 
-		uint64_t timeDelta = currentTime.QuadPart - m_qpcLastTime.QuadPart;
-
-		m_qpcLastTime = currentTime;
-		m_qpcSecondCounter += timeDelta;
+		m_clockLastTime = currentTime;
+		m_clockSecondCounter += timeDelta;
 
 		// Clamp excessively large time deltas (e.g. after paused in the debugger).
-		if (timeDelta > m_qpcMaxDelta)
+		if (timeDelta > m_clockMaxDelta)
 		{
-			timeDelta = m_qpcMaxDelta;
+			timeDelta = m_clockMaxDelta;
 		}
 
-		// Convert QPC units into a canonical tick format. This cannot overflow due to the previous clamp.
+		// Convert clock units into a canonical tick format. This cannot overflow due to the previous clamp.
 		timeDelta *= TicksPerSecond;
-		timeDelta /= m_qpcFrequency.QuadPart;
+		timeDelta /= Clock::Frequency;
 
 		uint32_t lastFrameCount = m_frameCount;
 
@@ -121,19 +116,28 @@ public:
 			// accumulate enough tiny errors that it would drop a frame. It is better to just round 
 			// small deviations down to zero to leave things running smoothly.
 
-			if (abs(static_cast<int64_t>(timeDelta - m_targetElapsedTicks)) < TicksPerSecond / 4000)
+			if (std::abs(static_cast<int64_t>(timeDelta - m_targetElapsedTicks)) < static_cast<int64_t>(TicksPerSecond / 4000))
 			{
 				timeDelta = m_targetElapsedTicks;
 			}
 
 			m_leftOverTicks += timeDelta;
 
+			uint32_t updates = 0;
 			while (m_leftOverTicks >= m_targetElapsedTicks)
 			{
+				if (m_maxUpdatesPerTick != 0 && updates == m_maxUpdatesPerTick)
+				{
+					m_droppedUpdates += m_leftOverTicks / m_targetElapsedTicks;
+					m_leftOverTicks %= m_targetElapsedTicks;
+					break;
+				}
+
 				m_elapsedTicks = m_targetElapsedTicks;
 				m_totalTicks += m_targetElapsedTicks;
 				m_leftOverTicks -= m_targetElapsedTicks;
 				m_frameCount++;
+				updates++;
 
 				{
 					PROFILE_SCOPE("Physics Update 1");
@@ -161,19 +165,18 @@ public:
 			m_framesThisSecond++;
 		}
 
-		if (m_qpcSecondCounter >= static_cast<uint64_t>(m_qpcFrequency.QuadPart))
+		if (m_clockSecondCounter >= Clock::Frequency)
 		{
 			m_framesPerSecond = m_framesThisSecond;
 			m_framesThisSecond = 0;
-			m_qpcSecondCounter %= m_qpcFrequency.QuadPart;
+			m_clockSecondCounter %= Clock::Frequency;
 		}
 	}
 
 private:
-	// Source timing data uses QPC units.
-	LARGE_INTEGER m_qpcFrequency;
-	LARGE_INTEGER m_qpcLastTime;
-	uint64_t m_qpcMaxDelta;
+	// Source timing data uses Clock units.
+	uint64_t m_clockLastTime;
+	uint64_t m_clockMaxDelta;
 
 	// Derived timing data uses a canonical tick format.
 	uint64_t m_elapsedTicks;
@@ -184,9 +187,11 @@ private:
 	uint32_t m_frameCount;
 	uint32_t m_framesPerSecond;
 	uint32_t m_framesThisSecond;
-	uint64_t m_qpcSecondCounter;
+	uint64_t m_clockSecondCounter;
 
 	// Members for configuring fixed timestep mode.
 	bool m_isFixedTimeStep;
 	uint64_t m_targetElapsedTicks;
+	uint32_t m_maxUpdatesPerTick;
+	uint64_t m_droppedUpdates;
 };
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threadCount) noexcept :
+	m_queuedTasks(0),
+	m_stop(false)
+{
+	StartWorkers(threadCount);
+}
+
+ThreadPool::~ThreadPool() noexcept
+{
+	StopWorkers();
+}
+
+void ThreadPool::SetThreadCount(unsigned int threadCount) noexcept
+{
+	StopWorkers();
+	StartWorkers(threadCount);
+}
+
+void ThreadPool::StartWorkers(unsigned int threadCount) noexcept
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	// The calling thread always participates, so only spawn threadCount - 1 workers
+	unsigned int workerCount = threadCount - 1;
+
+	m_stop = false;
+	m_queues.clear();
+	for (unsigned int iii = 0; iii < workerCount; ++iii)
+		m_queues.push_back(std::make_unique<WorkQueue>());
+
+	m_workers.reserve(workerCount);
+	for (unsigned int iii = 0; iii < workerCount; ++iii)
+		m_workers.emplace_back([this, iii]() { this->WorkerLoop(iii); });
+}
+
+void ThreadPool::StopWorkers() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_stop = true;
+	}
+	m_wakeCondition.notify_all();
+
+	for (std::thread& worker : m_workers)
+		worker.join();
+
+	m_workers.clear();
+	m_queues.clear();
+}
+
+void ThreadPool::ParallelForImpl(unsigned int begin, unsigned int end, unsigned int chunkSize, TaskFunction function, const void* context) noexcept
+{
+	if (begin >= end)
+		return;
+
+	chunkSize = std::max(1u, chunkSize);
+	unsigned int chunkCount = (end - begin + chunkSize - 1) / chunkSize;
+
+	// Nothing to gain from handing a single chunk to another thread
+	if (chunkCount == 1 || m_workers.empty())
+	{
+		function(context, begin, end);
+		return;
+	}
+
+	Batch batch;
+	batch.remaining.store(chunkCount, std::memory_order_relaxed);
+
+	// Count the tasks before they become visible so a worker popping one can never underflow the counter
+	m_queuedTasks.fetch_add(chunkCount, std::memory_order_release);
+
+	// Deal the chunks out round-robin so neighboring chunks start on different workers. Idle workers
+	// will steal from whoever ends up with the most work left.
+	unsigned int queueCount = static_cast<unsigned int>(m_queues.size());
+	for (unsigned int iii = 0; iii < chunkCount; ++iii)
+	{
+		unsigned int chunkBegin = begin + iii * chunkSize;
+		unsigned int chunkEnd = std::min(end, chunkBegin + chunkSize);
+
+		WorkQueue& queue = *m_queues[iii % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back({ function, context, chunkBegin, chunkEnd, &batch });
+	}
+
+	{
+		// Take the lock so that a worker can't miss the wakeup between checking its predicate and sleeping
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+	}
+	m_wakeCondition.notify_all();
+
+	// Help out until there is nothing left to steal, then wait for the chunks still being processed
+	Task task;
+	while (batch.remaining.load(std::memory_order_acquire) != 0 && TrySteal(queueCount, task))
+		RunTask(task);
+
+	std::unique_lock<std::mutex> lock(batch.mutex);
+	batch.condition.wait(lock, [&batch]() { return batch.done; });
+}
+
+void ThreadPool::WorkerLoop(unsigned int workerIndex) noexcept
+{
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_wakeMutex);
+			m_wakeCondition.wait(lock, [this]() { return m_stop || m_queuedTasks.load(std::memory_order_acquire) > 0; });
+
+			if (m_stop)
+				return;
+		}
+
+		PROFILE_SCOPE("ThreadPool Worker");
+
+		Task task;
+		while (TryPop(workerIndex, task) || TrySteal(workerIndex, task))
+			RunTask(task);
+	}
+}
+
+bool ThreadPool::TryPop(unsigned int queueIndex, Task& task) noexcept
+{
+	WorkQueue& queue = *m_queues[queueIndex];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tasks.empty())
+		return false;
+
+	task = queue.tasks.front();
+	queue.tasks.pop_front();
+	m_queuedTasks.fetch_sub(1, std::memory_order_acq_rel);
+	return true;
+}
+
+bool ThreadPool::TrySteal(unsigned int thiefIndex, Task& task) noexcept
+{
+	unsigned int queueCount = static_cast<unsigned int>(m_queues.size());
+	for (unsigned int iii = 1; iii <= queueCount; ++iii)
+	{
+		// Start with the queue after our own so that thieves spread out over the victims
+		WorkQueue& queue = *m_queues[(thiefIndex + iii) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+			m_queuedTasks.fetch_sub(1, std::memory_order_acq_rel);
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::RunTask(const Task& task) noexcept
+{
+	task.function(task.context, task.begin, task.end);
+
+	if (task.batch->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		// Notify while holding the lock - once it is released the caller may destroy the batch
+		std::lock_guard<std::mutex> lock(task.batch->mutex);
+		task.batch->done = true;
+		task.batch->condition.notify_all();
+	}
+}
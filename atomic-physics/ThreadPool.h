@@ -0,0 +1,91 @@
+#pragma once
+#include "CorePch.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Each worker owns a queue of tasks; a worker pops from the front of its own
+// queue and, once that is empty, steals from the back of the other workers' queues. The thread that
+// calls ParallelFor also takes part in the work until every chunk it submitted has completed.
+class ThreadPool
+{
+public:
+	ThreadPool(unsigned int threadCount = 0) noexcept;
+	ThreadPool(const ThreadPool&) = delete;
+	void operator=(const ThreadPool&) = delete;
+	~ThreadPool() noexcept;
+
+	static ThreadPool& Get() noexcept
+	{
+		static ThreadPool* instance = new ThreadPool();
+		return *instance;
+	}
+
+	// Total number of threads doing work during ParallelFor, including the calling thread
+	unsigned int ThreadCount() const noexcept { return static_cast<unsigned int>(m_workers.size()) + 1; }
+	// 0 -> use every hardware thread. Must not be called while a ParallelFor is in flight
+	void SetThreadCount(unsigned int threadCount) noexcept;
+
+	// Split [begin, end) into chunks of at most 'chunkSize' elements and call fn(chunkBegin, chunkEnd)
+	// for each chunk across the pool. Blocks until every chunk has been processed.
+	template<typename F>
+	void ParallelFor(unsigned int begin, unsigned int end, unsigned int chunkSize, const F& fn) noexcept
+	{
+		ParallelForImpl(begin, end, chunkSize,
+			[](const void* context, unsigned int chunkBegin, unsigned int chunkEnd) noexcept {
+				(*static_cast<const F*>(context))(chunkBegin, chunkEnd);
+			},
+			&fn);
+	}
+
+private:
+	using TaskFunction = void(*)(const void* context, unsigned int begin, unsigned int end) noexcept;
+
+	// Completion tracking for one ParallelFor call. 'done' is only set (under the mutex) by whichever
+	// thread finishes the last chunk, so the caller never returns while another thread still touches it.
+	struct Batch
+	{
+		std::atomic<unsigned int> remaining;
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool done = false;
+	};
+
+	struct Task
+	{
+		TaskFunction function;
+		const void* context;
+		unsigned int begin;
+		unsigned int end;
+		Batch* batch;
+	};
+
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void ParallelForImpl(unsigned int begin, unsigned int end, unsigned int chunkSize, TaskFunction function, const void* context) noexcept;
+
+	void StartWorkers(unsigned int threadCount) noexcept;
+	void StopWorkers() noexcept;
+	void WorkerLoop(unsigned int workerIndex) noexcept;
+
+	bool TryPop(unsigned int queueIndex, Task& task) noexcept;
+	bool TrySteal(unsigned int thiefIndex, Task& task) noexcept;
+	void RunTask(const Task& task) noexcept;
+
+	std::vector<std::thread> m_workers;
+	std::vector<std::unique_ptr<WorkQueue>> m_queues;
+
+	std::mutex m_wakeMutex;
+	std::condition_variable m_wakeCondition;
+	std::atomic<unsigned int> m_queuedTasks;
+	bool m_stop;
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include "CorePch.h"
+
+#include <array>
+#include <atomic>
+
+// Lock-free hand-off of the latest value from a producer to a consumer thread. Of the three buffers, the
+// producer owns one to write into and the consumer owns one to read from; the third is exchanged
+// atomically between them. Publishing never waits for the consumer and acquiring never waits for the
+// producer. The consumer always picks up the most recently published buffer and intermediate ones are
+// simply overwritten.
+//
+// There must only be one producer and one consumer at a time. Several producer threads are fine as long
+// as they are serialized by some other means (e.g. a mutex)
+template<typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() noexcept :
+		m_writeIndex(0),
+		m_sharedIndex(1),
+		m_readIndex(2)
+	{}
+	TripleBuffer(const TripleBuffer&) = delete;
+	void operator=(const TripleBuffer&) = delete;
+
+	// Producer: fill the write buffer, then publish it
+	T& WriteBuffer() noexcept { return m_buffers[m_writeIndex]; }
+	void Publish() noexcept
+	{
+		m_writeIndex = m_sharedIndex.exchange(m_writeIndex | FreshBit, std::memory_order_acq_rel) & IndexMask;
+	}
+
+	// Consumer: swap in the most recently published buffer, if there is a new one. Returns true if
+	// ReadBuffer changed
+	bool Acquire() noexcept
+	{
+		if ((m_sharedIndex.load(std::memory_order_relaxed) & FreshBit) == 0)
+			return false;
+
+		m_readIndex = m_sharedIndex.exchange(m_readIndex, std::memory_order_acq_rel) & IndexMask;
+		return true;
+	}
+	const T& ReadBuffer() const noexcept { return m_buffers[m_readIndex]; }
+
+private:
+	// The shared index carries a flag so the consumer can tell whether it holds a buffer it hasn't seen
+	static constexpr unsigned int FreshBit = 4;
+	static constexpr unsigned int IndexMask = 3;
+
+	std::array<T, 3> m_buffers;
+	unsigned int m_writeIndex;
+	std::atomic<unsigned int> m_sharedIndex;
+	unsigned int m_readIndex;
+};
@@ -1,7 +1,12 @@
 #include "UI.h"
+#include "FrameTiming.h"
 #include "HLSLStructures.h"
+#include "SimulationKernels.h"
+#include "ThreadPool.h"
 
 #include <algorithm>
+#include <cstring>
+#include <format>
 #include <string>
 #include <vector>
 
@@ -9,6 +14,24 @@ using DirectX::XMFLOAT3;
 
 const ImGuiTableSortSpecs* ParticleDetails::s_current_sort_specs = NULL;
 
+enum ScopeStatisticsColumnID
+{
+	ScopeStatisticsColumnID_Name,
+	ScopeStatisticsColumnID_Count,
+	ScopeStatisticsColumnID_Total,
+	ScopeStatisticsColumnID_Mean,
+	ScopeStatisticsColumnID_Min,
+	ScopeStatisticsColumnID_Max,
+	ScopeStatisticsColumnID_P50,
+	ScopeStatisticsColumnID_P95,
+	ScopeStatisticsColumnID_P99,
+	ScopeStatisticsColumnID_Cycles,
+	ScopeStatisticsColumnID_Instructions,
+	ScopeStatisticsColumnID_IPC,
+	ScopeStatisticsColumnID_CacheMisses,
+	ScopeStatisticsColumnID_BranchMisses
+};
+
 UI::UI() noexcept :
 	m_io(ImGui::GetIO()),
 	m_viewport(),
@@ -18,6 +41,7 @@ UI::UI() noexcept :
 	m_width(0.0f),
 	m_windowOffsetX(0.0f),
 	m_windowOffsetY(0.0f),
+	m_particleDetailsNeedSort(false),
 	m_simulationIsPlaying(false)
 {
 	PROFILE_FUNCTION();
@@ -31,15 +55,21 @@ UI::UI() noexcept :
 		}
 	);
 
-	t_particleAdded = SimulationManager::SetParticleAddedEventHandler(
-		[this](const Particle& particle, unsigned int particleIndex) noexcept {
-			this->OnParticleAdded(particle, particleIndex);
+	t_particlesAdded = SimulationManager::SetParticlesAddedEventHandler(
+		[this](const ParticleStore& particles, unsigned int first, unsigned int count) noexcept {
+			this->OnParticlesAdded(particles, first, count);
 		}
 	);
 
-	t_particleRemoved = SimulationManager::SetParticleRemovedEventHandler(
-		[this](unsigned int particleIndex) noexcept {
-			this->OnParticleRemoved(particleIndex);
+	t_particlesRemoved = SimulationManager::SetParticlesRemovedEventHandler(
+		[this](const std::vector<ParticleHandle>& handles, const std::vector<unsigned int>& indices) noexcept {
+			this->OnParticlesRemoved(handles, indices);
+		}
+	);
+
+	t_activeSimulationChanged = SimulationManager::SetActiveSimulationChangedEventHandler(
+		[this](unsigned int simulationIndex) noexcept {
+			this->OnActiveSimulationChanged(simulationIndex);
 		}
 	);
 }
@@ -48,8 +78,9 @@ UI::~UI() noexcept
 {
 	// Remove Event Handlers
 	SimulationManager::RemovePlayPauseEventHandler(t_playPause);
-	SimulationManager::RemoveParticleAddedEventHandler(t_particleAdded);
-	SimulationManager::RemoveParticleRemovedEventHandler(t_particleRemoved);
+	SimulationManager::RemoveParticlesAddedEventHandler(t_particlesAdded);
+	SimulationManager::RemoveParticlesRemovedEventHandler(t_particlesRemoved);
+	SimulationManager::RemoveActiveSimulationChangedEventHandler(t_activeSimulationChanged);
 }
 
 void UI::ClearRandomTypeSelection() noexcept
@@ -70,26 +101,66 @@ void UI::OnPlayPauseChanged(bool isPlaying) noexcept
 	m_simulationIsPlaying = isPlaying;
 }
 
-void UI::OnParticleAdded(const Particle& particle, unsigned int particleIndex) noexcept
+void UI::OnParticlesAdded(const ParticleStore& particles, unsigned int first, unsigned int count) noexcept
+{
+	PROFILE_FUNCTION();
+
+	m_particleDetailsRow.resize(particles.SlotCount());
+	// ImVector::reserve allocates exactly, so grow it the same way push_back would
+	m_particleDetails.reserve(m_particleDetails._grow_capacity(m_particleDetails.Size + static_cast<int>(count)));
+
+	const unsigned int* type = particles.Type();
+	const unsigned int* mass = particles.Mass();
+	for (unsigned int iii = first; iii < first + count; ++iii)
+	{
+		ParticleHandle handle = particles.Handle(iii);
+		m_particleDetailsRow[handle.index] = m_particleDetails.Size;
+
+		// Can't use emplace_back because m_particleDetails is ImVector, not std::vector
+		m_particleDetails.push_back(
+			{
+				static_cast<int>(handle.index),
+				handle,
+				SimulationManager::GetParticleName(type[iii]).c_str(),
+				mass[iii]
+			});
+	}
+	m_particleDetailsNeedSort = true;
+}
+
+void UI::OnParticlesRemoved(const std::vector<ParticleHandle>& handles, const std::vector<unsigned int>& /* indices */) noexcept
 {
 	PROFILE_FUNCTION();
 
-	// Can't use emplace_back because m_particleDetails is ImVector, not std::vector
-	m_particleDetails.push_back(
+	// Move the last row into each removed one, which leaves the table to be sorted again
+	for (ParticleHandle handle : handles)
+	{
+		unsigned int row = m_particleDetailsRow[handle.index];
+		unsigned int last = m_particleDetails.Size - 1;
+		if (row != last)
 		{
-			static_cast<int>(particleIndex),
-			SimulationManager::GetParticleName(particle.type).c_str(),
-			particle.mass
-		});
+			m_particleDetails[row] = m_particleDetails[last];
+			m_particleDetailsRow[m_particleDetails[row].Handle.index] = row;
+			m_particleDetailsNeedSort = true;
+		}
+		m_particleDetails.pop_back();
+	}
+}
+
+ParticleDetails& UI::GetParticleDetails(ParticleHandle handle) noexcept
+{
+	return m_particleDetails[m_particleDetailsRow[handle.index]];
 }
 
-void UI::OnParticleRemoved(unsigned int particleIndex) noexcept
+void UI::OnActiveSimulationChanged(unsigned int /* simulationIndex */) noexcept
 {
-	m_particleDetails.erase(m_particleDetails.begin() + particleIndex);
+	PROFILE_FUNCTION();
 
-	// Decrement the ID of each particle that came after the one that was removed
-	for (int iii = particleIndex; iii < m_particleDetails.size(); ++iii)
-		m_particleDetails[iii].ID -= 1;
+	// The particle table lists the particles of the displayed simulation only
+	m_selectedParticles.clear();
+	m_particleDetails.clear();
+	const ParticleStore& particles = SimulationManager::GetParticles();
+	OnParticlesAdded(particles, 0, particles.Size());
 }
 
 void UI::Render(const std::unique_ptr<Renderer>& renderer) noexcept
@@ -108,9 +179,10 @@ void UI::Render(const std::unique_ptr<Renderer>& renderer) noexcept
 		ImPlot::ShowDemoWindow();
 	}
 
+	// These windows draw from the snapshot and queue their edits, so they never wait for the simulation thread
 	SimulationDetailsWindow(renderer);
-	LogWindow();
 	PerformanceWindow();
+	LogWindow();
 	SceneEditWindow(renderer);
 
 	
@@ -246,24 +318,27 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 
 	m_left = ImGui::GetWindowContentRegionMax().x + padding.x;
 
+	const SimulationSnapshot& snapshot = SimulationManager::GetSnapshot();
+	Renderer* boxRenderer = renderer.get();
+
 	// Play Button
-	if (SimulationManager::SimulationIsPlaying())
+	if (snapshot.isPlaying)
 	{
 		if (ImGui::Button("Pause##Simulation_Details"))
-			SimulationManager::SwitchPlayPause();
+			SimulationManager::QueueEdit([]() { SimulationManager::SwitchPlayPause(); });
 	}
 	else
 	{
 		if (ImGui::Button("Play##Simulation_Details"))
-			SimulationManager::SwitchPlayPause();
+			SimulationManager::QueueEdit([]() { SimulationManager::SwitchPlayPause(); });
 	}
 
 	ImGui::Separator();
 
 	// Box size slider ================================================================
 
-	static float boxSize = SimulationManager::GetBoxSize().x * 2;
-	static XMFLOAT3 boxSize3 = { SimulationManager::GetBoxSize().x * 2, SimulationManager::GetBoxSize().y * 2, SimulationManager::GetBoxSize().z * 2 };
+	static float boxSize = snapshot.boxSize.x * 2;
+	static XMFLOAT3 boxSize3 = { snapshot.boxSize.x * 2, snapshot.boxSize.y * 2, snapshot.boxSize.z * 2 };
 	static bool uniformBox = true;
 
 	if (ImGui::TreeNode("Box##Simulation_Details"))
@@ -275,8 +350,12 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 				// SetBoxSize is a misnomer because it actually set the max x, y, z values where
 				// the length of each side will go from -x -> x therefore, you need to divide
 				// each value by 2 to correctly set the max sizes
-				SimulationManager::SetBoxSize(boxSize / 2.0f);
-				renderer->NotifyBoxSizeChanged();
+				SimulationManager::QueueEdit([boxRenderer, size = boxSize / 2.0f]()
+					{
+						SimulationManager::SetBoxSize(size);
+						boxRenderer->NotifyBoxSizeChanged();
+					}
+				);
 
 				// Sync boxSize3 with the new value
 				boxSize3.x = boxSize;
@@ -291,8 +370,12 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 				// SetBoxSize is a misnomer because it actually set the max x, y, z values where
 				// the length of each side will go from -x -> x therefore, you need to divide
 				// each value by 2 to correctly set the max sizes
-				SimulationManager::SetBoxSize({ boxSize3.x / 2, boxSize3.y / 2, boxSize3.z / 2 });
-				renderer->NotifyBoxSizeChanged();
+				SimulationManager::QueueEdit([boxRenderer, size = XMFLOAT3{ boxSize3.x / 2, boxSize3.y / 2, boxSize3.z / 2 }]()
+					{
+						SimulationManager::SetBoxSize(size);
+						boxRenderer->NotifyBoxSizeChanged();
+					}
+				);
 
 				// Sync boxSize with the max of boxSize3
 				boxSize = std::max(boxSize3.x, std::max(boxSize3.y, boxSize3.z));
@@ -303,12 +386,13 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 
 		if (ImGui::Checkbox("Uniform##Simulation_Details", &uniformBox))
 		{
-			if (uniformBox)
-				SimulationManager::SetBoxSize(boxSize / 2.0f);
-			else
-				SimulationManager::SetBoxSize({ boxSize3.x / 2, boxSize3.y / 2, boxSize3.z / 2 });
-
-			renderer->NotifyBoxSizeChanged();
+			XMFLOAT3 size = uniformBox ? XMFLOAT3{ boxSize / 2, boxSize / 2, boxSize / 2 } : XMFLOAT3{ boxSize3.x / 2, boxSize3.y / 2, boxSize3.z / 2 };
+			SimulationManager::QueueEdit([boxRenderer, size]()
+				{
+					SimulationManager::SetBoxSize(size);
+					boxRenderer->NotifyBoxSizeChanged();
+				}
+			);
 		}
 
 		ImGui::TreePop();
@@ -347,7 +431,7 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 
 				// Any time we switch between creating specific particles or creating them randomly
 				// we want to delete any temporary particles that have not been saved
-				SimulationManager::DeleteTemporaryParticles();
+				SimulationManager::QueueEdit([]() { SimulationManager::DeleteTemporaryParticles(); });
 			}
 
 			const std::vector<std::string>& particleTypeNames = SimulationManager::GetParticleNames();
@@ -473,7 +557,11 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 						if (m_selectedTypes[iii])
 							allowedTypes.push_back(iii);
 
-					SimulationManager::PlaceRandomParticles(allowedTypes, numberOfParticles, maxVelocity);
+					SimulationManager::QueueEdit([allowedTypes = std::move(allowedTypes), count = static_cast<unsigned int>(numberOfParticles), velocity = maxVelocity]()
+						{
+							SimulationManager::PlaceRandomParticles(allowedTypes, count, velocity);
+						}
+					);
 				}
 
 				if (selectedCount == 0) ImGui::EndDisabled();
@@ -482,50 +570,78 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 				{
 					if (ImGui::Button("Save Random Particles##Simulation_Details"))
 					{
-						SimulationManager::PublishTemporaryParticles();
+						SimulationManager::QueueEdit([]() { SimulationManager::PublishTemporaryParticles(); });
 					}
 				}
 			}
 			else
 			{
-				Particle& particle = SimulationManager::GetFirstOrCreateTemporaryParticle(particleTypeIndex);
-				unsigned int particleIndex = SimulationManager::GetIndexOfFirstTemporaryParticle();
-
-				// Particle Type Combo box
-				if (ImGui::BeginCombo("Particle Type##Add_Particle-Simulation_Details", particleTypeNames[particleTypeIndex].c_str()))
+				// The particle being added is created by a queued edit, so the controls appear the frame after
+				const ParticleStore& particles = snapshot.particles;
+				if (!SimulationManager::TemporaryParticlesExist())
+				{
+					SimulationManager::QueueEdit([type = particleTypeIndex]() { SimulationManager::GetFirstOrCreateTemporaryParticle(type); });
+				}
+				else if (particles.Contains(SimulationManager::GetFirstTemporaryParticle()))
 				{
-					for (unsigned int iii = 0; iii < particleTypeNames.size(); ++iii)
+					ParticleHandle particleHandle = SimulationManager::GetFirstTemporaryParticle();
+					Particle particle = static_cast<Particle>(particles[particles.IndexOf(particleHandle)]);
+
+					// Particle Type Combo box
+					if (ImGui::BeginCombo("Particle Type##Add_Particle-Simulation_Details", particleTypeNames[particleTypeIndex].c_str()))
 					{
-						const bool is_selected = (particleTypeIndex == iii);
-						if (ImGui::Selectable(particleTypeNames[iii].c_str(), is_selected))
+						for (unsigned int iii = 0; iii < particleTypeNames.size(); ++iii)
 						{
-							particleTypeIndex = iii;
+							const bool is_selected = (particleTypeIndex == iii);
+							if (ImGui::Selectable(particleTypeNames[iii].c_str(), is_selected))
+							{
+								particleTypeIndex = iii;
+								SimulationManager::QueueEdit([particleHandle, type = iii]() { SimulationManager::ChangeParticleType(particleHandle, type); });
 
-							// Update the particles table
-							m_particleDetails[particleIndex].Name = SimulationManager::GetParticleName(particleTypeIndex).c_str();
-							m_particleDetails[particleIndex].Mass = SimulationManager::GetDefaultMass(particleTypeIndex);
-						}
+								// Update the particles table
+								GetParticleDetails(particleHandle).Name = SimulationManager::GetParticleName(particleTypeIndex).c_str();
+								GetParticleDetails(particleHandle).Mass = SimulationManager::GetDefaultMass(particleTypeIndex);
+							}
 
-						// Set the initial focus when opening the combo (scrolling + keyboard navigation focus)
-						if (is_selected) ImGui::SetItemDefaultFocus();
+							// Set the initial focus when opening the combo (scrolling + keyboard navigation focus)
+							if (is_selected) ImGui::SetItemDefaultFocus();
+						}
+						ImGui::EndCombo();
 					}
-					ImGui::EndCombo();
-				}
 
-				// Position
-				float positionMax = renderer->GetBox()->GetBoxSize().x / 2.0f;
-				float positionDragSpeed = 0.01f;
-				ImGui::DragFloat3("Position##Temporary_Particle-Simulation_Details", (float*)(&particle.p_x), positionDragSpeed, -positionMax, positionMax);
+					// Position
+					float positionMax = renderer->GetBox()->GetBoxSize().x / 2.0f;
+					float positionDragSpeed = 0.01f;
+					//		Particle data is stored by column, so copy into a contiguous array for ImGui and queue any edits
+					float position[3] = { particle.p_x, particle.p_y, particle.p_z };
+					if (ImGui::DragFloat3("Position##Temporary_Particle-Simulation_Details", position, positionDragSpeed, -positionMax, positionMax))
+					{
+						SimulationManager::QueueEdit([particleHandle, x = position[0], y = position[1], z = position[2]]()
+							{
+								SimulationManager::SetParticlePosition(particleHandle, x, y, z);
+							}
+						);
+					}
 
-				// Velocity
-				float velocityMax = 25.0f;
-				float velocityDragSpeed = 0.1f;
-				ImGui::DragFloat3("Velocity##Temporary_Particle-Simulation_Details", (float*)(&particle.v_x), velocityDragSpeed, -velocityMax, velocityMax);
+					// Velocity
+					float velocityMax = 25.0f;
+					float velocityDragSpeed = 0.1f;
+					//		Particle data is stored by column, so copy into a contiguous array for ImGui and queue any edits
+					float velocity[3] = { particle.v_x, particle.v_y, particle.v_z };
+					if (ImGui::DragFloat3("Velocity##Temporary_Particle-Simulation_Details", velocity, velocityDragSpeed, -velocityMax, velocityMax))
+					{
+						SimulationManager::QueueEdit([particleHandle, x = velocity[0], y = velocity[1], z = velocity[2]]()
+							{
+								SimulationManager::SetParticleVelocity(particleHandle, x, y, z);
+							}
+						);
+					}
 
-				// Save Button
-				if (ImGui::Button("Save New Particle"))
-				{
-					SimulationManager::PublishTemporaryParticles();
+					// Save Button
+					if (ImGui::Button("Save New Particle"))
+					{
+						SimulationManager::QueueEdit([]() { SimulationManager::PublishTemporaryParticles(); });
+					}
 				}
 			}
 		}
@@ -546,7 +662,8 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 			}
 		}
 
-		SimulationManager::DeleteTemporaryParticles();
+		if (SimulationManager::TemporaryParticlesExist())
+			SimulationManager::QueueEdit([]() { SimulationManager::DeleteTemporaryParticles(); });
 	}
 
 	ImGui::Separator();
@@ -570,7 +687,6 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 
 	const float min_row_height = 13.0f; // minimum row height
 	const ImVec2 outer_size_value = ImVec2(0.0f, ImGui::GetTextLineHeightWithSpacing() * 12);
-	static bool items_need_sort = false;
 
 	if (ImGui::BeginTable("Particles Table", 5, flags, outer_size_value))
 	{
@@ -584,15 +700,18 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 		// Sort our data if sort specs have been changed!
 		ImGuiTableSortSpecs* sorts_specs = ImGui::TableGetSortSpecs();
 		if (sorts_specs && sorts_specs->SpecsDirty)
-			items_need_sort = true;
-		if (sorts_specs && items_need_sort && m_particleDetails.Size > 1)
+			m_particleDetailsNeedSort = true;
+		if (sorts_specs && m_particleDetailsNeedSort && m_particleDetails.Size > 1)
 		{
 			ParticleDetails::s_current_sort_specs = sorts_specs; // Store in variable accessible by the sort function.
 			qsort(&m_particleDetails[0], (size_t)m_particleDetails.Size, sizeof(m_particleDetails[0]), ParticleDetails::CompareWithSortSpecs);
 			ParticleDetails::s_current_sort_specs = NULL;
 			sorts_specs->SpecsDirty = false;
+
+			for (int iii = 0; iii < m_particleDetails.Size; ++iii)
+				m_particleDetailsRow[m_particleDetails[iii].Handle.index] = iii;
 		}
-		items_need_sort = false;
+		m_particleDetailsNeedSort = false;
 
 		// Show Headers
 		ImGui::TableHeadersRow();
@@ -600,8 +719,9 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 		// ???
 		ImGui::PushButtonRepeat(true);
 
-		// Use a clipper to loop over visible items
-		const std::vector<Particle> particles = SimulationManager::GetParticles();
+		// Use a clipper to loop over visible items. Positions and velocities come from the same snapshot
+		// the renderer draws, which may not have caught up with particles added this frame yet
+		const ParticleStore& particles = snapshot.particles;
 
 		ImGuiListClipper clipper;
 		clipper.Begin(m_particleDetails.Size);
@@ -610,9 +730,10 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 			for (int row_n = clipper.DisplayStart; row_n < clipper.DisplayEnd; row_n++)
 			{
 				ParticleDetails* particleDetails = &m_particleDetails[row_n];
-				const Particle& particle = particles[particleDetails->ID];
+				bool inSnapshot = particles.Contains(particleDetails->Handle);
+				Particle particle = inSnapshot ? static_cast<Particle>(particles[particles.IndexOf(particleDetails->Handle)]) : Particle{};
 
-				const bool item_is_selected = m_selectedParticles.contains(particleDetails->ID);
+				const bool item_is_selected = m_selectedParticles.contains(particleDetails->Handle);
 				ImGui::PushID(particleDetails->ID);
 				ImGui::TableNextRow(ImGuiTableRowFlags_None, min_row_height);
 
@@ -624,9 +745,9 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 					if (ImGui::GetIO().KeyCtrl)
 					{
 						if (item_is_selected)
-							m_selectedParticles.find_erase_unsorted(particleDetails->ID);
+							m_selectedParticles.find_erase_unsorted(particleDetails->Handle);
 						else
-							m_selectedParticles.push_back(particleDetails->ID);
+							m_selectedParticles.push_back(particleDetails->Handle);
 					}
 					else if (ImGui::GetIO().KeyShift)
 					{
@@ -634,19 +755,19 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 						if (m_selectedParticles.Size >= 1)
 						{
 							bool addingToSelected = false;
-							int mostRecentID = m_selectedParticles.back();
+							ParticleHandle mostRecent = m_selectedParticles.back();
 
 							for (unsigned int iii = 0; iii < m_particleDetails.Size; ++iii)
 							{
-								if (addingToSelected && !m_selectedParticles.contains(m_particleDetails[iii].ID))
-									m_selectedParticles.push_back(m_particleDetails[iii].ID);
+								if (addingToSelected && !m_selectedParticles.contains(m_particleDetails[iii].Handle))
+									m_selectedParticles.push_back(m_particleDetails[iii].Handle);
 								
-								if (m_particleDetails[iii].ID == mostRecentID || m_particleDetails[iii].ID == particleDetails->ID)
+								if (m_particleDetails[iii].Handle == mostRecent || m_particleDetails[iii].Handle == particleDetails->Handle)
 								{
 									if (!addingToSelected)
 									{
-										if (!m_selectedParticles.contains(m_particleDetails[iii].ID))
-											m_selectedParticles.push_back(particleDetails->ID);
+										if (!m_selectedParticles.contains(m_particleDetails[iii].Handle))
+											m_selectedParticles.push_back(particleDetails->Handle);
 										addingToSelected = true;
 									}
 									else
@@ -657,15 +778,15 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 						else
 						{
 							if (item_is_selected)
-								m_selectedParticles.find_erase_unsorted(particleDetails->ID);
+								m_selectedParticles.find_erase_unsorted(particleDetails->Handle);
 							else
-								m_selectedParticles.push_back(particleDetails->ID);
+								m_selectedParticles.push_back(particleDetails->Handle);
 						}
 					}
 					else
 					{
 						m_selectedParticles.clear();
-						m_selectedParticles.push_back(particleDetails->ID);
+						m_selectedParticles.push_back(particleDetails->Handle);
 					}
 				}
 
@@ -705,19 +826,19 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 
 	if (m_selectedParticles.Size == 1)
 	{
-		int particleIndex = m_selectedParticles[0];
+		ParticleHandle particleHandle = m_selectedParticles[0];
 
-		if (SimulationManager::IsParticleTemporary(particleIndex))
+		if (SimulationManager::IsParticleTemporary(particleHandle))
 		{
 			ImGui::TextWrapped("You've selected a temporary particle. You cannot edit the particle here - you must edit the temporary particle using the controls that were used to create it.");
 		}
-		else
+		else if (snapshot.particles.Contains(particleHandle))
 		{
-			Particle& selectedParticle = SimulationManager::GetParticle(particleIndex);
+			Particle selectedParticle = static_cast<Particle>(snapshot.particles[snapshot.particles.IndexOf(particleHandle)]);
 			const std::vector<std::string>& particleTypeNames = SimulationManager::GetParticleNames();
 
 			// Title
-			ImGui::Text(std::format("Selected: {}    ID: {}", particleTypeNames[selectedParticle.type], particleIndex).c_str());
+			ImGui::Text(std::format("Selected: {}    ID: {}", particleTypeNames[selectedParticle.type], particleHandle.index).c_str());
 
 			// Particle Type Combo box
 			if (ImGui::BeginCombo("Particle Type##Selected_Particle-Simulation_Details", particleTypeNames[selectedParticle.type].c_str()))
@@ -727,11 +848,11 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 					const bool is_selected = (selectedParticle.type == iii);
 					if (ImGui::Selectable(particleTypeNames[iii].c_str(), is_selected))
 					{
-						SimulationManager::ChangeParticleType(particleIndex, iii);
+						SimulationManager::QueueEdit([particleHandle, type = iii]() { SimulationManager::ChangeParticleType(particleHandle, type); });
 
 						// Update the particles table
-						m_particleDetails[particleIndex].Name = SimulationManager::GetParticleName(selectedParticle.type).c_str();
-						m_particleDetails[particleIndex].Mass = SimulationManager::GetDefaultMass(selectedParticle.type);
+						GetParticleDetails(particleHandle).Name = SimulationManager::GetParticleName(iii).c_str();
+						GetParticleDetails(particleHandle).Mass = SimulationManager::GetDefaultMass(iii);
 					}
 
 					// Set the initial focus when opening the combo (scrolling + keyboard navigation focus)
@@ -756,10 +877,10 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 					const bool is_selected = (currentMassAbundanceIndex == iii);
 					if (ImGui::Selectable(std::format("{} - Abundance: {}%", massAbundanceList[iii].mass, massAbundanceList[iii].abundance).c_str(), is_selected))
 					{
-						SimulationManager::ChangeParticleMass(particleIndex, massAbundanceList[iii].mass);
+						SimulationManager::QueueEdit([particleHandle, mass = massAbundanceList[iii].mass]() { SimulationManager::ChangeParticleMass(particleHandle, mass); });
 
 						// Update the particles table
-						m_particleDetails[particleIndex].Mass = massAbundanceList[iii].mass;
+						GetParticleDetails(particleHandle).Mass = massAbundanceList[iii].mass;
 					}
 
 					// Set the initial focus when opening the combo (scrolling + keyboard navigation focus)
@@ -771,12 +892,30 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 			// Position
 			float positionMax = renderer->GetBox()->GetBoxSize().x / 2.0f;
 			float positionDragSpeed = 0.01f;
-			ImGui::DragFloat3("Position##Selected_Particle-Simulation_Details", (float*)(&selectedParticle.p_x), positionDragSpeed, -positionMax, positionMax);
+			//		Particle data is stored by column, so copy into a contiguous array for ImGui and queue any edits
+			float position[3] = { selectedParticle.p_x, selectedParticle.p_y, selectedParticle.p_z };
+			if (ImGui::DragFloat3("Position##Selected_Particle-Simulation_Details", position, positionDragSpeed, -positionMax, positionMax))
+			{
+				SimulationManager::QueueEdit([particleHandle, x = position[0], y = position[1], z = position[2]]()
+					{
+						SimulationManager::SetParticlePosition(particleHandle, x, y, z);
+					}
+				);
+			}
 
 			// Velocity
 			float velocityMax = 25.0f;
 			float velocityDragSpeed = 0.1f;
-			ImGui::DragFloat3("Velocity##Selected_Particle-Simulation_Details", (float*)(&selectedParticle.v_x), velocityDragSpeed, -velocityMax, velocityMax);
+			//		Particle data is stored by column, so copy into a contiguous array for ImGui and queue any edits
+			float velocity[3] = { selectedParticle.v_x, selectedParticle.v_y, selectedParticle.v_z };
+			if (ImGui::DragFloat3("Velocity##Selected_Particle-Simulation_Details", velocity, velocityDragSpeed, -velocityMax, velocityMax))
+			{
+				SimulationManager::QueueEdit([particleHandle, x = velocity[0], y = velocity[1], z = velocity[2]]()
+					{
+						SimulationManager::SetParticleVelocity(particleHandle, x, y, z);
+					}
+				);
+			}
 
 			// Delete Particle Modal Popup
 			if (ImGui::Button("Delete Particle##Selected_Particle-Simulation_Details"))
@@ -794,7 +933,7 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 
 				if (ImGui::Button("Delete##Selected_Particle-Simulation_Detail", ImVec2(120, 0)))
 				{
-					SimulationManager::RemoveParticle(particleIndex);
+					SimulationManager::QueueEdit([particleHandle]() { SimulationManager::RemoveParticle(particleHandle); });
 					m_selectedParticles.clear();
 
 					ImGui::CloseCurrentPopup();
@@ -844,12 +983,11 @@ void UI::SimulationDetailsWindow(const std::unique_ptr<Renderer>& renderer) noex
 
 				if (ImGui::Button("Delete##Selected_Particle-Simulation_Detail", ImVec2(120, 0)))
 				{
-					std::vector<unsigned int> selectedParticles;
-					selectedParticles.reserve(m_selectedParticles.Size);
-					for (unsigned int iii = 0; iii < m_selectedParticles.Size; ++iii)
-						selectedParticles.push_back(m_selectedParticles[iii]);
-
-					SimulationManager::RemoveParticles(selectedParticles);
+					SimulationManager::QueueEdit([selectedParticles = std::vector<ParticleHandle>(m_selectedParticles.begin(), m_selectedParticles.end())]()
+						{
+							SimulationManager::RemoveParticles(selectedParticles);
+						}
+					);
 
 					m_selectedParticles.clear();
 
@@ -903,7 +1041,9 @@ void UI::PerformanceWindow() noexcept
 	// when the program is launched which causes an issue setting the viewport
 	m_width = std::max(ImGui::GetWindowPos().x - m_windowOffsetX - m_left, 1.0f);
 
-	PerformanceFPS(); 
+	PerformanceFrameTiming();
+	PerformanceSimulations();
+	PerformanceSimulation();
 #ifdef PROFILE
 	PerformanceProfile();
 #endif
@@ -913,39 +1053,343 @@ void UI::PerformanceWindow() noexcept
 	ImGui::End();
 }
 
-void UI::PerformanceFPS() noexcept
+void UI::PerformanceFrameTiming() noexcept
+{
+	PROFILE_FUNCTION();
+
+	if (ImGui::CollapsingHeader("Frame Timing", ImGuiTreeNodeFlags_None))
+	{
+		FrameTiming& frameTiming = FrameTiming::Get();
+		const FrameTiming::Summary frameSummary = frameTiming.FrameSummary();
+		const float budget = frameTiming.GetBudget();
+
+		ImGui::Text("%.3f ms/frame (%.1f FPS), p99 %.3f ms", 1000.0f / m_io.Framerate, m_io.Framerate, frameSummary.p99);
+
+		float budgetValue = budget;
+		ImGui::SetNextItemWidth(100.0f);
+		if (ImGui::InputFloat("Budget (ms)", &budgetValue, 0.0f, 0.0f, "%.2f") && budgetValue > 0.0f)
+			frameTiming.SetBudget(budgetValue);
+		ImGui::SameLine();
+		if (ImGui::Button("Reset##FrameTiming"))
+			frameTiming.Reset();
+
+		const uint64_t frameCount = frameTiming.FrameCount();
+		const uint64_t overBudgetCount = frameTiming.OverBudgetCount();
+		ImGui::Text("%llu frames, %llu over budget (%.2f%%)", frameCount, overBudgetCount,
+			frameCount > 0 ? 100.0 * static_cast<double>(overBudgetCount) / static_cast<double>(frameCount) : 0.0);
+
+		// Frame times of the last seconds. The y-axis only fits the frames in view, so a stutter is never cut off
+		const std::vector<FrameTiming::Frame>& history = frameTiming.History();
+		if (!history.empty() && ImPlot::BeginPlot("Frame Time##Scrolling", ImVec2(-1, 150)))
+		{
+			static constexpr double historySeconds = 10.0;
+			const double latest = history[(frameTiming.HistoryOffset() + history.size() - 1) % history.size()].time;
+
+			ImPlot::SetupAxes(NULL, "ms", ImPlotAxisFlags_None, ImPlotAxisFlags_AutoFit | ImPlotAxisFlags_RangeFit);
+			ImPlot::SetupAxisLimits(ImAxis_X1, latest - historySeconds, latest, ImGuiCond_Always);
+			ImPlot::PlotLine("Frame", &history[0].time, &history[0].duration, static_cast<int>(history.size()), 0,
+				static_cast<int>(frameTiming.HistoryOffset()), sizeof(FrameTiming::Frame));
+
+			const std::vector<FrameTiming::Frame>& overBudget = frameTiming.OverBudgetHistory();
+			if (!overBudget.empty())
+				ImPlot::PlotScatter("Over Budget", &overBudget[0].time, &overBudget[0].duration, static_cast<int>(overBudget.size()), 0,
+					static_cast<int>(frameTiming.OverBudgetHistoryOffset()), sizeof(FrameTiming::Frame));
+
+			const double budgetLine = budget;
+			ImPlot::PlotInfLines("Budget", &budgetLine, 1, ImPlotInfLinesFlags_Horizontal);
+			ImPlot::EndPlot();
+		}
+
+		ImGuiTableFlags flags =
+			ImGuiTableFlags_RowBg |
+			ImGuiTableFlags_Borders |
+			ImGuiTableFlags_SizingFixedFit;
+
+		if (ImGui::BeginTable("Frame Timing Table", 7, flags))
+		{
+			ImGui::TableSetupColumn("Phase");
+			ImGui::TableSetupColumn("Mean (ms)");
+			ImGui::TableSetupColumn("p50 (ms)");
+			ImGui::TableSetupColumn("p90 (ms)");
+			ImGui::TableSetupColumn("p99 (ms)");
+			ImGui::TableSetupColumn("p99.9 (ms)");
+			ImGui::TableSetupColumn("Max (ms)");
+			ImGui::TableHeadersRow();
+
+			auto row = [](const char* name, const FrameTiming::Summary& summary) noexcept {
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(name);
+				for (double value : { summary.mean, summary.p50, summary.p90, summary.p99, summary.p999, summary.max })
+				{
+					ImGui::TableNextColumn();
+					ImGui::Text("%.3f", value);
+				}
+			};
+
+			for (unsigned int iii = 0; iii < FrameTiming::PhaseCount; ++iii)
+			{
+				const FramePhase phase = static_cast<FramePhase>(iii);
+				row(FrameTiming::PhaseName(phase), frameTiming.PhaseSummary(phase));
+			}
+			row("Frame", frameSummary);
+
+			ImGui::EndTable();
+		}
+
+		// The latest frames over budget with their phases, newest first, to see where the time went
+		const std::vector<FrameTiming::Frame>& overBudget = frameTiming.OverBudgetHistory();
+		if (!overBudget.empty() && ImGui::TreeNode("Over Budget Frames"))
+		{
+			if (ImGui::BeginTable("Over Budget Frames Table", 2 + FrameTiming::PhaseCount, flags | ImGuiTableFlags_ScrollY, ImVec2(0.0f, ImGui::GetTextLineHeightWithSpacing() * 8)))
+			{
+				ImGui::TableSetupScrollFreeze(0, 1);
+				ImGui::TableSetupColumn("Frame");
+				ImGui::TableSetupColumn("Total (ms)");
+				for (unsigned int iii = 0; iii < FrameTiming::PhaseCount; ++iii)
+					ImGui::TableSetupColumn(FrameTiming::PhaseName(static_cast<FramePhase>(iii)));
+				ImGui::TableHeadersRow();
+
+				const size_t newest = (frameTiming.OverBudgetHistoryOffset() + overBudget.size() - 1) % overBudget.size();
+				for (size_t iii = 0; iii < overBudget.size(); ++iii)
+				{
+					const FrameTiming::Frame& frame = overBudget[(newest + overBudget.size() - iii) % overBudget.size()];
+
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					ImGui::Text("%llu", frame.index);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.3f", frame.duration);
+
+					// Highlight the phase that took the longest
+					const auto longest = std::max_element(frame.phases.begin(), frame.phases.end());
+					for (auto phase = frame.phases.begin(); phase != frame.phases.end(); ++phase)
+					{
+						ImGui::TableNextColumn();
+						if (phase == longest)
+							ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%.3f", *phase);
+						else
+							ImGui::Text("%.3f", *phase);
+					}
+				}
+				ImGui::EndTable();
+			}
+			ImGui::TreePop();
+		}
+	}
+}
+
+void UI::PerformanceSimulations() noexcept
+{
+	PROFILE_FUNCTION();
+
+	if (ImGui::CollapsingHeader("Simulations", ImGuiTreeNodeFlags_None))
+	{
+		ImGui::Indent();
+
+		const SimulationSnapshot& snapshot = SimulationManager::GetSnapshot();
+
+		bool runAll = snapshot.runAllSimulations;
+		if (ImGui::Checkbox("Run All Simulations", &runAll))
+			SimulationManager::QueueEdit([runAll]() { SimulationManager::SetRunAllSimulations(runAll); });
+
+		if (ImGui::Button("New##Simulations"))
+			SimulationManager::QueueEdit([]() { SimulationManager::SetActiveSimulation(SimulationManager::AddSimulation()); });
+		ImGui::SameLine();
+		if (ImGui::Button("Duplicate##Simulations"))
+			SimulationManager::QueueEdit([]() { SimulationManager::SetActiveSimulation(SimulationManager::DuplicateActiveSimulation()); });
+		ImGui::SameLine();
+		ImGui::BeginDisabled(snapshot.simulations.size() == 1);
+		if (ImGui::Button("Remove##Simulations"))
+			SimulationManager::QueueEdit([]() { SimulationManager::RemoveSimulation(SimulationManager::GetActiveSimulationIndex()); });
+		ImGui::EndDisabled();
+
+		static ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit;
+		if (ImGui::BeginTable("Simulations_Table", 5, flags))
+		{
+			ImGui::TableSetupColumn("Simulation");
+			ImGui::TableSetupColumn("");
+			ImGui::TableSetupColumn("Particles");
+			ImGui::TableSetupColumn("Steps / s");
+			ImGui::TableSetupColumn("Update (ms)");
+			ImGui::TableHeadersRow();
+
+			unsigned int activeIndex = snapshot.simulationIndex;
+			for (unsigned int iii = 0; iii < snapshot.simulations.size(); ++iii)
+			{
+				const SimulationSummary& simulation = snapshot.simulations[iii];
+				// Inactive simulations are frozen unless every simulation is being run
+				bool running = iii == activeIndex || runAll;
+
+				ImGui::PushID(static_cast<int>(iii));
+				ImGui::TableNextRow();
+
+				ImGui::TableNextColumn();
+				if (ImGui::Selectable(std::format("Simulation {}", iii).c_str(), iii == activeIndex))
+					SimulationManager::QueueEdit([iii]() { SimulationManager::SetActiveSimulation(iii); });
+
+				ImGui::TableNextColumn();
+				if (ImGui::SmallButton(simulation.isPlaying ? "Pause" : "Play"))
+					SimulationManager::QueueEdit([iii]() { SimulationManager::SwitchPlayPause(iii); });
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%u", simulation.particleCount);
+
+				ImGui::TableNextColumn();
+				if (running)
+					ImGui::Text("%.1f (%.3f M particle-steps)", simulation.stepsPerSecond, simulation.particleStepsPerSecond * 1.0e-6);
+				else
+					ImGui::TextDisabled("frozen");
+
+				ImGui::TableNextColumn();
+				if (running)
+					ImGui::Text("%.3f", simulation.updateMilliseconds);
+				else
+					ImGui::TextDisabled("-");
+
+				ImGui::PopID();
+			}
+			ImGui::EndTable();
+		}
+
+		ImGui::Unindent();
+	}
+}
+
+void UI::PerformanceSimulation() noexcept
 {
 	PROFILE_FUNCTION();
 
-	if (ImGui::CollapsingHeader("FPS", ImGuiTreeNodeFlags_None))
+	if (ImGui::CollapsingHeader("Simulation", ImGuiTreeNodeFlags_None))
 	{
-		ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_io.Framerate, m_io.Framerate);
+		ImGui::Indent();
+
+		const SimulationSnapshot& snapshot = SimulationManager::GetSnapshot();
+
+		// SIMD kernel used for the particle update
+		SimdLevel currentLevel = SimulationKernels::GetSimdLevel();
+		SimdLevel maxLevel = SimulationKernels::GetMaxSupportedSimdLevel();
+		ImGui::SetNextItemWidth(125.0f);
+		if (ImGui::BeginCombo("SIMD Kernel", SimulationKernels::SimdLevelName(currentLevel)))
+		{
+			for (int iii = 0; iii <= static_cast<int>(maxLevel); ++iii)
+			{
+				SimdLevel level = static_cast<SimdLevel>(iii);
+				const bool is_selected = (level == currentLevel);
+				if (ImGui::Selectable(SimulationKernels::SimdLevelName(level), is_selected))
+					SimulationKernels::SetSimdLevel(level);
 
-		static std::vector<float> fps(2000);
-		static float totalTime = 0.0f;
-		static std::vector<float> time(2000);
-		static int offset = 0;
-		static float history = 10.0f;
+				if (is_selected) ImGui::SetItemDefaultFocus();
+			}
+			ImGui::EndCombo();
+		}
+
+		// Number of threads used for the particle update. The pool can't be resized while an update is using it
+		static int threadCount = static_cast<int>(ThreadPool::Get().ThreadCount());
+		ImGui::SetNextItemWidth(125.0f);
+		ImGui::InputInt("Threads", &threadCount);
+		threadCount = std::clamp(threadCount, 1, static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+		ImGui::SameLine();
+		if (ImGui::Button("Apply##Simulation_Threads"))
+			SimulationManager::QueueEdit([count = static_cast<unsigned int>(threadCount)]() { ThreadPool::Get().SetThreadCount(count); });
+
+		// Fixed step integration
+		int integrator = static_cast<int>(snapshot.integrator);
+		ImGui::SetNextItemWidth(175.0f);
+		if (ImGui::Combo("Integrator", &integrator, "Velocity Verlet\0Event-Driven Hard Spheres\0\0"))
+			SimulationManager::QueueEdit([integrator]() { SimulationManager::SetIntegrator(static_cast<Integrator>(integrator)); });
+
+		if (snapshot.integrator == Integrator::EventDriven)
+		{
+			ImGui::Text("Collisions: %llu (walls %llu)", static_cast<unsigned long long>(snapshot.collisions), static_cast<unsigned long long>(snapshot.wallCollisions));
+			ImGui::Text("Cell crossings: %llu", static_cast<unsigned long long>(snapshot.cellCrossings));
+			ImGui::Text("Queued events: %zu (%llu stale so far)", snapshot.queuedEvents, static_cast<unsigned long long>(snapshot.staleEvents));
+			ImGui::Text("Kinetic energy: %.4f amu nm^2 / ps^2", snapshot.kineticEnergy);
+		}
 
-		totalTime += m_io.DeltaTime;
-		time[offset] = totalTime;
+		float timeStep = snapshot.timeStep;
+		ImGui::SetNextItemWidth(125.0f);
+		if (ImGui::InputFloat("Time Step", &timeStep, 0.0f, 0.0f, "%.2e"))
+			SimulationManager::QueueEdit([timeStep = std::max(timeStep, 1.0e-9f)]() { SimulationManager::SetTimeStep(timeStep); });
+
+		int substeps = static_cast<int>(snapshot.substepsPerTick);
+		ImGui::SetNextItemWidth(125.0f);
+		if (ImGui::InputInt("Substeps / Tick", &substeps))
+			SimulationManager::QueueEdit([substeps = static_cast<unsigned int>(std::clamp(substeps, 1, 10000))]() { SimulationManager::SetSubstepsPerTick(substeps); });
+
+		int ticksPerSecond = static_cast<int>(std::round(1.0 / snapshot.tickSeconds));
+		ImGui::SetNextItemWidth(125.0f);
+		if (ImGui::InputInt("Ticks / Second", &ticksPerSecond))
+			SimulationManager::QueueEdit([seconds = 1.0 / std::clamp(ticksPerSecond, 1, 1000)]() { SimulationManager::SetTickSeconds(seconds); });
+
+		int catchUpBudget = static_cast<int>(snapshot.catchUpBudget);
+		ImGui::SetNextItemWidth(125.0f);
+		if (ImGui::InputInt("Catch-up Budget", &catchUpBudget))
+			SimulationManager::QueueEdit([maxTicks = static_cast<unsigned int>(std::clamp(catchUpBudget, 0, 1000))]() { SimulationManager::SetCatchUpBudget(maxTicks); });
+
+		ImGui::Text("Simulated time: %.4f (%llu steps)", snapshot.simulatedSeconds, static_cast<unsigned long long>(snapshot.stepCount));
+		ImGui::Text("Dropped ticks: %llu", static_cast<unsigned long long>(snapshot.droppedTicks));
+
+		// Neighbor lists
+		float skin = snapshot.neighborListSkin;
+		ImGui::SetNextItemWidth(125.0f);
+		if (ImGui::DragFloat("Neighbor List Skin", &skin, 0.005f, 0.0f, 1.0f, "%.3f"))
+			SimulationManager::QueueEdit([skin]() { SimulationManager::SetNeighborListSkin(skin); });
+		ImGui::Text("Neighbor list rebuilds: %u (%u steps since last)", snapshot.neighborListRebuilds, snapshot.stepsSinceRebuild);
+		ImGui::Text("Neighbor pairs: %zu", snapshot.neighborCount / 2);
+
+		// Interatomic forces
+		bool lennardJonesEnabled = snapshot.lennardJonesEnabled;
+		if (ImGui::Checkbox("Lennard-Jones Forces", &lennardJonesEnabled))
+			SimulationManager::QueueEdit([lennardJonesEnabled]() { SimulationManager::SetLennardJonesEnabled(lennardJonesEnabled); });
+		if (snapshot.lennardJonesEnabled)
+			ImGui::Text("Potential energy: %.4f kcal/mol", snapshot.lennardJonesEnergy);
+
+		// PME models a periodic system, so the boundaries stay periodic while it is selected
+		bool periodic = snapshot.periodic;
+		ImGui::BeginDisabled(snapshot.electrostatics == Electrostatics::ParticleMeshEwald);
+		if (ImGui::Checkbox("Periodic Boundaries", &periodic))
+			SimulationManager::QueueEdit([periodic]() { SimulationManager::SetPeriodic(periodic); });
+		ImGui::EndDisabled();
+
+		int electrostatics = static_cast<int>(snapshot.electrostatics);
+		ImGui::SetNextItemWidth(175.0f);
+		if (ImGui::Combo("Electrostatics", &electrostatics, "None\0Barnes-Hut\0Particle-Mesh Ewald\0\0"))
+			SimulationManager::QueueEdit([electrostatics]() { SimulationManager::SetElectrostatics(static_cast<Electrostatics>(electrostatics)); });
+
+		if (snapshot.electrostatics == Electrostatics::BarnesHut)
+		{
+			float openingAngle = snapshot.openingAngle;
+			ImGui::SetNextItemWidth(125.0f);
+			if (ImGui::DragFloat("Opening Angle", &openingAngle, 0.01f, 0.0f, 1.5f, "%.2f"))
+				SimulationManager::QueueEdit([openingAngle]() { SimulationManager::GetBarnesHut().SetOpeningAngle(openingAngle); });
 
-		fps[offset] = m_io.Framerate;
-		offset = (offset + 1) % fps.size();
+			float softening = snapshot.softening;
+			ImGui::SetNextItemWidth(125.0f);
+			if (ImGui::DragFloat("Softening", &softening, 0.001f, 0.0001f, 0.5f, "%.4f"))
+				SimulationManager::QueueEdit([softening]() { SimulationManager::GetBarnesHut().SetSoftening(softening); });
 
-		float maxY = *std::max_element(fps.begin(), fps.end());
-		float minY = *std::min_element(fps.begin(), fps.end());
+			ImGui::Text("Octree nodes: %u", snapshot.octreeNodes);
+			ImGui::Text("Potential energy: %.4f kcal/mol", snapshot.barnesHutEnergy);
+		}
+		else if (snapshot.electrostatics == Electrostatics::ParticleMeshEwald)
+		{
+			float spacing = snapshot.gridSpacing;
+			ImGui::SetNextItemWidth(125.0f);
+			if (ImGui::DragFloat("Grid Spacing", &spacing, 0.005f, 0.01f, 1.0f, "%.3f nm"))
+				SimulationManager::QueueEdit([spacing]() { SimulationManager::GetParticleMeshEwald().SetGridSpacing(spacing); });
 
-		static ImPlotAxisFlags flags = ImPlotAxisFlags_None; // ImPlotAxisFlags_NoTickLabels;
+			float tolerance = snapshot.ewaldTolerance;
+			ImGui::SetNextItemWidth(125.0f);
+			if (ImGui::InputFloat("Ewald Tolerance", &tolerance, 0.0f, 0.0f, "%.1e"))
+				SimulationManager::QueueEdit([tolerance]() { SimulationManager::GetParticleMeshEwald().SetTolerance(tolerance); });
 
-		if (ImPlot::BeginPlot("FPS##Scrolling", ImVec2(-1, 150))) {
-			ImPlot::SetupAxes(NULL, NULL, flags, flags);
-			ImPlot::SetupAxisLimits(ImAxis_X1, totalTime - history, totalTime, ImGuiCond_Always);
-			ImPlot::SetupAxisLimits(ImAxis_Y1, std::max(0.0f, minY - 10.0f), maxY + 10.0f, ImGuiCond_Always);
-			ImPlot::SetNextFillStyle(IMPLOT_AUTO_COL, 0.5f);
-			ImPlot::PlotLine("FPS", &time[0], &fps[0], static_cast<int>(fps.size()), 0, offset, sizeof(float));
-			ImPlot::EndPlot(); 
+			ImGui::Text("Grid: %u x %u x %u (alpha = %.3f / nm)", snapshot.pmeGridSize[0], snapshot.pmeGridSize[1], snapshot.pmeGridSize[2], snapshot.pmeAlpha);
+			ImGui::Text("Potential energy: %.4f kcal/mol", snapshot.pmeRealSpaceEnergy + snapshot.pmeReciprocalEnergy + snapshot.pmeSelfEnergy);
+			ImGui::Text("  real %.4f, reciprocal %.4f, self %.4f", snapshot.pmeRealSpaceEnergy, snapshot.pmeReciprocalEnergy, snapshot.pmeSelfEnergy);
 		}
+
+		ImGui::Unindent();
 	}
 }
 
@@ -961,6 +1405,11 @@ void UI::PerformanceProfile() noexcept
 		{
 			ImGui::Text("Active Session: %s", Instrumentor::Get().SessionName().c_str());
 		}
+		else if (Instrumentor::Get().IsWriting())
+		{
+			// The JSON trace of the last capture is still being written in the background
+			ImGui::Text("Writing trace...");
+		}
 		else
 		{
 			static char resultsFile[128] = "profile/results.json";
@@ -986,10 +1435,242 @@ void UI::PerformanceProfile() noexcept
 			}
 		}
 
+		ImGui::Separator();
+
+		// Nothing is recorded for the statistics unless they are enabled
+		bool liveStatistics = Instrumentor::Get().LiveStatisticsEnabled();
+		if (ImGui::Checkbox("Live Statistics", &liveStatistics))
+			Instrumentor::Get().SetLiveStatistics(liveStatistics);
+		ImGui::SameLine();
+		if (ImGui::Button("Reset##Live_Statistics"))
+			Instrumentor::Get().ResetStatistics();
+
+		// Hardware counters also apply to captures
+		bool countersAvailable = HardwareCounters::Available();
+		bool counters = Instrumentor::Get().HardwareCountersEnabled();
+		ImGui::BeginDisabled(!countersAvailable);
+		if (ImGui::Checkbox("Hardware Counters", &counters))
+			Instrumentor::Get().SetHardwareCounters(counters);
+		ImGui::EndDisabled();
+		if (!countersAvailable && ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
+			ImGui::SetTooltip("Performance counters are not available on this machine");
+
+		if (liveStatistics)
+		{
+			PerformanceProfileStatistics();
+			PerformanceProfileFlameView();
+		}
+
 		ImGui::Unindent();
 	}
 }
 
+void UI::PerformanceProfileStatistics() noexcept
+{
+	PROFILE_FUNCTION();
+
+	Instrumentor::Get().GetStatistics(m_scopeStatistics);
+
+	ImGuiTableFlags flags =
+		ImGuiTableFlags_Resizable |
+		ImGuiTableFlags_Hideable |
+		ImGuiTableFlags_Sortable |
+		ImGuiTableFlags_RowBg |
+		ImGuiTableFlags_Borders |
+		ImGuiTableFlags_ScrollY |
+		ImGuiTableFlags_SizingFixedFit;
+
+	const ImVec2 outer_size_value = ImVec2(0.0f, ImGui::GetTextLineHeightWithSpacing() * 12);
+
+	// The counter columns are only there while the counters are enabled
+	const ImGuiTableColumnFlags counterFlags = Instrumentor::Get().HardwareCountersEnabled() ? ImGuiTableColumnFlags_None : ImGuiTableColumnFlags_Disabled;
+
+	if (ImGui::BeginTable("Scope Statistics Table", 14, flags, outer_size_value))
+	{
+		ImGui::TableSetupColumn("Scope", ImGuiTableColumnFlags_NoHide, 0.0f, ScopeStatisticsColumnID_Name);
+		ImGui::TableSetupColumn("Calls", ImGuiTableColumnFlags_None, 0.0f, ScopeStatisticsColumnID_Count);
+		ImGui::TableSetupColumn("Total (ms)", ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending, 0.0f, ScopeStatisticsColumnID_Total);
+		ImGui::TableSetupColumn("Mean (ms)", ImGuiTableColumnFlags_None, 0.0f, ScopeStatisticsColumnID_Mean);
+		ImGui::TableSetupColumn("Min (ms)", ImGuiTableColumnFlags_None, 0.0f, ScopeStatisticsColumnID_Min);
+		ImGui::TableSetupColumn("Max (ms)", ImGuiTableColumnFlags_None, 0.0f, ScopeStatisticsColumnID_Max);
+		ImGui::TableSetupColumn("p50 (ms)", ImGuiTableColumnFlags_None, 0.0f, ScopeStatisticsColumnID_P50);
+		ImGui::TableSetupColumn("p95 (ms)", ImGuiTableColumnFlags_None, 0.0f, ScopeStatisticsColumnID_P95);
+		ImGui::TableSetupColumn("p99 (ms)", ImGuiTableColumnFlags_None, 0.0f, ScopeStatisticsColumnID_P99);
+		ImGui::TableSetupColumn("Cycles", counterFlags, 0.0f, ScopeStatisticsColumnID_Cycles);
+		ImGui::TableSetupColumn("Instructions", counterFlags, 0.0f, ScopeStatisticsColumnID_Instructions);
+		ImGui::TableSetupColumn("IPC", counterFlags, 0.0f, ScopeStatisticsColumnID_IPC);
+		ImGui::TableSetupColumn("Cache Misses", counterFlags, 0.0f, ScopeStatisticsColumnID_CacheMisses);
+		ImGui::TableSetupColumn("Branch Misses", counterFlags, 0.0f, ScopeStatisticsColumnID_BranchMisses);
+		ImGui::TableSetupScrollFreeze(0, 1); // freeze only the header row
+
+		// The statistics change every frame, so sort them every frame
+		ImGuiTableSortSpecs* sorts_specs = ImGui::TableGetSortSpecs();
+		if (sorts_specs && sorts_specs->SpecsCount > 0)
+		{
+			const ImGuiTableColumnSortSpecs& spec = sorts_specs->Specs[0];
+			auto key = [column = spec.ColumnUserID](const Instrumentor::ScopeSummary& summary) noexcept -> double {
+				switch (column)
+				{
+				case ScopeStatisticsColumnID_Count:	return static_cast<double>(summary.count);
+				case ScopeStatisticsColumnID_Total:	return summary.total;
+				case ScopeStatisticsColumnID_Mean:	return summary.mean;
+				case ScopeStatisticsColumnID_Min:	return summary.min;
+				case ScopeStatisticsColumnID_Max:	return summary.max;
+				case ScopeStatisticsColumnID_P50:	return summary.p50;
+				case ScopeStatisticsColumnID_P95:	return summary.p95;
+				case ScopeStatisticsColumnID_P99:	return summary.p99;
+				case ScopeStatisticsColumnID_Cycles:		return summary.cycles;
+				case ScopeStatisticsColumnID_Instructions:	return summary.instructions;
+				case ScopeStatisticsColumnID_IPC:			return summary.cycles != 0.0 ? summary.instructions / summary.cycles : 0.0;
+				case ScopeStatisticsColumnID_CacheMisses:	return summary.cacheMisses;
+				case ScopeStatisticsColumnID_BranchMisses:	return summary.branchMisses;
+				default:							return 0.0;
+				}
+			};
+			bool ascending = spec.SortDirection == ImGuiSortDirection_Ascending;
+
+			std::sort(m_scopeStatistics.begin(), m_scopeStatistics.end(),
+				[&](const Instrumentor::ScopeSummary& a, const Instrumentor::ScopeSummary& b) noexcept {
+					if (spec.ColumnUserID == ScopeStatisticsColumnID_Name)
+						return ascending ? std::strcmp(a.name, b.name) < 0 : std::strcmp(a.name, b.name) > 0;
+					return ascending ? key(a) < key(b) : key(a) > key(b);
+				});
+			sorts_specs->SpecsDirty = false;
+		}
+
+		ImGui::TableHeadersRow();
+
+		ImGuiListClipper clipper;
+		clipper.Begin(static_cast<int>(m_scopeStatistics.size()));
+		while (clipper.Step())
+		{
+			for (int row_n = clipper.DisplayStart; row_n < clipper.DisplayEnd; row_n++)
+			{
+				const Instrumentor::ScopeSummary& summary = m_scopeStatistics[row_n];
+				ImGui::TableNextRow();
+
+				ImGui::TableSetColumnIndex(0);
+				ImGui::TextUnformatted(summary.name);
+				ImGui::TableSetColumnIndex(1);
+				ImGui::Text("%llu", static_cast<unsigned long long>(summary.count));
+				ImGui::TableSetColumnIndex(2);
+				ImGui::Text("%.3f", summary.total);
+				ImGui::TableSetColumnIndex(3);
+				ImGui::Text("%.4f", summary.mean);
+				ImGui::TableSetColumnIndex(4);
+				ImGui::Text("%.4f", summary.min);
+				ImGui::TableSetColumnIndex(5);
+				ImGui::Text("%.4f", summary.max);
+				ImGui::TableSetColumnIndex(6);
+				ImGui::Text("%.4f", summary.p50);
+				ImGui::TableSetColumnIndex(7);
+				ImGui::Text("%.4f", summary.p95);
+				ImGui::TableSetColumnIndex(8);
+				ImGui::Text("%.4f", summary.p99);
+
+				// Per call. Scopes that were never counted leave the counter columns empty
+				if (summary.cycles != 0.0)
+				{
+					ImGui::TableSetColumnIndex(9);
+					ImGui::Text("%.0f", summary.cycles);
+					ImGui::TableSetColumnIndex(10);
+					ImGui::Text("%.0f", summary.instructions);
+					ImGui::TableSetColumnIndex(11);
+					ImGui::Text("%.2f", summary.instructions / summary.cycles);
+					ImGui::TableSetColumnIndex(12);
+					ImGui::Text("%.1f", summary.cacheMisses);
+					ImGui::TableSetColumnIndex(13);
+					ImGui::Text("%.1f", summary.branchMisses);
+				}
+			}
+		}
+
+		ImGui::EndTable();
+	}
+}
+
+void UI::PerformanceProfileFlameView() noexcept
+{
+	PROFILE_FUNCTION();
+
+	const Instrumentor& instrumentor = Instrumentor::Get();
+	const std::vector<Instrumentor::TraceRecord>& records = instrumentor.LastFrameRecords();
+	int64_t frameStart = instrumentor.LastFrameStart();
+	int64_t frameEnd = instrumentor.LastFrameEnd();
+	if (frameEnd <= frameStart)
+		return;
+
+	ImGui::Text("Last Frame: %.3f ms", (frameEnd - frameStart) * 1.0e-6);
+
+	// One lane per thread; within a lane a scope is drawn one row below the scope that encloses it. Sorting by
+	// start time (and longest first on ties) puts every parent before its children
+	std::vector<Instrumentor::TraceRecord> sorted(records.begin(), records.end());
+	std::sort(sorted.begin(), sorted.end(), [](const Instrumentor::TraceRecord& a, const Instrumentor::TraceRecord& b) {
+		if (a.threadID != b.threadID)
+			return a.threadID < b.threadID;
+		if (a.start != b.start)
+			return a.start < b.start;
+		return a.end > b.end;
+	});
+
+	const float rowHeight = ImGui::GetTextLineHeight() + 2.0f;
+	const float width = std::max(ImGui::GetContentRegionAvail().x, 100.0f);
+	const float scale = width / static_cast<float>(frameEnd - frameStart);
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+	ImVec2 origin = ImGui::GetCursorScreenPos();
+	float laneTop = origin.y;
+	unsigned int laneDepth = 0;
+	std::vector<int64_t> openEnds;
+
+	for (size_t iii = 0; iii < sorted.size(); ++iii)
+	{
+		const Instrumentor::TraceRecord& record = sorted[iii];
+		if (iii > 0 && record.threadID != sorted[iii - 1].threadID)
+		{
+			laneTop += (laneDepth + 1) * rowHeight;
+			laneDepth = 0;
+			openEnds.clear();
+		}
+
+		while (!openEnds.empty() && openEnds.back() <= record.start)
+			openEnds.pop_back();
+		unsigned int depth = static_cast<unsigned int>(openEnds.size());
+		openEnds.push_back(record.end);
+		laneDepth = std::max(laneDepth, depth);
+
+		ImVec2 min(origin.x + (record.start - frameStart) * scale, laneTop + depth * rowHeight);
+		ImVec2 max(std::max(origin.x + (record.end - frameStart) * scale, min.x + 1.0f), min.y + rowHeight - 1.0f);
+
+		// Color by name so the same scope keeps its color from frame to frame
+		ImU32 hue = record.nameID * 2654435761u;
+		ImU32 color = IM_COL32(96 + (hue >> 24) % 128, 96 + (hue >> 16) % 128, 96 + (hue >> 8) % 128, 255);
+		drawList->AddRectFilled(min, max, color);
+
+		const char* name = Instrumentor::Get().Name(record.nameID);
+		if (max.x - min.x > ImGui::CalcTextSize(name).x + 4.0f)
+			drawList->AddText(ImVec2(min.x + 2.0f, min.y + 1.0f), IM_COL32(0, 0, 0, 255), name);
+
+		if (ImGui::IsMouseHoveringRect(min, max))
+		{
+			const CounterValues& counters = record.counters;
+			if (counters.cycles != 0)
+			{
+				ImGui::SetTooltip("%s\n%.4f ms (thread %u)\n%llu cycles, %llu instructions (IPC %.2f)\n%llu cache misses, %llu branch misses",
+					name, (record.end - record.start) * 1.0e-6, record.threadID,
+					static_cast<unsigned long long>(counters.cycles), static_cast<unsigned long long>(counters.instructions),
+					static_cast<double>(counters.instructions) / counters.cycles,
+					static_cast<unsigned long long>(counters.cacheMisses), static_cast<unsigned long long>(counters.branchMisses));
+			}
+			else
+				ImGui::SetTooltip("%s\n%.4f ms (thread %u)", name, (record.end - record.start) * 1.0e-6, record.threadID);
+		}
+	}
+
+	if (!sorted.empty())
+		laneTop += (laneDepth + 1) * rowHeight;
+	ImGui::Dummy(ImVec2(width, laneTop - origin.y));
+}
+
 void UI::SceneEditWindow(const std::unique_ptr<Renderer>& renderer) noexcept
 {
 	PROFILE_FUNCTION();
@@ -23,7 +23,8 @@ enum ParticleDetailsColumnID
 
 struct ParticleDetails
 {
-    int         ID;
+    int         ID;         // slot of the particle's handle, which stays the same while the particle exists
+    ParticleHandle Handle;
     const char* Name;
     unsigned int Mass;
 
@@ -81,8 +82,9 @@ public:
 
 private:
     void OnPlayPauseChanged(bool isPlaying) noexcept;
-    void OnParticleAdded(const Particle& particle, unsigned int particleCount) noexcept;
-    void OnParticleRemoved(unsigned int particleIndex) noexcept;
+    void OnParticlesAdded(const ParticleStore& particles, unsigned int first, unsigned int count) noexcept;
+    void OnParticlesRemoved(const std::vector<ParticleHandle>& handles, const std::vector<unsigned int>& indices) noexcept;
+    void OnActiveSimulationChanged(unsigned int simulationIndex) noexcept;
 
 	void CreateDockSpaceAndMenuBar() noexcept;
 	void MenuBar() noexcept;
@@ -91,13 +93,18 @@ private:
 
 
 	void PerformanceWindow() noexcept;
-	void PerformanceFPS() noexcept;
+	void PerformanceFrameTiming() noexcept;
+	void PerformanceSimulations() noexcept;
+	void PerformanceSimulation() noexcept;
 	void PerformanceProfile() noexcept;
+	void PerformanceProfileStatistics() noexcept;
+	void PerformanceProfileFlameView() noexcept;
 
 	void SceneEditWindow(const std::unique_ptr<Renderer>& renderer) noexcept;
 	void SceneLighting(const std::unique_ptr<Renderer>& renderer) noexcept;
 
     void ClearRandomTypeSelection() noexcept;
+    ParticleDetails& GetParticleDetails(ParticleHandle handle) noexcept;
 
 	ImGuiIO& m_io;
 	D3D11_VIEWPORT m_viewport;
@@ -107,7 +114,10 @@ private:
 	float m_windowOffsetX, m_windowOffsetY;
 
     ImVector<ParticleDetails>   m_particleDetails;
-    ImVector<int>               m_selectedParticles;
+    ImVector<ParticleHandle>    m_selectedParticles;
+    // Row of m_particleDetails for each handle slot, so rows can be found and removed in O(1)
+    std::vector<unsigned int>   m_particleDetailsRow;
+    bool                        m_particleDetailsNeedSort;
 
     // For generating random particles
     std::vector<bool>   m_unselectedTypes;
@@ -115,8 +125,12 @@ private:
 
     bool m_simulationIsPlaying;
 
+    // Live profiling statistics, refreshed every frame while the Profile header is open
+    std::vector<Instrumentor::ScopeSummary> m_scopeStatistics;
+
     // Event Tokens
     EventToken t_playPause;
-    EventToken t_particleAdded;
-    EventToken t_particleRemoved;
+    EventToken t_particlesAdded;
+    EventToken t_particlesRemoved;
+    EventToken t_activeSimulationChanged;
 };
\ No newline at end of file
@@ -68,5 +68,5 @@
 #include <d3dcompiler.h>
 #pragma comment(lib, "D3DCompiler")
 
-// Profiling may be used virtually throughout the application so just include it here
-#include "Profile.h"
\ No newline at end of file
+// Platform-neutral headers shared with the simulation core (DirectXMath storage types, profiling)
+#include "CorePch.h"
\ No newline at end of file